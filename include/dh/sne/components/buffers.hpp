@@ -24,6 +24,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
 #include "dh/types.hpp"
 
 namespace dh::sne {
@@ -41,6 +43,19 @@ namespace dh::sne {
     GLuint neighborhoodPreservation;
   };
 
+  // Points [rowBegin, rowEnd) of the symmetrized graph, whose edges are bound together as one storage block, starting
+  // at edge edgeBegin. The layout offsets of these points count from edgeBegin
+  struct GraphSegment {
+    uint rowBegin;
+    uint rowEnd;
+    ulong edgeBegin;
+    ulong nEdges;
+
+    // Byte range of the segment in an edge buffer of the given bytes per edge, e.g. 2 for bfloat16 pairs
+    ulong offset(ulong bytesPerEdge) const { return edgeBegin * bytesPerEdge; }
+    ulong size(ulong bytesPerEdge) const { return ceilDiv<ulong>(std::max<ulong>(nEdges, 1) * bytesPerEdge, 4) * 4; }
+  };
+
   // Data class provided by dh::sne::Similarities<D>->getBuffers() for other components
   struct SimilaritiesBuffers {
     GLuint dataset;
@@ -49,6 +64,7 @@ namespace dh::sne {
     GLuint neighbors;
     GLuint attributeWeights;
     GLuint neighborsSelected;
+    std::vector<GraphSegment> segments; // A single segment, unless the graph exceeds one storage block
   };
 
   // Data class provided by dh::sne::Field<D>->getBuffers() for other components
@@ -59,6 +59,13 @@ namespace dh::sne {
     // Compute the field for a size (resolution) and iteration (determines technique)
     void comp(uvec size, uint iteration);
 
+    // Compute the field for a size (resolution) at every pixel, not only at those near points, so that it can be
+    // queried anywhere within the bounds; e.g. once for a fixed embedding, against which other points are embedded
+    void compDense(uvec size);
+
+    // Query the last computed field at n positions, which need not be the embedding's
+    void query(GLuint positionsBuffer, GLuint valuesBuffer, uint n);
+
   private:
     // Functions called by Field::comp(size, uint);
     // 1. Functions used by full computation
@@ -69,9 +76,13 @@ namespace dh::sne {
     void compSingleHierarchyField();
     // 3. Functions used by dual hierarchy computation
     void compDualHierarchyField();
-    // 4. Functions used by all computations
+    // 4. Functions used by dense computation
+    void compDenseCompact();
+    // 5. Functions used by all computations
     void resizeField(uvec size);
+    void compField(bool fieldHierarchyAllowed);
     void queryField();
+    void adaptApproximation(uint iteration);
     
     enum class BufferType {
       eDispatch,
@@ -113,6 +124,9 @@ namespace dh::sne {
       eFullCompactComp,
       eFullFieldComp,
 
+      // Programs for computation at every pixel
+      eDenseCompactComp,
+
       // Programs for computation with single hierarchy
       eSingleHierarchyCompactComp,
       eSingleHierarchyFieldComp,
@@ -160,6 +174,10 @@ namespace dh::sne {
     uvec _size;
     bool _useEmbeddingHierarchy;
     bool _useFieldHierarchy;
+    float _thetaScale; // Adaptive multiplier on Params::dualHierarchyTheta/singleHierarchyTheta
+    float _fieldScale; // Adaptive multiplier on Params::fieldScaling2D/3D
+    uint _adaptiveIterations;
+    float _adaptiveTime;
 
     // Objects
     util::EnumArray<BufferType, GLuint> _buffers;
@@ -181,6 +199,7 @@ namespace dh::sne {
     }
     bool isInit() const { return _isInit; }
     uvec size() const { return _size; }
+    float fieldScale() const { return _fieldScale; }
     size_t memSize() const;
     
     // std::swap impl
@@ -196,6 +215,10 @@ namespace dh::sne {
       swap(a._size, b._size);
       swap(a._useEmbeddingHierarchy, b._useEmbeddingHierarchy);
       swap(a._useFieldHierarchy, b._useFieldHierarchy);
+      swap(a._thetaScale, b._thetaScale);
+      swap(a._fieldScale, b._fieldScale);
+      swap(a._adaptiveIterations, b._adaptiveIterations);
+      swap(a._adaptiveTime, b._adaptiveTime);
       swap(a._buffers, b._buffers);
       swap(a._programs, b._programs);
       swap(a._textures, b._textures);
@@ -49,8 +49,11 @@ namespace dh::sne {
 
     // Compute KL-divergence
     float comp();
+    float compApprox(GLuint sumQBuffer); // Reuses a sum over q_{ij} approximated elsewhere, e.g. by the minimization's field, in O(n k) instead of O(n^2) time
 
   private:
+    float compSum(GLuint sumQBuffer);
+
     enum class BufferType {
       eQijSum,
       eKLDSum,
@@ -92,6 +95,9 @@ namespace dh::sne {
     // Getters
     bool isInit() const { return _isInit; }
 
+    // Setters
+    void setSimilaritiesBuffers(SimilaritiesBuffers similaritiesBuffers) { _similaritiesBuffers = similaritiesBuffers; }
+
     // std::swap impl
     friend void swap(KLDivergence& a, KLDivergence& b) noexcept {
       using std::swap;
@@ -24,7 +24,9 @@
 
 #pragma once
 
+#include <deque>
 #include <memory>
+#include <string>
 #include "dh/types.hpp"
 #include "dh/util/aligned.hpp"
 #include "dh/util/enum.hpp"
@@ -35,6 +37,7 @@
 #include "dh/sne/components/buffers.hpp"
 #include "dh/sne/components/field.hpp"
 #include "dh/sne/components/kl_divergence.hpp"
+#include "dh/sne/components/snapshots.hpp"
 #include "dh/vis/render_queue.hpp"
 #include "dh/vis/input_queue.hpp"
 #include "dh/vis/components/selection_input_task.hpp"
@@ -67,23 +70,45 @@ namespace dh::sne {
     Minimization(Minimization&&) noexcept;
     Minimization& operator=(Minimization&&) noexcept;
 
+    void initializeEmbedding(int seed);                                         // Initialize as set by Params::initialization
     void initializeEmbeddingRandomly(int seed);
+    void initializeEmbeddingPCA();
+    bool initializeEmbeddingSpectral(int seed);
     void deselect();
     void selectAll();
     void selectInverse();
     void restartMinimization();
+    void restart(int seed);                                                     // Restart from a new random embedding, e.g. for another replicate
+    void refreshSimilarities();                                                 // Pick up new buffer handles after the similarities were recomputed
+    std::vector<float> transform(const SimilaritiesBuffers& similarities, uint n); // Embed n other points, similar to this embedding's points, against it while it stays fixed
+    void resume(Minimization& previous, const std::vector<float>& positions);  // Continue a minimization over fewer points, the added points starting at positions
+    void refine(const std::vector<float>& positions, uint nIterations);        // Start all points at positions, e.g. from a coarser embedding, and minimize past exaggeration for nIterations
     void restartExaggeration(uint nExaggerationIters);
+    void compactDisabled();                                                     // Remove disabled points from the similarities and the embedding, continuing the minimization
     // void reconfigureZAxis();
     // std::vector<char> getAxisMapping() { return _axisMapping; }
 
     // Computation
     void comp();                                                                // Compute full minimization (i.e. params.iterations)
+    static void compBatch(const std::vector<Minimization*>& minimizations);     // Compute full minimizations of the same similarities in lockstep, e.g. replicates, reading the graph once per iteration for all
+    void compSampling();                                                        // Compute full minimization by negative sampling on the CPU (i.e. params.samplingEpochs)
     bool compIteration();                                                       // Compute a single iteration: minimization + selection + translation
     void compIterationMinimize();                                               // Compute the minimization part of a single iteration
     void compIterationSelect(bool skipEval = false);                            // Compute the selection part of a single iteration
     void compIterationTranslate();                                              // Compute the translation part of a single iteration
+    void compConvergence();                                                     // Check for convergence, setting the reason to stop if converged
+    float klDivergence() { return _klDivergence.comp(); }                      // Compute KL divergence of the current embedding; O(n^2)
+    float klDivergenceApprox() { return _klDivergence.compApprox(_buffers(BufferType::eZ)); } // Compute KL divergence against the last iteration's field approximation of sum q_ij; O(n k)
+
+    static constexpr uint batchSize = 8;                                        // Most minimizations compBatch() takes, as sized in attractive_batch.comp
 
   private:
+    void compBounds();
+    void compFinish();                                                          // Log an early stop and flush snapshots, at the end of comp()
+    static void compAttractiveBatch(const std::vector<Minimization*>& minimizations); // Attractive forces of all minimizations' next iteration, in one pass over the graph
+    uvec fieldSize() const;
+    void compactPCs(GLuint selectionBuffer, uint n);                            // Keep the principal components of the n points' selected subset, as BufferTools::remove() does
+
     enum class BufferType {
       eLabels,
       eEmbedding,
@@ -108,6 +133,8 @@ namespace dh::sne {
       eEmbeddingRelative,
       eEmbeddingRelativeBeforeTranslation,
       eDisabled,
+      eConvergence,
+      eConvergenceReduce,
 
       Length
     };
@@ -123,6 +150,9 @@ namespace dh::sne {
       eSelectionComp,
       eCountSelectedComp,
       eTranslationComp,
+      eConvergenceComp,
+      eTransformComp,
+      eAttractiveBatchComp,
 
       Length
     };
@@ -153,6 +183,7 @@ namespace dh::sne {
     uint _iteration;
     uint _iterationIntense;
     uint _removeExaggerationIter;
+    uint _lateExaggerationIter; // First iteration of late exaggeration, brought forward if the minimization converges before it
     Bounds _bounds;
     Bounds _boundsPrev;
     vis::Input _input;
@@ -170,6 +201,11 @@ namespace dh::sne {
     glm::mat4 _proj_3D;
     uint _buttonSelectionPrev;
     uint _buttonAttributePrev;
+    struct ConvergenceCheck { float kld, gradientNorm, movement; };
+    std::deque<ConvergenceCheck> _convergenceChecks; // The last Params::convergenceWindow checks, and the one before
+    float _convergenceGradientNorm; // Gradient norm at the first check
+    std::string _convergenceReason; // Why the minimization stopped early, empty if it did not
+    bool _attractiveBatched; // Attractive forces of the next iteration were computed by compAttractiveBatch()
 
     // Objects
     util::EnumArray<BufferType, GLuint> _buffers;
@@ -185,6 +221,7 @@ namespace dh::sne {
     std::shared_ptr<vis::AxesRenderTask<DD>> _axesRenderTask;
     std::shared_ptr<vis::AttributeRenderTask> _attributeRenderTask;
     KLDivergence _klDivergence;
+    Snapshots _snapshots;
 
   public:
     // Getters
@@ -203,6 +240,7 @@ namespace dh::sne {
       };
     }
     bool isInit() const { return _isInit; }
+    const std::string& convergenceReason() const { return _convergenceReason; }
 
     // std::swap impl
     friend void swap(Minimization<D, DD>& a, Minimization<D, DD>& b) noexcept {
@@ -221,6 +259,11 @@ namespace dh::sne {
       swap(a._iteration, b._iteration);
       swap(a._iterationIntense, b._iterationIntense);
       swap(a._removeExaggerationIter, b._removeExaggerationIter);
+      swap(a._lateExaggerationIter, b._lateExaggerationIter);
+      swap(a._convergenceChecks, b._convergenceChecks);
+      swap(a._convergenceGradientNorm, b._convergenceGradientNorm);
+      swap(a._convergenceReason, b._convergenceReason);
+      swap(a._attractiveBatched, b._attractiveBatched);
       swap(a._buffers, b._buffers);
       swap(a._programs, b._programs);
       swap(a._timers, b._timers);
@@ -232,6 +275,7 @@ namespace dh::sne {
       swap(a._axesRenderTask, b._axesRenderTask);
       swap(a._attributeRenderTask, b._attributeRenderTask);
       swap(a._klDivergence, b._klDivergence);
+      swap(a._snapshots, b._snapshots);
     }
   };
 } // dh::sne
\ No newline at end of file
@@ -29,9 +29,11 @@
 #include <set>
 #include "dh/types.hpp"
 #include "dh/util/enum.hpp"
+#include "dh/util/csr.hpp"
 #include "dh/util/gl/timer.hpp"
 #include "dh/util/gl/program.hpp"
 #include "dh/util/cu/timer.cuh"
+#include "dh/util/cu/knn.cuh"
 #include "dh/sne/params.hpp"
 #include "dh/sne/components/buffers.hpp"
 #include "dh/util/gl/window.hpp" //
@@ -42,6 +44,10 @@ namespace dh::sne {
     // Constr/destr
     Similarities();
     Similarities(const float* dataPtr, Params* params);
+    Similarities(util::CSRMatrix&& data, Params* params); // Sparse input; takes ownership of a host copy
+    Similarities(Similarities& reference, const float* dataPtr, Params* params); // New points against a dense reference, each with its KNN in the reference only, searched through the reference's kept index; params->n counts the new points
+    Similarities(const Similarities& reference, const std::vector<uint>& landmarks, const util::CSRMatrix& walks, Params* params); // Landmarks of a reference, similar by the walks between them found by reference.landmarks(); params->n counts the landmarks
+    Similarities(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& similarities, Params* params); // A given symmetrized graph without dataset, e.g. a coarsened one; params->n counts its points
     ~Similarities();
 
     // Copy constr/assignment is explicitly deleted
@@ -57,6 +63,11 @@ namespace dh::sne {
     // Compute similarities
     void comp();
     void recomp(GLuint selectionBufferHandle, float perplexity, uint k);
+    void recomp(float perplexity); // All points at another perplexity; reuses a KNN search kept through Params::keepKNN if it found enough neighbors
+    void insert(const float* dataPtr, uint n); // Append n points; searches them through the kept index, and recalibrates only the points whose neighbors changed
+    void compact(GLuint selectionBufferHandle); // Remove unselected points, patching the graph instead of searching again
+    void landmarks(std::vector<uint>& landmarks, util::CSRMatrix& walks) const; // Select Params::nLandmarks landmarks, and the fractions of each point's random walks reaching each landmark first
+    void downloadGraph(std::vector<uint>& layout, std::vector<uint>& neighbors, std::vector<float>& similarities) const; // Host copy of the symmetrized graph, as n (offset, size) pairs into neighbors and similarities
     void renormalizeSimilarities(GLuint selectionBufferHandle = 0);
     void weighSimilarities(float weight, GLuint selectionBufferHandle = 0, bool interOnly = false);
     void weighSimilaritiesPerAttributeRatio(std::set<uint> weightedAttributeIndices, GLuint selectionBufferHandle, uint nSelected, GLuint labelsBufferHandle);
@@ -68,17 +79,19 @@ namespace dh::sne {
     enum class BufferType {
       eDataset,
       eDistancesL1,
-      eNeighbors,
-      eSimilarities,
+      eNeighbors, // If Params::compressedOffsets, packs each neighbor's 16-bit index offset with its bfloat16 similarity
+      eSimilarities, // If Params::compressSimilarities, bfloat16 similarities in pairs, or without storage if Params::compressedOffsets
       eSimilaritiesOriginal,
       eLayout,
       eAttributeWeights,
       eNeighborsSelected,
+      eDatasetOffsets, // Sparse input only; eDataset then holds the CSR values
+      eDatasetIndices, // Sparse input only
 
       Length
     };
 
-    // Basically buffers that have to be destroyed and recreated in order to grow their memory allocation
+    // Transient buffers, obtained from and returned to util::GLBufferPool within a single call
     enum class BufferTempType {
       eDistances,
       eNeighbors,
@@ -88,6 +101,8 @@ namespace dh::sne {
       eCounts,
       eWeightedAttributeIndices,
       eSubDistancesL1,
+      eFactors,
+      eIndices,
 
       Length
     };
@@ -104,6 +119,8 @@ namespace dh::sne {
       eWeighSimilaritiesPerAttributeRangeComp,
       eWeighSimilaritiesPerAttributeResembleComp,
       eSubDistancesL1Comp,
+      eCompactSizesComp,
+      eCompactComp,
       
       Length
     };
@@ -117,11 +134,35 @@ namespace dh::sne {
       Length
     };
 
+    // Internal functions
+    void initPrograms();
+    void uploadSparseData();
+    void recreateGraphBuffers();
+    void createGraphBuffers(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& similarities);
+    void compactDataset(GLuint selectionBufferHandle);
+    void compactFromKNN(GLuint selectionBufferHandle); // As compact(), refilling rows that lose neighbors from a kept search with more than Params::k
+    void readGraph(std::vector<uint>& layout, std::vector<uint>& neighbors, std::vector<float>& similarities) const; // As downloadGraph(), also while comp() has yet to compress the graph
+    void prune();
+    void compL1Distances();
+    void calibrate(const std::vector<float>& distances, uint nRows, std::vector<float>& similarities); // p_j|i of nRows rows of Params::k squared distances, itself first, on the device
+    void reorder();
+    void compress();
+    void symmetrizeSegments();
+    uint knnRowsPerBlock() const; // Points whose KNN rows are bound together as one storage block
+
     // State
     bool _isInit;
     Params* _params;
     const float* _dataPtr;
-    uint _symmetricSize;
+    ulong _symmetricSize;
+    std::vector<GraphSegment> _segments; // Segments of a graph exceeding one storage block, empty otherwise
+    util::CSRMatrix _sparseData; // Host copy of sparse input, required for KNN search and recomp()
+    std::vector<uint> _permutation; // Original index of each point if points were reordered, empty otherwise
+    uint _knnK; // Number of neighbors in the kept KNN search, 0 if none is kept
+    std::vector<float> _knnDistances;
+    std::vector<uint> _knnIndices;
+    util::KNNIndex _knnIndex; // FAISS index over dense input, of the kept KNN search or built for a transform, for insert() and transforms; empty if points were reordered or removed since
+    std::vector<float> _mins, _scales; // Normalization of dense input held on the device, empty otherwise
 
     // Objects
     util::EnumArray<BufferType, GLuint> _buffers;
@@ -133,6 +174,9 @@ namespace dh::sne {
   public:
     // Getters
     bool isInit() const { return _isInit; }
+    const std::vector<uint>& permutation() const { return _permutation; }
+    uint knnK() const { return _knnK; }
+    const std::vector<uint>& knnIndices() const { return _knnIndices; } // knnK() neighbors per point, itself first, if a KNN search was kept
     SimilaritiesBuffers getBuffers() const {
       return {
         _buffers(BufferType::eDataset),
@@ -140,7 +184,8 @@ namespace dh::sne {
         _buffers(BufferType::eLayout),
         _buffers(BufferType::eNeighbors),
         _buffers(BufferType::eAttributeWeights),
-        _buffers(BufferType::eNeighborsSelected)
+        _buffers(BufferType::eNeighborsSelected),
+        _segments.empty() ? std::vector<GraphSegment> { { 0, _params->n, 0, _symmetricSize } } : _segments
       };
     }
 
@@ -150,6 +195,16 @@ namespace dh::sne {
       swap(a._isInit, b._isInit);
       swap(a._params, b._params);
       swap(a._dataPtr, b._dataPtr);
+      swap(a._symmetricSize, b._symmetricSize);
+      swap(a._segments, b._segments);
+      swap(a._sparseData, b._sparseData);
+      swap(a._permutation, b._permutation);
+      swap(a._knnK, b._knnK);
+      swap(a._knnDistances, b._knnDistances);
+      swap(a._knnIndices, b._knnIndices);
+      swap(a._knnIndex, b._knnIndex);
+      swap(a._mins, b._mins);
+      swap(a._scales, b._scales);
       swap(a._buffers, b._buffers);
       swap(a._buffersTemp, b._buffersTemp);
       swap(a._programs, b._programs);
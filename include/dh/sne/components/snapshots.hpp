@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include "dh/types.hpp"
+#include "dh/sne/params.hpp"
+
+namespace dh::sne {
+  class Snapshots {
+  public:
+    // Constr/destr
+    Snapshots();
+    Snapshots(Params* params, GLuint embeddingBuffer, uint nDims, uint nDimsPadded, std::vector<uint> permutation = {}); // Reordered points are written in input order
+    ~Snapshots();
+
+    // Copy constr/assignment is explicitly deleted
+    Snapshots(const Snapshots&) = delete;
+    Snapshots& operator=(const Snapshots&) = delete;
+
+    // Move constr/operator moves handles
+    Snapshots(Snapshots&&) noexcept;
+    Snapshots& operator=(Snapshots&&) noexcept;
+
+    // Hand finished copies to the writer thread, and start a new copy if iteration is a multiple
+    // of params.snapshotInterval. Never blocks; if all staging buffers are still in use by earlier
+    // snapshots, the snapshot for this iteration is skipped.
+    void comp(uint iteration);
+
+    // Block until all started snapshots are on disk
+    void flush();
+
+  private:
+    static constexpr uint nStagingBuffers = 3;
+
+    // Shared with the writer thread, defined in snapshots.cpp
+    struct Writer;
+
+    // Staging buffers with in-flight copies, ordered by iteration
+    std::vector<uint> pendingOrder() const;
+
+    // State
+    bool _isInit;
+    Params* _params;
+    GLuint _embeddingBuffer;
+    size_t _snapshotSize;
+
+    // Objects
+    std::array<GLuint, nStagingBuffers> _buffers;
+    std::array<void*, nStagingBuffers> _fences;     // GLsync handles of in-flight copies
+    std::array<uint, nStagingBuffers> _iterations;  // Iterations captured by in-flight copies
+    std::unique_ptr<Writer> _writer;
+
+  public:
+    // Getters
+    bool isInit() const { return _isInit; }
+
+    // std::swap impl
+    friend void swap(Snapshots& a, Snapshots& b) noexcept {
+      using std::swap;
+      swap(a._isInit, b._isInit);
+      swap(a._params, b._params);
+      swap(a._embeddingBuffer, b._embeddingBuffer);
+      swap(a._snapshotSize, b._snapshotSize);
+      swap(a._buffers, b._buffers);
+      swap(a._fences, b._fences);
+      swap(a._iterations, b._iterations);
+      swap(a._writer, b._writer);
+    }
+  };
+} // dh::sne
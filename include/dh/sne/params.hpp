@@ -38,6 +38,15 @@ namespace dh::sne {
     uint nTexels; // Number of texels of images in case imageDataset
     bool normalizeData = false;
     bool uniformDims = true;
+    bool sparseData = false; // Set by SNE when constructed from a CSR matrix
+    uint knnBlockSize = 0; // If > 0, the dataset is never uploaded as a whole, but streamed through an exact KNN search in blocks of this many points
+    bool compressSimilarities = false; // Store similarities as bfloat16, packed with 16-bit neighbor offsets into 32 bits per edge if they fit (e.g. with reordered points), or beside 32-bit neighbors otherwise; disables editing similarities
+    bool compressedOffsets = false; // Set by Similarities when compressed edges hold neighbor offsets
+    bool segmentedGraph = false; // Set by Similarities when the symmetrized graph exceeds one storage block, and is bound in segments of points; as when compressed, it then cannot be edited
+    bool keepKNN = false; // Keep a host copy of the KNN search, so similarities can be recomputed at lower perplexities without searching again
+    bool reorderPoints = false; // Renumber points along the KNN graph after similarities are computed, for memory locality; output keeps input order
+    float pruneThreshold = 0.f; // Drop symmetrized similarities below this fraction of the largest in both their points' neighbor sets; 0 keeps all
+    float pruneMass = 1.f; // Keep only each point's largest similarities covering this fraction of its total; 1 keeps all
     std::string datasetName = "";
 
     // Basic tSNE parameters
@@ -53,14 +62,67 @@ namespace dh::sne {
     float fieldScaling2D = 2.0f;
     float fieldScaling3D = 1.2f;
 
+    // Adaptive approximation; if fieldTimeBudget > 0, theta is raised or lowered between adaptiveThetaMin and
+    // adaptiveThetaMax (bounding dualHierarchyTheta, singleHierarchyTheta follows by the same ratio) every
+    // adaptiveInterval iterations, to hold the field computation's measured time near the budget
+    float fieldTimeBudget = 0.f; // Milliseconds per iteration, 0 keeps theta fixed
+    float adaptiveThetaMin = 0.1f;
+    float adaptiveThetaMax = 1.0f;
+    uint adaptiveInterval = 20;
+    bool adaptiveFieldScaling = false; // Once theta reaches adaptiveThetaMax, coarsen the field down to half of fieldScaling2D/3D
+
     // Embedding initialization parameters
     int seed = 1;
     float rngRange = 0.1f;
-    
+    std::string initialization = "random"; // "random", "pca" along the first principal components, or "spectral" along the similarity graph's Laplacian eigenvectors
+    uint nReplicates = 1; // If > 1, minimize from seeds seed, seed + 1, ... against the same similarities and keep the embedding with the lowest KL divergence
+    uint transformIterations = 250; // Minimization steps of SNE::transform(), which embeds new points against the fixed embedding
+    float transformEta = 0.1f; // Learning rate of SNE::transform(); its per-point gradients are not scaled down by n, so it is far below eta
+
+    // Landmark minimization, for datasets too large to minimize as a whole; if nLandmarks > 0, only the landmarks are
+    // minimized, similar by the random walks between them over the full graph. The other points then start at the
+    // weighted mean of the landmarks their walks reach, and all points are refined for landmarkRefineIterations
+    uint nLandmarks = 0; // 0 minimizes all points
+    std::string landmarkSelection = "random"; // "random", or "walk" for the points most visited by random walks
+    uint landmarkWalks = 10; // Random walks from each point
+    uint landmarkWalkLength = 256; // Steps after which a walk that reached no landmark is dropped
+    uint landmarkRefineIterations = 50;
+
+    // Multilevel minimization; if multilevelLevels > 1, the graph is coarsened by heavy-edge matching into up to that
+    // many levels, stopping once a level has fewer than multilevelMinPoints points or barely shrinks. The coarsest level
+    // is minimized with the full schedule. Each finer level starts from its coarse points' positions, and is refined for
+    // half the iterations of the level below it, down to multilevelRefineIterations on the finest
+    uint multilevelLevels = 1; // 1 minimizes all points directly
+    uint multilevelMinPoints = 10000;
+    uint multilevelRefineIterations = 100;
+
+    // Negative sampling; if set, the embedding is minimized on the CPU by sampling edges with probability proportional
+    // to their similarity, for attraction, and samplingNegatives random points per edge, for repulsion, instead of by
+    // the field-based gradient descent. Attraction is multiplied by samplingExaggeration, which moves the result
+    // from t-SNE-like at 1 towards UMAP-like at around 4
+    bool negativeSampling = false;
+    uint samplingEpochs = 500;
+    uint samplingNegatives = 5;
+    float samplingLearningRate = 1.f; // Decays linearly to 0 over the epochs
+    float samplingExaggeration = 1.f;
+
     // Gradient descent iteration parameters
+    bool autoSchedule = false; // Derive eta, exaggeration, momentum and the iterations below from n, once similarities are computed
     uint momentumSwitchIter = 250;
     uint nExaggerationIters = 250;
     uint nExponentialDecayIters = 150;
+    float lateExaggerationFactor = 1.f; // If > 1, exaggeration applied again over the last lateExaggerationIters iterations, or right after early termination
+    uint lateExaggerationIters = 250;
+
+    // Early termination, checked every convergenceInterval iterations once exaggeration has decayed and momentum has
+    // switched. Stops once the KL divergence improved by less than convergenceTolerance over the last convergenceWindow
+    // checks, the gradient norm fell below convergenceGradient times its first checked value, or points moved less than
+    // convergenceMovement times the embedding's extent in one iteration
+    float convergenceTolerance = 0.f; // 0 disables early termination
+    float convergenceGradient = 1e-3f;
+    float convergenceMovement = 1e-5f;
+    uint convergenceInterval = 50;
+    uint convergenceWindow = 4;
 
     // Gradient descent parameters
     float minimumGain = 0.1f;
@@ -84,6 +146,12 @@ namespace dh::sne {
     float maxAttributeWeight = 2.f;
     float maxSimilarityWeight = 3.f;
 
+    // Snapshot params; the embedding is written every snapshotInterval iterations, either to numbered
+    // files or appended to a single file. Output is .npy if snapshotFilename has that extension, raw binary otherwise
+    std::string snapshotFilename = ""; // Empty disables snapshots
+    uint snapshotInterval = 0;
+    bool snapshotAppend = false;
+
     // Image dataset params
     bool imageDataset = false;
     uint imgWidth = 28;
@@ -27,6 +27,7 @@
 #include <variant>
 #include <vector>
 #include "dh/types.hpp"
+#include "dh/util/csr.hpp"
 #include "dh/util/timer.hpp"
 #include "dh/sne/params.hpp"
 #include "dh/sne/components/similarities.hpp"
@@ -41,6 +42,8 @@ namespace dh::sne {
     // Constr/destr
     SNE();
     SNE(Params* params, std::vector<char> axisMapping, const std::vector<float>& data, const std::vector<int>& labels = {});
+    SNE(Params* params, std::vector<char> axisMapping, const float* dataPtr, const int* labelPtr = nullptr); // Data is not copied, e.g. for memory-mapped input
+    SNE(Params* params, std::vector<char> axisMapping, util::CSRMatrix data, const int* labelPtr = nullptr); // Sparse input, moved into Similarities
     ~SNE();
 
     // Copy constr/assignment is explicitly deleted (no copying underlying handles)
@@ -58,10 +61,16 @@ namespace dh::sne {
     void compSimilarities();      // Only compute similarities
     void compMinimization();      // Only perform minimization
     void compMinimizationStep();  // Only perform a single step of minimization
+    void recompSimilarities(float perplexity); // Recompute similarities at another perplexity, keeping the minimization
+    void restartMinimization();   // Restart minimization from Params::seed, e.g. after changing its parameters
+    std::vector<float> transform(const float* dataPtr, uint n); // Embed n new points against the current embedding, which is kept fixed
+    void insert(const float* dataPtr, uint n, const int* labelPtr = nullptr); // Append n points to the dataset, and continue minimizing with them near their neighbors; needs Params::keepKNN
 
     // Getters
     // Don't call some of these *while* minimizing unless you don't care about performance
     std::vector<float> embedding() const;
+    float klDivergence();         // KL divergence of the current embedding; O(n^2)
+    const std::vector<float>& replicateKLDivergences() const { return _replicateKLDivergences; } // Per replicate, if Params::nReplicates > 1
     millis similaritiesTime() const;
     millis minimizationTime() const;
 
@@ -71,14 +80,24 @@ namespace dh::sne {
     // Given that, we define both in the same place and use std::visit for runtime polymorphism
     using Minimization = std::variant<sne::Minimization<2, 2>, sne::Minimization<2, 3>, sne::Minimization<3, 3>>;
 
+    // Internal functions
+    void compReplicates();
+    void compLandmarks();         // Minimize Params::nLandmarks landmarks, interpolate the other points and refine all
+    void compMultilevel();        // Minimize a coarsened graph, then refine on each finer level up to all points
+    void scheduleAutomatically(Params& params); // Derive the gradient descent schedule from the number of points, if Params::autoSchedule
+    Params childParams(uint n);   // Params of a nested minimization of n points, e.g. over landmarks or a coarsened graph
+
     // State
     bool _isInit;
     const float* _dataPtr;
     const int* _labelPtr;
+    util::HostVector<float> _dataReordered;  // Host inputs in the order of reordered points, if Params::reorderPoints is set or points were inserted
+    std::vector<int> _labelsReordered;
     Params* _params;
     std::vector<char> _axisMapping;
     util::ChronoTimer _similaritiesTimer;
     util::ChronoTimer _minimizationTimer;
+    std::vector<float> _replicateKLDivergences;
 
     // Subcomponents
     Similarities _similarities;
@@ -91,10 +110,15 @@ namespace dh::sne {
     friend void swap(SNE& a, SNE& b) noexcept {
       using std::swap;
       swap(a._isInit, b._isInit);
+      swap(a._dataPtr, b._dataPtr);
+      swap(a._labelPtr, b._labelPtr);
+      swap(a._dataReordered, b._dataReordered);
+      swap(a._labelsReordered, b._labelsReordered);
       swap(a._params, b._params);
       swap(a._axisMapping, b._axisMapping);
       swap(a._similaritiesTimer, b._similaritiesTimer);
       swap(a._minimizationTimer, b._minimizationTimer);
+      swap(a._replicateKLDivergences, b._replicateKLDivergences);
       swap(a._similarities, b._similarities);
       swap(a._minimization, b._minimization);
     }
@@ -24,10 +24,14 @@
 
 #pragma once
 
+#include <cstdint>
+
 namespace dh {
   using GLuint = unsigned int; // Matches GLAD, use to prevent unnecessary glad includes but retain notation for OpenGL handles etc.
   using GLint = int;           // Matches GLAD, use to prevent unnecessary glad includes but retain notation for OpenGL handles etc.
   using uint = unsigned int;   // Matches GLSL, use to retain notation for unsigned integers outside shader code
+  using ulong = std::uint64_t; // Matches GLSL uint64_t, use for element counts, offsets and byte sizes that scale with n * k or n * nHighDims
+                               // Point ids stay uint, as do indices into buffers in shader code
   
   // Rounded up division of some n by div
   template <typename genType> 
@@ -116,7 +116,7 @@ namespace dh::util {
   }
 
   template <unsigned D, typename genType>
-  std::vector<genType> to_unaligned_vector(std::vector<AlignedVec<D, genType>> alignedVec, unsigned int n) {
+  std::vector<genType> to_unaligned_vector(const std::vector<AlignedVec<D, genType>>& alignedVec, unsigned int n) {
     uint Dvec = detail::std430_align(D) / 4;
     std::vector<genType> unalignedVec(D * n);
     for(uint i = 0; i < n; i++) {
@@ -0,0 +1,47 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include "dh/types.hpp"
+
+namespace dh::util {
+  // Coarsening of a weighted graph, given as n (offset, size) pairs into neighbors and weights, i.e. the
+  // eLayout/eNeighbors/eSimilarities format of sne::Similarities, for multilevel minimization
+
+  // Heavy-edge matching. Points are visited in a seeded random order, and each point not yet matched is matched to
+  // the unmatched neighbor it shares its heaviest edge with, or left on its own. Returns for each point the coarse
+  // point it merges into; coarse points are numbered in order of their first point, so they keep the points' order.
+  // nCoarse receives the number of coarse points
+  std::vector<uint> matchHeavyEdges(const std::vector<uint>& layout, const std::vector<uint>& neighbors,
+                                    const std::vector<float>& weights, int seed, uint& nCoarse);
+
+  // Graph over the coarse points of a matching, in the same format. Edges between the same coarse points add up,
+  // and edges within a coarse point are dropped
+  void coarsenGraph(const std::vector<uint>& layout, const std::vector<uint>& neighbors,
+                    const std::vector<float>& weights, const std::vector<uint>& coarse, uint nCoarse,
+                    std::vector<uint>& coarseLayout, std::vector<uint>& coarseNeighbors, std::vector<float>& coarseWeights);
+} // dh::util
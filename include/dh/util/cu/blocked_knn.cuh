@@ -0,0 +1,98 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include "dh/types.hpp"
+#include "dh/util/enum.hpp"
+#include "dh/util/cu/interop.cuh"
+
+namespace dh::util {
+  /**
+   * BlockedKNN
+   * 
+   * Exact KNN search for datasets that do not fit in memory, e.g. memory-mapped from disk. The dataset
+   * is streamed through the GPU in blocks of blockSize points; each block of queries is searched 
+   * against every block of references, and the top-k lists of all reference blocks are merged. A
+   * completed query block is written straight to the output buffers, so neither the dataset nor the 
+   * full n * k result is ever resident in host memory. Output matches KNN, i.e. squared L2 distances.
+   * 
+   * If mins and scales are provided, each attribute is transformed as (x - mins[a]) * scales[a] while
+   * blocks are staged, matching an in-memory normalization of the dataset.
+   */
+  class BlockedKNN {
+  public:
+    BlockedKNN();
+    BlockedKNN(const float* dataPtr, GLuint distancesBuffer, GLuint indicesBuffer, uint n, uint k, uint d, uint blockSize,
+               std::vector<float> mins = {}, std::vector<float> scales = {});
+    ~BlockedKNN();
+
+    // Copy constr/assignment is explicitly deleted (no copying handles)
+    BlockedKNN(const BlockedKNN&) = delete;
+    BlockedKNN& operator=(const BlockedKNN&) = delete;
+
+    // Move constr/operator moves handles
+    BlockedKNN(BlockedKNN&&) noexcept;
+    BlockedKNN& operator=(BlockedKNN&&) noexcept;
+
+    // Perform KNN computation, storing results in provided buffers
+    void comp();
+
+    bool isInit() const { return _isInit; }
+
+  private:
+    enum class BufferType {
+      eDistances,
+      eIndices,
+
+      Length
+    };
+
+    // Copy (and transform) points [begin, end) into a contiguous staging block
+    const float* stage(uint begin, uint end, std::vector<float>& staging) const;
+
+    bool _isInit;
+    uint _n, _k, _d, _blockSize;
+    const float* _dataPtr;
+    std::vector<float> _mins;
+    std::vector<float> _scales;
+    EnumArray<BufferType, CUGLInteropBuffer> _interopBuffers;
+
+  public:
+    // std::swap impl
+    friend void swap(BlockedKNN& a, BlockedKNN& b) noexcept {
+      using std::swap;
+      swap(a._isInit, b._isInit);
+      swap(a._n, b._n);
+      swap(a._k, b._k);
+      swap(a._d, b._d);
+      swap(a._blockSize, b._blockSize);
+      swap(a._dataPtr, b._dataPtr);
+      swap(a._mins, b._mins);
+      swap(a._scales, b._scales);
+      swap(a._interopBuffers, b._interopBuffers);
+    }
+  };
+} // dh::util
@@ -24,16 +24,24 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
 #include "dh/types.hpp"
 #include "dh/util/enum.hpp"
 #include "dh/util/cu/interop.cuh"
 
+namespace faiss::gpu {
+  class StandardGpuResources;
+  class GpuIndexIVFFlat;
+} // faiss::gpu
+
 namespace dh::util {
   class KNN {
   public:
     KNN();
     KNN(const float* dataPtr, GLuint distancesBuffer, GLuint indicesBuffer, uint n, uint k, uint d);
     KNN(GLuint datasetBuffer, GLuint distancesBuffer, GLuint indicesBuffer, uint n, uint k, uint d);
+    KNN(GLuint datasetBuffer, GLuint queryBuffer, GLuint distancesBuffer, GLuint indicesBuffer, uint n, uint nQuery, uint k, uint d); // Searches nQuery other points against the dataset
     ~KNN();
 
     // Copy constr/assignment is explicitly deleted (no copying handles)
@@ -52,6 +60,7 @@ namespace dh::util {
   private:
     enum class BufferType {
       eDataset,
+      eQuery,
       eDistances,
       eIndices,
 
@@ -59,7 +68,7 @@ namespace dh::util {
     };
 
     bool _isInit;
-    uint _n, _k, _d;
+    uint _n, _nQuery, _k, _d;
     const float* _dataPtr;
     EnumArray<BufferType, CUGLInteropBuffer> _interopBuffers;
 
@@ -69,10 +78,60 @@ namespace dh::util {
       using std::swap;
       swap(a._isInit, b._isInit);
       swap(a._n, b._n);
+      swap(a._nQuery, b._nQuery);
       swap(a._k, b._k);
       swap(a._d, b._d);
       swap(a._dataPtr, b._dataPtr);
       swap(a._interopBuffers, b._interopBuffers);
     }
   };
+
+  // FAISS index kept across searches, to which points can be added, so that batches of new points are searched without
+  // training and adding all points again. Holds points [begin, begin + n) of a dataset buffer, and returns their indices
+  // in that buffer. Its inverted lists are trained once, on the initial points
+  class KNNIndex {
+  public:
+    KNNIndex();
+    KNNIndex(GLuint datasetBuffer, uint begin, uint n, uint d);
+    ~KNNIndex();
+
+    // Copy constr/assignment is explicitly deleted (no copying handles)
+    KNNIndex(const KNNIndex&) = delete;
+    KNNIndex& operator=(const KNNIndex&) = delete;
+
+    // Move constr/operator moves handles
+    KNNIndex(KNNIndex&&) noexcept;
+    KNNIndex& operator=(KNNIndex&&) noexcept;
+
+    // Add the n points of a dataset buffer following those held, which may have been recreated to hold them
+    void add(GLuint datasetBuffer, uint n);
+
+    // Search k neighbors of points [begin, begin + nQuery) of a dataset buffer, or of the listed points, into host
+    // vectors of nQuery * k squared distances and indices, nearest first. Missing neighbors have index uint(-1)
+    void search(GLuint datasetBuffer, uint begin, uint nQuery, uint k, std::vector<float>& distances, std::vector<uint>& indices);
+    void search(GLuint datasetBuffer, const std::vector<uint>& points, uint k, std::vector<float>& distances, std::vector<uint>& indices);
+
+    bool isInit() const { return _isInit; }
+    uint size() const { return _n; }
+
+  private:
+    void search(const float* queryPtr, uint nQuery, uint k, float* distances, uint* indices);
+
+    bool _isInit;
+    uint _begin, _n, _d;
+    std::unique_ptr<faiss::gpu::StandardGpuResources> _resources;
+    std::unique_ptr<faiss::gpu::GpuIndexIVFFlat> _index;
+
+  public:
+    // std::swap impl
+    friend void swap(KNNIndex& a, KNNIndex& b) noexcept {
+      using std::swap;
+      swap(a._isInit, b._isInit);
+      swap(a._begin, b._begin);
+      swap(a._n, b._n);
+      swap(a._d, b._d);
+      swap(a._resources, b._resources);
+      swap(a._index, b._index);
+    }
+  };
 } // dh::util
\ No newline at end of file
@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+#include "dh/types.hpp"
+
+namespace dh::util {
+  /**
+   * GLBufferPool
+   * 
+   * Recycles transient buffer objects, so repeated temporary allocations (e.g. reductions run every frame) do
+   * not go through the driver. Requests are rounded up to a size class, and released buffers are kept for reuse
+   * while the pool holds less than retainLimit bytes in free buffers; larger requests are allocated exactly and
+   * freed on release. Pooled buffers always have GL_DYNAMIC_STORAGE_BIT set, their contents are undefined on
+   * acquisition, and they may be larger than requested, so only the requested range should be relied on.
+   */
+  class GLBufferPool {
+  public:
+    // Accessor; there is one GLBufferPool used by the util library
+    static GLBufferPool& instance() {
+      static GLBufferPool instance;
+      return instance;
+    }
+
+    // Obtain a buffer of at least size bytes
+    GLuint acquire(ulong size);
+
+    // Return buffers to the pool; handles are set to 0
+    void release(GLuint& handle);
+    void release(GLsizei n, GLuint* handles);
+
+    // Delete all free buffers; requires the context to be current
+    void clear();
+
+    // Memory accounting in bytes
+    ulong allocatedSize() const { return _allocatedSize; }  // In use and free
+    ulong inUseSize() const { return _inUseSize; }
+    ulong highWaterSize() const { return _highWaterSize; }  // Largest in-use size to date
+
+  private:
+    // Hidden constr/destr
+    GLBufferPool();
+    ~GLBufferPool();
+
+    ulong sizeClass(ulong size) const;
+
+    // State
+    ulong _retainLimit;
+    ulong _allocatedSize;
+    ulong _freeSize;
+    ulong _inUseSize;
+    ulong _highWaterSize;
+
+    // Objects
+    std::unordered_map<GLuint, ulong> _inUse;       // Handles and their allocated sizes
+    std::multimap<ulong, GLuint> _free;             // Free buffers by allocated size
+  };
+} // dh::util
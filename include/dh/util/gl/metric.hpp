@@ -24,28 +24,65 @@
 
 #pragma once
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <string>
 #include <glad/glad.h>
+#include "dh/types.hpp"
 #include "dh/util/enum.hpp"
+#include "dh/util/error.hpp"
 
 namespace dh::util {
   // Query a buffer's memory size in bytes
   inline
-  GLuint glGetBufferSize(GLuint handle) {
-    GLint size = 0;
-    glGetNamedBufferParameteriv(handle, GL_BUFFER_SIZE, &size);
-    return static_cast<GLuint>(size);
+  ulong glGetBufferSize(GLuint handle) {
+    GLint64 size = 0;
+    glGetNamedBufferParameteri64v(handle, GL_BUFFER_SIZE, &size);
+    return static_cast<ulong>(size);
   }
 
   inline 
-  GLuint glGetBuffersSize(GLsizei n, GLuint* handles) {
-    GLuint size = 0;
+  ulong glGetBuffersSize(GLsizei n, GLuint* handles) {
+    ulong size = 0;
     for (GLsizei i = 0; i < n; ++i) {
       size += glGetBufferSize(handles[i]);
     }
     return size;
   }
 
+  // Query the largest buffer range in bytes that can be bound as a shader storage block
+  inline
+  ulong glGetMaxStorageBlockSize() {
+    GLint64 size = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &size);
+    return static_cast<ulong>(size);
+  }
+
+  // Query the alignment in bytes of offsets at which buffer ranges can be bound as shader storage blocks
+  inline
+  ulong glGetStorageOffsetAlignment() {
+    GLint alignment = 0;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return static_cast<ulong>(alignment);
+  }
+
+  // Query the largest number of elements of the given size in a buffer range that can be bound as a shader storage
+  // block, and indexed by 32-bit shader code
+  inline
+  ulong glGetMaxStorageElements(ulong elementSize) {
+    return std::min<ulong>(glGetMaxStorageBlockSize() / elementSize, std::numeric_limits<uint>::max());
+  }
+
+  // Assert that a storage buffer of n elements of the given size can be bound, and indexed by 32-bit shader code
+  inline
+  void glAssertStorageSize(ulong n, ulong elementSize, const std::string& name) {
+    runtimeAssert(n <= std::numeric_limits<uint>::max(), 
+      name + " holds " + std::to_string(n) + " elements, exceeding 32-bit shader indexing");
+    runtimeAssert(n * elementSize <= glGetMaxStorageBlockSize(), 
+      name + " requires " + std::to_string(n * elementSize) + " bytes, exceeding GL_MAX_SHADER_STORAGE_BLOCK_SIZE");
+  }
+
   inline
   GLuint glGetTextureSize(GLuint handle) {
     GLint size = 0;
@@ -24,10 +24,14 @@
 
 #pragma once
 
+#include <iosfwd>
 #include <string>
 #include <vector>
 #include <set>
 #include "dh/types.hpp"
+#include "dh/util/csr.hpp"
+#include "dh/util/thread_pool.hpp"
+#include "dh/util/mapped_file.hpp"
 
 namespace dh::util {
  /**
@@ -37,7 +41,7 @@ namespace dh::util {
    * contain labels for each vector, these can be read assuming they are stored as 32 bit uints.
    */
   void readBinFile(const std::string &fileName, 
-                   std::vector<float> &data,
+                   HostVector<float> &data,
                    std::vector<int> &labels, 
                    uint n,
                    uint d,
@@ -75,10 +79,188 @@ namespace dh::util {
   void writeTextValuesFile(const std::string &fileName,
                            const std::vector<std::string> &values);
 
+  /**
+   * DataType
+   * 
+   * Scalar element types understood by the NumPy reader/writer below.
+   */
+  enum class DataType {
+    eFloat32,
+    eFloat16,
+    eUint8,
+    eInt32,
+    eUint32,
+    eInt64,
+    eFloat64,
+
+    Length
+  };
+
+  /**
+   * sizeOf(...)
+   * 
+   * Size in bytes of a single element of the specified type.
+   */
+  size_t sizeOf(DataType type);
+
+  /**
+   * NpyHeader
+   * 
+   * Parsed header of a NumPy array: element type, memory order, shape, and the offset in bytes
+   * from the start of the array's file (or .npz member) to its raw data.
+   */
+  struct NpyHeader {
+    DataType type;
+    bool fortranOrder;
+    std::vector<size_t> shape;
+    size_t dataOffset;
+
+    // Number of rows, i.e. the first axis, or 1 for a scalar
+    size_t rows() const;
+
+    // Number of values per row, i.e. the product of all remaining axes
+    size_t cols() const;
+  };
+
+  /**
+   * NpyArray
+   * 
+   * Memory-mapped, read-only view over a .npy file or over an uncompressed member of a .npz
+   * archive (as written by np.save/np.savez). Nothing is read until the data is touched, and
+   * float32 data in C order can be used in place through floatData(). Other types and orders are
+   * converted on request by toFloat()/toInt().
+   */
+  class NpyArray {
+  public:
+    NpyArray();
+    NpyArray(const std::string& fileName);                                // Open a .npy file
+    NpyArray(const std::string& fileName, const std::string& arrayName);  // Open a member of a .npz archive; empty name selects the first
+    ~NpyArray();
+
+    // Copy constr/assignment is explicitly deleted (no copying mapping handles)
+    NpyArray(const NpyArray&) = delete;
+    NpyArray& operator=(const NpyArray&) = delete;
+
+    // Move constr/operator moves handles
+    NpyArray(NpyArray&&) noexcept;
+    NpyArray& operator=(NpyArray&&) noexcept;
+
+    // Returns a pointer into the mapping if the array is float32 in C order, or nullptr otherwise
+    const float* floatData() const;
+
+    // Convert to a row-major rows() x cols() vector, whatever the stored type and order. Host vectors are
+    // allocated through ThreadPool::firstTouch(), with the rows as its range
+    void toFloat(HostVector<float>& data) const;
+    void toInt(std::vector<int>& data) const;
+    void toUint(HostVector<uint>& data) const;
+    void toSize(HostVector<size_t>& data) const;
+    void toSize(std::vector<size_t>& data) const;
+
+    // List the array names stored in a .npz archive, without their .npy extension
+    static std::vector<std::string> list(const std::string& fileName);
+
+  private:
+    bool _isInit;
+    MappedFile _file;
+    NpyHeader _header;
+    const std::byte* _data;
+
+  public:
+    bool isInit() const { return _isInit; }
+    const NpyHeader& header() const { return _header; }
+    const std::byte* rawData() const { return _data; }
+
+    // std::swap impl
+    friend void swap(NpyArray& a, NpyArray& b) noexcept {
+      using std::swap;
+      swap(a._isInit, b._isInit);
+      swap(a._file, b._file);
+      swap(a._header, b._header);
+      swap(a._data, b._data);
+    }
+  };
+
+  /**
+   * readNpyFile(...)
+   * 
+   * Read a .npy file, or an array stored in a .npz archive, and interpret it as N D-dimensional
+   * float vectors; N and D are taken from the array's shape. Should labels be stored in the same
+   * .npz archive under "labels", these can be read through the label overload.
+   */
+  void readNpyFile(const std::string &fileName,
+                   HostVector<float> &data,
+                   uint& n,
+                   uint& d,
+                   const std::string &arrayName = "");
+  void readNpyFile(const std::string &fileName,
+                   std::vector<int> &labels,
+                   const std::string &arrayName = "");
+
+  /**
+   * readCSRFile(...)
+   * 
+   * Read a sparse matrix stored in CSR format by scipy.sparse.save_npz(..., compressed=False),
+   * i.e. a .npz archive holding "shape", "indptr", "indices" and "data" arrays. Column indices
+   * are sorted within each row if they were not already.
+   */
+  void readCSRFile(const std::string &fileName,
+                   CSRMatrix &data);
+
+  /**
+   * isCSRFile(...)
+   * 
+   * Test whether a .npz archive holds a sparse matrix as read by readCSRFile(...)
+   */
+  bool isCSRFile(const std::string &fileName);
+
+  /**
+   * selectClasses(...)
+   * 
+   * Apply the class handling of readBinFile(...) to separately loaded data and labels: either count
+   * the classes and shift labels to start at 0, or only keep datapoints of the first nClasses classes.
+   */
+  void selectClasses(HostVector<float> &data,
+                     std::vector<int> &labels,
+                     uint d,
+                     bool withLabels,
+                     int& nClasses,
+                     bool includeAllClasses);
+  void selectClasses(CSRMatrix &data,
+                     std::vector<int> &labels,
+                     bool withLabels,
+                     int& nClasses,
+                     bool includeAllClasses);
+
+  /**
+   * writeNpyHeader(...)
+   * 
+   * Write a version 1.0 .npy header for an array of the given type and shape. As done by NumPy
+   * itself, the header is padded so the first axis can later grow in place without moving data.
+   */
+  void writeNpyHeader(std::ostream &ofs,
+                      DataType type,
+                      const std::vector<size_t> &shape);
+
+  /**
+   * writeNpyFile(...)
+   * 
+   * Write N D-dimensional vectors directly to a .npy file, in C order, without intermediate copies.
+   */
+  void writeNpyFile(const std::string &fileName,
+                    const float* data,
+                    uint n,
+                    uint d);
+  void writeNpyFile(const std::string &fileName,
+                    const int* data,
+                    uint n);
+
+  // Buffer dumps below are binary files (./buffer_dumps/<filename>.bin) with a 64-byte header holding
+  // a magic number, version, DataType, n, d and a checksum of the data, followed by the raw values
+
   /**
    * readGLBuffer
    * 
-   * Reads a text file in /dual_hierarchy_tsne/buffer_dumps/ into an OpenGL buffer. Useful for debugging. THE HANDLE IS RECREATED, so make sure to update any copies of it!
+   * Reads a binary dump in /dual_hierarchy_tsne/buffer_dumps/ into an OpenGL buffer, uploading directly from a memory mapping. Useful for debugging. THE HANDLE IS RECREATED, so make sure to update any copies of it!
    */
   template<typename T>
   void readGLBuffer(GLuint& handle,
@@ -89,7 +271,7 @@ namespace dh::util {
   /**
    * writeGLBuffer
    * 
-   * Write an OpenGL buffer to a text file in /dual_hierarchy_tsne/buffer_dumps/ (create the folder beforehand). Useful for debugging
+   * Write an OpenGL buffer to a binary dump in /dual_hierarchy_tsne/buffer_dumps/ (create the folder beforehand). Useful for debugging
    */
   template<typename T>
   void writeGLBuffer(const GLuint handle,
@@ -100,7 +282,7 @@ namespace dh::util {
   /**
    * readVector
    * 
-   * Reads a text file in /dual_hierarchy_tsne/buffer_dumps/ into a vector. Useful for debugging
+   * Reads a binary dump in /dual_hierarchy_tsne/buffer_dumps/ into a vector. Useful for debugging
    */
   template<typename T>
   std::vector<T> readVector(uint n,
@@ -110,7 +292,7 @@ namespace dh::util {
   /**
    * writeVector
    * 
-   * Write a vector to a text file in /dual_hierarchy_tsne/buffer_dumps/ (create the folder beforehand). Useful for debugging
+   * Write a vector to a binary dump in /dual_hierarchy_tsne/buffer_dumps/ (create the folder beforehand). Useful for debugging
    */
   template<typename T>
   void writeVector(const std::vector<T> vec,
@@ -119,17 +301,17 @@ namespace dh::util {
                    const std::string filename);
 
   /**
-   * readVector
+   * readSet
    * 
-   * Reads a text file in /dual_hierarchy_tsne/buffer_dumps/ into a vector. Useful for debugging
+   * Reads a binary dump in /dual_hierarchy_tsne/buffer_dumps/ into a set. Useful for debugging
    */
   template<typename T>
   std::set<T> readSet(const std::string filename);
 
   /**
-   * writeVector
+   * writeSet
    * 
-   * Write a vector to a text file in /dual_hierarchy_tsne/buffer_dumps/ (create the folder beforehand). Useful for debugging
+   * Write a set to a binary dump in /dual_hierarchy_tsne/buffer_dumps/ (create the folder beforehand). Useful for debugging
    */
   template<typename T>
   void writeSet(const std::set<T> vec, const std::string filename);
@@ -139,7 +321,7 @@ namespace dh::util {
    * 
    * Normalize a vector between lower and upper (0 and 1 by default) with one global minimum and maximum
    */
-  void normalizeData(std::vector<float>& data,
+  void normalizeData(HostVector<float>& data,
                      uint n,
                      uint d,
                      float lower = 0.f,
@@ -150,9 +332,46 @@ namespace dh::util {
    * 
    * Normalize a vector between lower and upper (0 and 1 by default) with a separate minimum and maximum per dimension
    */
-  void normalizeDataNonUniformDims(std::vector<float>& data,
+  void normalizeDataNonUniformDims(HostVector<float>& data,
                                    uint n,
                                    uint d,
                                    float lower = 0.f,
                                    float upper = 1.f);
+
+  /**
+   * computeNormalization
+   * 
+   * Determine the transform x' = (x - mins[a]) * scales[a] per attribute that normalizeData or
+   * normalizeDataNonUniformDims apply with their default bounds, without modifying the data.
+   * For data too large to normalize in memory, which is instead transformed block by block
+   */
+  void computeNormalization(const float* data,
+                            ulong n,
+                            uint d,
+                            bool uniformDims,
+                            std::vector<float>& mins,
+                            std::vector<float>& scales);
+
+  /**
+   * applyNormalization
+   * 
+   * Apply a transform obtained from computeNormalization to n rows of data, writing them to output.
+   * For points normalized the same way as an earlier dataset, which may lie outside its bounds
+   */
+  void applyNormalization(const float* data,
+                          ulong n,
+                          uint d,
+                          const std::vector<float>& mins,
+                          const std::vector<float>& scales,
+                          float* output);
+
+  /**
+   * normalizeData
+   * 
+   * Normalize a sparse matrix by its largest absolute value, either globally or per dimension.
+   * Unlike the dense variants no offset is applied, so zeros stay zero and the matrix stays sparse
+   */
+  void normalizeData(CSRMatrix& data,
+                     bool uniformDims = true,
+                     float upper = 1.f);
 } // dh::util
\ No newline at end of file
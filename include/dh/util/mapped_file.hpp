@@ -0,0 +1,78 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "dh/types.hpp"
+
+namespace dh::util {
+  // Simple read-only memory mapping of a file, so large inputs can be accessed
+  // in place instead of being streamed into a separate copy first
+  class MappedFile {
+  public:
+    MappedFile();
+    MappedFile(const std::string& fileName);
+    ~MappedFile();
+
+    // Copy constr/assignment is explicitly deleted (no copying mapping handles)
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Move constr/operator moves handles
+    MappedFile(MappedFile&&) noexcept;
+    MappedFile& operator=(MappedFile&&) noexcept;
+
+    const std::byte* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool isInit() const { return _isInit; }
+
+  private:
+    bool _isInit;
+    const std::byte* _data;
+    size_t _size;
+#ifdef _WIN32
+    void* _fileHandle;
+    void* _mappingHandle;
+#else
+    int _fileDescriptor;
+#endif
+
+  public:
+    // std::swap impl
+    friend void swap(MappedFile& a, MappedFile& b) noexcept {
+      using std::swap;
+      swap(a._isInit, b._isInit);
+      swap(a._data, b._data);
+      swap(a._size, b._size);
+#ifdef _WIN32
+      swap(a._fileHandle, b._fileHandle);
+      swap(a._mappingHandle, b._mappingHandle);
+#else
+      swap(a._fileDescriptor, b._fileDescriptor);
+#endif
+    }
+  };
+} // dh::util
@@ -0,0 +1,66 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include "dh/types.hpp"
+
+namespace dh::util {
+  /**
+   * NegativeSampler
+   * 
+   * Stochastic gradient descent on the t-SNE objective over a weighted graph, given as n (offset, size) pairs into
+   * neighbors and weights, i.e. the eLayout/eNeighbors/eSimilarities format of sne::Similarities. Each epoch visits
+   * every edge with probability proportional to its weight, attracting its point to the neighbor, and repelling the
+   * point from nNegatives uniformly drawn points. Repulsion is divided by the mean Cauchy kernel over the previous
+   * epoch's negative samples, an estimate of t-SNE's normalization Z over n^2. Attraction is multiplied by
+   * exaggeration; 1 gives t-SNE-like embeddings, and around 4 UMAP-like ones. Each update moves a single point, and
+   * threads apply them without locks (Hogwild), as they rarely touch the same point at once.
+   */
+  class NegativeSampler {
+  public:
+    NegativeSampler(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& weights,
+                    uint nNegatives, float exaggeration, int seed);
+
+    // Run one epoch over an embedding of nDims (at most 3) floats per point, stored stride floats apart
+    void epoch(float* embedding, uint nDims, uint stride, float learningRate);
+
+    // Getters
+    uint epochs() const { return _epoch; }
+    float meanKernel() const { return _meanKernel; }
+
+  private:
+    const std::vector<uint>& _layout;
+    const std::vector<uint>& _neighbors;
+    const std::vector<float>& _weights;
+    uint _nNegatives;
+    float _exaggeration;
+    int _seed;
+    float _maxWeight;
+    float _meanKernel;
+    uint _epoch;
+  };
+} // dh::util
@@ -0,0 +1,51 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include "dh/types.hpp"
+#include "dh/util/csr.hpp"
+
+namespace dh::util {
+  // Random walks over a weighted graph, given as n (offset, size) pairs into neighbors and weights, i.e. the
+  // eLayout/eNeighbors/eSimilarities format of sne::Similarities. Each step moves to a neighbor with probability
+  // proportional to the weight of their edge. Walks from a point draw from a generator seeded by seed and that
+  // point only, so results do not depend on scheduling
+
+  // The nLandmarks points visited most often by nWalks walks of walkLength steps from every point, sorted ascending.
+  // Visits approximate the walk's stationary distribution, which favours points central to their neighborhood
+  // over the outliers a uniform sample also draws
+  std::vector<uint> selectLandmarksByWalks(const std::vector<uint>& layout, const std::vector<uint>& neighbors,
+                                           const std::vector<float>& weights, uint nLandmarks, uint nWalks,
+                                           uint walkLength, int seed);
+
+  // For each point, the landmarks that its nWalks walks reach first. A walk ends at the first landmark other than
+  // its start, and is dropped if it reaches none within walkLength steps. Row i holds, for each landmark by its
+  // index into landmarks, the fraction of point i's remaining walks that ended there; it is empty if none remain
+  CSRMatrix walkToLandmarks(const std::vector<uint>& layout, const std::vector<uint>& neighbors,
+                            const std::vector<float>& weights, const std::vector<uint>& landmarks, uint nWalks,
+                            uint walkLength, int seed);
+} // dh::util
@@ -0,0 +1,54 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include "dh/types.hpp"
+#include "dh/util/csr.hpp"
+
+namespace dh::util {
+  // Point reorderings are stored as permutations, where entry i holds the original index of the
+  // point that is moved to position i
+
+  // Reverse Cuthill-McKee order of a symmetric graph, given as n (offset, size) pairs into neighbors,
+  // i.e. the eLayout/eNeighbors format of sne::Similarities. Neighboring points end up close together,
+  // which keeps the gathers over a point's neighbors within few cache lines
+  std::vector<uint> reverseCuthillMcKee(const std::vector<uint>& layout, const std::vector<uint>& neighbors);
+
+  // For each original index its new position
+  std::vector<uint> invertPermutation(const std::vector<uint>& permutation);
+
+  // Drop the points for which selection is 0, renumbering the remaining original indices to 0..m-1
+  // while keeping their relative order
+  void compactPermutation(std::vector<uint>& permutation, const std::vector<uint>& selection);
+
+  // Move the rows of a dense or sparse dataset to their new positions
+  void permuteRows(HostVector<float>& data, uint nDims, const std::vector<uint>& permutation);
+  void permuteRows(CSRMatrix& data, const std::vector<uint>& permutation);
+
+  // Write reordered rows of src (with srcStride floats per row) back to their original positions in dst
+  void restoreRowOrder(const std::vector<uint>& permutation, const float* src, uint srcStride, float* dst, uint nDims);
+} // dh::util
@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include "dh/types.hpp"
+#include "dh/util/csr.hpp"
+
+namespace dh::util {
+  /**
+   * SparseKNN
+   * 
+   * Exact k-nearest neighbor search (squared L2) over sparse rows, on the host. Dot products are
+   * accumulated through an inverted index over columns, so only pairs sharing a column are touched;
+   * the remaining candidates have distance |x|^2 + |y|^2 and are drawn in order of increasing norm.
+   * Output matches util::KNN: n * k distances and indices, with each point itself first.
+   */
+  class SparseKNN {
+  public:
+    SparseKNN();
+    SparseKNN(const CSRMatrix* dataPtr, uint k);
+    ~SparseKNN();
+
+    // Copy constr/assignment is explicitly deleted
+    SparseKNN(const SparseKNN&) = delete;
+    SparseKNN& operator=(const SparseKNN&) = delete;
+
+    // Move constr/operator moves handles
+    SparseKNN(SparseKNN&&) noexcept;
+    SparseKNN& operator=(SparseKNN&&) noexcept;
+
+    // Perform KNN computation, storing results in provided vectors
+    void comp(std::vector<float>& distances, std::vector<uint>& indices);
+
+    bool isInit() const { return _isInit; }
+
+  private:
+    bool _isInit;
+    uint _k;
+    const CSRMatrix* _dataPtr;
+
+  public:
+    // std::swap impl
+    friend void swap(SparseKNN& a, SparseKNN& b) noexcept {
+      using std::swap;
+      swap(a._isInit, b._isInit);
+      swap(a._k, b._k);
+      swap(a._dataPtr, b._dataPtr);
+    }
+  };
+} // dh::util
@@ -0,0 +1,47 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include "dh/types.hpp"
+#include "dh/util/thread_pool.hpp"
+
+namespace dh::util {
+  // Pruning of a symmetric weighted graph, given as n (offset, size) pairs into neighbors and weights, i.e. the
+  // eLayout/eNeighbors/eSimilarities format of sne::Similarities. Each row keeps its edges weighing at least threshold
+  // times its heaviest edge, and only its heaviest edges that together cover a mass fraction of its total weight.
+  // An edge is kept if either of its rows keeps it, so the pruned graph stays symmetric, and every row with edges
+  // keeps at least its heaviest one. Kept weights are rescaled to the original total, and the pruned graph is
+  // compact, rows keeping their order. Returns the fraction of total weight kept before rescaling
+  float pruneGraph(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& weights,
+                   float threshold, float mass,
+                   std::vector<uint>& prunedLayout, std::vector<uint>& prunedNeighbors, std::vector<float>& prunedWeights);
+
+  // As above, for a graph given as n + 1 64-bit offsets into neighbors and weights, as util::symmetrizeKNN() builds it
+  float pruneGraph(const HostVector<ulong>& offsets, const HostVector<uint>& neighbors, const HostVector<float>& weights,
+                   float threshold, float mass,
+                   HostVector<ulong>& prunedOffsets, HostVector<uint>& prunedNeighbors, HostVector<float>& prunedWeights);
+} // dh::util
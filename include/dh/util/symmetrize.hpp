@@ -0,0 +1,38 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "dh/types.hpp"
+#include "dh/util/thread_pool.hpp"
+
+namespace dh::util {
+  // Symmetrization of a KNN graph of n rows of k neighbors, itself first, weighted by conditional similarities p_j|i,
+  // as on the device by sne::Similarities::comp() for graphs that fit a single storage block. Each row holds the
+  // union of its neighbors and the points having it as neighbor, sorted by index, each weighing 0.5 * (p_j|i + p_i|j).
+  // Row i's edges start at offsets[i], and offsets[n] is their total
+  void symmetrizeKNN(const HostVector<uint>& indices, const HostVector<float>& conditionals, uint n, uint k,
+                     HostVector<ulong>& offsets, HostVector<uint>& neighbors, HostVector<float>& similarities);
+} // dh::util
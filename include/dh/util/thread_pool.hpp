@@ -0,0 +1,218 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "dh/types.hpp"
+
+namespace dh::util {
+  /**
+   * DefaultInitAllocator
+   * 
+   * Allocator that default-initializes elements, so that a vector of trivial elements is resized
+   * without being zeroed on the calling thread, and its pages are left untouched.
+   */
+  template <typename T>
+  struct DefaultInitAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind { using other = DefaultInitAllocator<U>; };
+
+    using std::allocator<T>::allocator;
+
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+      ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+      ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+  };
+
+  // Large host array, such as a dataset, CSR matrix or embedding, to be allocated by ThreadPool::firstTouch()
+  template <typename T>
+  using HostVector = std::vector<T, DefaultInitAllocator<T>>;
+
+  /**
+   * ThreadPool
+   * 
+   * Work-stealing scheduler shared by all CPU stages. A parallel range is cut into chunks of grain
+   * elements, and each worker starts on its own contiguous run of chunks, taken from the front; workers
+   * that run out steal single chunks from the back of other runs. Without stealing, a worker thus touches
+   * the same part of an array in every pass over it with the same grain, so with pinned threads, pages
+   * first written in a parallel pass stay on the NUMA node of the workers that later read them. This
+   * only holds for arrays allocated by firstTouch(); a std::vector is zeroed, and thus placed, by the
+   * thread that resizes it. The calling thread acts as worker 0. Calls from inside a running task
+   * execute serially on the calling worker.
+   */
+  class ThreadPool {
+  public:
+    // Accessor; there is one ThreadPool used by the util library
+    static ThreadPool& instance() {
+      static ThreadPool instance;
+      return instance;
+    }
+
+    // Restart with nThreads workers including the calling thread, 0 being one per hardware thread; if
+    // pinThreads, the other workers are bound to consecutive logical cores. Not to be called from a task
+    void configure(uint nThreads, bool pinThreads);
+
+    // Grain size giving a few chunks per worker, for load balancing, but never fewer than minGrain elements
+    ulong grainSize(ulong n, ulong minGrain = 1) const;
+
+    // Resize data to n rows of stride zeroed elements, zeroing the rows in the chunks of a parallelFor over
+    // [0, n) with the same grain, so that every page is first touched by the worker later processing it
+    template <typename T>
+    void firstTouch(HostVector<T>& data, ulong n, ulong stride = 1, ulong grain = 0) {
+      static_assert(std::is_trivially_copyable_v<T>, "ThreadPool::firstTouch() zeroes elements bytewise");
+      HostVector<T>().swap(data);
+      data.resize(n * stride);
+      parallelFor(0, n, grain, [&](ulong b, ulong e) {
+        std::memset(static_cast<void*>(data.data() + b * stride), 0, (e - b) * stride * sizeof(T));
+      });
+    }
+
+    // Call f(begin, end) on consecutive chunks of [begin, end); grain 0 selects grainSize(end - begin)
+    template <typename F>
+    void parallelFor(ulong begin, ulong end, ulong grain, F&& f) {
+      if (end <= begin) {
+        return;
+      }
+      using Fn = std::remove_reference_t<F>;
+      run([](const void* ctx, ulong b, ulong e) { (*static_cast<Fn*>(const_cast<void*>(ctx)))(b, e); },
+          std::addressof(f), begin, end, grain == 0 ? grainSize(end - begin) : grain);
+    }
+
+    // Combine the results of f(begin, end) for all chunks with reduce, in chunk order, so the result does
+    // not depend on scheduling
+    template <typename T, typename F, typename R>
+    T parallelReduce(ulong begin, ulong end, ulong grain, T identity, F&& f, R&& reduce) {
+      if (end <= begin) {
+        return identity;
+      }
+      grain = grain == 0 ? grainSize(end - begin) : grain;
+      std::vector<T> partials(ceilDiv(end - begin, grain), identity);
+      parallelFor(begin, end, grain, [&](ulong b, ulong e) {
+        partials[(b - begin) / grain] = f(b, e);
+      });
+      for (const T& partial : partials) {
+        identity = reduce(identity, partial);
+      }
+      return identity;
+    }
+
+    // Exclusive prefix sum of n values; in and out may alias. Returns the total
+    template <typename T>
+    T parallelScan(const T* in, T* out, ulong n) {
+      const ulong grain = grainSize(n, 4096);
+      std::vector<T> offsets(ceilDiv(n, grain), T(0));
+      parallelFor(0, n, grain, [&](ulong b, ulong e) {
+        T sum = T(0);
+        for (ulong i = b; i < e; ++i) {
+          sum += in[i];
+        }
+        offsets[b / grain] = sum;
+      });
+      T total = T(0);
+      for (T& offset : offsets) {
+        const T sum = offset;
+        offset = total;
+        total += sum;
+      }
+      parallelFor(0, n, grain, [&](ulong b, ulong e) {
+        T sum = offsets[b / grain];
+        for (ulong i = b; i < e; ++i) {
+          const T value = in[i];
+          out[i] = sum;
+          sum += value;
+        }
+      });
+      return total;
+    }
+
+    // Index of the worker running the current task, in [0, nThreads()); 0 outside of tasks
+    uint workerIndex() const;
+
+    // Getters
+    uint nThreads() const { return _nThreads; }
+    bool pinThreads() const { return _pinThreads; }
+
+  private:
+    using Kernel = void (*)(const void*, ulong, ulong);
+
+    // Per-worker run of chunks [lo, hi), packed in one word so the owner and thieves can race on it
+    struct alignas(64) ChunkRange {
+      std::atomic<ulong> packed;
+    };
+
+    // Hidden constr/destr
+    ThreadPool();
+    ~ThreadPool();
+
+    void start(uint nThreads, bool pinThreads);
+    void stop();
+    void run(Kernel kernel, const void* ctx, ulong begin, ulong end, ulong grain);
+    void workerLoop(uint worker);
+    void work(uint worker);
+    bool pop(uint worker, ulong& chunk);
+    bool steal(uint victim, ulong& chunk);
+
+    // State
+    uint _nThreads;
+    bool _pinThreads;
+    bool _stop;
+    ulong _generation;
+    uint _pending;
+    std::atomic<bool> _failed;
+    std::exception_ptr _exception;
+
+    // Current job
+    Kernel _kernel;
+    const void* _ctx;
+    ulong _begin;
+    ulong _end;
+    ulong _grain;
+
+    // Objects
+    std::vector<std::thread> _workers;
+    std::unique_ptr<ChunkRange[]> _ranges;
+    std::mutex _dispatchMutex;                  // Serializes jobs submitted from different threads
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+  };
+} // dh::util
@@ -22,7 +22,12 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <exception>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
 #include <cstdlib>
 #include <string>
 #include <vector>
@@ -30,6 +35,7 @@
 #include <cxxopts.hpp>
 #include "dh/util/io.hpp"
 #include "dh/util/logger.hpp"
+#include "dh/util/thread_pool.hpp"
 #include "dh/util/gl/window.hpp"
 #include "dh/vis/renderer.hpp"
 #include "dh/sne/sne.hpp"
@@ -43,6 +49,7 @@ const std::string windowTitle = "Dual-Hierarchy t-SNE Demo";
 // I/O and SNE parameters, set by cli(...)
 std::string iptFilename;
 std::string optFilename;
+std::string lblFilename;
 dh::sne::Params params;
 std::vector<char> axisMapping(3, 't');
 
@@ -52,23 +59,61 @@ bool progDoLabels = false;
 bool progDoVisDuring = false;
 bool progDoVisAfter = false;
 
+// Sweep parameters, set by cli(...); a sweep minimizes every combination and writes one row per combination
+std::vector<float> sweepPerplexities;
+std::vector<float> sweepExaggerations;
+std::vector<float> sweepEtas;
+std::vector<float> sweepThetas;
+std::string sweepFilename;
+
+// Transform parameters, set by cli(...); new points are embedded against the finished embedding
+std::string transformFilename;
+std::string transformOptFilename;
+
+bool hasExtension(const std::string& filename, const std::string& extension) {
+  return filename.size() >= extension.size()
+    && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool isNpyInput() {
+  return hasExtension(iptFilename, ".npy") || hasExtension(iptFilename, ".npz");
+}
+
+// Sparse input is a scipy.sparse CSR matrix saved as an uncompressed .npz archive
+bool isSparseInput() {
+  return hasExtension(iptFilename, ".npz") && dh::util::isCSRFile(iptFilename);
+}
+
+// Memory-map the input array; for .npz archives an array named "data" is preferred
+dh::util::NpyArray openNpyInput() {
+  if (hasExtension(iptFilename, ".npy")) {
+    return dh::util::NpyArray(iptFilename);
+  }
+  const auto names = dh::util::NpyArray::list(iptFilename);
+  const bool hasData = std::find(names.begin(), names.end(), "data") != names.end();
+  return dh::util::NpyArray(iptFilename, hasData ? "data" : "");
+}
+
 void cli(int argc, char** argv) {
   // Configure command line options
   cxxopts::Options options("sne_cmd", progDescr);
   options.add_options()
     // Required arguments
-    ("iptFilename", "Input data file (required)", cxxopts::value<std::string>())
-    ("nPoints", "number of data points (required)", cxxopts::value<uint>())
-    ("nHighDims", "number of input dims (required)", cxxopts::value<uint>())
+    ("iptFilename", "Input data file, either raw binary or .npy/.npz (required)", cxxopts::value<std::string>())
+    ("nPoints", "number of data points (required, unless read from .npy/.npz)", cxxopts::value<uint>())
+    ("nHighDims", "number of input dims (required, unless read from .npy/.npz)", cxxopts::value<uint>())
     ("nLowDims", "number of output dims (required)", cxxopts::value<uint>())
     
     // Optional parameter arguments
     ("p,perplexity", "Perplexity parameter (default: 30)", cxxopts::value<float>())
     ("i,iterations", "Number of minimization steps (default: 10000)", cxxopts::value<uint>())
     ("t,theta", "Approximation parameter (default: 0.25)", cxxopts::value<float>())
+    ("fieldBudget", "Adjust theta between 0.1 and 1 to keep field computation near this many milliseconds per iteration (default: 0, off)", cxxopts::value<float>())
+    ("adaptFieldScaling", "With --fieldBudget, also coarsen the field once theta reaches its upper bound", cxxopts::value<bool>())
 
     // Optional program arguments
-    ("o,optFilename", "Output data file (default: none)", cxxopts::value<std::string>())
+    ("o,optFilename", "Output data file, written as .npy if it has that extension (default: none)", cxxopts::value<std::string>())
+    ("lblFilename", "Input label file in .npy format, for .npy/.npz input (default: \"labels\" array in .npz input)", cxxopts::value<std::string>())
     ("resWidth", "Window resolution width (default: 1536)", cxxopts::value<uint>())
     ("resHeight", "Window resolution height (default: 1024)", cxxopts::value<uint>())
     ("images", "Input data are images", cxxopts::value<bool>())
@@ -84,6 +129,42 @@ void cli(int argc, char** argv) {
     ("normalize", "Normalize data as preprocessing step", cxxopts::value<bool>())
     ("nonUniformDims", "Treat the dimensions/attributes as having different ranges and properties", cxxopts::value<bool>())
     ("disablePCA", "Disable PCA, which can be slow on some datasets", cxxopts::value<bool>())
+    ("init", "Embedding initialization: random, pca or spectral; informed ones need fewer exaggeration iterations (default: random)", cxxopts::value<std::string>())
+    ("exaggerationIters", "Number of early exaggeration steps (default: 250)", cxxopts::value<uint>())
+    ("autoSchedule", "Scale learning rate, exaggeration and their iterations with the number of points", cxxopts::value<bool>())
+    ("lateExaggeration", "Exaggeration factor over the last --lateExaggerationIters iterations (default: 1, off)", cxxopts::value<float>())
+    ("lateExaggerationIters", "Number of late exaggeration steps (default: 250)", cxxopts::value<uint>())
+    ("converge", "Stop minimizing before the last iteration once the KL divergence improves by less than this fraction over 4 checks, i.e. 4 times --convergeInterval iterations, e.g. 0.001 (default: 0, off)", cxxopts::value<float>())
+    ("convergeInterval", "Number of iterations between convergence checks (default: 50)", cxxopts::value<uint>())
+    ("snapshotFilename", "Write embedding snapshots to numbered files, or one file with --snapshotAppend; .npy or raw binary (default: none)", cxxopts::value<std::string>())
+    ("snapshotInterval", "Number of iterations between embedding snapshots (default: 100)", cxxopts::value<uint>())
+    ("snapshotAppend", "Append all snapshots to a single file instead of numbered files", cxxopts::value<bool>())
+    ("reorder", "Renumber points along the KNN graph for memory locality during minimization; output keeps input order", cxxopts::value<bool>())
+    ("pruneThreshold", "Drop similarities below this fraction of the largest of both their points (default: 0, off)", cxxopts::value<float>())
+    ("pruneMass", "Keep only each point's largest similarities covering this fraction of its total (default: 1, off)", cxxopts::value<float>())
+    ("compress", "Store similarities in 32 to 48 bits per neighbor instead of 128, which disables editing them; 32 needs nearby neighbor indices, so is best combined with --reorder", cxxopts::value<bool>())
+    ("knnBlockSize", "Stream the dataset through an exact KNN search in blocks of this many points, for datasets larger than memory (default: 0, off)", cxxopts::value<uint>())
+    ("landmarks", "Minimize only this many landmarks, similar by random walks over the KNN graph, then interpolate and refine the other points (default: 0, off)", cxxopts::value<uint>())
+    ("landmarkSelection", "Landmark selection: random, or walk for the points most visited by random walks (default: random)", cxxopts::value<std::string>())
+    ("landmarkRefineIters", "Number of minimization steps over all points after interpolation (default: 50)", cxxopts::value<uint>())
+    ("levels", "Coarsen the KNN graph into up to this many levels, minimize the coarsest and refine on each finer one (default: 1, off)", cxxopts::value<uint>())
+    ("levelRefineIters", "Number of minimization steps on the finest level, doubling on each coarser one (default: 100)", cxxopts::value<uint>())
+    ("negativeSampling", "Minimize on the CPU by sampling edges for attraction and random points for repulsion, instead of by field-based gradient descent", cxxopts::value<bool>())
+    ("samplingEpochs", "Number of negative sampling epochs, each visiting every edge with probability proportional to its similarity (default: 500)", cxxopts::value<uint>())
+    ("samplingNegatives", "Number of random points repelled per sampled edge (default: 5)", cxxopts::value<uint>())
+    ("samplingExaggeration", "Attraction factor of negative sampling; 1 is t-SNE-like, around 4 UMAP-like (default: 1)", cxxopts::value<float>())
+    ("replicates", "Minimize this many embeddings from consecutive seeds against the same similarities, keeping the one with the lowest KL divergence (default: 1)", cxxopts::value<uint>())
+    ("sweepPerplexity", "Comma-separated perplexities to sweep over; the KNN search is done once, for the largest", cxxopts::value<std::vector<float>>())
+    ("sweepExaggeration", "Comma-separated exaggeration factors to sweep over", cxxopts::value<std::vector<float>>())
+    ("sweepEta", "Comma-separated learning rates to sweep over", cxxopts::value<std::vector<float>>())
+    ("sweepTheta", "Comma-separated approximation parameters (> 0) to sweep over", cxxopts::value<std::vector<float>>())
+    ("sweepFilename", "Results table of a sweep, in CSV format (default: sweep.csv)", cxxopts::value<std::string>())
+    ("transformFilename", "Further points in .npy format to embed against the finished embedding, which stays fixed", cxxopts::value<std::string>())
+    ("transformOptFilename", "Output file of the transformed points, in .npy format (default: transform.npy)", cxxopts::value<std::string>())
+    ("transformIterations", "Number of minimization steps for transformed points (default: 250)", cxxopts::value<uint>())
+    ("transformEta", "Learning rate for transformed points (default: 0.1)", cxxopts::value<float>())
+    ("threads", "Number of threads used by CPU stages such as loading and sparse KNN search (default: all hardware threads)", cxxopts::value<uint>())
+    ("pinThreads", "Bind CPU worker threads to consecutive cores, so memory they first touch stays on their NUMA node", cxxopts::value<bool>())
     ("h,help", "Print this help message and exit")
 
     // Optional axis specifiers
@@ -92,32 +173,44 @@ void cli(int argc, char** argv) {
     ("z,zAxis", "What to map to the z-axis, t=t-SNE, p=PCA, a=Attribute, -=None (default: t)", cxxopts::value<char>());
 
   options.parse_positional({"iptFilename", "nPoints", "nHighDims", "nLowDims"});
-  options.positional_help("<iptFilename> <n> <nHighDims> <nLowDims>");
+  options.positional_help("<iptFilename> <n> <nHighDims> <nLowDims> | <iptFilename.npy/.npz> <nLowDims>");
   auto result = options.parse(argc, argv);
 
   // Output help message as requested
-  if (result.count("help")) {
+  if (result.count("help") || !result.count("iptFilename")) {
     std::cout << options.help() << std::endl;
     std::exit(0);
   }
+  iptFilename = result["iptFilename"].as<std::string>();
 
-  // Check for required arguments, output help message otherwise
-  if (!result.count("iptFilename") || !result.count("nPoints") 
-      || !result.count("nHighDims") || !result.count("nLowDims")) {
+  // Parse required arguments; .npy/.npz input provides its own dimensions, in which case
+  // a single positional argument following the filename is the number of output dims
+  if (isSparseInput() && result.count("nPoints") && !result.count("nHighDims")) {
+    std::vector<size_t> shape;
+    dh::util::NpyArray(iptFilename, "shape").toSize(shape);
+    params.n = static_cast<uint>(shape[0]);
+    params.nHighDims = static_cast<uint>(shape[1]);
+    params.nLowDims = result["nPoints"].as<uint>();
+    params.sparseData = true;
+  } else if (isNpyInput() && result.count("nPoints") && !result.count("nHighDims")) {
+    const auto header = openNpyInput().header();
+    params.n = static_cast<uint>(header.rows());
+    params.nHighDims = static_cast<uint>(header.cols());
+    params.nLowDims = result["nPoints"].as<uint>();
+  } else if (result.count("nPoints") && result.count("nHighDims") && result.count("nLowDims")) {
+    params.n = result["nPoints"].as<uint>();
+    params.nHighDims = result["nHighDims"].as<uint>();
+    params.nLowDims = result["nLowDims"].as<uint>();
+  } else {
     std::cout << options.help() << std::endl;
     std::exit(0);
   }
-
-  // Parse required arguments
-  iptFilename = result["iptFilename"].as<std::string>();
-  params.n = result["nPoints"].as<uint>();
-  params.nHighDims = result["nHighDims"].as<uint>();
-  params.nLowDims = result["nLowDims"].as<uint>();
   if(params.nLowDims == 2) { axisMapping[2] = '-'; }
   params.nPCs = std::min(params.nPCs, (int) params.nHighDims);
 
   // Check for and parse optional arguments
   if (result.count("optFilename")) { optFilename = result["optFilename"].as<std::string>(); }
+  if (result.count("lblFilename")) { lblFilename = result["lblFilename"].as<std::string>(); }
   if (result.count("resWidth")) { params.resWidth = result["resWidth"].as<uint>(); }
   if (result.count("resHeight")) { params.resHeight = result["resHeight"].as<uint>(); }
   if (result.count("images")) { params.imageDataset = true; }
@@ -129,6 +222,8 @@ void cli(int argc, char** argv) {
   if (result.count("perplexity")) { params.perplexity = result["perplexity"].as<float>(); }
   if (result.count("iterations")) { params.iterations = result["iterations"].as<uint>(); }
   if (result.count("theta")) { params.dualHierarchyTheta = result["theta"].as<float>(); }
+  if (result.count("fieldBudget")) { params.fieldTimeBudget = result["fieldBudget"].as<float>(); }
+  if (result.count("adaptFieldScaling")) { params.adaptiveFieldScaling = true; }
   // if (result.count("xAxis")) { axisMapping[0] = result["xAxis"].as<char>(); }
   // if (result.count("yAxis")) { axisMapping[1] = result["yAxis"].as<char>(); }
   if (result.count("zAxis")) { axisMapping[2] = result["zAxis"].as<char>(); }
@@ -139,25 +234,197 @@ void cli(int argc, char** argv) {
   if (result.count("normalize")) { params.normalizeData = true; }
   if (result.count("nonUniformDims")) { params.uniformDims = false; }
   if (result.count("disablePCA")) { params.disablePCA = true; }
+  if (result.count("init")) { params.initialization = result["init"].as<std::string>(); }
+  if (result.count("exaggerationIters")) { params.nExaggerationIters = result["exaggerationIters"].as<uint>(); }
+  if (result.count("autoSchedule")) { params.autoSchedule = true; }
+  if (result.count("lateExaggeration")) { params.lateExaggerationFactor = result["lateExaggeration"].as<float>(); }
+  if (result.count("lateExaggerationIters")) { params.lateExaggerationIters = result["lateExaggerationIters"].as<uint>(); }
+  if (result.count("converge")) { params.convergenceTolerance = result["converge"].as<float>(); }
+  if (result.count("convergeInterval")) { params.convergenceInterval = std::max(1u, result["convergeInterval"].as<uint>()); }
+  if (params.initialization == "pca" && params.disablePCA) {
+    throw std::runtime_error("PCA initialization cannot be combined with --disablePCA");
+  }
+  if (result.count("snapshotFilename")) { params.snapshotFilename = result["snapshotFilename"].as<std::string>(); params.snapshotInterval = 100; }
+  if (result.count("snapshotInterval")) { params.snapshotInterval = result["snapshotInterval"].as<uint>(); }
+  if (result.count("snapshotAppend")) { params.snapshotAppend = true; }
+  if (result.count("reorder")) { params.reorderPoints = true; }
+  if (result.count("pruneThreshold")) { params.pruneThreshold = std::clamp(result["pruneThreshold"].as<float>(), 0.f, 1.f); }
+  if (result.count("pruneMass")) { params.pruneMass = std::clamp(result["pruneMass"].as<float>(), 0.f, 1.f); }
+  if (result.count("compress")) { params.compressSimilarities = true; }
+  if (result.count("knnBlockSize")) { params.knnBlockSize = result["knnBlockSize"].as<uint>(); }
+  if (params.knnBlockSize > 0) {
+    // Streaming only bounds memory if the dataset is read in place from its mapping, never copied as a whole
+    if (params.sparseData || !isNpyInput()) {
+      throw std::runtime_error("--knnBlockSize requires dense .npy or .npz input, which is memory-mapped; .bin input is read into memory as a whole");
+    }
+    if (params.normalizeData || params.nClasses >= 0) {
+      throw std::runtime_error("--knnBlockSize cannot be combined with --normalize or --nClasses, which copy the dataset into memory");
+    }
+  }
+  if (result.count("landmarks")) { params.nLandmarks = result["landmarks"].as<uint>(); }
+  if (result.count("landmarkSelection")) { params.landmarkSelection = result["landmarkSelection"].as<std::string>(); }
+  if (result.count("landmarkRefineIters")) { params.landmarkRefineIterations = result["landmarkRefineIters"].as<uint>(); }
+  if (params.nLandmarks > 0 && (params.compressSimilarities || progDoVisDuring)) {
+    throw std::runtime_error("Landmarks cannot be combined with --compress, or with --visDuring, which minimizes all points step by step");
+  }
+  if (result.count("levels")) { params.multilevelLevels = std::max(1u, result["levels"].as<uint>()); }
+  if (result.count("levelRefineIters")) { params.multilevelRefineIterations = result["levelRefineIters"].as<uint>(); }
+  if (params.multilevelLevels > 1 && (params.compressSimilarities || progDoVisDuring || params.nLandmarks > 0)) {
+    throw std::runtime_error("Multilevel minimization cannot be combined with --compress, --visDuring or --landmarks");
+  }
+  if (result.count("negativeSampling")) { params.negativeSampling = true; }
+  if (result.count("samplingEpochs")) { params.samplingEpochs = result["samplingEpochs"].as<uint>(); }
+  if (result.count("samplingNegatives")) { params.samplingNegatives = result["samplingNegatives"].as<uint>(); }
+  if (result.count("samplingExaggeration")) { params.samplingExaggeration = result["samplingExaggeration"].as<float>(); }
+  if (params.negativeSampling && (params.compressSimilarities || progDoVisDuring || params.nLandmarks > 0 || params.multilevelLevels > 1)) {
+    throw std::runtime_error("Negative sampling cannot be combined with --compress, --visDuring, --landmarks or --levels");
+  }
+  if (result.count("replicates")) { params.nReplicates = std::max(1u, result["replicates"].as<uint>()); }
+  if (result.count("threads") || result.count("pinThreads")) {
+    dh::util::ThreadPool::instance().configure(result.count("threads") ? result["threads"].as<uint>() : 0, result.count("pinThreads"));
+  }
+  if (result.count("sweepPerplexity")) { sweepPerplexities = result["sweepPerplexity"].as<std::vector<float>>(); }
+  if (result.count("sweepExaggeration")) { sweepExaggerations = result["sweepExaggeration"].as<std::vector<float>>(); }
+  if (result.count("sweepEta")) { sweepEtas = result["sweepEta"].as<std::vector<float>>(); }
+  if (result.count("sweepTheta")) { sweepThetas = result["sweepTheta"].as<std::vector<float>>(); }
+  if (result.count("sweepFilename")) { sweepFilename = result["sweepFilename"].as<std::string>(); }
+  if (!sweepPerplexities.empty() || !sweepExaggerations.empty() || !sweepEtas.empty() || !sweepThetas.empty()) {
+    // Unswept parameters keep their single value
+    if (sweepPerplexities.empty()) { sweepPerplexities = { params.perplexity }; }
+    if (sweepExaggerations.empty()) { sweepExaggerations = { params.exaggerationFactor }; }
+    if (sweepEtas.empty()) { sweepEtas = { params.eta }; }
+    if (sweepThetas.empty()) { sweepThetas = { params.dualHierarchyTheta }; }
+    if (sweepFilename.empty()) { sweepFilename = "sweep.csv"; }
+    if (params.autoSchedule) {
+      throw std::runtime_error("Sweeps set exaggeration and eta for every run, so cannot be combined with --autoSchedule");
+    }
+    if (params.fieldTimeBudget > 0.f && result.count("sweepTheta")) {
+      throw std::runtime_error("--sweepTheta cannot be combined with --fieldBudget, which adjusts theta during minimization");
+    }
+    if (std::any_of(sweepThetas.begin(), sweepThetas.end(), [](float theta) { return theta <= 0.f; })) {
+      throw std::runtime_error("Swept theta values must be positive, as hierarchies are set up once");
+    }
+
+    // Perplexities run in descending order, so the first KNN search finds enough neighbors for all of them
+    std::sort(sweepPerplexities.begin(), sweepPerplexities.end(), std::greater<float>());
+    params.perplexity = sweepPerplexities[0];
+    params.k = std::min(params.kMax, 3 * static_cast<uint>(params.perplexity) + 1);
+    params.keepKNN = sweepPerplexities.size() > 1;
+  }
+  if (result.count("transformFilename")) { transformFilename = result["transformFilename"].as<std::string>(); }
+  if (result.count("transformOptFilename")) { transformOptFilename = result["transformOptFilename"].as<std::string>(); }
+  if (result.count("transformIterations")) { params.transformIterations = result["transformIterations"].as<uint>(); }
+  if (result.count("transformEta")) { params.transformEta = result["transformEta"].as<float>(); }
+  if (!transformFilename.empty()) {
+    if (transformOptFilename.empty()) { transformOptFilename = "transform.npy"; }
+    if (params.sparseData || params.knnBlockSize > 0 || params.compressSimilarities) {
+      throw std::runtime_error("Transforming points requires dense input held in memory and uncompressed similarities");
+    }
+    if (params.normalizeData) {
+      throw std::runtime_error("Transforming points cannot be combined with --normalize, which would not be applied to them");
+    }
+  }
   params.datasetName = iptFilename.substr(0, iptFilename.length() - 4);
   params.nTexels = params.nHighDims / params.imgDepth;
 }
 
+void sweep(dh::sne::SNE& sne) {
+  using millis = std::chrono::milliseconds;
+  using clock = std::chrono::steady_clock;
+
+  std::ofstream out(sweepFilename);
+  if (!out) {
+    throw std::runtime_error("Cannot open sweep results file " + sweepFilename);
+  }
+  out << "perplexity,k,exaggeration,eta,theta,similarities_ms,minimization_ms,kl_divergence" << std::endl;
+
+  // Similarities are computed once per perplexity, and shared by all minimizations at that perplexity
+  for (size_t p = 0; p < sweepPerplexities.size(); ++p) {
+    const auto similaritiesStart = clock::now();
+    if (p == 0) {
+      sne.compSimilarities();
+    } else {
+      sne.recompSimilarities(sweepPerplexities[p]);
+    }
+    const auto similaritiesTime = std::chrono::duration_cast<millis>(clock::now() - similaritiesStart);
+
+    for (float exaggeration : sweepExaggerations) {
+      for (float eta : sweepEtas) {
+        for (float theta : sweepThetas) {
+          params.exaggerationFactor = exaggeration;
+          params.eta = eta;
+          params.dualHierarchyTheta = theta;
+
+          const auto minimizationStart = clock::now();
+          sne.restartMinimization();
+          sne.compMinimization();
+          const auto minimizationTime = std::chrono::duration_cast<millis>(clock::now() - minimizationStart);
+          const float kld = sne.klDivergence();
+
+          dh::util::Logger::newl() << "Sweep : perplexity " << params.perplexity << ", exaggeration " << exaggeration
+                                   << ", eta " << eta << ", theta " << theta << ", KL divergence " << kld;
+          out << params.perplexity << ',' << params.k << ',' << exaggeration << ',' << eta << ',' << theta << ','
+              << similaritiesTime.count() << ',' << minimizationTime.count() << ',' << kld << std::endl;
+        }
+      }
+    }
+  }
+}
+
 void sne() {
   // Set up logger to use standard output stream for demo
   dh::util::Logger::init(&std::cout);
 
   // Load dataset
-  std::vector<float> data;
+  dh::util::HostVector<float> data;
   std::vector<int> labels;
+  dh::util::CSRMatrix sparseData;
+  dh::util::NpyArray dataArray; // Kept alive, as the minimization may read directly from the mapping
+  const float* dataPtr = nullptr;
   bool includeAllClasses = params.nClasses < 0;
-  dh::util::readBinFile(iptFilename, data, labels, params.n, params.nHighDims, progDoLabels, params.nClasses, includeAllClasses);
-  if(params.normalizeData) {
+  if (params.sparseData) {
+    dh::util::readCSRFile(iptFilename, sparseData);
+    if (progDoLabels) {
+      dh::util::readNpyFile(lblFilename.empty() ? iptFilename : lblFilename, labels);
+      if (labels.size() != params.n) {
+        throw std::runtime_error("Label count does not match number of data points: " + std::to_string(labels.size()));
+      }
+    }
+    dh::util::selectClasses(sparseData, labels, progDoLabels, params.nClasses, includeAllClasses);
+  } else if (isNpyInput()) {
+    dataArray = openNpyInput();
+    if (progDoLabels) {
+      if (lblFilename.empty() && hasExtension(iptFilename, ".npy")) {
+        throw std::runtime_error("Labels for .npy input must be provided through --lblFilename");
+      }
+      dh::util::readNpyFile(lblFilename.empty() ? iptFilename : lblFilename, labels);
+      if (labels.size() != params.n) {
+        throw std::runtime_error("Label count does not match number of data points: " + std::to_string(labels.size()));
+      }
+    }
+
+    // Float32 data in C order is used in place, unless it is to be modified
+    if (params.knnBlockSize > 0 && !dataArray.floatData()) {
+      throw std::runtime_error("--knnBlockSize requires float32 data in C order, which is used in place; other arrays are converted in memory");
+    }
+    if (dataArray.floatData() && !params.normalizeData && includeAllClasses) {
+      dataPtr = dataArray.floatData();
+    } else {
+      dataArray.toFloat(data);
+    }
+    dh::util::selectClasses(data, labels, params.nHighDims, progDoLabels, params.nClasses, includeAllClasses);
+  } else {
+    dh::util::readBinFile(iptFilename, data, labels, params.n, params.nHighDims, progDoLabels, params.nClasses, includeAllClasses);
+  }
+  if (!dataPtr) {
+    dataPtr = data.data();
+  }
+  if(params.normalizeData && !params.sparseData) { // Sparse input is always scaled by its max. absolute value instead
     if(params.uniformDims) { dh::util::normalizeData(data, params.n, params.nHighDims, 0.f, 255.f); }
     else { dh::util::normalizeDataNonUniformDims(data, params.n, params.nHighDims); }
   }
   if(!includeAllClasses) {
-    params.n = data.size() / params.nHighDims;
+    params.n = params.sparseData ? sparseData.nRows : data.size() / params.nHighDims;
     params.nClusters = params.nClasses;  
   }
 
@@ -176,7 +443,15 @@ void sne() {
 
   // Create necessary components
   dh::vis::Renderer renderer(&params, axisMapping.data(), window);
-  dh::sne::SNE sne(&params, axisMapping, data, labels);
+  dh::sne::SNE sne = params.sparseData
+    ? dh::sne::SNE(&params, axisMapping, std::move(sparseData), labels.data())
+    : dh::sne::SNE(&params, axisMapping, dataPtr, labels.data());
+
+  // A sweep only writes its results table
+  if (!sweepFilename.empty()) {
+    sweep(sne);
+    return;
+  }
 
   // If visualization is requested, minimize and render at the same time
   if (progDoVisDuring) {
@@ -204,7 +479,25 @@ void sne() {
 
   // If requested, output embedding to file 
   if (!optFilename.empty()) {
-    dh::util::writeBinFile(optFilename, sne.embedding(), labels, params.n, params.nLowDims, progDoLabels);
+    if (hasExtension(optFilename, ".npy")) {
+      dh::util::writeNpyFile(optFilename, sne.embedding().data(), params.n, params.nLowDims);
+    } else {
+      dh::util::writeBinFile(optFilename, sne.embedding(), labels, params.n, params.nLowDims, progDoLabels);
+    }
+  }
+
+  // If requested, embed further points against the finished embedding
+  if (!transformFilename.empty()) {
+    dh::util::NpyArray transformArray(transformFilename);
+    const auto header = transformArray.header();
+    if (header.cols() != params.nHighDims) {
+      throw std::runtime_error("Transformed points do not match number of input dims: " + std::to_string(header.cols()));
+    }
+    dh::util::HostVector<float> transformData;
+    transformArray.toFloat(transformData);
+    const uint nTransform = static_cast<uint>(header.rows());
+    const std::vector<float> transformed = sne.transform(transformData.data(), nTransform);
+    dh::util::writeNpyFile(transformOptFilename, transformed.data(), nTransform, params.nLowDims);
   }
 
   // If requested, run visualization after minimization is completed
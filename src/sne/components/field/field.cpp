@@ -28,10 +28,21 @@
 #include <cmath>
 #include <resource_embed/resource_embed.hpp>
 #include "dh/sne/components/field.hpp"
+#include "dh/util/logger.hpp"
 #include "dh/util/gl/error.hpp"
 #include "dh/util/gl/metric.hpp"
 
 namespace dh::sne {
+  // Logging shorthands
+  using util::Logger;
+  const std::string prefix = util::genLoggerPrefix("[Field]");
+
+  // Constants
+  constexpr float adaptiveStep = 1.2f;         // Multiplicative step on theta/field scaling per adjustment
+  constexpr float adaptiveUpper = 1.1f;        // Adjust towards speed if the budget is exceeded by this ratio
+  constexpr float adaptiveLower = 0.8f;        // Adjust towards accuracy if the budget is undershot by this ratio
+  constexpr float adaptiveFieldScaleMin = 0.5f;
+
   template <uint D>
   Field<D>::Field()
   : _isInit(false) {
@@ -71,12 +82,83 @@ namespace dh::sne {
       compFullCompact();
     }
 
+    // Perform field computation over the pixels in the work queue
+    compField(iteration >= _params->nExaggerationIters);
+
+    // Update field buffer in sne::Minimization by querying the field texture at N positions
+    queryField();
+
+    // Update hierarchy refit/rebuild countdown
+    if (_useEmbeddingHierarchy) {
+      if (iteration <= (_params->nExaggerationIters + DH_BVH_REFIT_PADDING)
+      || _hierarchyRebuildIterations >= DH_BVH_REFIT_ITERS) {
+        _hierarchyRebuildIterations = 0;
+      } else {
+        _hierarchyRebuildIterations++;
+      }
+    }
+
+    // Adjust theta/field scaling to the time budget
+    if (_params->fieldTimeBudget > 0.f) {
+      adaptApproximation(iteration);
+    }
+  }
+
+  template <uint D>
+  void Field<D>::compDense(uvec size) {
+    // Resize field if size > _size, i.e. recreates field and stencil textures
+    resizeField(size);
+
+    // Rebuild embedding hierarchy if necessary, as the embedding may have moved since it was last built
+    if (_useEmbeddingHierarchy) {
+      _embeddingHierarchy.comp(true);
+      _hierarchyRebuildIterations = 0;
+    }
+
+    // Generate work queue with all pixels in the field texture, and perform field computation over them
+    compDenseCompact();
+    compField(true);
+  }
+
+  template <uint D>
+  void Field<D>::compDenseCompact() {
+    auto& timer = _timers(TimerType::eCompact);
+    timer.tick();
+
+    auto& program = _programs(ProgramType::eDenseCompactComp);
+    program.bind();
+
+    // Set pixel queue head to the number of pixels, which are all pushed
+    const uint nPixels = product(_size);
+    glClearNamedBufferSubData(_buffers(BufferType::ePixelQueueHead),
+      GL_R32UI, 0, sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &nPixels);
+
+    // Set uniforms
+    program.template uniform<uint, D>("textureSize", _size);
+
+    // Set buffer bindings
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::ePixelQueue));
+
+    // Dispatch shader
+    if constexpr (D == 3) {
+      glDispatchCompute(ceilDiv(_size.x, 8u), ceilDiv(_size.y, 4u), ceilDiv(_size.z, 4u));
+    } else if constexpr (D == 2) {
+      glDispatchCompute(ceilDiv(_size.x, 16u), ceilDiv(_size.y, 16u), 1u);
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    timer.tock();
+    glAssert();
+  }
+
+  template <uint D>
+  void Field<D>::compField(bool fieldHierarchyAllowed) {
     // Determine if field hierarchy should be actively used this iteration
-    const typename FieldHierarchy<D>::Layout fLayout(size);
+    const typename FieldHierarchy<D>::Layout fLayout(_size);
     const typename EmbeddingHierarchy<D>::Layout eLayout = _embeddingHierarchy.layout();
     const int lvlDiff = static_cast<int>(eLayout.nLvls) - static_cast<int>(fLayout.nLvls);
     const bool fieldHierarchyActive = _useFieldHierarchy 
-                                    && iteration >= _params->nExaggerationIters
+                                    && fieldHierarchyAllowed
                                     && lvlDiff < DH_HIER_LVL_DIFFERENCE;
 
     // Build field hierarchy if necessary
@@ -92,19 +174,59 @@ namespace dh::sne {
     } else {
       compFullField();
     }
+  }
 
-    // Update field buffer in sne::Minimization by querying the field texture at N positions
-    queryField();
+  template <uint D>
+  void Field<D>::adaptApproximation(uint iteration) {
+    // Poll timers, which swaps their queries and reads those recorded last iteration; the first
+    // poll has no finished queries to read from, so its result is skipped
+    util::glPollTimers(_timers.size(), _timers.data());
+    if (_timers(TimerType::eField).iterations() <= 1) {
+      return;
+    }
 
-    // Update hierarchy refit/rebuild countdown
-    if (_useEmbeddingHierarchy) {
-      if (iteration <= (_params->nExaggerationIters + DH_BVH_REFIT_PADDING)
-      || _hierarchyRebuildIterations >= DH_BVH_REFIT_ITERS) {
-        _hierarchyRebuildIterations = 0;
-      } else {
-        _hierarchyRebuildIterations++;
+    // Accumulate field time over the interval
+    _adaptiveTime += static_cast<float>(
+        _timers(TimerType::eCompact).template get<util::TimerValue::eLast, std::chrono::microseconds>().count()
+      + _timers(TimerType::eField).template get<util::TimerValue::eLast, std::chrono::microseconds>().count()
+      + _timers(TimerType::eQueryFieldComp).template get<util::TimerValue::eLast, std::chrono::microseconds>().count()
+    ) / 1000.f;
+    if (++_adaptiveIterations < std::max(_params->adaptiveInterval, 1u)) {
+      return;
+    }
+    const float time = _adaptiveTime / static_cast<float>(_adaptiveIterations);
+    _adaptiveTime = 0.f;
+    _adaptiveIterations = 0;
+
+    // Bounds on the theta multiplier follow from bounds on dualHierarchyTheta; theta only
+    // has effect if the hierarchies were enabled at construction
+    const bool adaptTheta = _useEmbeddingHierarchy;
+    const float thetaScaleMin = adaptTheta ? _params->adaptiveThetaMin / _params->dualHierarchyTheta : 1.f;
+    const float thetaScaleMax = adaptTheta ? _params->adaptiveThetaMax / _params->dualHierarchyTheta : 1.f;
+    const float thetaScale = _thetaScale;
+    const float fieldScale = _fieldScale;
+
+    if (time > adaptiveUpper * _params->fieldTimeBudget) {
+      // Too slow; coarsen theta first, then the field itself
+      if (adaptTheta && _thetaScale < thetaScaleMax) {
+        _thetaScale = std::min(_thetaScale * adaptiveStep, thetaScaleMax);
+      } else if (_params->adaptiveFieldScaling) {
+        _fieldScale = std::max(_fieldScale / adaptiveStep, adaptiveFieldScaleMin);
+      }
+    } else if (time < adaptiveLower * _params->fieldTimeBudget) {
+      // Time to spare; restore the field first, then refine theta
+      if (_fieldScale < 1.f) {
+        _fieldScale = std::min(_fieldScale * adaptiveStep, 1.f);
+      } else if (adaptTheta && _thetaScale > thetaScaleMin) {
+        _thetaScale = std::max(_thetaScale / adaptiveStep, thetaScaleMin);
       }
     }
+
+    if (_thetaScale != thetaScale || _fieldScale != fieldScale) {
+      Logger::newl() << prefix << "Iteration " << iteration << ", field took " << time << " ms, "
+                     << "theta " << _thetaScale * _params->dualHierarchyTheta
+                     << ", field scaling " << _fieldScale;
+    }
   }
 
   template <uint D>
@@ -112,24 +234,29 @@ namespace dh::sne {
     auto& timer = _timers(TimerType::eQueryFieldComp);
     timer.tick();
 
+    query(_minimization.embedding, _minimization.field, _params->n);
+
+    timer.tock();
+  }
+
+  template <uint D>
+  void Field<D>::query(GLuint positionsBuffer, GLuint valuesBuffer, uint n) {
     auto& program = _programs(ProgramType::eQueryFieldComp);
     program.bind();
 
     // Set uniforms, bind texture unit
-    program.template uniform<uint>("nPoints", _params->n);
+    program.template uniform<uint>("nPoints", n);
     program.template uniform<int>("fieldSampler", 0);
     glBindTextureUnit(0, _textures(TextureType::eField));
 
     // Bind buffers
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _minimization.embedding);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _minimization.field);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, valuesBuffer);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _minimization.bounds);
 
     // Dispatch compute shader
-    glDispatchCompute(ceilDiv(_params->n, 128u), 1, 1);
+    glDispatchCompute(ceilDiv(n, 128u), 1, 1);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-
-    timer.tock();
     glAssert();
   }
 
@@ -144,13 +271,23 @@ namespace dh::sne {
   template Field<2>::~Field();
   template Field<2>& Field<2>::operator=(Field<2>&& other) noexcept;
   template void Field<2>::comp(util::AlignedVec<2, uint> size, uint iteration);
+  template void Field<2>::compDense(util::AlignedVec<2, uint> size);
+  template void Field<2>::compDenseCompact();
+  template void Field<2>::compField(bool fieldHierarchyAllowed);
   template void Field<2>::queryField();
+  template void Field<2>::query(GLuint positionsBuffer, GLuint valuesBuffer, uint n);
+  template void Field<2>::adaptApproximation(uint iteration);
   template size_t Field<2>::memSize() const;
   template Field<3>::Field();
   template Field<3>::Field(Field<3>&& other) noexcept;
   template Field<3>::~Field();
   template Field<3>& Field<3>::operator=(Field<3>&& other) noexcept;
   template void Field<3>::comp(util::AlignedVec<3, uint> size, uint iteration);
+  template void Field<3>::compDense(util::AlignedVec<3, uint> size);
+  template void Field<3>::compDenseCompact();
+  template void Field<3>::compField(bool fieldHierarchyAllowed);
   template void Field<3>::queryField();
+  template void Field<3>::query(GLuint positionsBuffer, GLuint valuesBuffer, uint n);
+  template void Field<3>::adaptApproximation(uint iteration);
   template size_t Field<3>::memSize() const;
 } // dh::sne
\ No newline at end of file
@@ -60,16 +60,17 @@ namespace dh::sne {
     // 1. Perform dual-hierarchy traversal
     {
       // Set uniforms (dual-subdivision program)
+      const float theta = _thetaScale * _params->dualHierarchyTheta;
       auto& dsProgram = _programs(ProgramType::eDualHierarchyFieldDualSubdivideComp);
       dsProgram.template uniform<uint>("eLvls", eLayout.nLvls);
       dsProgram.template uniform<uint>("fLvls", fLayout.nLvls);
-      dsProgram.template uniform<float>("theta2", _params->dualHierarchyTheta * _params->dualHierarchyTheta);
+      dsProgram.template uniform<float>("theta2", theta * theta);
       dsProgram.template uniform<uint>("doBhCrit", true);
 
       // Set uniforms (single-subdivision program)
       auto& ssProgram = _programs(ProgramType::eDualHierarchyFieldSingleSubdivideComp);
       ssProgram.template uniform<uint>("fLvls", fLayout.nLvls);
-      ssProgram.template uniform<float>("theta2", _params->dualHierarchyTheta * _params->dualHierarchyTheta);
+      ssProgram.template uniform<float>("theta2", theta * theta);
       ssProgram.template uniform<uint>("doBhCrit", true);
 
       // Set buffer bindings which are reused throughout traversal
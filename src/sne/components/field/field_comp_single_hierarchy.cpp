@@ -91,7 +91,8 @@ namespace dh::sne {
 
     // Set uniforms
     program.template uniform<uint>("nLvls", layout.nLvls);
-    program.template uniform<float>("theta2", _params->singleHierarchyTheta * _params->singleHierarchyTheta);
+    const float theta = _thetaScale * _params->singleHierarchyTheta;
+    program.template uniform<float>("theta2", theta * theta);
     program.template uniform<uint, D>("textureSize", _size);
     program.template uniform<bool>("doBhCrit", true);
     
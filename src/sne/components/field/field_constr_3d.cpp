@@ -76,7 +76,11 @@ namespace dh::sne {
     _hierarchyRebuildIterations(0),
     _size(0),
     _useEmbeddingHierarchy(params->dualHierarchyTheta > 0.0f),
-    _useFieldHierarchy(params->dualHierarchyTheta > 0.0f) {
+    _useFieldHierarchy(params->dualHierarchyTheta > 0.0f),
+    _thetaScale(1.f),
+    _fieldScale(1.f),
+    _adaptiveIterations(0),
+    _adaptiveTime(0.f) {
     Logger::newt() << prefix << "Initializing...";
     
     // Initialize shader programs
@@ -87,6 +91,7 @@ namespace dh::sne {
       _programs(ProgramType::eFullCompactDraw).addShader(util::GLShaderType::eFragment, rsrc::get("sne/field/3D/fullCompactGrid.frag"));
       _programs(ProgramType::eFullCompactComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/field/3D/fullCompact.comp"));
       _programs(ProgramType::eFullFieldComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/field/3D/fullField.comp"));
+      _programs(ProgramType::eDenseCompactComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/field/3D/denseCompact.comp"));
       _programs(ProgramType::eSingleHierarchyCompactComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/field/3D/singleHierarchyCompact.comp"));
       _programs(ProgramType::eSingleHierarchyFieldComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/field/3D/singleHierarchyField.comp"));
       _programs(ProgramType::eDualHierarchyFieldDualSubdivideComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/field/3D/dualHierarchyFieldIterative.comp"));
@@ -164,7 +169,7 @@ namespace dh::sne {
     }
 
     // Output memory use of OpenGL buffer objects
-    const GLuint bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
+    const ulong bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
     Logger::rest() << prefix << "Initialized, buffer storage : " << static_cast<float>(bufferSize) / 1'048'576.0f << " mb";
 
     // Embedding hierarchy used, initialize
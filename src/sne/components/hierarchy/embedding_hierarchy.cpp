@@ -114,7 +114,7 @@ namespace dh::sne {
 #endif // DH_ENABLE_VIS_EMBEDDING_HIERARCHY
 
     // Output memory use of OpenGL buffer objects
-    const GLuint bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
+    const ulong bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
     Logger::rest() << prefix << "Initialized, buffer storage : " << static_cast<float>(bufferSize) / 1'048'576.0f << " mb";
 
     _isInit = true;
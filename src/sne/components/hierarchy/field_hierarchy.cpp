@@ -80,7 +80,7 @@ namespace dh::sne {
 #endif // DH_ENABLE_VIS_FIELD_HIERARCHY
 
     // Output memory use of OpenGL buffer objects
-    const GLuint bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
+    const ulong bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
     Logger::rest() << prefix << "Initialized, buffer storage : " << static_cast<float>(bufferSize) / 1'048'576.0f << " mb";
 
     _isInit = true;
@@ -130,7 +130,7 @@ namespace dh::sne {
       glNamedBufferStorage(_buffers(BufferType::eField), _constrLayout.nNodes * sizeof(glm::vec4), nullptr, 0);
 
       // Report buffer storage size
-      const GLuint bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
+      const ulong bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
       Logger::rest() << prefix << "Expanded hierarchy, buffer storage : " << static_cast<float>(bufferSize) / 1'048'576.0f << " mb";
       Logger::newl();
     }
@@ -44,12 +44,13 @@ namespace dh::sne {
     
     // Initialize shader programs
     {
+      const bool compressed = _params->compressSimilarities;
       if (_params->nLowDims == 2) {
         _programs(ProgramType::eQijSumComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/kl_divergence/2D/qijSum.comp"));
-        _programs(ProgramType::eKLDSumComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/kl_divergence/2D/KLDSum.comp"));
+        _programs(ProgramType::eKLDSumComp).addShader(util::GLShaderType::eCompute, rsrc::get(compressed ? "sne/kl_divergence/2D/KLDSum_compressed.comp" : "sne/kl_divergence/2D/KLDSum.comp"));
       } else if (_params->nLowDims == 3) {
         _programs(ProgramType::eQijSumComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/kl_divergence/3D/qijSum.comp"));
-        _programs(ProgramType::eKLDSumComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/kl_divergence/3D/KLDSum.comp"));
+        _programs(ProgramType::eKLDSumComp).addShader(util::GLShaderType::eCompute, rsrc::get(compressed ? "sne/kl_divergence/3D/KLDSum_compressed.comp" : "sne/kl_divergence/3D/KLDSum.comp"));
       }
       _programs(ProgramType::eReduceComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/kl_divergence/reduce.comp"));
 
@@ -70,7 +71,7 @@ namespace dh::sne {
     }
     
     // Output memory use of OpenGL buffer objects
-    const GLuint bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
+    const ulong bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
     Logger::rest() << prefix << "Initialized, buffer storage : " << static_cast<float>(bufferSize) / 1'048'576.0f << " mb";
 
     _isInit = true;
@@ -152,7 +153,15 @@ namespace dh::sne {
       glAssert();
     }
 
-    // 3.
+    return compSum(_buffers(BufferType::eReduceFinal));
+  }
+
+  float KLDivergence::compApprox(GLuint sumQBuffer) {
+    return compSum(sumQBuffer);
+  }
+
+  float KLDivergence::compSum(GLuint sumQBuffer) {
+    // 1.
     // Compute inner sum of KLD: for each i, sum over all j
     // the values of p_{ij} ln (p_{ij} / q_{ij})
     {
@@ -164,22 +173,26 @@ namespace dh::sne {
 
       // Set uniforms
       program.template uniform<uint>("nPoints", _params->n);
+      if (_params->compressSimilarities) { program.template uniform<bool>("offsets", _params->compressedOffsets); }
 
       // Set buffer bindings
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _minimizationBuffers.embedding);
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::eReduceFinal));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sumQBuffer);
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _similaritiesBuffers.layout);
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _similaritiesBuffers.neighbors);
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _similaritiesBuffers.similarities);
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _buffers(BufferType::eKLDSum));
 
-      // In steps of 512, perforn sums over all j
+      // Per graph segment, with its range of the neighbors and similarities bound, in steps of 512, perforn sums over all j
+      const ulong similarityBytes = _params->compressSimilarities ? sizeof(uint) / 2 : sizeof(float); // Compressed similarities are bfloat16 pairs
       const uint step = 512;
-      const uint end = _params->n;
-      for (int begin = 0; begin < end; begin += step) {
-        // Dispatch shader for a limited range
-        program.template uniform<uint>("begin", begin);
-        glDispatchCompute(std::min(step, end - begin), 1, 1);
+      for (const GraphSegment& segment : _similaritiesBuffers.segments) {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, _similaritiesBuffers.neighbors, segment.offset(sizeof(uint)), segment.size(sizeof(uint)));
+        if (!_params->compressSimilarities || !_params->compressedOffsets) { glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4, _similaritiesBuffers.similarities, segment.offset(similarityBytes), segment.size(similarityBytes)); } // Neighbors compressed with offsets hold similarities as well
+        const uint end = segment.rowEnd;
+        for (uint begin = segment.rowBegin; begin < end; begin += step) {
+          // Dispatch shader for a limited range
+          program.template uniform<uint>("begin", begin);
+          glDispatchCompute(std::min(step, end - begin), 1, 1);
+        }
       }
       glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
@@ -187,8 +200,8 @@ namespace dh::sne {
       glAssert();
     }
 
-    // 4.
-    // Compute KLD, i.e. do a parallel reduction over the inner sums of step 3.
+    // 2.
+    // Compute KLD, i.e. do a parallel reduction over the inner sums of step 1.
     {
       auto& timer = _timers(TimerType::eKLDSumReduce);
       timer.tick();
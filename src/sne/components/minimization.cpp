@@ -23,7 +23,13 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <numeric>
 #include <random>
+#include <sstream>
+#include <utility>
 #include <vector>
 #include <set>
 #include <resource_embed/resource_embed.hpp>
@@ -34,6 +40,9 @@
 #include "dh/util/gl/error.hpp"
 #include "dh/util/gl/metric.hpp"
 #include "dh/util/gl/buffertools.hpp"
+#include "dh/util/gl/buffer_pool.hpp"
+#include "dh/util/negative_sampling.hpp"
+#include "dh/util/thread_pool.hpp"
 #include "dh/vis/input_queue.hpp"
 #include "dh/util/cu/knn.cuh"
 #include <faiss/VectorTransform.h>
@@ -47,18 +56,77 @@ namespace dh::sne {
 
   // Params for field size
   constexpr uint fieldMinSize = 5;
+  constexpr float transformBoundsPadding = 0.1f; // Fraction of the range by which the fixed field extends beyond an embedding's bounds in transform()
+
+  namespace {
+    // Eigendecomposition of a small symmetric m x m matrix a by cyclic Jacobi rotations. Eigenvalues are returned in
+    // descending order, with the corresponding eigenvectors as the columns of row-major vectors
+    void symmetricEigen(std::vector<double> a, uint m, std::vector<double>& values, std::vector<double>& vectors) {
+      std::vector<double> v(static_cast<ulong>(m) * m, 0.0);
+      for (uint i = 0; i < m; ++i) { v[i * m + i] = 1.0; }
+      for (uint sweep = 0; sweep < 64; ++sweep) {
+        double off = 0.0, diagonal = 0.0;
+        for (uint p = 0; p < m; ++p) {
+          diagonal += a[p * m + p] * a[p * m + p];
+          for (uint q = p + 1; q < m; ++q) { off += a[p * m + q] * a[p * m + q]; }
+        }
+        if (off <= 1e-30 * diagonal) {
+          break;
+        }
+        for (uint p = 0; p < m; ++p) {
+          for (uint q = p + 1; q < m; ++q) {
+            if (a[p * m + q] == 0.0) {
+              continue;
+            }
+
+            // Rotate rows and columns p and q, so that a[p][q] becomes zero
+            const double theta = (a[q * m + q] - a[p * m + p]) / (2.0 * a[p * m + q]);
+            const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+            const double c = 1.0 / std::sqrt(t * t + 1.0);
+            const double s = t * c;
+            for (uint k = 0; k < m; ++k) {
+              const double akp = a[k * m + p], akq = a[k * m + q];
+              a[k * m + p] = c * akp - s * akq;
+              a[k * m + q] = s * akp + c * akq;
+            }
+            for (uint k = 0; k < m; ++k) {
+              const double apk = a[p * m + k], aqk = a[q * m + k];
+              a[p * m + k] = c * apk - s * aqk;
+              a[q * m + k] = s * apk + c * aqk;
+            }
+            for (uint k = 0; k < m; ++k) {
+              const double vkp = v[k * m + p], vkq = v[k * m + q];
+              v[k * m + p] = c * vkp - s * vkq;
+              v[k * m + q] = s * vkp + c * vkq;
+            }
+          }
+        }
+      }
+
+      std::vector<uint> order(m);
+      std::iota(order.begin(), order.end(), 0u);
+      std::sort(order.begin(), order.end(), [&](uint i, uint j) { return a[i * m + i] > a[j * m + j]; });
+      values.resize(m);
+      vectors.resize(static_cast<ulong>(m) * m);
+      for (uint l = 0; l < m; ++l) {
+        values[l] = a[order[l] * m + order[l]];
+        for (uint k = 0; k < m; ++k) { vectors[k * m + l] = v[k * m + order[l]]; }
+      }
+    }
+  } // namespace
 
   template <uint D, uint DD>
   Minimization<D, DD>::Minimization()
-  : _isInit(false) {
+  : _isInit(false), _attractiveBatched(false) {
     // ...
   }
 
   template <uint D, uint DD>
   Minimization<D, DD>::Minimization(Similarities* similarities, const float* dataPtr, const int* labelPtr, Params* params, std::vector<char> axisMapping)
-  : _isInit(false), _loggedNewline(false), _similarities(similarities), _similaritiesBuffers(similarities->getBuffers()),
+  : _isInit(false), _loggedNewline(false), _similarities(similarities), _similaritiesBuffers(similarities->getBuffers()), _pcs(nullptr),
     _selectionCounts(2, 0), _params(params), _axisMapping(axisMapping), _axisMappingPrev(axisMapping), _axisIndexPrev(-1),
-    _selectedDatapointPrev(0), _iteration(0), _iterationIntense(1000), _removeExaggerationIter(_params->nExaggerationIters) {
+    _selectedDatapointPrev(0), _iteration(0), _iterationIntense(1000), _removeExaggerationIter(_params->nExaggerationIters),
+    _lateExaggerationIter(_params->iterations - std::min(_params->lateExaggerationIters, _params->iterations)), _convergenceGradientNorm(0.f), _attractiveBatched(false) {
     Logger::newt() << prefix << "Initializing...";
 
     // Initialize shader programs
@@ -68,15 +136,21 @@ namespace dh::sne {
       if constexpr (D == 2) {
         _programs(ProgramType::eBoundsComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/bounds.comp"));
         _programs(ProgramType::eZComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/Z.comp"));
-        _programs(ProgramType::eAttractiveComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/attractive.comp"));
+        _programs(ProgramType::eAttractiveComp).addShader(util::GLShaderType::eCompute, rsrc::get(_params->compressSimilarities ? "sne/minimization/2D/attractive_compressed.comp" : "sne/minimization/2D/attractive.comp"));
         _programs(ProgramType::eGradientsComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/gradients.comp"));
         _programs(ProgramType::eCenterEmbeddingComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/centerEmbedding.comp"));
+        _programs(ProgramType::eConvergenceComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/convergence.comp"));
+        _programs(ProgramType::eTransformComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/transform.comp"));
+        _programs(ProgramType::eAttractiveBatchComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/attractive_batch.comp"));
       } else if constexpr (D == 3) {
         _programs(ProgramType::eBoundsComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/3D/bounds.comp"));
         _programs(ProgramType::eZComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/3D/Z.comp"));
-        _programs(ProgramType::eAttractiveComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/3D/attractive.comp"));
+        _programs(ProgramType::eAttractiveComp).addShader(util::GLShaderType::eCompute, rsrc::get(_params->compressSimilarities ? "sne/minimization/3D/attractive_compressed.comp" : "sne/minimization/3D/attractive.comp"));
         _programs(ProgramType::eGradientsComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/3D/gradients.comp"));
         _programs(ProgramType::eCenterEmbeddingComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/3D/centerEmbedding.comp"));
+        _programs(ProgramType::eConvergenceComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/3D/convergence.comp"));
+        _programs(ProgramType::eTransformComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/3D/transform.comp"));
+        _programs(ProgramType::eAttractiveBatchComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/3D/attractive_batch.comp"));
       }
       if constexpr (DD == 2) {
         _programs(ProgramType::eSelectionComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/minimization/2D/selection.comp"));
@@ -102,8 +176,7 @@ namespace dh::sne {
 
     // Initialize buffer objects
     {
-      const std::vector<vec> zerovecs(_params->n, vec(0));
-      const std::vector<vec> unitvecs(_params->n, vec(1));
+      const std::vector<vec> unitvecs(256, vec(1)); // Covers the largest bounds buffer; n-sized vectors are cleared on the device instead
       const std::vector<uint> falses(_params->n, 0); // TODO: use bools instead of uints (but I can't seem to initialize buffers with bools; std::vector specializes <bool>)
       const std::vector<float> ones(_params->n, 1.0f);
       std::vector<float> zeros(_params->n, 0.0f);
@@ -123,10 +196,10 @@ namespace dh::sne {
       glNamedBufferStorage(_buffers(BufferType::eField), _params->n * 4 * sizeof(float), nullptr, 0);
       glNamedBufferStorage(_buffers(BufferType::eAttractive), _params->n * sizeof(vec), nullptr, 0);
       glNamedBufferStorage(_buffers(BufferType::eGradients), _params->n * sizeof(vec), nullptr, 0);
-      glNamedBufferStorage(_buffers(BufferType::ePrevGradients), _params->n * sizeof(vec), zerovecs.data(), 0);
-      glNamedBufferStorage(_buffers(BufferType::eGain), _params->n * sizeof(vec), unitvecs.data(), 0);
-      glNamedBufferStorage(_buffers(BufferType::eNeighborsEmb), _params->n * _params->k * sizeof(uint), nullptr, 0);
-      glNamedBufferStorage(_buffers(BufferType::eDistancesEmb), _params->n * _params->k * sizeof(float), nullptr, 0);
+      glNamedBufferStorage(_buffers(BufferType::ePrevGradients), _params->n * sizeof(vec), nullptr, 0);
+      glNamedBufferStorage(_buffers(BufferType::eGain), _params->n * sizeof(vec), nullptr, 0);
+      glNamedBufferStorage(_buffers(BufferType::eNeighborsEmb), static_cast<ulong>(_params->n) * _params->k * sizeof(uint), nullptr, 0);
+      glNamedBufferStorage(_buffers(BufferType::eDistancesEmb), static_cast<ulong>(_params->n) * _params->k * sizeof(float), nullptr, 0);
       glNamedBufferStorage(_buffers(BufferType::eNeighborhoodPreservation), _params->n * sizeof(float), nullptr, 0);
       glNamedBufferStorage(_buffers(BufferType::eSelection), _params->n * sizeof(uint), falses.data(), GL_DYNAMIC_STORAGE_BIT);
       glNamedBufferStorage(_buffers(BufferType::eLabeled), _params->n * sizeof(uint), labeled.data(), 0); // Indicates whether datapoints are labeled
@@ -134,6 +207,10 @@ namespace dh::sne {
       glNamedBufferStorage(_buffers(BufferType::eFixed), _params->n * sizeof(uint), falses.data(), 0); // Indicates whether datapoints are fixed
       glNamedBufferStorage(_buffers(BufferType::eTranslating), _params->n * sizeof(uint), falses.data(), 0); // Indicates whether datapoints are being translated
       glNamedBufferStorage(_buffers(BufferType::eWeights), _params->n * sizeof(float), ones.data(), 0); // The attractive force multiplier per datapoint
+      glNamedBufferStorage(_buffers(BufferType::eConvergence), 2 * sizeof(float), nullptr, 0);
+      glNamedBufferStorage(_buffers(BufferType::eConvergenceReduce), 128 * 2 * sizeof(float), nullptr, 0);
+      glClearNamedBufferData(_buffers(BufferType::ePrevGradients), GL_R32F, GL_RED, GL_FLOAT, nullptr);
+      glClearNamedBufferData(_buffers(BufferType::eGain), GL_R32F, GL_RED, GL_FLOAT, ones.data());
       glAssert();
     }
 
@@ -144,10 +221,10 @@ namespace dh::sne {
       _pcs = matrixPCA.apply(_params->n, dataPtr);
     }
 
-    initializeEmbeddingRandomly(_params->seed);
+    initializeEmbedding(_params->seed);
 
     // Output memory use of OpenGL buffer objects
-    const GLuint bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
+    const ulong bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
     Logger::rest() << prefix << "Initialized, buffer storage : " << static_cast<float>(bufferSize) / 1'048'576.0f << " mb";
 
     // Setup field subcomponent
@@ -172,18 +249,257 @@ namespace dh::sne {
 
     _klDivergence = KLDivergence(_params, _similaritiesBuffers, buffers());
 
+    // Setup snapshot subcomponent, if requested
+    if (!_params->snapshotFilename.empty() && _params->snapshotInterval > 0) {
+      _snapshots = Snapshots(_params, _buffers(BufferType::eEmbedding), D, sizeof(vec) / sizeof(float), _similarities->permutation());
+    }
+
     _isInit = true;
     glAssert();
   }
 
+  // Initialize the embedding as set by Params::initialization, falling back to a random embedding if the
+  // requested one is unavailable. Informed embeddings are scaled to the spread of a random one
+  template <uint D, uint DD>
+  void Minimization<D, DD>::initializeEmbedding(int seed) {
+    if (_params->initialization == "pca") {
+      if (_pcs && _params->nPCs >= static_cast<int>(D)) {
+        initializeEmbeddingPCA();
+        return;
+      }
+      Logger::newl() << prefix << "No principal components to initialize from, initializing randomly";
+    } else if (_params->initialization == "spectral") {
+      if (initializeEmbeddingSpectral(seed)) {
+        return;
+      }
+      Logger::newl() << prefix << "No similarities to initialize from, initializing randomly";
+    } else if (_params->initialization != "random") {
+      Logger::newl() << prefix << "Unknown initialization \"" << _params->initialization << "\", initializing randomly";
+    }
+    initializeEmbeddingRandomly(seed);
+  }
+
+  // Scale points along the first D principal components, computed in the constructor
+  template <uint D, uint DD>
+  void Minimization<D, DD>::initializeEmbeddingPCA() {
+    const uint n = _params->n;
+    const ulong nPCs = _params->nPCs;
+    auto& pool = util::ThreadPool::instance();
+
+    // Principal components are centered; the first has the largest spread, which is scaled to rngRange
+    const double sumSq = pool.parallelReduce(0, n, 0, 0.0, [&](ulong begin, ulong end) {
+      double sum = 0.0;
+      for (ulong i = begin; i < end; ++i) { sum += static_cast<double>(_pcs[i * nPCs]) * _pcs[i * nPCs]; }
+      return sum;
+    }, std::plus<double>());
+    const float deviation = static_cast<float>(std::sqrt(sumSq / n));
+    const float scale = deviation > 0.f ? _params->rngRange / deviation : 1.f;
+
+    util::HostVector<vec> embedding;
+    pool.firstTouch(embedding, n);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        for (uint j = 0; j < D; ++j) {
+          embedding[i][j] = _pcs[i * nPCs + j] * scale;
+        }
+      }
+    });
+
+    glNamedBufferSubData(_buffers(BufferType::eEmbedding), 0, n * sizeof(vec), embedding.data());
+    glAssert();
+  }
+
+  // Spectral embedding along the eigenvectors of the similarity graph's normalized Laplacian with the smallest
+  // nonzero eigenvalues. These are the leading eigenvectors of M = (I + D^-1/2 P D^-1/2) / 2 after the trivial
+  // one, found by LOBPCG (Knyazev, 2001) from random vectors: every step, the current vectors are replaced by the
+  // leading Ritz vectors of M over their span with their residuals and the previous step's directions, all kept
+  // orthogonal to the trivial eigenvector. Stops once every residual ||Mx - lambda x|| falls below tolerance.
+  // Returns false if the similarities are not available as floats, i.e. when compressed, or not with absolute offsets,
+  // i.e. when segmented
+  template <uint D, uint DD>
+  bool Minimization<D, DD>::initializeEmbeddingSpectral(int seed) {
+    if (_params->compressSimilarities || _params->segmentedGraph) { return false; }
+    constexpr uint maxIters = 200;
+    constexpr double tolerance = 1e-5; // Of unit vectors, as the eigenvalues of M lie in [0, 1]
+    const uint n = _params->n;
+    auto& pool = util::ThreadPool::instance();
+    using Block = std::vector<std::vector<double>>; // Columns of n values
+
+    // Copy the symmetric graph to host
+    std::vector<uint> layout(2 * n);
+    glGetNamedBufferSubData(_similaritiesBuffers.layout, 0, layout.size() * sizeof(uint), layout.data());
+    const ulong nEdges = static_cast<ulong>(layout[2 * (n - 1)]) + layout[2 * (n - 1) + 1];
+    std::vector<uint> neighbors(nEdges);
+    std::vector<float> similarities(nEdges);
+    glGetNamedBufferSubData(_similaritiesBuffers.neighbors, 0, nEdges * sizeof(uint), neighbors.data());
+    glGetNamedBufferSubData(_similaritiesBuffers.similarities, 0, nEdges * sizeof(float), similarities.data());
+    glAssert();
+
+    // Inverse square roots of the degrees; the trivial eigenvector is proportional to their reciprocals
+    std::vector<double> degreeInvSqrt(n);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        double degree = 0.0;
+        for (ulong ij = layout[2 * i]; ij < layout[2 * i] + layout[2 * i + 1]; ++ij) { degree += similarities[ij]; }
+        degreeInvSqrt[i] = degree > 0.0 ? 1.0 / std::sqrt(degree) : 0.0;
+      }
+    });
+    std::vector<double> trivial(n);
+    for (uint i = 0; i < n; ++i) { trivial[i] = degreeInvSqrt[i] > 0.0 ? 1.0 / degreeInvSqrt[i] : 0.0; }
+
+    // Dot product of columns, in chunk order so the result does not depend on scheduling
+    const auto dot = [&](const std::vector<double>& a, const std::vector<double>& b) {
+      return pool.parallelReduce(0, n, 0, 0.0, [&](ulong begin, ulong end) {
+        double sum = 0.0;
+        for (ulong i = begin; i < end; ++i) { sum += a[i] * b[i]; }
+        return sum;
+      }, std::plus<double>());
+    };
+    const double trivialNorm = std::sqrt(dot(trivial, trivial));
+    if (trivialNorm == 0.0) { return false; }
+    for (double& t : trivial) { t /= trivialNorm; }
+
+    // y = M x for all columns in a single pass over the graph
+    const auto apply = [&](const Block& x, Block& y) {
+      const uint m = static_cast<uint>(x.size());
+      y.assign(m, std::vector<double>(n));
+      pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          double sum[3 * D] = {};
+          for (ulong ij = layout[2 * i]; ij < layout[2 * i] + layout[2 * i + 1]; ++ij) {
+            const ulong j = neighbors[ij];
+            const double w = similarities[ij] * degreeInvSqrt[j];
+            for (uint l = 0; l < m; ++l) { sum[l] += w * x[l][j]; }
+          }
+          for (uint l = 0; l < m; ++l) { y[l][i] = 0.5 * (x[l][i] + degreeInvSqrt[i] * sum[l]); }
+        }
+      });
+    };
+
+    // Project out the trivial eigenvector and earlier columns through Gram-Schmidt, twice for stability, and
+    // normalize. Columns left without length, i.e. dependent on earlier ones, are dropped
+    const auto orthonormalize = [&](Block& x) {
+      Block basis;
+      for (auto& v : x) {
+        const double length = std::sqrt(dot(v, v));
+        if (length == 0.0) {
+          continue;
+        }
+        for (uint pass = 0; pass < 2; ++pass) {
+          const double t = dot(v, trivial);
+          std::vector<double> projections(basis.size());
+          for (uint l = 0; l < basis.size(); ++l) { projections[l] = dot(v, basis[l]); }
+          pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+            for (ulong i = begin; i < end; ++i) {
+              v[i] -= t * trivial[i];
+              for (uint l = 0; l < basis.size(); ++l) { v[i] -= projections[l] * basis[l][i]; }
+            }
+          });
+        }
+        const double norm = std::sqrt(dot(v, v));
+        if (norm <= 1e-8 * length) {
+          continue;
+        }
+        for (double& value : v) { value /= norm; }
+        basis.push_back(std::move(v));
+      }
+      x = std::move(basis);
+    };
+
+    // Leading D Ritz vectors x of M over orthonormal columns s, with as = M s, and their parts p outside the first
+    // D columns of s, i.e. the directions taken this step
+    std::vector<double> lambda(D);
+    const auto rayleighRitz = [&](const Block& s, const Block& as, Block& x, Block& ax, Block& p) {
+      const uint m = static_cast<uint>(s.size());
+      std::vector<double> g(static_cast<ulong>(m) * m);
+      for (uint a = 0; a < m; ++a) {
+        for (uint b = 0; b <= a; ++b) { g[a * m + b] = g[b * m + a] = 0.5 * (dot(s[a], as[b]) + dot(s[b], as[a])); }
+      }
+      std::vector<double> values, vectors;
+      symmetricEigen(g, m, values, vectors);
+      x.assign(D, std::vector<double>(n, 0.0));
+      ax.assign(D, std::vector<double>(n, 0.0));
+      p.assign(D, std::vector<double>(n, 0.0));
+      pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          for (uint l = 0; l < D; ++l) {
+            for (uint a = 0; a < m; ++a) {
+              const double c = vectors[a * m + l];
+              x[l][i] += c * s[a][i];
+              ax[l][i] += c * as[a][i];
+              if (a >= D) { p[l][i] += c * s[a][i]; }
+            }
+          }
+        }
+      });
+      std::copy_n(values.begin(), D, lambda.begin());
+    };
+
+    Block x(D, std::vector<double>(n)), ax, p, s, as;
+    {
+      std::mt19937 rng(seed);
+      std::normal_distribution<double> normal;
+      for (auto& column : x) {
+        for (double& v : column) { v = normal(rng); }
+      }
+    }
+    orthonormalize(x);
+    if (x.size() < D) { return false; }
+    apply(x, ax);
+    rayleighRitz(Block(x), Block(ax), x, ax, p);
+
+    uint iter = 0;
+    for (; iter < maxIters; ++iter) {
+      // Residuals of the Ritz pairs
+      Block r(D, std::vector<double>(n));
+      double residual = 0.0;
+      for (uint l = 0; l < D; ++l) {
+        pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+          for (ulong i = begin; i < end; ++i) { r[l][i] = ax[l][i] - lambda[l] * x[l][i]; }
+        });
+        residual = std::max(residual, std::sqrt(dot(r[l], r[l])));
+      }
+      if (residual < tolerance) {
+        break;
+      }
+
+      // Search over the span of the current vectors, their residuals and the previous directions
+      s = x;
+      s.insert(s.end(), std::make_move_iterator(r.begin()), std::make_move_iterator(r.end()));
+      s.insert(s.end(), std::make_move_iterator(p.begin()), std::make_move_iterator(p.end()));
+      orthonormalize(s);
+      apply(s, as);
+      rayleighRitz(s, as, x, ax, p);
+    }
+    Logger::newl() << prefix << "Spectral initialization took " << iter << " iterations";
+
+    // Eigenvectors of the random walk on P, scaled to the spread of a random embedding along the first
+    double sumSq = 0.0;
+    for (uint i = 0; i < n; ++i) {
+      for (uint l = 0; l < D; ++l) { x[l][i] *= degreeInvSqrt[i]; }
+      sumSq += x[0][i] * x[0][i];
+    }
+    const double deviation = std::sqrt(sumSq / n);
+    const double scale = deviation > 0.0 ? _params->rngRange / deviation : 1.0;
+    util::HostVector<vec> embedding;
+    pool.firstTouch(embedding, n);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        for (uint l = 0; l < D; ++l) { embedding[i][l] = static_cast<float>(x[l][i] * scale); }
+      }
+    });
+
+    glNamedBufferSubData(_buffers(BufferType::eEmbedding), 0, n * sizeof(vec), embedding.data());
+    glAssert();
+    return true;
+  }
+
   // Generate randomized embedding data
-  // TODO: look at CUDA-tSNE's approach, they have several options available for initialization
   template <uint D, uint DD>
   void Minimization<D, DD>::initializeEmbeddingRandomly(int seed) {
     
-    // Copy over embedding buffer to host
+    // Every point is overwritten, so there is no need to copy the embedding buffer to host first
     std::vector<vec> embedding(_params->n);
-    glGetNamedBufferSubData(_buffers(BufferType::eEmbedding), 0, _params->n * sizeof(vec), embedding.data());
 
     // Seed the (bad) rng
     std::srand(seed);
@@ -233,15 +549,190 @@ namespace dh::sne {
   template <uint D, uint DD>
   void Minimization<D, DD>::restartMinimization() {
     if(_iteration < 100) { return; }
-    if(_input.alt) { initializeEmbeddingRandomly(_iteration); } else
-    if(_input.num >= 0) { initializeEmbeddingRandomly(_input.num); }
-    else { initializeEmbeddingRandomly(_params->seed); }
+    if(_input.alt) { restart(_iteration); } else
+    if(_input.num >= 0) { restart(_input.num); }
+    else { restart(_params->seed); }
+  }
+
+  // Restarts the minimization from a new random embedding, resetting optimizer state
+  template <uint D, uint DD>
+  void Minimization<D, DD>::restart(int seed) {
+    initializeEmbedding(seed);
     _iteration = 0;
     _iterationIntense = 1000;
     restartExaggeration(_params->nExaggerationIters);
-    const std::vector<vec> unitvecs(_params->n, vec(1));
+    _lateExaggerationIter = _params->iterations - std::min(_params->lateExaggerationIters, _params->iterations);
+    _convergenceChecks.clear();
+    _convergenceReason.clear();
+    const float one = 1.f;
+    glClearNamedBufferData(_buffers(BufferType::ePrevGradients), GL_R32F, GL_RED, GL_FLOAT, nullptr);
+    glClearNamedBufferData(_buffers(BufferType::eGain), GL_R32F, GL_RED, GL_FLOAT, &one);
+    glAssert();
+  }
+
+  // Embeds n other points against the current embedding, which stays fixed. Their similarities hold their neighbors
+  // in the embedding, and each starts at the mean of its neighbors' positions. The field of the embedding is computed
+  // once over its padded bounds, at every pixel; each iteration then only queries it at the other points, and moves
+  // them by it and by their attraction to their neighbors. As the embedding does not move, each point minimizes the
+  // KL divergence of its own conditional similarities, independent of the others
+  template <uint D, uint DD>
+  std::vector<float> Minimization<D, DD>::transform(const SimilaritiesBuffers& similarities, uint n) {
+    // Pad the bounds of the embedding, so points moving slightly beyond them still see its field
+    compBounds();
+    glGetNamedBufferSubData(_buffers(BufferType::eBounds), 0, sizeof(Bounds), &_bounds);
+    {
+      const vec padding = transformBoundsPadding * _bounds.range();
+      _bounds.min -= padding;
+      _bounds.max += padding;
+      const vec range = _bounds.range();
+      const std::array<vec, 4> bounds = { _bounds.min, _bounds.max, range, vec(1.f) / range };
+      glNamedBufferSubData(_buffers(BufferType::eBounds), 0, sizeof(bounds), bounds.data());
+      glAssert();
+    }
+    _field.compDense(fieldSize());
+
+    // Per-point state of the other points
+    auto& pool = util::GLBufferPool::instance();
+    GLuint embeddingBuffer = pool.acquire(n * sizeof(vec));
+    GLuint fieldBuffer = pool.acquire(n * 4 * sizeof(float));
+    GLuint prevGradientsBuffer = pool.acquire(n * sizeof(vec));
+    GLuint gainBuffer = pool.acquire(n * sizeof(vec));
+
+    // The first pass only places the other points; each after it is an iteration
+    auto& program = _programs(ProgramType::eTransformComp);
+    for (uint iteration = 0; iteration <= _params->transformIterations; ++iteration) {
+      // Query the fixed field at the other points
+      if (iteration > 0) {
+        _field.query(embeddingBuffer, fieldBuffer, n);
+      }
+
+      program.bind();
+
+      // Set uniforms
+      program.template uniform<uint>("nPoints", n);
+      program.template uniform<float>("eta", _params->transformEta);
+      program.template uniform<float>("minGain", _params->minimumGain);
+      program.template uniform<float>("iterMult", iteration <= _params->transformIterations / 2 ? _params->momentum : _params->finalMomentum);
+      program.template uniform<bool>("initialize", iteration == 0);
+
+      // Set buffer bindings
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eEmbedding));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, similarities.layout);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, similarities.neighbors);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, similarities.similarities);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, fieldBuffer);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, embeddingBuffer);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, prevGradientsBuffer);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, gainBuffer);
+
+      // Dispatch shader
+      glDispatchCompute(ceilDiv(n, 256u), 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      glAssert();
+    }
+
+    // Copy the other points back to host, dropping padding
+    std::vector<vec> embedding(n);
+    glGetNamedBufferSubData(embeddingBuffer, 0, n * sizeof(vec), embedding.data());
+    glAssert();
+    pool.release(embeddingBuffer);
+    pool.release(fieldBuffer);
+    pool.release(prevGradientsBuffer);
+    pool.release(gainBuffer);
+    return dh::util::to_unaligned_vector<D, float>(embedding, n);
+  }
+
+  // Continues where a minimization over the first points left off, after points were appended to the similarities.
+  // Per-point state is copied over, and the added points start at the given positions with fresh optimizer state.
+  // Render tasks of equal priority are not inserted twice, so the previous minimization's tasks are replaced
+  template <uint D, uint DD>
+  void Minimization<D, DD>::resume(Minimization<D, DD>& previous, const std::vector<float>& positions) {
+    const uint nAdded = positions.size() / D;
+    runtimeAssert(nAdded < _params->n && positions.size() == static_cast<ulong>(nAdded) * D, "Minimization::resume() positions do not match params");
+    const uint nPrevious = _params->n - nAdded;
+
+    const auto copy = [&](BufferType type, ulong size) {
+      glCopyNamedBufferSubData(previous._buffers(type), _buffers(type), 0, 0, nPrevious * size);
+    };
+    copy(BufferType::eEmbedding, sizeof(vec));
+    copy(BufferType::eEmbeddingRelative, sizeof(vecc));
+    copy(BufferType::ePrevGradients, sizeof(vec));
+    copy(BufferType::eGain, sizeof(vec));
+    copy(BufferType::eFixed, sizeof(uint));
+    copy(BufferType::eDisabled, sizeof(uint));
+    copy(BufferType::eWeights, sizeof(float));
+    glCopyNamedBufferSubData(previous._buffers(BufferType::eBounds), _buffers(BufferType::eBounds), 0, 0, 4 * sizeof(vec));
+
+    std::vector<vec> embedding(nAdded);
+    for (uint i = 0; i < nAdded; ++i) {
+      for (uint j = 0; j < D; ++j) {
+        embedding[i][j] = positions[i * D + j];
+      }
+    }
+    glNamedBufferSubData(_buffers(BufferType::eEmbedding), nPrevious * sizeof(vec), nAdded * sizeof(vec), embedding.data());
+    glAssert();
+
+    _iteration = previous._iteration;
+    _iterationIntense = previous._iterationIntense;
+    _removeExaggerationIter = previous._removeExaggerationIter;
+    _lateExaggerationIter = previous._lateExaggerationIter;
+    _bounds = previous._bounds;
+    _boundsPrev = previous._boundsPrev;
+    _window = previous._window;
+    _loggedNewline = previous._loggedNewline;
+
+#ifdef DH_ENABLE_VIS_EMBEDDING
+    if (auto& queue = vis::RenderQueue::instance(); queue.isInit()) {
+      queue.erase(previous._axesRenderTask);
+      queue.erase(previous._embeddingRenderTask);
+      queue.erase(previous._selectionRenderTask);
+      queue.erase(previous._attributeRenderTask);
+      queue.insert(_axesRenderTask);
+      queue.insert(_embeddingRenderTask);
+      queue.insert(_selectionRenderTask);
+      queue.insert(_attributeRenderTask);
+    }
+#endif // DH_ENABLE_VIS_EMBEDDING
+  }
+
+  // Starts over from given positions of all points, which already form a layout, e.g. one interpolated from a coarser
+  // embedding. Exaggeration and the initial momentum would undo that layout, so iterations start after both, with
+  // fresh optimizer state. Runs nIterations iterations, or fewer if converged
+  template <uint D, uint DD>
+  void Minimization<D, DD>::refine(const std::vector<float>& positions, uint nIterations) {
+    runtimeAssert(positions.size() == static_cast<ulong>(_params->n) * D, "Minimization::refine() positions do not match params");
+
+    std::vector<vec> embedding(_params->n);
+    for (uint i = 0; i < _params->n; ++i) {
+      for (uint j = 0; j < D; ++j) {
+        embedding[i][j] = positions[i * D + j];
+      }
+    }
+    const float one = 1.f;
+    glNamedBufferSubData(_buffers(BufferType::eEmbedding), 0, _params->n * sizeof(vec), embedding.data());
     glClearNamedBufferData(_buffers(BufferType::ePrevGradients), GL_R32F, GL_RED, GL_FLOAT, nullptr);
-    glClearNamedBufferData(_buffers(BufferType::eGain), GL_R32F, GL_RED, GL_FLOAT, unitvecs.data());
+    glClearNamedBufferData(_buffers(BufferType::eGain), GL_R32F, GL_RED, GL_FLOAT, &one);
+    glAssert();
+
+    _removeExaggerationIter = 0;
+    _iteration = std::max(_params->nExponentialDecayIters, _params->momentumSwitchIter) + 1;
+    _lateExaggerationIter = _params->iterations - std::min(_params->lateExaggerationIters, _params->iterations);
+    _convergenceChecks.clear();
+    _convergenceReason.clear();
+    const uint end = _iteration + nIterations;
+    while (_iteration < end && _convergenceReason.empty()) {
+      compIteration();
+    }
+  }
+
+  // Refreshes buffer handles, because Similarities::recomp() deletes and recreates buffers
+  template <uint D, uint DD>
+  void Minimization<D, DD>::refreshSimilarities() {
+    _similaritiesBuffers = _similarities->getBuffers();
+    _klDivergence.setSimilaritiesBuffers(_similaritiesBuffers);
+    if (_attributeRenderTask) {
+      _attributeRenderTask->setSimilaritiesBuffers(_similaritiesBuffers);
+    }
   }
 
   // Restarts the exaggeration by pushing the exaggeration end iteration further ahead
@@ -250,6 +741,64 @@ namespace dh::sne {
     _removeExaggerationIter = _iteration + nExaggerationIters;
   }
 
+  // Removes disabled points for good, instead of recomputing the similarities of the rest. Their edges are dropped
+  // from the graph, which is renumbered in place; per-point buffers keep their handles and are compacted the same way
+  template <uint D, uint DD>
+  void Minimization<D, DD>::compactDisabled() {
+    if (_params->knnBlockSize > 0 || _params->compressSimilarities || _params->segmentedGraph) { return; } // The graph cannot be edited
+    const uint nEnabled = dh::util::BufferTools::instance().reduce<uint>(_buffers(BufferType::eDisabled), 3, _params->n, 0, 0);
+    if (nEnabled == 0 || nEnabled == _params->n) { return; }
+
+    // Points to keep are the enabled ones
+    auto& pool = util::GLBufferPool::instance();
+    GLuint keep = pool.acquire(_params->n * sizeof(uint));
+    glCopyNamedBufferSubData(_buffers(BufferType::eDisabled), keep, 0, 0, _params->n * sizeof(uint));
+    dh::util::BufferTools::instance().flip<uint>(keep, _params->n);
+
+    // Undo the rescaling applied on disabling, as the similarities are renormalized over the remaining points instead
+    const uint n = _params->n;
+    compactPCs(keep, n);
+    _similarities->weighSimilarities((float) nEnabled / (float) n);
+    _similarities->compact(keep);
+    refreshSimilarities();
+
+    auto& tools = dh::util::BufferTools::instance();
+    tools.compact<float>(_buffers(BufferType::eEmbedding), n, sizeof(vec) / sizeof(float), keep);
+    tools.compact<float>(_buffers(BufferType::eEmbeddingRelative), n, sizeof(vecc) / sizeof(float), keep);
+    tools.compact<float>(_buffers(BufferType::ePrevGradients), n, sizeof(vec) / sizeof(float), keep);
+    tools.compact<float>(_buffers(BufferType::eGain), n, sizeof(vec) / sizeof(float), keep);
+    tools.compact<float>(_buffers(BufferType::eWeights), n, 1, keep);
+    tools.compact<uint>(_buffers(BufferType::eLabels), n, 1, keep);
+    tools.compact<uint>(_buffers(BufferType::eLabeled), n, 1, keep);
+    tools.compact<uint>(_buffers(BufferType::eFixed), n, 1, keep);
+    pool.release(keep);
+
+    glClearNamedBufferData(_buffers(BufferType::eDisabled), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glClearNamedBufferData(_buffers(BufferType::eTranslating), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glAssert();
+    deselect();
+    _embeddingRenderTask->setPointRadius(std::min(100.f / _params->n, 0.005f));
+  }
+
+  // Move the principal components of selected points to the front, so a later PCA initialization matches the
+  // remaining points. Nothing is removed if nothing is selected
+  template <uint D, uint DD>
+  void Minimization<D, DD>::compactPCs(GLuint selectionBuffer, uint n) {
+    if (!_pcs) { return; }
+
+    std::vector<uint> selection(n);
+    glGetNamedBufferSubData(selectionBuffer, 0, n * sizeof(uint), selection.data());
+    if (std::find_if(selection.begin(), selection.end(), [](uint s) { return s != 0; }) == selection.end()) { return; }
+
+    const ulong nPCs = _params->nPCs;
+    ulong write = 0;
+    for (ulong i = 0; i < n; ++i) {
+      if (!selection[i]) { continue; }
+      if (write != i) { std::memmove(&_pcs[write * nPCs], &_pcs[i * nPCs], nPCs * sizeof(float)); }
+      ++write;
+    }
+  }
+
   // Configures the axes on request of change
   // template <uint D, uint DD>
   // void Minimization<D, DD>::reconfigureZAxis() {
@@ -300,9 +849,145 @@ namespace dh::sne {
 
   template <uint D, uint DD>
   void Minimization<D, DD>::comp() {
-    while (_iteration < _params->iterations) {
+    while (_iteration < _params->iterations && _convergenceReason.empty()) {
       compIteration();
     }
+    compFinish();
+  }
+
+  template <uint D, uint DD>
+  void Minimization<D, DD>::compFinish() {
+    if (!_convergenceReason.empty()) {
+      Logger::newl() << prefix << "Stopped at iteration " << _iteration << ", " << _convergenceReason;
+    }
+    if (_snapshots.isInit()) {
+      _snapshots.flush();
+    }
+  }
+
+  // Minimizations that have not finished take their iterations together. Their attractive forces are computed in one
+  // pass over the graph, which they share; fields, gradients and updates remain per minimization. Compressed
+  // similarities have no batched attractive pass, so are read by each minimization itself
+  template <uint D, uint DD>
+  void Minimization<D, DD>::compBatch(const std::vector<Minimization*>& minimizations) {
+    runtimeAssert(minimizations.size() <= batchSize, "Minimization::compBatch() takes at most batchSize minimizations");
+
+    std::vector<Minimization*> active;
+    while (true) {
+      active.clear();
+      for (Minimization* m : minimizations) {
+        if (m->_iteration < m->_params->iterations && m->_convergenceReason.empty()) { active.push_back(m); }
+      }
+      if (active.empty()) {
+        break;
+      }
+      if (!active[0]->_params->compressSimilarities) {
+        compAttractiveBatch(active);
+      }
+      for (Minimization* m : active) {
+        m->compIteration();
+      }
+    }
+    for (Minimization* m : minimizations) {
+      m->compFinish();
+    }
+  }
+
+  // Gathers the embeddings of the minimizations into one buffer, computes all their attractive forces as step 4 of
+  // compIterationMinimize() does, and scatters these back. The first minimization's programs, weights and disabled
+  // points serve all of them
+  template <uint D, uint DD>
+  void Minimization<D, DD>::compAttractiveBatch(const std::vector<Minimization*>& minimizations) {
+    Minimization& lead = *minimizations[0];
+    const uint n = lead._params->n;
+    const uint nReplicates = static_cast<uint>(minimizations.size());
+    const ulong embeddingSize = static_cast<ulong>(n) * sizeof(vec);
+    auto& pool = util::GLBufferPool::instance();
+    GLuint embeddings = pool.acquire(nReplicates * embeddingSize);
+    GLuint attractive = pool.acquire(nReplicates * embeddingSize);
+    for (uint r = 0; r < nReplicates; ++r) {
+      glCopyNamedBufferSubData(minimizations[r]->_buffers(BufferType::eEmbedding), embeddings, 0, r * embeddingSize, embeddingSize);
+    }
+
+    auto& timer = lead._timers(TimerType::eAttractiveComp);
+    timer.tick();
+
+    auto& program = lead._programs(ProgramType::eAttractiveBatchComp);
+    program.bind();
+
+    // Set uniforms
+    program.template uniform<uint>("nPoints", n);
+    program.template uniform<uint>("nReplicates", nReplicates);
+    program.template uniform<float>("invPos", 1.f / static_cast<float>(n));
+    program.template uniform<float>("weightFalloff", lead._embeddingRenderTask->getWeightFalloff());
+
+    // Set buffer bindings
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, embeddings);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, lead._buffers(BufferType::eDisabled));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, lead._buffers(BufferType::eWeights));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, lead._similaritiesBuffers.layout);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, attractive);
+
+    // Dispatch shader once per graph segment, with its range of the neighbors and similarities bound
+    for (const GraphSegment& segment : lead._similaritiesBuffers.segments) {
+      program.template uniform<uint>("begin", segment.rowBegin);
+      program.template uniform<uint>("end", segment.rowEnd);
+      glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4, lead._similaritiesBuffers.neighbors, segment.offset(sizeof(uint)), segment.size(sizeof(uint)));
+      glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 5, lead._similaritiesBuffers.similarities, segment.offset(sizeof(float)), segment.size(sizeof(float)));
+      glDispatchCompute(ceilDiv(segment.rowEnd - segment.rowBegin, 256u / 32u), 1, 1); // One warp/subgroup per datapoint
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    timer.tock();
+    glAssert();
+
+    for (uint r = 0; r < nReplicates; ++r) {
+      glCopyNamedBufferSubData(attractive, minimizations[r]->_buffers(BufferType::eAttractive), r * embeddingSize, 0, embeddingSize);
+      minimizations[r]->_attractiveBatched = true;
+    }
+    pool.release(embeddings);
+    pool.release(attractive);
+    glAssert();
+  }
+
+  // Minimizes a host copy of the embedding by negative sampling over a host copy of the graph, see
+  // util::NegativeSampler. Gradients and gains of the field-based descent are reset afterwards, so it can continue
+  template <uint D, uint DD>
+  void Minimization<D, DD>::compSampling() {
+    runtimeAssert(!_params->compressSimilarities && !_params->segmentedGraph, "Minimization::compSampling() requires uncompressed similarities within one storage block");
+
+    std::vector<uint> layout, neighbors;
+    std::vector<float> similarities;
+    _similarities->downloadGraph(layout, neighbors, similarities);
+
+    constexpr uint stride = sizeof(vec) / sizeof(float);
+    util::HostVector<float> embedding;
+    util::ThreadPool::instance().firstTouch(embedding, _params->n, stride);
+    glGetNamedBufferSubData(_buffers(BufferType::eEmbedding), 0, embedding.size() * sizeof(float), embedding.data());
+    glAssert();
+
+    util::NegativeSampler sampler(layout, neighbors, similarities, _params->samplingNegatives, _params->samplingExaggeration, _params->seed);
+    util::ProgressBar progressBar(prefix + "Sampling...");
+    const uint nEpochs = std::max(_params->samplingEpochs, 1u);
+    for (uint e = 0; e < nEpochs; ++e) {
+      const float learningRate = _params->samplingLearningRate * (1.f - static_cast<float>(e) / static_cast<float>(nEpochs));
+      sampler.epoch(embedding.data(), D, stride, learningRate);
+      if (e % 10 == 0) {
+        progressBar.setPostfix("Epoch " + std::to_string(e));
+        progressBar.setProgress(static_cast<float>(e) / static_cast<float>(nEpochs));
+      }
+    }
+    progressBar.setPostfix("Done");
+    progressBar.setProgress(1.0f);
+
+    const float one = 1.f;
+    glNamedBufferSubData(_buffers(BufferType::eEmbedding), 0, embedding.size() * sizeof(float), embedding.data());
+    glClearNamedBufferData(_buffers(BufferType::ePrevGradients), GL_R32F, GL_RED, GL_FLOAT, nullptr);
+    glClearNamedBufferData(_buffers(BufferType::eGain), GL_R32F, GL_RED, GL_FLOAT, &one);
+    glAssert();
+
+    _iteration = _params->iterations;
+    Logger::newl() << prefix << "Sampled " << nEpochs << " epochs, mean kernel " << sampler.meanKernel();
   }
 
   // Core function handling everything that needs to happen each frame
@@ -417,8 +1102,9 @@ namespace dh::sne {
 
     if(_embeddingRenderTask->getButtonPressed() == 1) {
       uint n = _params->n;
+      compactPCs(_buffers(BufferType::eSelection), n);
       _similarities->recomp(_buffers(BufferType::eSelection), _embeddingRenderTask->getPerplexity(), _embeddingRenderTask->getK());
-      _similaritiesBuffers = _similarities->getBuffers(); // Refresh buffer handles, because recomp() deletes and recreates buffers
+      refreshSimilarities();
       dh::util::BufferTools::instance().remove<float>(_buffers(BufferType::eEmbeddingRelative), n, D, _buffers(BufferType::eSelection));
       dh::util::BufferTools::instance().remove<float>(_buffers(BufferType::eWeights), n, 1, _buffers(BufferType::eSelection));
       dh::util::BufferTools::instance().remove<uint>(_buffers(BufferType::eLabels), n, 1, _buffers(BufferType::eSelection));
@@ -430,9 +1116,9 @@ namespace dh::sne {
       _embeddingRenderTask->setPointRadius(std::min(100.f / (nEnabled - _selectionCounts[0]), 0.005f));
       _embeddingRenderTask->setMinimizationBuffers(buffers()); // Update buffer handles, because BufferTools::remove() deletes and recreates buffers
       _attributeRenderTask->setMinimizationBuffers(buffers());
-      _attributeRenderTask->setSimilaritiesBuffers(_similaritiesBuffers);
       restartMinimization();
     }
+    if(_embeddingRenderTask->getButtonPressed() == 3) { compactDisabled(); } // Remove disabled
 
     int classToSelect = _attributeRenderTask->getClassButtonPressed();
     if(classToSelect >= 0) {
@@ -471,38 +1157,50 @@ namespace dh::sne {
   }
 
   template <uint D, uint DD>
-  void Minimization<D, DD>::compIterationMinimize() {
+  void Minimization<D, DD>::compBounds() {
+    auto& timer = _timers(TimerType::eBoundsComp);
+    timer.tick();
 
-    // 1.
-    // Compute embedding bounds
-    {
-      auto& timer = _timers(TimerType::eBoundsComp);
-      timer.tick();
+    auto& program = _programs(ProgramType::eBoundsComp);
+    program.bind();
 
-      auto& program = _programs(ProgramType::eBoundsComp);
-      program.bind();
+    // Set uniforms
+    program.template uniform<uint>("nPoints", _params->n);
 
-      // Set uniforms
-      program.template uniform<uint>("nPoints", _params->n);
+    // Set buffer bindings
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eEmbedding));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::eEmbeddingRelativeBeforeTranslation));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eTranslating));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffers(BufferType::eBoundsReduce));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _buffers(BufferType::eBounds));
 
-      // Set buffer bindings
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eEmbedding));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::eEmbeddingRelativeBeforeTranslation));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eTranslating));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffers(BufferType::eBoundsReduce));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _buffers(BufferType::eBounds));
+    // Dispatch shader
+    program.template uniform<uint>("iter", 0);
+    glDispatchCompute(128, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    program.template uniform<uint>("iter", 1);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-      // Dispatch shader
-      program.template uniform<uint>("iter", 0);
-      glDispatchCompute(128, 1, 1);
-      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-      program.template uniform<uint>("iter", 1);
-      glDispatchCompute(1, 1, 1);
-      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    timer.tock();
+    glAssert();
+  }
 
-      timer.tock();
-      glAssert();
-    }
+  // Field texture size, scaling the bounds; the nearest larger power of two for the field hierarchy
+  template <uint D, uint DD>
+  typename Minimization<D, DD>::uvec Minimization<D, DD>::fieldSize() const {
+    const vec range = _bounds.range();
+    const float ratio = _field.fieldScale() * ((D == 2) ? _params->fieldScaling2D : _params->fieldScaling3D);
+    uvec size = dh::util::max(uvec(range * ratio), uvec(fieldMinSize));
+    return uvec(glm::pow(2, glm::ceil(glm::log(static_cast<float>(size.x)) / glm::log(2.f))));
+  }
+
+  template <uint D, uint DD>
+  void Minimization<D, DD>::compIterationMinimize() {
+
+    // 1.
+    // Compute embedding bounds
+    compBounds();
     
     // Copy bounds back to host (hey look: an expensive thing I shouldn't be doing)
     _boundsPrev = _bounds;
@@ -510,18 +1208,7 @@ namespace dh::sne {
 
     // 2.
     // Perform field approximation in subcomponent
-    {
-      // Determine field texture size by scaling bounds
-      const vec range = _bounds.range();
-      const float ratio = (D == 2) ? _params->fieldScaling2D : _params->fieldScaling3D;
-      uvec size = dh::util::max(uvec(range * ratio), uvec(fieldMinSize));
-
-      // Size becomes nearest larger power of two for field hierarchy
-      size = uvec(glm::pow(2, glm::ceil(glm::log(static_cast<float>(size.x)) / glm::log(2.f))));
-
-      // Delegate to subclass
-      _field.comp(size, _iteration);
-    }
+    _field.comp(fieldSize(), _iteration);
 
     // 3.
     // Compute Z, ergo a reduction over q_{ij}
@@ -554,8 +1241,8 @@ namespace dh::sne {
     }
 
     // 4.
-    // Compute attractive forces
-    { 
+    // Compute attractive forces, unless compAttractiveBatch() did for this iteration
+    if (!std::exchange(_attractiveBatched, false)) {
       auto& timer = _timers(TimerType::eAttractiveComp);
       timer.tick();
 
@@ -563,22 +1250,27 @@ namespace dh::sne {
       program.bind();
       
       // Set uniforms
-      program.template uniform<uint>("nPos", _params->n);
       program.template uniform<float>("invPos", 1.f / static_cast<float>(_params->n));
       program.template uniform<float>("weightFalloff", _embeddingRenderTask->getWeightFalloff());
+      if (_params->compressSimilarities) { program.template uniform<bool>("offsets", _params->compressedOffsets); }
 
       // Set buffer bindings
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eEmbedding));
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::eFixed));
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eDisabled));
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffers(BufferType::eWeights));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _similaritiesBuffers.layout);  // n structs of two uints; the first is the offset into _similaritiesBuffers.neighbors where its kNN set starts, the second is the size of its kNN set
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _similaritiesBuffers.neighbors); // Each i's expanded neighbor set starts at eLayout[i].offset and contains eLayout[i].size neighbors, no longer including itself
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _similaritiesBuffers.similarities); // Corresponding similarities
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _similaritiesBuffers.layout);  // n structs of two uints; the first is the offset into _similaritiesBuffers.neighbors where its kNN set starts, counting from its segment's first edge, the second is the size of its kNN set
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _buffers(BufferType::eAttractive));
 
-      // Dispatch shader
-      glDispatchCompute(ceilDiv(_params->n, 256u / 32u), 1, 1); // One warp/subgroup per datapoint
+      // Dispatch shader once per graph segment, with its range of the neighbors and similarities bound
+      const ulong similarityBytes = _params->compressSimilarities ? sizeof(uint) / 2 : sizeof(float); // Compressed similarities are bfloat16 pairs
+      for (const GraphSegment& segment : _similaritiesBuffers.segments) {
+        program.template uniform<uint>("begin", segment.rowBegin);
+        program.template uniform<uint>("end", segment.rowEnd);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 5, _similaritiesBuffers.neighbors, segment.offset(sizeof(uint)), segment.size(sizeof(uint))); // Each i's expanded neighbor set starts at eLayout[i].offset and contains eLayout[i].size neighbors, no longer including itself
+        if (!_params->compressSimilarities || !_params->compressedOffsets) { glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 6, _similaritiesBuffers.similarities, segment.offset(similarityBytes), segment.size(similarityBytes)); } // Corresponding similarities, packed into neighbors if compressed with offsets
+        glDispatchCompute(ceilDiv(segment.rowEnd - segment.rowBegin, 256u / 32u), 1, 1); // One warp/subgroup per datapoint
+      }
       glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
       timer.tock();
@@ -593,6 +1285,9 @@ namespace dh::sne {
       float decay = 1.0f - static_cast<float>(_iteration - _removeExaggerationIter)
                          / static_cast<float>(_params->nExponentialDecayIters);
       exaggeration = 1.0f + (_params->exaggerationFactor - 1.0f) * decay;
+    } else if (_params->lateExaggerationFactor > 1.0f && _iteration >= _lateExaggerationIter
+               && _iteration < _lateExaggerationIter + _params->lateExaggerationIters) {
+      exaggeration = _params->lateExaggerationFactor;
     }
 
     // 5.
@@ -622,6 +1317,11 @@ namespace dh::sne {
       glAssert();
     }
 
+    // Gradients, Z and positions are consistent until the embedding is updated
+    if (_params->convergenceTolerance > 0.f && _convergenceReason.empty()) {
+      compConvergence();
+    }
+
     // Precompute instead of doing it in shader N times
     const float iterMult = (static_cast<double>(_iteration) < _params->momentumSwitchIter) 
                          ? _params->momentum 
@@ -695,7 +1395,7 @@ namespace dh::sne {
     // 8.
     // Compute neighborhood preservation per datapoint
     _colorMapping = _embeddingRenderTask->getColorMapping();
-    if(_colorMapping == 2 && _colorMappingPrev != 2) {
+    if(_colorMapping == 2 && _colorMappingPrev != 2 && !_params->compressSimilarities && !_params->segmentedGraph) { // Compressed or segmented neighbors are not read by the preservation shader
       // Compute approximate KNN of each point in embedding, delegated to FAISS
       std::vector<vec> embedding(_params->n);
       glGetNamedBufferSubData(_buffers(BufferType::eEmbedding), 0, _params->n * sizeof(vec), embedding.data());
@@ -755,6 +1455,93 @@ namespace dh::sne {
       util::ProgressBar progressBar(prefix + "Computing...", postfix);
       progressBar.setProgress(static_cast<float>(_iteration) / static_cast<float>(_params->iterations));
     }
+
+    // Stage a snapshot of the embedding if one is due; written out asynchronously
+    if (_snapshots.isInit()) {
+      _snapshots.comp(_iteration);
+    }
+  }
+
+  // Early termination, once exaggeration has decayed and momentum has switched. Every Params::convergenceInterval
+  // iterations, the KL divergence is estimated in O(n k) time from the field's approximation of Z, and the gradient
+  // norm and last step are reduced. Stops once the estimate improved too little over the last Params::convergenceWindow
+  // checks, the gradient norm fell far below its first checked value, or points barely moved. Late exaggeration worsens
+  // the estimate, so is not checked; if the minimization converges before it, it starts at once, and stops after it
+  template <uint D, uint DD>
+  void Minimization<D, DD>::compConvergence() {
+    const bool isLate = _params->lateExaggerationFactor > 1.0f;
+    if (isLate && _iteration >= _lateExaggerationIter) {
+      const uint end = _lateExaggerationIter + _params->lateExaggerationIters;
+      if (end < _params->iterations && _iteration + 1 >= end) {
+        std::stringstream reason;
+        reason << "converged at iteration " << _lateExaggerationIter - 1 << ", followed by " << _params->lateExaggerationIters << " iterations of late exaggeration";
+        _convergenceReason = reason.str();
+      }
+      return;
+    }
+    const uint begin = std::max(_removeExaggerationIter + _params->nExponentialDecayIters, _params->momentumSwitchIter) + 1;
+    if (_iteration < begin || (_iteration - begin) % _params->convergenceInterval != 0) {
+      return;
+    }
+
+    // Reduce squared gradient norms and squared steps
+    {
+      auto& program = _programs(ProgramType::eConvergenceComp);
+      program.bind();
+
+      // Set uniforms
+      program.template uniform<uint>("nPoints", _params->n);
+
+      // Set buffer bindings
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eGradients));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::ePrevGradients));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eDisabled));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffers(BufferType::eConvergenceReduce));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _buffers(BufferType::eConvergence));
+
+      // Dispatch shader
+      program.template uniform<uint>("iter", 0);
+      glDispatchCompute(128, 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      program.template uniform<uint>("iter", 1);
+      glDispatchCompute(1, 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      glAssert();
+    }
+    std::array<float, 2> sums;
+    glGetNamedBufferSubData(_buffers(BufferType::eConvergence), 0, sizeof(sums), sums.data());
+
+    // Root mean square gradient, and root mean square step relative to the embedding's extent
+    const float extent = glm::length(_bounds.range());
+    ConvergenceCheck check = {
+      _klDivergence.compApprox(_buffers(BufferType::eZ)),
+      std::sqrt(sums[0] / _params->n),
+      extent > 0.f ? std::sqrt(sums[1] / _params->n) / extent : 0.f
+    };
+    if (_convergenceChecks.empty()) {
+      _convergenceGradientNorm = check.gradientNorm;
+    }
+    _convergenceChecks.push_back(check);
+    if (_convergenceChecks.size() > _params->convergenceWindow + 1) {
+      _convergenceChecks.pop_front();
+    }
+
+    std::stringstream reason;
+    const uint window = (_convergenceChecks.size() - 1) * _params->convergenceInterval;
+    const float improvement = (_convergenceChecks.front().kld - check.kld) / std::abs(check.kld);
+    if (_convergenceChecks.size() > _params->convergenceWindow && improvement < _params->convergenceTolerance) {
+      reason << "KL divergence estimate " << check.kld << " improved by " << improvement * 100.f << "% over " << window << " iterations";
+    } else if (check.gradientNorm < _params->convergenceGradient * _convergenceGradientNorm) {
+      reason << "gradient norm fell to " << check.gradientNorm / _convergenceGradientNorm * 100.f << "% of its value at iteration " << begin;
+    } else if (check.movement < _params->convergenceMovement) {
+      reason << "points moved " << check.movement * 100.f << "% of the embedding's extent per iteration";
+    }
+    if (isLate && !reason.str().empty()) {
+      Logger::newl() << prefix << "Converged at iteration " << _iteration << ", " << reason.str() << "; starting late exaggeration";
+      _lateExaggerationIter = _iteration + 1;
+      return;
+    }
+    _convergenceReason = reason.str();
   }
 
   template <uint D, uint DD>
@@ -22,15 +22,30 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <random>
 #include <resource_embed/resource_embed.hpp>
 #include "dh/sne/components/similarities.hpp"
 #include "dh/util/logger.hpp"
 #include "dh/util/gl/error.hpp"
 #include "dh/util/gl/metric.hpp"
 #include "dh/util/gl/buffertools.hpp"
+#include "dh/util/gl/buffer_pool.hpp"
 #include "dh/util/io.hpp"
 #include "dh/util/cu/inclusive_scan.cuh"
 #include "dh/util/cu/knn.cuh"
+#include "dh/util/cu/blocked_knn.cuh"
+#include "dh/util/sparse_knn.hpp"
+#include "dh/util/random_walk.hpp"
+#include "dh/util/reorder.hpp"
+#include "dh/util/sparsify.hpp"
+#include "dh/util/symmetrize.hpp"
+#include "dh/util/thread_pool.hpp"
 #include <typeinfo> //
 #include <numeric> //
 #include <imgui.h> //
@@ -43,50 +58,78 @@ namespace dh::sne {
   using util::Logger;
   const std::string prefix = util::genLoggerPrefix("[Similarities]");
 
+  // Constants
+  constexpr uint landmarkVisitLength = 16; // Steps of the single walk per point counting visits, for Params::landmarkSelection "walk"
+
   float Similarities::average(std::vector<float> vec) {
     return std::accumulate(vec.begin(), vec.end(), 0.f) / vec.size();
   }
   
   Similarities::Similarities()
-  : _isInit(false), _dataPtr(nullptr) {
+  : _isInit(false), _dataPtr(nullptr), _knnK(0) {
     // ...
   }
 
   Similarities::Similarities(const float* dataPtr, Params* params)
-  : _isInit(false), _dataPtr(dataPtr), _params(params) {
+  : _isInit(false), _dataPtr(dataPtr), _params(params), _knnK(0) {
     Logger::newt() << prefix << "Initializing...";
 
-    // Initialize shader programs
-    {
-      _programs(ProgramType::eSimilaritiesComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/similarities.comp"));
-      _programs(ProgramType::eExpandComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/expand.comp"));
-      _programs(ProgramType::eLayoutComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/layout.comp"));
-      _programs(ProgramType::eNeighborsComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/neighbors.comp"));
-      _programs(ProgramType::eNeighborsSortComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/neighbors_sort.comp"));
-      _programs(ProgramType::eL1DistancesComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/L1_distances.comp"));
-      _programs(ProgramType::eWeighSimilaritiesComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/weigh_similarities.comp"));
-      _programs(ProgramType::eWeighSimilaritiesPerAttributeRatioComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/weigh_similarities_per_attr_ratio.comp"));
-      _programs(ProgramType::eWeighSimilaritiesPerAttributeRangeComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/weigh_similarities_per_attr_range.comp"));
-      _programs(ProgramType::eWeighSimilaritiesPerAttributeResembleComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/weigh_similarities_per_attr_resemble.comp"));
-      _programs(ProgramType::eSubDistancesL1Comp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/subdistances.comp"));
+    initPrograms();
 
-      for (auto& program : _programs) {
-        program.link();
+    // Out-of-core input is left where it is, as the KNN search streams it. It provides no per-attribute features
+    if (_params->knnBlockSize > 0) {
+      _params->disablePCA = true;
+    }
+
+    // Create and initialize buffers
+    glCreateBuffers(_buffers.size(), _buffers.data());
+    {
+      if (_params->knnBlockSize == 0) {
+        const ulong nValues = static_cast<ulong>(_params->n) * _params->nHighDims;
+        util::glAssertStorageSize(nValues, sizeof(float), "Similarities: dataset");
+
+        // The normalization is kept, so points added later are normalized the same way
+        util::HostVector<float> data;
+        util::ThreadPool::instance().firstTouch(data, _params->n, _params->nHighDims);
+        dh::util::computeNormalization(dataPtr, _params->n, _params->nHighDims, _params->uniformDims || _params->imageDataset, _mins, _scales);
+        dh::util::applyNormalization(dataPtr, _params->n, _params->nHighDims, _mins, _scales, data.data());
+        glNamedBufferStorage(_buffers(BufferType::eDataset), nValues * sizeof(float), data.data(), 0);
       }
+
+      const std::vector<float> ones(_params->nHighDims, 1.0f);
+      glNamedBufferStorage(_buffers(BufferType::eLayout), _params->n * 2 * sizeof(uint), nullptr, 0); // n structs of two uints; the first is its expanded neighbor set offset (eScan[i - 1]), the second is its expanded neighbor set size (eScan[i] - eScan[i - 1])
+      glNamedBufferStorage(_buffers(BufferType::eAttributeWeights), _params->nHighDims * sizeof(float), ones.data(), GL_DYNAMIC_STORAGE_BIT);
       glAssert();
     }
 
+    _isInit = true;
+    Logger::rest() << prefix << "Initialized";
+
+    dh::util::BufferTools::instance().init();
+  }
+
+  Similarities::Similarities(util::CSRMatrix&& data, Params* params)
+  : _isInit(false), _dataPtr(nullptr), _params(params), _sparseData(std::move(data)), _knnK(0) {
+    Logger::newt() << prefix << "Initializing...";
+
+    runtimeAssert(_sparseData.nRows == _params->n && _sparseData.nCols == _params->nHighDims, "Similarities: sparse input does not match params");
+    util::glAssertStorageSize(_sparseData.nnz(), sizeof(float), "Similarities: sparse dataset");
+    runtimeAssert(!_params->imageDataset, "Similarities: sparse input cannot be an image dataset");
+    _params->sparseData = true;
+    _params->disablePCA = true; // PCA would densify the input
+    _params->knnBlockSize = 0; // Sparse input is small enough to be held in memory
+
+    // Dividing by the largest absolute value instead of min-max scaling keeps zeros zero
+    dh::util::normalizeData(_sparseData, _params->uniformDims || _params->imageDataset);
+
+    initPrograms();
+
     // Create and initialize buffers
     glCreateBuffers(_buffers.size(), _buffers.data());
     {
       const std::vector<float> ones(_params->nHighDims, 1.0f);
-      std::vector<float> data;
-      data.assign(dataPtr, dataPtr + _params->n * _params->nHighDims);
-      if(_params->uniformDims || _params->imageDataset) { dh::util::normalizeData(data, _params->n, _params->nHighDims); }
-      else { dh::util::normalizeDataNonUniformDims(data, _params->n, _params->nHighDims); }
-
-      glNamedBufferStorage(_buffers(BufferType::eDataset), _params->n * _params->nHighDims * sizeof(float), data.data(), 0);
-      glNamedBufferStorage(_buffers(BufferType::eLayout), _params->n * 2 * sizeof(uint), nullptr, 0); // n structs of two uints; the first is its expanded neighbor set offset (eScan[i - 1]), the second is its expanded neighbor set size (eScan[i] - eScan[i - 1])
+      uploadSparseData();
+      glNamedBufferStorage(_buffers(BufferType::eLayout), _params->n * 2 * sizeof(uint), nullptr, 0);
       glNamedBufferStorage(_buffers(BufferType::eAttributeWeights), _params->nHighDims * sizeof(float), ones.data(), GL_DYNAMIC_STORAGE_BIT);
       glAssert();
     }
@@ -97,9 +140,605 @@ namespace dh::sne {
     dh::util::BufferTools::instance().init();
   }
 
+  Similarities::Similarities(Similarities& reference, const float* dataPtr, Params* params)
+  : _isInit(false), _dataPtr(dataPtr), _params(params), _knnK(0) {
+    Logger::newt() << prefix << "Initializing...";
+
+    const Params* refParams = reference._params;
+    runtimeAssert(reference.isInit() && !reference._mins.empty(), "Similarities: reference was not computed from a dense dataset");
+    runtimeAssert(!refParams->sparseData && refParams->knnBlockSize == 0 && !refParams->compressSimilarities, "Similarities: reference dataset must be dense, held on the device and uncompressed");
+    runtimeAssert(_params->n > 0 && _params->nHighDims == refParams->nHighDims, "Similarities: points do not match reference params");
+    _params->segmentedGraph = false; // New points have k neighbors each, but are few
+
+    initPrograms();
+
+    const uint nReference = refParams->n;
+    const uint n = _params->n;
+    const uint k = refParams->k - 1; // New points are not in the reference, so have no first neighbor that is the point itself
+    const uint d = _params->nHighDims;
+    const ulong nValues = static_cast<ulong>(n) * d;
+    const ulong nNeighbors = static_cast<ulong>(n) * k;
+    util::glAssertStorageSize(nValues, sizeof(float), "Similarities: dataset");
+    util::glAssertStorageSize(nNeighbors, sizeof(float), "Similarities: KNN");
+    _symmetricSize = nNeighbors;
+
+    // Normalize new points as the reference points were, so that both are searched in the same space
+    util::HostVector<float> data;
+    util::ThreadPool::instance().firstTouch(data, n, d);
+    dh::util::applyNormalization(dataPtr, n, d, reference._mins, reference._scales, data.data());
+
+    // Point i's neighbors, which index the reference points, start at i * k
+    std::vector<uint> layout(2 * n);
+    for (uint i = 0; i < n; ++i) {
+      layout[2 * i] = i * k;
+      layout[2 * i + 1] = k;
+    }
+
+    // Create and initialize buffers; the dataset holds the new points only
+    glCreateBuffers(_buffers.size(), _buffers.data());
+    {
+      const std::vector<float> ones(d, 1.0f);
+      const std::vector<float> zeroes(nNeighbors, 0.f);
+      glNamedBufferStorage(_buffers(BufferType::eDataset), nValues * sizeof(float), data.data(), 0);
+      glNamedBufferStorage(_buffers(BufferType::eLayout), layout.size() * sizeof(uint), layout.data(), 0);
+      glNamedBufferStorage(_buffers(BufferType::eSimilarities), nNeighbors * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+      glNamedBufferStorage(_buffers(BufferType::eSimilaritiesOriginal), nNeighbors * sizeof(float), nullptr, 0);
+      glNamedBufferStorage(_buffers(BufferType::eDistancesL1), nNeighbors * sizeof(float), zeroes.data(), 0);
+      glNamedBufferStorage(_buffers(BufferType::eNeighborsSelected), nNeighbors * sizeof(uint), nullptr, 0);
+      glNamedBufferStorage(_buffers(BufferType::eAttributeWeights), d * sizeof(float), ones.data(), GL_DYNAMIC_STORAGE_BIT);
+      glAssert();
+    }
+
+    // Search the KNN of each new point among the reference points, through the reference's kept index, which is only
+    // built here if it has none over its current points, and is then kept for later transforms and insert(). The
+    // reference is reordered if Params::reorderPoints, and its neighbor indices then follow the minimization's order
+    if (!reference._knnIndex.isInit() || reference._knnIndex.size() != nReference) {
+      reference._knnIndex = util::KNNIndex(reference._buffers(BufferType::eDataset), 0, nReference, d);
+    }
+    std::vector<float> distances;
+    std::vector<uint> indices;
+    reference._knnIndex.search(_buffers(BufferType::eDataset), 0, n, k, distances, indices);
+
+    // Neighbors the approximate search did not fill repeat the last found one, at its distance
+    for (uint i = 0; i < n; ++i) {
+      for (uint l = 1; l < k; ++l) {
+        const ulong il = static_cast<ulong>(i) * k + l;
+        if (indices[il] >= nReference) {
+          indices[il] = indices[il - 1];
+          distances[il] = distances[il - 1];
+        }
+      }
+    }
+    glNamedBufferStorage(_buffers(BufferType::eNeighbors), nNeighbors * sizeof(uint), indices.data(), 0);
+    glAssert();
+
+    // Compute p_j|i at the reference's perplexity. These are not symmetrized, as the reference points do not move
+    {
+      auto& pool = util::GLBufferPool::instance();
+      GLuint distancesBuffer = pool.acquire(nNeighbors * sizeof(float));
+      glNamedBufferSubData(distancesBuffer, 0, nNeighbors * sizeof(float), distances.data());
+      glAssert();
+
+      auto& program = _programs(ProgramType::eSimilaritiesComp);
+      program.bind();
+
+      program.template uniform<uint>("nPoints", n);
+      program.template uniform<uint>("kNeighbors", k);
+      program.template uniform<float>("perplexity", refParams->perplexity);
+      program.template uniform<uint>("nIters", 200);
+      program.template uniform<float>("epsilon", 1e-4);
+      program.template uniform<uint>("firstNeighbor", 0);
+
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eNeighbors));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, distancesBuffer);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eSimilarities));
+
+      glDispatchCompute(ceilDiv(n, 256u), 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      glCopyNamedBufferSubData(_buffers(BufferType::eSimilarities), _buffers(BufferType::eSimilaritiesOriginal), 0, 0, nNeighbors * sizeof(float));
+      glAssert();
+
+      pool.release(distancesBuffer);
+    }
+
+    _isInit = true;
+    Logger::rest() << prefix << "Initialized";
+  }
+
+  Similarities::Similarities(const Similarities& reference, const std::vector<uint>& landmarks, const util::CSRMatrix& walks, Params* params)
+  : _isInit(false), _dataPtr(nullptr), _params(params), _knnK(0) {
+    Logger::newt() << prefix << "Initializing...";
+
+    const Params* refParams = reference._params;
+    runtimeAssert(reference.isInit() && walks.nRows == refParams->n && walks.nCols == landmarks.size(), "Similarities: walks do not match reference");
+    runtimeAssert(_params->n == landmarks.size() && _params->nHighDims == refParams->nHighDims, "Similarities: landmarks do not match params");
+    _params->reorderPoints = false; // Landmarks follow the reference's order
+    _params->compressSimilarities = false;
+    _params->segmentedGraph = false;
+    _params->keepKNN = false;
+
+    initPrograms();
+
+    // p_j|i is the fraction of landmark i's walks that ended at landmark j. These are symmetrized as comp() does,
+    // so that each row holds 0.5 * (p_j|i + p_i|j); both directions of each edge are gathered, then merged per row
+    const uint n = _params->n;
+    std::vector<uint> layout(2 * n, 0);
+    for (uint i = 0; i < n; ++i) {
+      for (size_t ij = walks.offsets[landmarks[i]]; ij < walks.offsets[landmarks[i] + 1]; ++ij) {
+        ++layout[2 * i + 1];
+        ++layout[2 * walks.indices[ij] + 1];
+      }
+    }
+    ulong nEdges = 0;
+    for (uint i = 0; i < n; ++i) {
+      layout[2 * i] = static_cast<uint>(nEdges);
+      nEdges += layout[2 * i + 1];
+      layout[2 * i + 1] = 0;
+    }
+    util::glAssertStorageSize(nEdges, sizeof(float), "Similarities: landmark neighbors");
+    std::vector<std::pair<uint, float>> edges(nEdges);
+    for (uint i = 0; i < n; ++i) {
+      for (size_t ij = walks.offsets[landmarks[i]]; ij < walks.offsets[landmarks[i] + 1]; ++ij) {
+        const uint j = walks.indices[ij];
+        const float p = 0.5f * walks.values[ij];
+        edges[layout[2 * i] + layout[2 * i + 1]++] = { j, p };
+        edges[layout[2 * j] + layout[2 * j + 1]++] = { i, p };
+      }
+    }
+    std::vector<uint> neighbors;
+    std::vector<float> similarities;
+    neighbors.reserve(nEdges);
+    similarities.reserve(nEdges);
+    for (uint i = 0; i < n; ++i) {
+      const auto begin = edges.begin() + layout[2 * i];
+      const auto end = begin + layout[2 * i + 1];
+      std::sort(begin, end, [](const auto& a, const auto& b) { return a.first < b.first; });
+      layout[2 * i] = static_cast<uint>(neighbors.size());
+      for (auto it = begin; it != end; ++it) {
+        if (it != begin && it->first == neighbors.back()) {
+          similarities.back() += it->second;
+        } else {
+          neighbors.push_back(it->first);
+          similarities.push_back(it->second);
+        }
+      }
+      layout[2 * i + 1] = static_cast<uint>(neighbors.size()) - layout[2 * i];
+    }
+
+    // Create and initialize buffers
+    glCreateBuffers(_buffers.size(), _buffers.data());
+    createGraphBuffers(layout, neighbors, similarities);
+
+    // The landmarks' rows of the dataset, normalized as the reference's were. Reference rows follow its point order,
+    // like the landmarks; dense host input is read in input order. Out-of-core input provides no dataset
+    const uint d = _params->nHighDims;
+    if (refParams->sparseData) {
+      const util::CSRMatrix& data = reference._sparseData;
+      _sparseData.nRows = n;
+      _sparseData.nCols = data.nCols;
+      _sparseData.offsets.resize(static_cast<ulong>(n) + 1, 0);
+      for (uint i = 0; i < n; ++i) {
+        const size_t begin = data.offsets[landmarks[i]];
+        const size_t end = data.offsets[landmarks[i] + 1];
+        _sparseData.indices.insert(_sparseData.indices.end(), data.indices.begin() + begin, data.indices.begin() + end);
+        _sparseData.values.insert(_sparseData.values.end(), data.values.begin() + begin, data.values.begin() + end);
+        _sparseData.offsets[i + 1] = _sparseData.values.size();
+      }
+      uploadSparseData();
+    } else if (refParams->knnBlockSize == 0) {
+      runtimeAssert(reference._dataPtr != nullptr && !reference._mins.empty(), "Similarities: reference holds no dense dataset");
+      const auto& permutation = reference._permutation;
+      std::vector<float> rows(static_cast<ulong>(n) * d);
+      std::vector<float> data(rows.size());
+      util::ThreadPool::instance().parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          const ulong iRef = permutation.empty() ? landmarks[i] : permutation[landmarks[i]];
+          std::memcpy(&rows[i * d], &reference._dataPtr[iRef * d], d * sizeof(float));
+        }
+      });
+      _mins = reference._mins;
+      _scales = reference._scales;
+      dh::util::applyNormalization(rows.data(), n, d, _mins, _scales, data.data());
+      glNamedBufferStorage(_buffers(BufferType::eDataset), data.size() * sizeof(float), data.data(), 0);
+      glAssert();
+    }
+
+    _isInit = true;
+    Logger::rest() << prefix << "Initialized";
+  }
+
+  Similarities::Similarities(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& similarities, Params* params)
+  : _isInit(false), _dataPtr(nullptr), _params(params), _knnK(0) {
+    Logger::newt() << prefix << "Initializing...";
+
+    runtimeAssert(layout.size() == 2 * static_cast<ulong>(_params->n) && neighbors.size() == similarities.size(), "Similarities: graph does not match params");
+    util::glAssertStorageSize(neighbors.size(), sizeof(float), "Similarities: neighbors");
+    _params->sparseData = false;
+    _params->reorderPoints = false;
+    _params->compressSimilarities = false;
+    _params->segmentedGraph = false;
+    _params->keepKNN = false;
+
+    initPrograms();
+
+    // The dataset is left without storage, as there are no input rows to go with the points
+    glCreateBuffers(_buffers.size(), _buffers.data());
+    createGraphBuffers(layout, neighbors, similarities);
+
+    _isInit = true;
+    Logger::rest() << prefix << "Initialized";
+  }
+
+  // Creates graph buffers from a host copy, for similarities that were not computed by comp()
+  void Similarities::createGraphBuffers(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& similarities) {
+    _symmetricSize = neighbors.size();
+    const ulong storageSize = std::max<ulong>(_symmetricSize, 1); // Avoid zero-sized storage for a graph without edges
+    const std::vector<float> ones(_params->nHighDims, 1.0f);
+    const std::vector<float> zeroes(storageSize, 0.f);
+    glNamedBufferStorage(_buffers(BufferType::eLayout), layout.size() * sizeof(uint), layout.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eNeighbors), storageSize * sizeof(uint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(_buffers(BufferType::eSimilarities), storageSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(_buffers(BufferType::eSimilaritiesOriginal), storageSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferSubData(_buffers(BufferType::eNeighbors), 0, _symmetricSize * sizeof(uint), neighbors.data());
+    glNamedBufferSubData(_buffers(BufferType::eSimilarities), 0, _symmetricSize * sizeof(float), similarities.data());
+    glNamedBufferSubData(_buffers(BufferType::eSimilaritiesOriginal), 0, _symmetricSize * sizeof(float), similarities.data());
+    glNamedBufferStorage(_buffers(BufferType::eDistancesL1), storageSize * sizeof(float), zeroes.data(), 0); // Left zero, as for out-of-core input
+    glNamedBufferStorage(_buffers(BufferType::eNeighborsSelected), storageSize * sizeof(uint), nullptr, 0);
+    glNamedBufferStorage(_buffers(BufferType::eAttributeWeights), _params->nHighDims * sizeof(float), ones.data(), GL_DYNAMIC_STORAGE_BIT);
+    glAssert();
+  }
+
+  void Similarities::uploadSparseData() {
+    // Offsets are 64-bit on the host, but fit 32 bits on the device as nnz is bounded by 32-bit shader indexing
+    const std::vector<uint> offsets(_sparseData.offsets.begin(), _sparseData.offsets.end());
+    const size_t nnz = std::max(_sparseData.nnz(), size_t(1)); // Avoid zero-sized storage for an all-zero input
+    glNamedBufferStorage(_buffers(BufferType::eDataset), nnz * sizeof(float), _sparseData.nnz() ? _sparseData.values.data() : nullptr, 0);
+    glNamedBufferStorage(_buffers(BufferType::eDatasetOffsets), offsets.size() * sizeof(uint), offsets.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eDatasetIndices), nnz * sizeof(uint), _sparseData.nnz() ? _sparseData.indices.data() : nullptr, 0);
+    glAssert();
+  }
+
+  void Similarities::reorder() {
+    const uint n = _params->n;
+
+    // Copy symmetrized KNN graph to host
+    std::vector<uint> layout(2 * n);
+    std::vector<uint> neighbors(_symmetricSize);
+    std::vector<float> similarities(_symmetricSize);
+    glGetNamedBufferSubData(_buffers(BufferType::eLayout), 0, layout.size() * sizeof(uint), layout.data());
+    glGetNamedBufferSubData(_buffers(BufferType::eNeighbors), 0, neighbors.size() * sizeof(uint), neighbors.data());
+    glGetNamedBufferSubData(_buffers(BufferType::eSimilarities), 0, similarities.size() * sizeof(float), similarities.data());
+    glAssert();
+
+    _permutation = util::reverseCuthillMcKee(layout, neighbors);
+    const std::vector<uint> inverse = util::invertPermutation(_permutation);
+
+    // Move each neighbor set to its point's new position and renumber its neighbors, keeping them sorted
+    std::vector<uint> layoutReordered(2 * n);
+    std::vector<uint> neighborsReordered(_symmetricSize);
+    std::vector<float> similaritiesReordered(_symmetricSize);
+    std::vector<std::pair<uint, float>> set;
+    uint offset = 0;
+    for (uint i = 0; i < n; ++i) {
+      const uint iOld = _permutation[i];
+      const uint begin = layout[2 * iOld];
+      const uint size = layout[2 * iOld + 1];
+      set.resize(size);
+      for (uint j = 0; j < size; ++j) {
+        set[j] = { inverse[neighbors[begin + j]], similarities[begin + j] };
+      }
+      std::sort(set.begin(), set.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+      for (uint j = 0; j < size; ++j) {
+        neighborsReordered[offset + j] = set[j].first;
+        similaritiesReordered[offset + j] = set[j].second;
+      }
+      layoutReordered[2 * i] = offset;
+      layoutReordered[2 * i + 1] = size;
+      offset += size;
+    }
+
+    // Replace device copies; layout and neighbors have immutable storage, so are recreated
+    glDeleteBuffers(1, &_buffers(BufferType::eLayout));
+    glCreateBuffers(1, &_buffers(BufferType::eLayout));
+    glNamedBufferStorage(_buffers(BufferType::eLayout), layoutReordered.size() * sizeof(uint), layoutReordered.data(), 0);
+    glDeleteBuffers(1, &_buffers(BufferType::eNeighbors));
+    glCreateBuffers(1, &_buffers(BufferType::eNeighbors));
+    glNamedBufferStorage(_buffers(BufferType::eNeighbors), neighborsReordered.size() * sizeof(uint), neighborsReordered.data(), 0);
+    glNamedBufferSubData(_buffers(BufferType::eSimilarities), 0, similaritiesReordered.size() * sizeof(float), similaritiesReordered.data());
+    glAssert();
+
+    // Cached KNN results follow the new order, so later recomp(perplexity) calls can still use them. The index
+    // holds points in the old order, and is built again by insert() if needed
+    _knnIndex = util::KNNIndex();
+    if (_knnK > 0) {
+      std::vector<float> distances(_knnDistances.size());
+      std::vector<uint> indices(_knnIndices.size());
+      util::ThreadPool::instance().parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          const ulong iOld = _permutation[i];
+          for (ulong l = 0; l < _knnK; ++l) {
+            distances[i * _knnK + l] = _knnDistances[iOld * _knnK + l];
+            indices[i * _knnK + l] = inverse[_knnIndices[iOld * _knnK + l]];
+          }
+        }
+      });
+      _knnDistances = std::move(distances);
+      _knnIndices = std::move(indices);
+    }
+
+    // Reorder dataset as well; out-of-core input has no device copy
+    if (_params->sparseData) {
+      util::permuteRows(_sparseData, _permutation);
+      std::array<GLuint, 3> handles = { _buffers(BufferType::eDataset), _buffers(BufferType::eDatasetOffsets), _buffers(BufferType::eDatasetIndices) };
+      glDeleteBuffers(handles.size(), handles.data());
+      glCreateBuffers(1, &_buffers(BufferType::eDataset));
+      glCreateBuffers(1, &_buffers(BufferType::eDatasetOffsets));
+      glCreateBuffers(1, &_buffers(BufferType::eDatasetIndices));
+      uploadSparseData();
+    } else if (_params->knnBlockSize == 0) {
+      util::HostVector<float> data;
+      util::ThreadPool::instance().firstTouch(data, n, _params->nHighDims);
+      glGetNamedBufferSubData(_buffers(BufferType::eDataset), 0, data.size() * sizeof(float), data.data());
+      util::permuteRows(data, _params->nHighDims, _permutation);
+      glDeleteBuffers(1, &_buffers(BufferType::eDataset));
+      glCreateBuffers(1, &_buffers(BufferType::eDataset));
+      glNamedBufferStorage(_buffers(BufferType::eDataset), data.size() * sizeof(float), data.data(), 0);
+      glAssert();
+    }
+  }
+
+  // Prunes the symmetrized KNN graph through util::pruneGraph(), so that fewer edges are read by the attractive
+  // force computation and everything else iterating over neighbors. Similarities are renormalized to their
+  // original total, so they still sum to the same joint distribution
+  void Similarities::prune() {
+    std::vector<uint> layout, neighbors;
+    std::vector<float> similarities;
+    readGraph(layout, neighbors, similarities);
+
+    std::vector<uint> layoutPruned, neighborsPruned;
+    std::vector<float> similaritiesPruned;
+    const float kept = util::pruneGraph(layout, neighbors, similarities, _params->pruneThreshold, _params->pruneMass,
+                                        layoutPruned, neighborsPruned, similaritiesPruned);
+    const uint symmetricSize = std::max(static_cast<uint>(neighborsPruned.size()), 1u); // Avoid zero-sized storage for a graph without edges
+    Logger::curt() << prefix << "Pruned " << _symmetricSize - neighborsPruned.size() << " of " << _symmetricSize
+                   << " neighbors, keeping " << 100.f * kept << "% of similarity";
+
+    // Replace device copies; storage is immutable, so buffers are recreated
+    std::array<GLuint, 3> handles = { _buffers(BufferType::eLayout), _buffers(BufferType::eNeighbors), _buffers(BufferType::eSimilarities) };
+    glDeleteBuffers(handles.size(), handles.data());
+    glCreateBuffers(1, &_buffers(BufferType::eLayout));
+    glCreateBuffers(1, &_buffers(BufferType::eNeighbors));
+    glCreateBuffers(1, &_buffers(BufferType::eSimilarities));
+    glNamedBufferStorage(_buffers(BufferType::eLayout), layoutPruned.size() * sizeof(uint), layoutPruned.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eNeighbors), symmetricSize * sizeof(uint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(_buffers(BufferType::eSimilarities), symmetricSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferSubData(_buffers(BufferType::eNeighbors), 0, neighborsPruned.size() * sizeof(uint), neighborsPruned.data());
+    glNamedBufferSubData(_buffers(BufferType::eSimilarities), 0, similaritiesPruned.size() * sizeof(float), similaritiesPruned.data());
+    glAssert();
+    _symmetricSize = neighborsPruned.size();
+  }
+
+  // Accumulates L1 distances along the edges of the graph into zeroed eDistancesL1
+  // Sparse input merges both rows' nonzeros in a single pass, so needs no batching over attributes
+  // Out-of-core input has no dataset on the device, and leaves them zero
+  // A compressed or segmented graph has no L1 distances at all
+  void Similarities::compL1Distances() {
+    if (_params->sparseData && !_params->compressSimilarities && !_params->segmentedGraph) {
+      auto &program = _programs(ProgramType::eL1DistancesComp);
+      program.bind();
+
+      program.template uniform<uint>("nPoints", _params->n);
+
+      // Set buffer bindings
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eDataset));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::eLayout));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eNeighbors));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffers(BufferType::eDistancesL1));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _buffers(BufferType::eDatasetOffsets));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _buffers(BufferType::eDatasetIndices));
+
+      glDispatchCompute(ceilDiv(_params->n, 256u / 32u), 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      glAssert();
+    } else if (_params->knnBlockSize == 0 && !_params->compressSimilarities && !_params->segmentedGraph) {
+      auto &program = _programs(ProgramType::eL1DistancesComp);
+      program.bind();
+
+      program.template uniform<uint>("nPoints", _params->n);
+      program.template uniform<uint>("nHighDims", _params->nHighDims);
+
+      // Set buffer bindings
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eDataset));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::eLayout));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eNeighbors));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffers(BufferType::eDistancesL1));
+
+      // Dispatch shader in batches of batchSize attriibutes
+      uint batchSize = 5;
+      for(uint b = 0; b * batchSize < _params->nHighDims; ++b) {
+        program.template uniform<uint>("batchBegin", b * batchSize);
+        program.template uniform<uint>("batchEnd", std::min((b+1) * batchSize, (uint) _params->nHighDims));
+        glDispatchCompute(ceilDiv(_params->n, 256u / 32u), 1, 1);
+        glFinish();
+        glAssert();
+      }
+    }
+  }
+
+  // Similarities are rounded to bfloat16, to nearest even. If each neighbor j of i lies within a 16-bit signed offset
+  // j - i, as is likely after reordering, the offset is packed with the similarity into 32 bits per edge. Otherwise
+  // neighbors keep their 32-bit indices and similarities are packed in pairs, for 48 bits per edge at any size
+  void Similarities::compress() {
+    const uint n = _params->n;
+    const ulong size = _symmetricSize;
+
+    // Copy symmetrized KNN graph to host
+    std::vector<uint> layout, neighbors;
+    std::vector<float> similarities;
+    readGraph(layout, neighbors, similarities);
+    const auto toBfloat16 = [&](ulong ij) {
+      uint bits;
+      std::memcpy(&bits, &similarities[ij], sizeof(uint));
+      return (bits + 0x7FFFu + ((bits >> 16) & 1u)) >> 16;
+    };
+
+    auto& pool = util::ThreadPool::instance();
+    const bool fits = pool.parallelReduce(0, n, 0, 1u, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        for (ulong ij = layout[2 * i]; ij < layout[2 * i] + layout[2 * i + 1]; ++ij) {
+          const std::int64_t offset = static_cast<std::int64_t>(neighbors[ij]) - static_cast<std::int64_t>(i);
+          if (offset < std::numeric_limits<std::int16_t>::min() || offset > std::numeric_limits<std::int16_t>::max()) {
+            return 0u;
+          }
+        }
+      }
+      return 1u;
+    }, [](uint a, uint b) { return a & b; });
+    _params->compressedOffsets = fits;
+
+    if (fits) {
+      // Pack offset in the upper half and the similarity in the lower half, replacing neighbors
+      std::vector<uint> packed(size);
+      pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          for (ulong ij = layout[2 * i]; ij < layout[2 * i] + layout[2 * i + 1]; ++ij) {
+            const uint offset = (neighbors[ij] - static_cast<uint>(i)) & 0xFFFFu; // Two's complement of the offset
+            packed[ij] = (offset << 16) | toBfloat16(ij);
+          }
+        }
+      });
+      glDeleteBuffers(1, &_buffers(BufferType::eNeighbors));
+      glCreateBuffers(1, &_buffers(BufferType::eNeighbors));
+      glNamedBufferStorage(_buffers(BufferType::eNeighbors), std::max<ulong>(size, 1) * sizeof(uint), packed.data(), 0);
+      glDeleteBuffers(1, &_buffers(BufferType::eSimilarities));
+      glCreateBuffers(1, &_buffers(BufferType::eSimilarities));
+    } else {
+      // Pack edge ij in the lower half of word ij / 2 if ij is even, and the upper half if odd, replacing similarities
+      std::vector<uint> packed(std::max<ulong>(ceilDiv<ulong>(size, 2), 1), 0u);
+      pool.parallelFor(0, packed.size(), 0, [&](ulong begin, ulong end) {
+        for (ulong w = begin; w < end; ++w) {
+          const ulong ij = 2 * w;
+          packed[w] = (ij < size ? toBfloat16(ij) : 0u) | (ij + 1 < size ? toBfloat16(ij + 1) << 16 : 0u);
+        }
+      });
+      glDeleteBuffers(1, &_buffers(BufferType::eSimilarities));
+      glCreateBuffers(1, &_buffers(BufferType::eSimilarities));
+      glNamedBufferStorage(_buffers(BufferType::eSimilarities), packed.size() * sizeof(uint), packed.data(), 0);
+    }
+    glAssert();
+    Logger::curt() << prefix << "Compressed similarities to " << (fits ? 32 : 48) << " bits per neighbor";
+  }
+
+  // Symmetrizes the KNN graph on the host, as steps 3 to 7 of comp() do on the device, for a graph exceeding one
+  // storage block. Points are split into segments whose edges each fit one block from an aligned first edge. Layout
+  // offsets count from their segment's first edge, so stay 32-bit, and shaders reading the graph are dispatched
+  // once per segment, with its range of the edge buffers bound
+  void Similarities::symmetrizeSegments() {
+    runtimeAssert(!_params->reorderPoints && !_params->compressSimilarities,
+                  "Similarities: a graph exceeding one storage block cannot be reordered or compressed");
+    const uint n = _params->n;
+    const uint k = _params->k;
+    auto& pool = util::ThreadPool::instance();
+
+    // Copy KNN and p_j|i to host, and symmetrize
+    util::HostVector<uint> indices;
+    util::HostVector<float> conditionals;
+    pool.firstTouch(indices, n, k);
+    pool.firstTouch(conditionals, n, k);
+    glGetNamedBufferSubData(_buffersTemp(BufferTempType::eNeighbors), 0, indices.size() * sizeof(uint), indices.data());
+    glGetNamedBufferSubData(_buffersTemp(BufferTempType::eSimilarities), 0, conditionals.size() * sizeof(float), conditionals.data());
+    glAssert();
+    util::HostVector<ulong> offsets;
+    util::HostVector<uint> neighbors;
+    util::HostVector<float> similarities;
+    util::symmetrizeKNN(indices, conditionals, n, k, offsets, neighbors, similarities);
+
+    // Prune here, as prune() does on a graph within one block, so segments are split over the edges that remain
+    if (_params->pruneThreshold > 0.f || _params->pruneMass < 1.f) {
+      util::HostVector<ulong> offsetsPruned;
+      util::HostVector<uint> neighborsPruned;
+      util::HostVector<float> similaritiesPruned;
+      const float kept = util::pruneGraph(offsets, neighbors, similarities, _params->pruneThreshold, _params->pruneMass,
+                                          offsetsPruned, neighborsPruned, similaritiesPruned);
+      Logger::curt() << prefix << "Pruned " << offsets[n] - offsetsPruned[n] << " of " << offsets[n]
+                     << " neighbors, keeping " << 100.f * kept << "% of similarity";
+      offsets = std::move(offsetsPruned);
+      neighbors = std::move(neighborsPruned);
+      similarities = std::move(similaritiesPruned);
+    }
+    _symmetricSize = offsets[n];
+
+    // Each segment takes the following points while their edges fit one block. Its first edge is rounded down to a
+    // multiple of the offset alignment in bytes, so that its range is aligned for edges of any size
+    const ulong capacity = util::glGetMaxStorageElements(sizeof(float));
+    const ulong alignment = util::glGetStorageOffsetAlignment();
+    for (uint begin = 0; begin < n;) {
+      const ulong edgeBegin = offsets[begin] / alignment * alignment;
+      const uint end = static_cast<uint>(std::upper_bound(offsets.begin() + begin + 1, offsets.end(), edgeBegin + capacity) - offsets.begin()) - 1;
+      runtimeAssert(end > begin, "Similarities: a point's neighbor set exceeds one storage block");
+      _segments.push_back({ begin, end, edgeBegin, offsets[end] - edgeBegin });
+      begin = end;
+    }
+    util::HostVector<uint> layout(2 * static_cast<ulong>(n));
+    for (const GraphSegment& segment : _segments) {
+      pool.parallelFor(segment.rowBegin, segment.rowEnd, 0, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          layout[2 * i] = static_cast<uint>(offsets[i] - segment.edgeBegin);
+          layout[2 * i + 1] = static_cast<uint>(offsets[i + 1] - offsets[i]);
+        }
+      });
+    }
+
+    // Replace the layout, whose storage is immutable, and create the edge buffers
+    glDeleteBuffers(1, &_buffers(BufferType::eLayout));
+    glCreateBuffers(1, &_buffers(BufferType::eLayout));
+    glNamedBufferStorage(_buffers(BufferType::eLayout), layout.size() * sizeof(uint), layout.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eNeighbors), _symmetricSize * sizeof(uint), neighbors.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eSimilarities), _symmetricSize * sizeof(float), similarities.data(), GL_DYNAMIC_STORAGE_BIT);
+    glAssert();
+  }
+
+  // All points if the KNN fits one storage block. Otherwise, as many as do, in a multiple of the offset alignment in
+  // bytes, so that ranges of their rows start aligned
+  uint Similarities::knnRowsPerBlock() const {
+    const ulong capacity = util::glGetMaxStorageElements(sizeof(float));
+    if (static_cast<ulong>(_params->n) * _params->k <= capacity) {
+      return _params->n;
+    }
+    const ulong alignment = util::glGetStorageOffsetAlignment();
+    return static_cast<uint>(std::max<ulong>(capacity / _params->k / alignment, 1) * alignment);
+  }
+
+  void Similarities::initPrograms() {
+    const bool sparse = _params->sparseData;
+
+    // Initialize shader programs
+    {
+      _programs(ProgramType::eSimilaritiesComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/similarities.comp"));
+      _programs(ProgramType::eExpandComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/expand.comp"));
+      _programs(ProgramType::eLayoutComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/layout.comp"));
+      _programs(ProgramType::eNeighborsComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/neighbors.comp"));
+      _programs(ProgramType::eNeighborsSortComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/neighbors_sort.comp"));
+      _programs(ProgramType::eL1DistancesComp).addShader(util::GLShaderType::eCompute, rsrc::get(sparse ? "sne/similarities/L1_distances_sparse.comp" : "sne/similarities/L1_distances.comp"));
+      _programs(ProgramType::eWeighSimilaritiesComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/weigh_similarities.comp"));
+      _programs(ProgramType::eWeighSimilaritiesPerAttributeRatioComp).addShader(util::GLShaderType::eCompute, rsrc::get(sparse ? "sne/similarities/weigh_similarities_per_attr_ratio_sparse.comp" : "sne/similarities/weigh_similarities_per_attr_ratio.comp"));
+      _programs(ProgramType::eWeighSimilaritiesPerAttributeRangeComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/weigh_similarities_per_attr_range.comp"));
+      _programs(ProgramType::eWeighSimilaritiesPerAttributeResembleComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/weigh_similarities_per_attr_resemble.comp"));
+      _programs(ProgramType::eSubDistancesL1Comp).addShader(util::GLShaderType::eCompute, rsrc::get(sparse ? "sne/similarities/subdistances_sparse.comp" : "sne/similarities/subdistances.comp"));
+      _programs(ProgramType::eCompactSizesComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/compact_sizes.comp"));
+      _programs(ProgramType::eCompactComp).addShader(util::GLShaderType::eCompute, rsrc::get("sne/similarities/compact.comp"));
+
+      for (auto& program : _programs) {
+        program.link();
+      }
+      glAssert();
+    }
+  }
+
   Similarities::~Similarities() {
     if (isInit()) {
       glDeleteBuffers(_buffers.size(), _buffers.data());
+      util::GLBufferPool::instance().clear();
     }
   }
 
@@ -115,16 +754,24 @@ namespace dh::sne {
   void Similarities::comp() {
     runtimeAssert(isInit(), "Similarities::comp() called without proper initialization");
 
-    // Create and initialize temporary buffer objects
-    glCreateBuffers(_buffersTemp.size(), _buffersTemp.data());
+    // Create and initialize temporary buffer objects. KNN rows larger than one storage block are bound in turn
+    const ulong nNeighbors = static_cast<ulong>(_params->n) * _params->k;
+    const ulong capacity = util::glGetMaxStorageElements(sizeof(float));
+    _segments.clear();
+    _params->segmentedGraph = false;
+    // Pooled buffers may hold stale data, so zero-initialized ones are cleared on the device
     {
-      std::vector<uint> zeroes(_params->n * _params->k, 0);
-      glNamedBufferStorage(_buffersTemp(BufferTempType::eDistances), _params->n * _params->k * sizeof(float), nullptr, 0); // n * k floats of neighbor distances; every k'th element is 0
-      glNamedBufferStorage(_buffersTemp(BufferTempType::eNeighbors), _params->n * _params->k * sizeof(uint), nullptr, 0); // n * k uints of neighbor indices (ranging from 0 to n-1); every k'th element is vector index itself (so it's actually k-1 NN)
-      glNamedBufferStorage(_buffersTemp(BufferTempType::eSimilarities), _params->n * _params->k * sizeof(float), zeroes.data(), 0); // n * k floats of neighbor similarities; every k'th element is 0
-      glNamedBufferStorage(_buffersTemp(BufferTempType::eSizes), _params->n * sizeof(uint), zeroes.data(), 0); // n uints of (expanded) neighbor set sizes; every element is k-1 plus its number of "unregistered neighbors" that have it as neighbor but that it doesn't reciprocate
-      glNamedBufferStorage(_buffersTemp(BufferTempType::eScan), _params->n * sizeof(uint), nullptr, 0); // Prefix sum/inclusive scan over expanded neighbor set sizes (eSizes). (This should be a temp buffer, but that yields an error)
-      glNamedBufferStorage(_buffersTemp(BufferTempType::eCounts), _params->n * sizeof(uint), zeroes.data(), 0);
+      auto& pool = util::GLBufferPool::instance();
+      _buffersTemp(BufferTempType::eDistances) = pool.acquire(nNeighbors * sizeof(float)); // n * k floats of neighbor distances; every k'th element is 0
+      _buffersTemp(BufferTempType::eNeighbors) = pool.acquire(nNeighbors * sizeof(uint)); // n * k uints of neighbor indices (ranging from 0 to n-1); every k'th element is vector index itself (so it's actually k-1 NN)
+      _buffersTemp(BufferTempType::eSimilarities) = pool.acquire(nNeighbors * sizeof(float)); // n * k floats of neighbor similarities; every k'th element is 0
+      _buffersTemp(BufferTempType::eSizes) = pool.acquire(_params->n * sizeof(uint)); // n uints of (expanded) neighbor set sizes; every element is k-1 plus its number of "unregistered neighbors" that have it as neighbor but that it doesn't reciprocate
+      _buffersTemp(BufferTempType::eScan) = pool.acquire(_params->n * sizeof(uint)); // Prefix sum/inclusive scan over expanded neighbor set sizes (eSizes). (This should be a temp buffer, but that yields an error)
+      _buffersTemp(BufferTempType::eCounts) = pool.acquire(_params->n * sizeof(uint));
+      glClearNamedBufferData(_buffersTemp(BufferTempType::eSimilarities), GL_R32F, GL_RED, GL_FLOAT, nullptr);
+      glClearNamedBufferData(_buffersTemp(BufferTempType::eSizes), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+      glClearNamedBufferData(_buffersTemp(BufferTempType::eCounts), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+      glAssert();
     }
     
     // Progress bar for logging steps of the similarity computation
@@ -136,7 +783,50 @@ namespace dh::sne {
     // 1.
     // Compute approximate KNN of each point, delegated to FAISS
     // Produces a fixed number of neighbors
-    {
+    // Sparse input is searched exactly on the host instead, through an inverted index over its columns
+    // If an earlier search found at least k neighbors and was kept, the nearest k of these are used instead
+    if (_knnK >= _params->k) {
+      const uint k = _params->k;
+      std::vector<float> distances(nNeighbors);
+      std::vector<uint> indices(nNeighbors);
+      util::ThreadPool::instance().parallelFor(0, _params->n, 0, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          std::copy_n(&_knnDistances[i * _knnK], k, &distances[i * k]);
+          std::copy_n(&_knnIndices[i * _knnK], k, &indices[i * k]);
+        }
+      });
+      glNamedBufferSubData(_buffersTemp(BufferTempType::eDistances), 0, distances.size() * sizeof(float), distances.data());
+      glNamedBufferSubData(_buffersTemp(BufferTempType::eNeighbors), 0, indices.size() * sizeof(uint), indices.data());
+      glAssert();
+    } else if (_params->sparseData) {
+      std::vector<float> distances;
+      std::vector<uint> indices;
+      util::SparseKNN knn(&_sparseData, _params->k);
+      knn.comp(distances, indices);
+      glNamedBufferSubData(_buffersTemp(BufferTempType::eDistances), 0, distances.size() * sizeof(float), distances.data());
+      glNamedBufferSubData(_buffersTemp(BufferTempType::eNeighbors), 0, indices.size() * sizeof(uint), indices.data());
+      glAssert();
+    } else if (_params->knnBlockSize > 0) {
+      // Normalization is applied to each block as it is streamed, matching the in-memory normalization
+      std::vector<float> mins, scales;
+      dh::util::computeNormalization(_dataPtr, _params->n, _params->nHighDims, _params->uniformDims || _params->imageDataset, mins, scales);
+      util::BlockedKNN knn(
+        _dataPtr,
+        _buffersTemp(BufferTempType::eDistances),
+        _buffersTemp(BufferTempType::eNeighbors),
+        _params->n, _params->k, _params->nHighDims, _params->knnBlockSize,
+        mins, scales);
+      knn.comp();
+    } else if (_params->keepKNN) {
+      // The index is kept alongside the search, so insert() can search new points without building it again
+      std::vector<float> distances;
+      std::vector<uint> indices;
+      _knnIndex = util::KNNIndex(_buffers(BufferType::eDataset), 0, _params->n, _params->nHighDims);
+      _knnIndex.search(_buffers(BufferType::eDataset), 0, _params->n, _params->k, distances, indices);
+      glNamedBufferSubData(_buffersTemp(BufferTempType::eDistances), 0, distances.size() * sizeof(float), distances.data());
+      glNamedBufferSubData(_buffersTemp(BufferTempType::eNeighbors), 0, indices.size() * sizeof(uint), indices.data());
+      glAssert();
+    } else {
       util::KNN knn(
         _buffers(BufferType::eDataset),
         _buffersTemp(BufferTempType::eDistances),
@@ -145,6 +835,16 @@ namespace dh::sne {
       knn.comp();
     }
 
+    // Keep a host copy of a new search for recomp(perplexity), if requested
+    if (_params->keepKNN && _knnK < _params->k) {
+      _knnK = _params->k;
+      _knnDistances.resize(nNeighbors);
+      _knnIndices.resize(nNeighbors);
+      glGetNamedBufferSubData(_buffersTemp(BufferTempType::eDistances), 0, nNeighbors * sizeof(float), _knnDistances.data());
+      glGetNamedBufferSubData(_buffersTemp(BufferTempType::eNeighbors), 0, nNeighbors * sizeof(uint), _knnIndices.data());
+      glAssert();
+    }
+
     // Update progress bar
     progressBar.setPostfix("Performing similarity computation");
     progressBar.setProgress(1.0f / 6.0f);
@@ -164,14 +864,24 @@ namespace dh::sne {
       program.template uniform<float>("perplexity", _params->perplexity);
       program.template uniform<uint>("nIters", 200); // Number of binary search iterations for finding sigma corresponding to perplexity
       program.template uniform<float>("epsilon", 1e-4);
-
-      // Set buffer bindings
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffersTemp(BufferTempType::eNeighbors));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffersTemp(BufferTempType::eDistances));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffersTemp(BufferTempType::eSimilarities));
-
-      // Dispatch shader
-      glDispatchCompute(ceilDiv(_params->n, 256u), 1, 1);
+      program.template uniform<uint>("firstNeighbor", 1);
+
+      // Rows are calibrated independently, so are dispatched over as many of them as one storage block holds
+      const uint rowsPerBlock = knnRowsPerBlock();
+      for (uint begin = 0; begin < _params->n; begin += rowsPerBlock) {
+        const uint rows = std::min(rowsPerBlock, _params->n - begin);
+        const ulong offset = static_cast<ulong>(begin) * _params->k * sizeof(float);
+        const ulong size = static_cast<ulong>(rows) * _params->k * sizeof(float);
+        program.template uniform<uint>("nPoints", rows);
+
+        // Set buffer bindings
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, _buffersTemp(BufferTempType::eNeighbors), offset, size);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, _buffersTemp(BufferTempType::eDistances), offset, size);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, _buffersTemp(BufferTempType::eSimilarities), offset, size);
+
+        // Dispatch shader
+        glDispatchCompute(ceilDiv(rows, 256u), 1, 1);
+      }
       glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
       
       timer.tock();
@@ -185,7 +895,9 @@ namespace dh::sne {
     // 3.
     // Expand KNN data so it becomes symmetric. That is, every neigbor referred by a point itself refers to that point as a neighbor.
     // Actually just fills eSizes, which, for each element, is _params->k-1+the number of "unregistered neighbors"; datapoints that have it as a neighbor but which it doesn't reciprocate
-    {
+    // Points search the KNN rows of their neighbors, so this requires all of them in one storage block
+    const bool knnFits = nNeighbors <= capacity;
+    if (knnFits) {
       auto& timer = _timers(TimerType::eExpandComp);
       timer.tick();
       
@@ -215,19 +927,25 @@ namespace dh::sne {
     // 4.
     // Determine sizes of expanded neighborhoods in memory through prefix sum (https://en.wikipedia.org/wiki/Prefix_sum). Leverages CUDA CUB library underneath
 
-    {
+    uint symmetricSize = 0;
+    if (knnFits) {
       util::InclusiveScan scan(_buffersTemp(BufferTempType::eSizes), _buffersTemp(BufferTempType::eScan), _params->n);
       scan.comp();
-      glGetNamedBufferSubData(_buffersTemp(BufferTempType::eScan), (_params->n - 1) * sizeof(uint), sizeof(uint), &_symmetricSize); // Copy the last element of the eScan buffer (which is the total size) to host
+      glGetNamedBufferSubData(_buffersTemp(BufferTempType::eScan), (_params->n - 1) * sizeof(uint), sizeof(uint), &symmetricSize); // Copy the last element of the eScan buffer (which is the total size) to host
     }
 
+    // The 32-bit scan wraps if expanded sets exceed 2^32 entries. Their total lies in [n * (k-1), 2 * n * (k-1)],
+    // and n * k fits 32 bits, so a wrapped total always ends up below n * (k-1). A graph that wraps the scan or
+    // exceeds one storage block is symmetrized on the host instead, and split into segments that each fit one
+    _params->segmentedGraph = !knnFits || symmetricSize < nNeighbors - _params->n || symmetricSize > capacity;
+
     // Initialize permanent buffer objects
-    std::vector<float> zeroes(_symmetricSize, 0.f);
-    glNamedBufferStorage(_buffers(BufferType::eNeighbors), _symmetricSize * sizeof(uint), nullptr, 0); // Each i's expanded neighbor set starts at eLayout[i].offset and contains eLayout[i].size neighbors, no longer including itself
-    glNamedBufferStorage(_buffers(BufferType::eSimilarities), _symmetricSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT); // Corresponding similarities
-    glNamedBufferStorage(_buffers(BufferType::eDistancesL1), _symmetricSize * sizeof(float), zeroes.data(), 0); // Corresponding distances
-    glNamedBufferStorage(_buffers(BufferType::eNeighborsSelected), _symmetricSize * sizeof(uint), nullptr, 0); // Buffer used only by Minimization; creating it here because here we know the size
-    glAssert();
+    if (!_params->segmentedGraph) {
+      _symmetricSize = symmetricSize;
+      glNamedBufferStorage(_buffers(BufferType::eNeighbors), _symmetricSize * sizeof(uint), nullptr, 0); // Each i's expanded neighbor set starts at eLayout[i].offset and contains eLayout[i].size neighbors, no longer including itself
+      glNamedBufferStorage(_buffers(BufferType::eSimilarities), _symmetricSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT); // Corresponding similarities
+      glAssert();
+    }
 
     // Update progress bar
     progressBar.setPostfix("Computing layout");
@@ -235,7 +953,7 @@ namespace dh::sne {
 
     // 5.
     // Fill layout buffer
-    {
+    if (!_params->segmentedGraph) {
       auto& timer = _timers(TimerType::eLayoutComp);
       timer.tick();
 
@@ -263,7 +981,7 @@ namespace dh::sne {
 
     // 6.
     // Generate expanded similarities, neighbor and distances buffers, symmetrized and ready for use during the minimization
-    {
+    if (!_params->segmentedGraph) {
       auto& timer = _timers(TimerType::eNeighborsComp);
       timer.tick();
 
@@ -291,7 +1009,7 @@ namespace dh::sne {
 
     // 7.
     // Sort neighbours within each KNN set (and corresponding similarities)
-    {
+    if (!_params->segmentedGraph) {
       auto &program = _programs(ProgramType::eNeighborsSortComp);
       program.bind();
 
@@ -308,48 +1026,63 @@ namespace dh::sne {
 
       glAssert();
     }
-    
-    // 8.
-    // Calculating L1 distances
-    {
-      auto &program = _programs(ProgramType::eL1DistancesComp);
-      program.bind();
 
-      program.template uniform<uint>("nPoints", _params->n);
-      program.template uniform<uint>("nHighDims", _params->nHighDims);
+    // Steps 5 to 7 on the host, for a graph exceeding one storage block
+    if (_params->segmentedGraph) {
+      symmetrizeSegments();
+    }
+    
+    // Drop edges carrying negligible similarity before anything else is derived from the graph. A segmented graph
+    // was pruned on the host already
+    if (!_params->segmentedGraph && (_params->pruneThreshold > 0.f || _params->pruneMass < 1.f)) {
+      prune();
+    }
 
-      // Set buffer bindings
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _buffers(BufferType::eDataset));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::eLayout));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eNeighbors));
-      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffers(BufferType::eDistancesL1));
+    // Renumber points along the symmetrized KNN graph, so that the neighbors gathered by the attractive force
+    // computation mostly lie close together in memory. L1 distances below are then computed in the new order.
+    // After recomp(), points keep their current order, as the minimization's buffers already follow it
+    if (_params->reorderPoints && _permutation.empty()) {
+      reorder();
+    }
 
-      // Dispatch shader in batches of batchSize attriibutes
-      uint batchSize = 5;
-      for(uint b = 0; b * batchSize < _params->nHighDims; ++b) {
-        program.template uniform<uint>("batchBegin", b * batchSize);
-        program.template uniform<uint>("batchEnd", std::min((b+1) * batchSize, (uint) _params->nHighDims));
-        glDispatchCompute(ceilDiv(_params->n, 256u / 32u), 1, 1);
-        glFinish();
-        glAssert();
-      }
+    // Similarities are final here, so may be compressed. A compressed or segmented graph only serves the
+    // minimization, so the buffers backing similarity editing are not created
+    if (_params->compressSimilarities) {
+      compress();
+    }
+    if (!_params->compressSimilarities && !_params->segmentedGraph) {
+      std::vector<float> zeroes(_symmetricSize, 0.f);
+      glNamedBufferStorage(_buffers(BufferType::eDistancesL1), _symmetricSize * sizeof(float), zeroes.data(), 0); // Corresponding distances
+      glNamedBufferStorage(_buffers(BufferType::eNeighborsSelected), _symmetricSize * sizeof(uint), nullptr, 0); // Buffer used only by Minimization; creating it here because here we know the size
+      glAssert();
     }
+
+    // 8.
+    // Calculating L1 distances
+    compL1Distances();
     
     // Keep backup of similarities in eSimilaritiesOriginal, because eSimilarities may get changed
-    glNamedBufferStorage(_buffers(BufferType::eSimilaritiesOriginal), _symmetricSize * sizeof(float), nullptr, 0);
-    glCopyNamedBufferSubData(_buffers(BufferType::eSimilarities), _buffers(BufferType::eSimilaritiesOriginal), 0, 0, _symmetricSize * sizeof(float));
+    if (!_params->compressSimilarities && !_params->segmentedGraph) {
+      glNamedBufferStorage(_buffers(BufferType::eSimilaritiesOriginal), _symmetricSize * sizeof(float), nullptr, 0);
+      glCopyNamedBufferSubData(_buffers(BufferType::eSimilarities), _buffers(BufferType::eSimilaritiesOriginal), 0, 0, _symmetricSize * sizeof(float));
+    }
 
     // Update progress bar
     progressBar.setPostfix("Done!");
     progressBar.setProgress(1.0f);
 
-    // Delete temporary buffers
-    glDeleteBuffers(_buffersTemp.size(), _buffersTemp.data());
+    // Return temporary buffers; the largest are freed rather than kept in the pool
+    const std::array<BufferTempType, 6> tempTypes = { BufferTempType::eDistances, BufferTempType::eNeighbors, BufferTempType::eSimilarities,
+                                                      BufferTempType::eSizes, BufferTempType::eScan, BufferTempType::eCounts };
+    for (BufferTempType type : tempTypes) {
+      util::GLBufferPool::instance().release(_buffersTemp(type));
+    }
     glAssert();
 
-    // Output memory use of persistent OpenGL buffer objects
-    const GLuint bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
-    Logger::curt() << prefix << "Completed, buffer storage : " << static_cast<float>(bufferSize) / 1'048'576.0f << " mb";
+    // Output memory use of persistent OpenGL buffer objects, and the peak of pooled temporary ones
+    const ulong bufferSize = util::glGetBuffersSize(_buffers.size(), _buffers.data());
+    const ulong tempSize = util::GLBufferPool::instance().highWaterSize();
+    Logger::curt() << prefix << "Completed, buffer storage : " << static_cast<float>(bufferSize) / 1'048'576.0f << " mb, temporary peak : " << static_cast<float>(tempSize) / 1'048'576.0f << " mb";
 
     // Poll twice so front/back timers are swapped
     glPollTimers(_timers.size(), _timers.data());
@@ -357,24 +1090,848 @@ namespace dh::sne {
   }
 
   void Similarities::recomp(GLuint selectionBufferHandle, float perplexity, uint k) {
-    _params->n = dh::util::BufferTools::instance().remove<float>(_buffers(BufferType::eDataset), _params->n, _params->nHighDims, selectionBufferHandle);
+    if (_params->knnBlockSize > 0) { return; } // Out-of-core input cannot be compacted to a selection
+    if (dh::util::BufferTools::instance().reduce<uint>(selectionBufferHandle, 0, _params->n) == 0) { return; } // Nothing selected; sparse and dense data are both kept whole
+
+    compactDataset(selectionBufferHandle);
     _params->perplexity = perplexity;
     _params->k = k;
-    glDeleteBuffers(1, &_buffers(BufferType::eNeighbors));
+    recreateGraphBuffers();
+    comp();
+  }
+
+  // Reduce the dataset, the permutation and a kept KNN search to the selected points, and update the number of points
+  void Similarities::compactDataset(GLuint selectionBufferHandle) {
+    // An empty selection keeps every point, as BufferTools::remove() does
+    if (dh::util::BufferTools::instance().reduce<uint>(selectionBufferHandle, 0, _params->n) == 0) { return; }
+
+    std::vector<uint> selection;
+    if (_params->sparseData || !_permutation.empty() || _knnK > 0) {
+      selection.resize(_params->n);
+      glGetNamedBufferSubData(selectionBufferHandle, 0, _params->n * sizeof(uint), selection.data());
+    }
+
+    // Reordered points keep their current order; only the original indices of removed points are dropped
+    if (!_permutation.empty()) {
+      util::compactPermutation(_permutation, selection);
+    }
+
+    // Cached KNN rows of selected points keep their surviving neighbors in order, renumbered, which are also their
+    // nearest among the selected points. Rows are cut to the number of neighbors that all of them still have. The
+    // index holds removed points, and is built again by insert() if needed
+    _knnIndex = util::KNNIndex();
+    if (_knnK > 0) {
+      const uint k = _knnK;
+      const uint missing = std::numeric_limits<uint>::max();
+      std::vector<uint> kept, index(selection.size(), missing);
+      for (uint i = 0; i < selection.size(); ++i) {
+        if (selection[i]) {
+          index[i] = static_cast<uint>(kept.size());
+          kept.push_back(i);
+        }
+      }
+      const auto survives = [&](uint j) { return j < index.size() && index[j] != missing; };
+
+      auto& pool = util::ThreadPool::instance();
+      const uint kKept = pool.parallelReduce(0, kept.size(), 0, k, [&](ulong begin, ulong end) {
+        uint count = k;
+        for (ulong a = begin; a < end; ++a) {
+          const uint* row = &_knnIndices[static_cast<ulong>(kept[a]) * k];
+          count = std::min(count, static_cast<uint>(std::count_if(row, row + k, survives)));
+        }
+        return count;
+      }, [](uint a, uint b) { return std::min(a, b); });
+
+      std::vector<float> distances(kept.size() * kKept);
+      std::vector<uint> indices(kept.size() * kKept);
+      pool.parallelFor(0, kept.size(), 0, [&](ulong begin, ulong end) {
+        for (ulong a = begin; a < end; ++a) {
+          const ulong i = kept[a];
+          for (uint l = 0, m = 0; l < kKept; ++m) {
+            const uint j = _knnIndices[i * k + m];
+            if (survives(j)) {
+              distances[a * kKept + l] = _knnDistances[i * k + m];
+              indices[a * kKept + l] = index[j];
+              ++l;
+            }
+          }
+        }
+      });
+      _knnK = kKept;
+      _knnDistances = std::move(distances);
+      _knnIndices = std::move(indices);
+    }
+
+    if (_params->sparseData) {
+      // Compact the host copy to the selected rows, then replace the device copy
+      std::vector<int> labels(selection.begin(), selection.end());
+      int nClasses = 1;
+      for (int& label : labels) { label = label == 1 ? 0 : 1; } // Keep selected rows, as class 0
+      dh::util::selectClasses(_sparseData, labels, true, nClasses, false);
+      _params->n = _sparseData.nRows;
+
+      std::array<GLuint, 3> handles = { _buffers(BufferType::eDataset), _buffers(BufferType::eDatasetOffsets), _buffers(BufferType::eDatasetIndices) };
+      glDeleteBuffers(handles.size(), handles.data());
+      glCreateBuffers(1, &_buffers(BufferType::eDataset));
+      glCreateBuffers(1, &_buffers(BufferType::eDatasetOffsets));
+      glCreateBuffers(1, &_buffers(BufferType::eDatasetIndices));
+      uploadSparseData();
+    } else {
+      _params->n = dh::util::BufferTools::instance().remove<float>(_buffers(BufferType::eDataset), _params->n, _params->nHighDims, selectionBufferHandle);
+    }
+    glAssert();
+  }
+
+  void Similarities::compact(GLuint selectionBufferHandle) {
+    if (_params->knnBlockSize > 0 || _params->compressSimilarities || _params->segmentedGraph) { return; } // Out-of-core input and compressed or segmented graphs cannot be edited
+    if (_knnK > _params->k) {
+      compactFromKNN(selectionBufferHandle);
+      return;
+    }
+
+    const uint nOld = _params->n;
+    auto& pool = util::GLBufferPool::instance();
+    _buffersTemp(BufferTempType::eSizes) = pool.acquire(nOld * sizeof(uint));
+    _buffersTemp(BufferTempType::eScan) = pool.acquire(nOld * sizeof(uint));
+    _buffersTemp(BufferTempType::eFactors) = pool.acquire(nOld * sizeof(float));
+    _buffersTemp(BufferTempType::eIndices) = pool.acquire(nOld * sizeof(uint));
+    glAssert();
+
+    // 1.
+    // Count the neighbors each remaining point keeps, and the factor restoring the similarity it lost with the rest
+    {
+      auto& program = _programs(ProgramType::eCompactSizesComp);
+      program.bind();
+
+      program.template uniform<uint>("nPoints", nOld);
+
+      // Set buffer bindings
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, selectionBufferHandle);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffers(BufferType::eLayout));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffers(BufferType::eNeighbors));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffers(BufferType::eSimilarities));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _buffersTemp(BufferTempType::eSizes));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _buffersTemp(BufferTempType::eFactors));
+
+      // Dispatch shader
+      glDispatchCompute(ceilDiv(nOld, 256u / 32u), 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      glAssert();
+    }
+
+    // 2.
+    // New offsets of the remaining neighbor sets, and new indices of the remaining points, through prefix sums
+    uint symmetricSize, nNew;
+    {
+      util::InclusiveScan scanSizes(_buffersTemp(BufferTempType::eSizes), _buffersTemp(BufferTempType::eScan), nOld);
+      scanSizes.comp();
+      util::InclusiveScan scanIndices(selectionBufferHandle, _buffersTemp(BufferTempType::eIndices), nOld);
+      scanIndices.comp();
+      glGetNamedBufferSubData(_buffersTemp(BufferTempType::eScan), (nOld - 1) * sizeof(uint), sizeof(uint), &symmetricSize);
+      glGetNamedBufferSubData(_buffersTemp(BufferTempType::eIndices), (nOld - 1) * sizeof(uint), sizeof(uint), &nNew);
+      glAssert();
+    }
+
+    // 3.
+    // Write the remaining edges into new graph buffers, renumbered and rescaled; the old ones are read meanwhile
+    util::EnumArray<BufferType, GLuint> graph;
+    const std::array<BufferType, 6> graphTypes = { BufferType::eLayout, BufferType::eNeighbors, BufferType::eSimilarities,
+                                                   BufferType::eSimilaritiesOriginal, BufferType::eDistancesL1, BufferType::eNeighborsSelected };
+    for (BufferType type : graphTypes) { glCreateBuffers(1, &graph(type)); }
+    glNamedBufferStorage(graph(BufferType::eLayout), nNew * 2 * sizeof(uint), nullptr, 0);
+    glNamedBufferStorage(graph(BufferType::eNeighbors), symmetricSize * sizeof(uint), nullptr, 0);
+    glNamedBufferStorage(graph(BufferType::eSimilarities), symmetricSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(graph(BufferType::eSimilaritiesOriginal), symmetricSize * sizeof(float), nullptr, 0);
+    glNamedBufferStorage(graph(BufferType::eDistancesL1), symmetricSize * sizeof(float), nullptr, 0);
+    glNamedBufferStorage(graph(BufferType::eNeighborsSelected), symmetricSize * sizeof(uint), nullptr, 0);
+    glAssert();
+    {
+      auto& program = _programs(ProgramType::eCompactComp);
+      program.bind();
+
+      program.template uniform<uint>("nPoints", nOld);
+
+      // Set buffer bindings
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, selectionBufferHandle);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _buffersTemp(BufferTempType::eIndices));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _buffersTemp(BufferTempType::eScan));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffersTemp(BufferTempType::eFactors));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _buffers(BufferType::eLayout));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _buffers(BufferType::eNeighbors));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _buffers(BufferType::eSimilarities));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _buffers(BufferType::eSimilaritiesOriginal));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _buffers(BufferType::eDistancesL1));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, graph(BufferType::eLayout));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, graph(BufferType::eNeighbors));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, graph(BufferType::eSimilarities));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, graph(BufferType::eSimilaritiesOriginal));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, graph(BufferType::eDistancesL1));
+
+      // Dispatch shader
+      glDispatchCompute(ceilDiv(nOld, 256u / 32u), 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+      glAssert();
+    }
+
+    // Swap in the new graph buffers, and compact the dataset itself
+    for (BufferType type : graphTypes) {
+      glDeleteBuffers(1, &_buffers(type));
+      _buffers(type) = graph(type);
+    }
+    _symmetricSize = symmetricSize;
+    compactDataset(selectionBufferHandle);
+    runtimeAssert(_params->n == nNew, "Similarities::compact() selection is not a 0/1 mask");
+
+    const std::array<BufferTempType, 4> tempTypes = { BufferTempType::eSizes, BufferTempType::eScan, BufferTempType::eFactors, BufferTempType::eIndices };
+    for (BufferTempType type : tempTypes) {
+      pool.release(_buffersTemp(type));
+    }
+    glAssert();
+    Logger::newl() << prefix << "Compacted to " << nNew << " points, " << _symmetricSize << " neighbors";
+  }
+
+  // As compact(), for a kept KNN search with more neighbors than Params::k. Rows of selected points that lose any of
+  // their first Params::k neighbors refill each vacated slot with the row's next surviving candidate, and only these
+  // rows are recalibrated. The graph is patched on the host by the changes of their conditional similarities, as
+  // insert() does, so all other rows keep their similarities
+  void Similarities::compactFromKNN(GLuint selectionBufferHandle) {
+    const uint nOld = _params->n;
+    const uint k = _knnK;         // Neighbors per kept row
+    const uint kGraph = _params->k; // Neighbors per row entering the graph, itself first
+    const uint missing = std::numeric_limits<uint>::max();
+    auto& pool = util::ThreadPool::instance();
+
+    // New indices of the remaining points
+    std::vector<uint> selection(nOld);
+    glGetNamedBufferSubData(selectionBufferHandle, 0, nOld * sizeof(uint), selection.data());
+    glAssert();
+    std::vector<uint> kept, index(nOld, missing);
+    for (uint i = 0; i < nOld; ++i) {
+      if (selection[i]) {
+        index[i] = static_cast<uint>(kept.size());
+        kept.push_back(i);
+      }
+    }
+    const uint nNew = static_cast<uint>(kept.size());
+    const auto survives = [&](uint j) { return j < nOld && index[j] != missing; };
+
+    // 1.
+    // Find the remaining points that lose one of their first Params::k neighbors, and refill their rows from the kept
+    // search. A row running out of candidates is padded with the point itself, at its last distance, which is
+    // calibrated as a duplicate of it but never enters the graph. Points and neighbors keep their old indices until
+    // the graph is patched
+    std::vector<uint> touched;
+    for (uint i : kept) {
+      const uint* row = &_knnIndices[static_cast<ulong>(i) * k];
+      if (!std::all_of(row + 1, row + kGraph, survives)) {
+        touched.push_back(i);
+      }
+    }
+    const uint nTouched = static_cast<uint>(touched.size());
+    std::vector<uint> slot(nOld, missing);
+    std::vector<uint> refilled(static_cast<ulong>(nTouched) * kGraph);
+    std::vector<float> rows(2 * static_cast<ulong>(nTouched) * kGraph); // Old rows, then refilled rows
+    pool.parallelFor(0, nTouched, 0, [&](ulong begin, ulong end) {
+      for (ulong s = begin; s < end; ++s) {
+        const ulong i = touched[s];
+        const float* rowDistances = &_knnDistances[i * k];
+        const uint* rowIndices = &_knnIndices[i * k];
+        float* oldDistances = &rows[s * kGraph];
+        float* newDistances = &rows[(nTouched + s) * kGraph];
+        uint* newIndices = &refilled[s * kGraph];
+        std::copy_n(rowDistances, kGraph, oldDistances);
+        uint l = 0;
+        for (uint m = 0; m < k && l < kGraph; ++m) {
+          if (survives(rowIndices[m])) {
+            newDistances[l] = rowDistances[m];
+            newIndices[l] = rowIndices[m];
+            ++l;
+          }
+        }
+        for (; l < kGraph; ++l) {
+          newDistances[l] = newDistances[l - 1];
+          newIndices[l] = static_cast<uint>(i);
+        }
+      }
+    });
+    for (uint s = 0; s < nTouched; ++s) { slot[touched[s]] = s; }
+
+    // 2.
+    // Calibrate touched points over their old and refilled rows
+    std::vector<float> conditional;
+    calibrate(rows, 2 * nTouched, conditional);
+
+    // First Params::k neighbors of a remaining point after refilling, and before
+    const auto row = [&](uint a) -> const uint* {
+      return slot[a] != missing ? &refilled[static_cast<ulong>(slot[a]) * kGraph] : &_knnIndices[static_cast<ulong>(a) * k];
+    };
+    const auto oldRow = [&](uint a) -> const uint* { return &_knnIndices[static_cast<ulong>(a) * k]; };
+
+    // The position of b in the first Params::k neighbors of a row, or 0 if absent, as the point itself is first
+    const auto find = [&](const uint* neighbors, uint b) -> uint {
+      for (uint l = 1; l < kGraph; ++l) {
+        if (neighbors[l] == b) { return l; }
+      }
+      return 0;
+    };
+
+    // Change of p_b|a between the old and new calibration of a
+    const auto delta = [&](uint a, uint b) {
+      const ulong s = slot[a];
+      float p = 0.f;
+      if (s == missing) {
+        return p;
+      }
+      if (const uint l = find(row(a), b)) {
+        p += conditional[(nTouched + s) * kGraph + l];
+      }
+      if (const uint l = find(oldRow(a), b)) {
+        p -= conditional[s * kGraph + l];
+      }
+      return p;
+    };
+
+    // Relations new to the graph, as (point, neighbor) pairs of the point whose row gains the neighbor
+    std::vector<std::pair<uint, uint>> added;
+    for (uint a : touched) {
+      for (uint l = 1; l < kGraph; ++l) {
+        const uint b = row(a)[l];
+        if (b != a && !find(oldRow(a), b)) {
+          added.emplace_back(b, a);
+        }
+      }
+    }
+    std::sort(added.begin(), added.end());
+    std::vector<ulong> addedOffsets(static_cast<ulong>(nOld) + 1, 0);
+    for (const auto& pair : added) { ++addedOffsets[pair.first + 1]; }
+    for (uint i = 0; i < nOld; ++i) { addedOffsets[i + 1] += addedOffsets[i]; }
+
+    // 3.
+    // Patch the symmetrized graph, whose similarities are 0.5 * (p_j|i + p_i|j), as insert() does. Edges to removed
+    // points are dropped, and the rest renumbered, which keeps rows sorted
+    std::vector<uint> layout, neighbors;
+    std::vector<float> similarities, originals(_symmetricSize);
+    downloadGraph(layout, neighbors, similarities);
+    glGetNamedBufferSubData(_buffers(BufferType::eSimilaritiesOriginal), 0, originals.size() * sizeof(float), originals.data());
+    glAssert();
+
+    struct Chunk { std::vector<uint> neighbors; std::vector<float> similarities, originals; };
+    const ulong grain = pool.grainSize(nNew, 1024);
+    std::vector<Chunk> chunks(ceilDiv(static_cast<ulong>(nNew), grain));
+    std::vector<ulong> offsets(static_cast<ulong>(nNew) + 1, 0);
+    pool.parallelFor(0, nNew, grain, [&](ulong begin, ulong end) {
+      auto& chunk = chunks[begin / grain];
+      std::vector<uint> edges;
+      for (ulong i = begin; i < end; ++i) {
+        const uint a = kept[i];
+        const uint rowBegin = layout[2 * a];
+        const uint rowEnd = layout[2 * a] + layout[2 * a + 1];
+        edges.clear();
+        std::copy_if(neighbors.begin() + rowBegin, neighbors.begin() + rowEnd, std::back_inserter(edges), survives);
+        if (slot[a] != missing) {
+          for (uint l = 1; l < kGraph; ++l) {
+            if (row(a)[l] != a) { edges.push_back(row(a)[l]); }
+          }
+        }
+        for (ulong r = addedOffsets[a]; r < addedOffsets[a + 1]; ++r) {
+          edges.push_back(added[r].second);
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        const size_t size = chunk.neighbors.size();
+        uint ij = rowBegin;
+        for (uint b : edges) {
+          while (ij < rowEnd && neighbors[ij] < b) { ++ij; }
+          const bool isOld = ij < rowEnd && neighbors[ij] == b;
+          float similarity = isOld ? similarities[ij] : 0.f;
+          float original = isOld ? originals[ij] : 0.f;
+          if (slot[a] != missing || slot[b] != missing) {
+            if (!find(row(a), b) && !find(row(b), a)) {
+              continue;
+            }
+            const float change = 0.5f * (delta(a, b) + delta(b, a));
+            similarity = std::max(similarity + change, 0.f);
+            original = std::max(original + change, 0.f);
+          }
+          chunk.neighbors.push_back(index[b]);
+          chunk.similarities.push_back(similarity);
+          chunk.originals.push_back(original);
+        }
+        offsets[i] = chunk.neighbors.size() - size;
+      }
+    });
+
+    const ulong nEdges = pool.parallelScan(offsets.data(), offsets.data(), nNew);
+    offsets[nNew] = nEdges;
+    layout.resize(2 * static_cast<ulong>(nNew));
+    neighbors.resize(nEdges);
+    similarities.resize(nEdges);
+    originals.resize(nEdges);
+    pool.parallelFor(0, chunks.size(), 1, [&](ulong begin, ulong end) {
+      for (ulong c = begin; c < end; ++c) {
+        const ulong iBegin = c * grain;
+        const ulong iEnd = std::min(iBegin + grain, static_cast<ulong>(nNew));
+        for (ulong i = iBegin; i < iEnd; ++i) {
+          layout[2 * i] = static_cast<uint>(offsets[i]);
+          layout[2 * i + 1] = static_cast<uint>(offsets[i + 1] - offsets[i]);
+        }
+        std::copy(chunks[c].neighbors.begin(), chunks[c].neighbors.end(), neighbors.begin() + offsets[iBegin]);
+        std::copy(chunks[c].similarities.begin(), chunks[c].similarities.end(), similarities.begin() + offsets[iBegin]);
+        std::copy(chunks[c].originals.begin(), chunks[c].originals.end(), originals.begin() + offsets[iBegin]);
+        chunks[c] = Chunk();
+      }
+    });
+
+    // 4.
+    // Compact the dataset and the kept search, then replace device copies of the graph; storage is immutable, so
+    // buffers are recreated. Attribute weights are kept, and L1 distances are accumulated anew over the patched graph
+    compactDataset(selectionBufferHandle);
+    runtimeAssert(_params->n == nNew, "Similarities::compact() selection is not a 0/1 mask");
+    _symmetricSize = nEdges;
+    const ulong storageSize = std::max<ulong>(nEdges, 1); // Avoid zero-sized storage for a graph without edges
+    const std::vector<float> zeroes(storageSize, 0.f);
+    glDeleteBuffers(1, &_buffers(BufferType::eLayout));
+    glCreateBuffers(1, &_buffers(BufferType::eLayout));
+    recreateGraphBuffers();
+    glNamedBufferStorage(_buffers(BufferType::eLayout), layout.size() * sizeof(uint), layout.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eNeighbors), storageSize * sizeof(uint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(_buffers(BufferType::eSimilarities), storageSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(_buffers(BufferType::eSimilaritiesOriginal), storageSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferSubData(_buffers(BufferType::eNeighbors), 0, nEdges * sizeof(uint), neighbors.data());
+    glNamedBufferSubData(_buffers(BufferType::eSimilarities), 0, nEdges * sizeof(float), similarities.data());
+    glNamedBufferSubData(_buffers(BufferType::eSimilaritiesOriginal), 0, nEdges * sizeof(float), originals.data());
+    glNamedBufferStorage(_buffers(BufferType::eDistancesL1), storageSize * sizeof(float), zeroes.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eNeighborsSelected), storageSize * sizeof(uint), nullptr, 0);
+    glAssert();
+    compL1Distances();
+    Logger::newl() << prefix << "Compacted to " << nNew << " points, " << _symmetricSize << " neighbors; refilled " << nTouched << " points";
+  }
+
+  // Selects Params::nLandmarks landmarks, and walks from every point to them over the symmetrized graph, where a
+  // step follows an edge with probability proportional to its similarity
+  void Similarities::landmarks(std::vector<uint>& landmarks, util::CSRMatrix& walks) const {
+    runtimeAssert(!_params->compressSimilarities && !_params->segmentedGraph, "Similarities: landmarks require uncompressed similarities within one storage block"); // Rejected by SNE::compSimilarities() before minimization
+    const uint n = _params->n;
+    const uint nLandmarks = std::min(_params->nLandmarks, n);
+
+    std::vector<uint> layout;
+    std::vector<uint> neighbors;
+    std::vector<float> similarities;
+    downloadGraph(layout, neighbors, similarities);
+
+    if (_params->landmarkSelection == "walk") {
+      landmarks = util::selectLandmarksByWalks(layout, neighbors, similarities, nLandmarks, 1, landmarkVisitLength, _params->seed);
+    } else {
+      if (_params->landmarkSelection != "random") {
+        Logger::newl() << prefix << "Unknown landmark selection \"" << _params->landmarkSelection << "\", selecting randomly";
+      }
+      landmarks.resize(n);
+      std::iota(landmarks.begin(), landmarks.end(), 0u);
+      std::shuffle(landmarks.begin(), landmarks.end(), std::mt19937(_params->seed));
+      landmarks.resize(nLandmarks);
+      std::sort(landmarks.begin(), landmarks.end());
+    }
+
+    walks = util::walkToLandmarks(layout, neighbors, similarities, landmarks, _params->landmarkWalks, _params->landmarkWalkLength, _params->seed);
+  }
+
+  void Similarities::downloadGraph(std::vector<uint>& layout, std::vector<uint>& neighbors, std::vector<float>& similarities) const {
+    runtimeAssert(!_params->compressSimilarities, "Similarities: compressed similarities cannot be downloaded as floats");
+    readGraph(layout, neighbors, similarities);
+  }
+
+  void Similarities::readGraph(std::vector<uint>& layout, std::vector<uint>& neighbors, std::vector<float>& similarities) const {
+    runtimeAssert(!_params->segmentedGraph, "Similarities: a graph exceeding one storage block has no 32-bit layout to download");
+    layout.resize(2 * static_cast<ulong>(_params->n));
+    neighbors.resize(_symmetricSize);
+    similarities.resize(_symmetricSize);
+    glGetNamedBufferSubData(_buffers(BufferType::eLayout), 0, layout.size() * sizeof(uint), layout.data());
+    glGetNamedBufferSubData(_buffers(BufferType::eNeighbors), 0, neighbors.size() * sizeof(uint), neighbors.data());
+    glGetNamedBufferSubData(_buffers(BufferType::eSimilarities), 0, similarities.size() * sizeof(float), similarities.data());
+    glAssert();
+  }
+
+  void Similarities::recomp(float perplexity) {
+    // Same neighborhood size as Params' default for a given perplexity
+    _params->perplexity = perplexity;
+    _params->k = std::min(_params->kMax, 3 * static_cast<uint>(perplexity) + 1);
+    if (_knnK < _params->k) {
+      Logger::newl() << prefix << "No kept KNN search for k = " << _params->k << ", searching again";
+    }
+
+    // The layout is reused, as the number of points is unchanged
+    recreateGraphBuffers();
+    comp();
+  }
+
+  // Symmetrized sets differ in size on recomputation, so buffers with immutable storage are recreated
+  void Similarities::recreateGraphBuffers() {
+    std::array<GLuint, 5> handles = {
+      _buffers(BufferType::eNeighbors), _buffers(BufferType::eSimilarities), _buffers(BufferType::eSimilaritiesOriginal),
+      _buffers(BufferType::eDistancesL1), _buffers(BufferType::eNeighborsSelected)
+    };
+    glDeleteBuffers(handles.size(), handles.data());
     glCreateBuffers(1, &_buffers(BufferType::eNeighbors));
-    glDeleteBuffers(1, &_buffers(BufferType::eSimilarities));
     glCreateBuffers(1, &_buffers(BufferType::eSimilarities));
-    glDeleteBuffers(1, &_buffers(BufferType::eSimilaritiesOriginal));
     glCreateBuffers(1, &_buffers(BufferType::eSimilaritiesOriginal));
-    glDeleteBuffers(1, &_buffers(BufferType::eDistancesL1));
     glCreateBuffers(1, &_buffers(BufferType::eDistancesL1));
-    glDeleteBuffers(1, &_buffers(BufferType::eNeighborsSelected));
     glCreateBuffers(1, &_buffers(BufferType::eNeighborsSelected));
-    comp();
+    glAssert();
+  }
+
+  // Calibrates rows independently, as step 2 of comp() does for the kept search; the neighbors binding is unread
+  void Similarities::calibrate(const std::vector<float>& distances, uint nRows, std::vector<float>& similarities) {
+    const ulong size = static_cast<ulong>(nRows) * _params->k;
+    similarities.resize(size);
+    if (nRows == 0) {
+      return;
+    }
+
+    auto& pool = util::GLBufferPool::instance();
+    GLuint distancesBuffer = pool.acquire(size * sizeof(float));
+    GLuint similaritiesBuffer = pool.acquire(size * sizeof(float));
+    glNamedBufferSubData(distancesBuffer, 0, size * sizeof(float), distances.data());
+
+    auto& program = _programs(ProgramType::eSimilaritiesComp);
+    program.bind();
+    program.template uniform<uint>("nPoints", nRows);
+    program.template uniform<uint>("kNeighbors", _params->k);
+    program.template uniform<float>("perplexity", _params->perplexity);
+    program.template uniform<uint>("nIters", 200);
+    program.template uniform<float>("epsilon", 1e-4);
+    program.template uniform<uint>("firstNeighbor", 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, distancesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, distancesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, similaritiesBuffer);
+    glDispatchCompute(ceilDiv(nRows, 256u), 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glGetNamedBufferSubData(similaritiesBuffer, 0, size * sizeof(float), similarities.data());
+    pool.release(distancesBuffer);
+    pool.release(similaritiesBuffer);
+    glAssert();
+  }
+
+  void Similarities::insert(const float* dataPtr, uint n) {
+    runtimeAssert(isInit() && !_mins.empty(), "Similarities::insert() requires dense input held on the device");
+    runtimeAssert(_knnK >= _params->k, "Similarities::insert() requires a KNN search kept through Params::keepKNN");
+    runtimeAssert(!_params->compressSimilarities && !_params->segmentedGraph, "Similarities::insert() requires uncompressed similarities within one storage block");
+    if (n == 0) {
+      return;
+    }
+
+    const uint nOld = _params->n;
+    const uint nNew = nOld + n;
+    const uint d = _params->nHighDims;
+    const uint k = _knnK;         // Neighbors per kept row
+    const uint kGraph = _params->k; // Neighbors per row entering the graph, itself first
+    const uint missing = std::numeric_limits<uint>::max();
+    const ulong nValues = static_cast<ulong>(n) * d;
+    util::glAssertStorageSize(static_cast<ulong>(nNew) * d, sizeof(float), "Similarities: dataset");
+    util::glAssertStorageSize(static_cast<ulong>(nNew) * k, sizeof(float), "Similarities: KNN");
+    auto& pool = util::ThreadPool::instance();
+
+    // Normalize new points as the existing ones were, and append them to the dataset
+    {
+      util::HostVector<float> data;
+      pool.firstTouch(data, n, d);
+      dh::util::applyNormalization(dataPtr, n, d, _mins, _scales, data.data());
+      GLuint dataset;
+      glCreateBuffers(1, &dataset);
+      glNamedBufferStorage(dataset, static_cast<ulong>(nNew) * d * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+      glCopyNamedBufferSubData(_buffers(BufferType::eDataset), dataset, 0, 0, static_cast<ulong>(nOld) * d * sizeof(float));
+      glNamedBufferSubData(dataset, static_cast<ulong>(nOld) * d * sizeof(float), nValues * sizeof(float), data.data());
+      glDeleteBuffers(1, &_buffers(BufferType::eDataset));
+      _buffers(BufferType::eDataset) = dataset;
+      glAssert();
+    }
+
+    // 1.
+    // Search the KNN of the new points among all points, through the kept index to which they are added first. As
+    // new points are part of the searched dataset, each finds itself first, matching the kept search. The index is
+    // only built here if the kept search came without one, e.g. because points were reordered since
+    if (!_knnIndex.isInit() || _knnIndex.size() != nOld) {
+      _knnIndex = util::KNNIndex(_buffers(BufferType::eDataset), 0, nOld, d);
+    }
+    _knnIndex.add(_buffers(BufferType::eDataset), n);
+    std::vector<float> distances;
+    std::vector<uint> indices;
+    _knnIndex.search(_buffers(BufferType::eDataset), nOld, n, k, distances, indices);
+
+    // Neighbors the approximate search did not fill refer to the point itself, at the last found distance, so they
+    // are calibrated as a duplicate of it but never enter the graph
+    for (uint j = 0; j < n; ++j) {
+      for (uint l = 1; l < k; ++l) {
+        const ulong jl = static_cast<ulong>(j) * k + l;
+        if (indices[jl] >= nNew) {
+          indices[jl] = nOld + j;
+          distances[jl] = distances[jl - 1];
+        }
+      }
+    }
+
+    // 2.
+    // Find the existing points that the new points enter the KNN of. Such a reverse neighbor lies within two hops of
+    // a new point in the KNN graph, so the new points' existing neighbors and their own neighbors are candidates.
+    // These are searched against an index over the new points only, for the k - 1 nearest that may enter their set
+    std::vector<uint> candidates;
+    {
+      std::vector<char> isCandidate(nOld, 0);
+      for (ulong jl = 0; jl < indices.size(); ++jl) {
+        const uint i = indices[jl];
+        if (i >= nOld || jl % k >= kGraph) {
+          continue;
+        }
+        isCandidate[i] = 1;
+        for (uint l = 1; l < kGraph; ++l) {
+          const uint h = _knnIndices[static_cast<ulong>(i) * k + l];
+          if (h < nOld) { isCandidate[h] = 1; }
+        }
+      }
+      for (uint i = 0; i < nOld; ++i) {
+        if (isCandidate[i]) { candidates.push_back(i); }
+      }
+    }
+    const uint kReverse = std::min(k - 1, n);
+    std::vector<float> reverseDistances;
+    std::vector<uint> reverseIndices;
+    if (!candidates.empty()) {
+      util::KNNIndex index(_buffers(BufferType::eDataset), nOld, n, d);
+      index.search(_buffers(BufferType::eDataset), candidates, kReverse, reverseDistances, reverseIndices);
+    }
+
+    // Merge each candidate's hits nearer than its k'th nearest into its kept set, displacing the farthest; the point
+    // itself stays first. A point whose first Params::k neighbors changed is touched, and its old row is kept to
+    // undo its conditional similarities in the graph
+    std::vector<uint> touched;
+    std::vector<uint> touchedIndices;
+    std::vector<float> touchedDistances;
+    {
+      struct Chunk { std::vector<uint> rows, indices; std::vector<float> distances; };
+      const ulong grain = pool.grainSize(candidates.size(), 64);
+      std::vector<Chunk> chunks(ceilDiv(static_cast<ulong>(candidates.size()), grain));
+      pool.parallelFor(0, candidates.size(), grain, [&](ulong begin, ulong end) {
+        auto& chunk = chunks[begin / grain];
+        std::vector<std::pair<float, uint>> set(k);
+        for (ulong c = begin; c < end; ++c) {
+          const ulong i = candidates[c];
+          float* rowDistances = &_knnDistances[i * k];
+          uint* rowIndices = &_knnIndices[i * k];
+          const float* hitDistances = &reverseDistances[c * kReverse];
+          const uint* hitIndices = &reverseIndices[c * kReverse];
+          const auto isHit = [&](ulong b) {
+            return b < kReverse && hitIndices[b] < nNew && hitDistances[b] < rowDistances[k - 1];
+          };
+          if (!isHit(0)) {
+            continue;
+          }
+          if (hitDistances[0] < rowDistances[kGraph - 1]) {
+            chunk.rows.push_back(static_cast<uint>(i));
+            chunk.indices.insert(chunk.indices.end(), rowIndices, rowIndices + kGraph);
+            chunk.distances.insert(chunk.distances.end(), rowDistances, rowDistances + kGraph);
+          }
+
+          ulong a = 1, b = 0;
+          set[0] = { rowDistances[0], rowIndices[0] };
+          for (uint l = 1; l < k; ++l) {
+            if (isHit(b) && hitDistances[b] < rowDistances[a]) {
+              set[l] = { hitDistances[b], hitIndices[b] };
+              ++b;
+            } else {
+              set[l] = { rowDistances[a], rowIndices[a] };
+              ++a;
+            }
+          }
+          for (uint l = 0; l < k; ++l) {
+            rowDistances[l] = set[l].first;
+            rowIndices[l] = set[l].second;
+          }
+        }
+      });
+      for (auto& chunk : chunks) {
+        touched.insert(touched.end(), chunk.rows.begin(), chunk.rows.end());
+        touchedIndices.insert(touchedIndices.end(), chunk.indices.begin(), chunk.indices.end());
+        touchedDistances.insert(touchedDistances.end(), chunk.distances.begin(), chunk.distances.end());
+      }
+    }
+
+    // Append the new points' search, and extend the permutation with their input order
+    _knnDistances.insert(_knnDistances.end(), distances.begin(), distances.end());
+    _knnIndices.insert(_knnIndices.end(), indices.begin(), indices.end());
+    if (!_permutation.empty()) {
+      for (uint j = 0; j < n; ++j) { _permutation.push_back(nOld + j); }
+    }
+
+    // 3.
+    // Calibrate touched points over their old and new rows, and the new points over theirs; other points keep theirs.
+    // Slots number the touched points, then the new points
+    const uint nTouched = static_cast<uint>(touched.size());
+    std::vector<uint> points(touched);
+    std::vector<uint> slot(nNew, missing);
+    for (uint j = 0; j < n; ++j) { points.push_back(nOld + j); }
+    for (uint s = 0; s < points.size(); ++s) { slot[points[s]] = s; }
+    std::vector<float> conditional;
+    {
+      std::vector<float> rows(touchedDistances);
+      for (uint a : points) {
+        const float* rowDistances = &_knnDistances[static_cast<ulong>(a) * k];
+        rows.insert(rows.end(), rowDistances, rowDistances + kGraph);
+      }
+      calibrate(rows, nTouched + static_cast<uint>(points.size()), conditional);
+    }
+
+    // The position of b in the first Params::k neighbors of a row, or 0 if absent, as the point itself is first
+    const auto row = [&](uint a) { return &_knnIndices[static_cast<ulong>(a) * k]; };
+    const auto find = [&](const uint* neighbors, uint b) -> uint {
+      for (uint l = 1; l < kGraph; ++l) {
+        if (neighbors[l] == b) { return l; }
+      }
+      return 0;
+    };
+
+    // Change of p_b|a between the old and new calibration of a
+    const auto delta = [&](uint a, uint b) {
+      const ulong s = slot[a];
+      float p = 0.f;
+      if (s == missing) {
+        return p;
+      }
+      if (const uint l = find(row(a), b)) {
+        p += conditional[(nTouched + s) * kGraph + l];
+      }
+      if (s < nTouched) {
+        if (const uint l = find(&touchedIndices[s * kGraph], b)) {
+          p -= conditional[s * kGraph + l];
+        }
+      }
+      return p;
+    };
+
+    // Relations new to the graph, which did not exist in their point's old row, as (point, neighbor) pairs of the
+    // point whose row gains the neighbor; the neighbor's own row gains the point through its new row
+    std::vector<std::pair<uint, uint>> added;
+    for (uint s = 0; s < points.size(); ++s) {
+      const uint a = points[s];
+      for (uint l = 1; l < kGraph; ++l) {
+        const uint b = row(a)[l];
+        if (b != a && (s >= nTouched || !find(&touchedIndices[static_cast<ulong>(s) * kGraph], b))) {
+          added.emplace_back(b, a);
+        }
+      }
+    }
+    std::sort(added.begin(), added.end());
+    std::vector<ulong> addedOffsets(static_cast<ulong>(nNew) + 1, 0);
+    for (const auto& pair : added) { ++addedOffsets[pair.first + 1]; }
+    for (uint i = 0; i < nNew; ++i) { addedOffsets[i + 1] += addedOffsets[i]; }
+
+    // 4.
+    // Patch the symmetrized graph, whose similarities are 0.5 * (p_j|i + p_i|j), by the changes of conditional
+    // similarities in either direction. Edges between untouched points are copied; an edge is dropped once
+    // neither point has the other among its first Params::k neighbors. Rows are built per chunk of points, as
+    // their sizes are unknown up front, and then concatenated
+    std::vector<uint> layout, neighbors;
+    std::vector<float> similarities, originals(_symmetricSize);
+    downloadGraph(layout, neighbors, similarities);
+    glGetNamedBufferSubData(_buffers(BufferType::eSimilaritiesOriginal), 0, originals.size() * sizeof(float), originals.data());
+    glAssert();
+
+    struct Chunk { std::vector<uint> neighbors; std::vector<float> similarities, originals; };
+    const ulong grain = pool.grainSize(nNew, 1024);
+    std::vector<Chunk> chunks(ceilDiv(static_cast<ulong>(nNew), grain));
+    std::vector<ulong> offsets(static_cast<ulong>(nNew) + 1, 0);
+    pool.parallelFor(0, nNew, grain, [&](ulong begin, ulong end) {
+      auto& chunk = chunks[begin / grain];
+      std::vector<uint> edges;
+      for (ulong i = begin; i < end; ++i) {
+        const uint a = static_cast<uint>(i);
+        const uint rowBegin = a < nOld ? layout[2 * i] : 0;
+        const uint rowEnd = a < nOld ? layout[2 * i] + layout[2 * i + 1] : 0;
+        edges.assign(neighbors.begin() + rowBegin, neighbors.begin() + rowEnd);
+        if (slot[a] != missing) {
+          for (uint l = 1; l < kGraph; ++l) {
+            if (row(a)[l] != a) { edges.push_back(row(a)[l]); }
+          }
+        }
+        for (ulong r = addedOffsets[a]; r < addedOffsets[a + 1]; ++r) {
+          edges.push_back(added[r].second);
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        const size_t size = chunk.neighbors.size();
+        uint ij = rowBegin;
+        for (uint b : edges) {
+          while (ij < rowEnd && neighbors[ij] < b) { ++ij; }
+          const bool isOld = ij < rowEnd && neighbors[ij] == b;
+          float similarity = isOld ? similarities[ij] : 0.f;
+          float original = isOld ? originals[ij] : 0.f;
+          if (slot[a] != missing || slot[b] != missing) {
+            if (!find(row(a), b) && !find(row(b), a)) {
+              continue;
+            }
+            const float change = 0.5f * (delta(a, b) + delta(b, a));
+            similarity = std::max(similarity + change, 0.f);
+            original = std::max(original + change, 0.f);
+          }
+          chunk.neighbors.push_back(b);
+          chunk.similarities.push_back(similarity);
+          chunk.originals.push_back(original);
+        }
+        offsets[i] = chunk.neighbors.size() - size;
+      }
+    });
+
+    const ulong nEdges = pool.parallelScan(offsets.data(), offsets.data(), nNew);
+    offsets[nNew] = nEdges;
+    runtimeAssert(nEdges <= std::numeric_limits<uint>::max(), "Similarities: symmetrized neighbor sets exceed 32-bit shader indexing");
+    util::glAssertStorageSize(nEdges, sizeof(float), "Similarities: symmetrized neighbors");
+    layout.resize(2 * static_cast<ulong>(nNew));
+    neighbors.resize(nEdges);
+    similarities.resize(nEdges);
+    originals.resize(nEdges);
+    pool.parallelFor(0, chunks.size(), 1, [&](ulong begin, ulong end) {
+      for (ulong c = begin; c < end; ++c) {
+        const ulong iBegin = c * grain;
+        const ulong iEnd = std::min(iBegin + grain, static_cast<ulong>(nNew));
+        for (ulong i = iBegin; i < iEnd; ++i) {
+          layout[2 * i] = static_cast<uint>(offsets[i]);
+          layout[2 * i + 1] = static_cast<uint>(offsets[i + 1] - offsets[i]);
+        }
+        std::copy(chunks[c].neighbors.begin(), chunks[c].neighbors.end(), neighbors.begin() + offsets[iBegin]);
+        std::copy(chunks[c].similarities.begin(), chunks[c].similarities.end(), similarities.begin() + offsets[iBegin]);
+        std::copy(chunks[c].originals.begin(), chunks[c].originals.end(), originals.begin() + offsets[iBegin]);
+        chunks[c] = Chunk();
+      }
+    });
+    Logger::newl() << prefix << "Inserted " << n << " points, recalibrated " << nTouched << " existing points";
+
+    // 5.
+    // Replace device copies; storage is immutable, so buffers are recreated. Attribute weights are kept, and L1
+    // distances are accumulated anew over the patched graph
+    _params->n = nNew;
+    _symmetricSize = nEdges;
+    const ulong storageSize = std::max<ulong>(nEdges, 1); // Avoid zero-sized storage for a graph without edges
+    const std::vector<float> zeroes(storageSize, 0.f);
+    glDeleteBuffers(1, &_buffers(BufferType::eLayout));
+    glCreateBuffers(1, &_buffers(BufferType::eLayout));
+    recreateGraphBuffers();
+    glNamedBufferStorage(_buffers(BufferType::eLayout), layout.size() * sizeof(uint), layout.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eNeighbors), storageSize * sizeof(uint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(_buffers(BufferType::eSimilarities), storageSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(_buffers(BufferType::eSimilaritiesOriginal), storageSize * sizeof(float), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferSubData(_buffers(BufferType::eNeighbors), 0, nEdges * sizeof(uint), neighbors.data());
+    glNamedBufferSubData(_buffers(BufferType::eSimilarities), 0, nEdges * sizeof(float), similarities.data());
+    glNamedBufferSubData(_buffers(BufferType::eSimilaritiesOriginal), 0, nEdges * sizeof(float), originals.data());
+    glNamedBufferStorage(_buffers(BufferType::eDistancesL1), storageSize * sizeof(float), zeroes.data(), 0);
+    glNamedBufferStorage(_buffers(BufferType::eNeighborsSelected), storageSize * sizeof(uint), nullptr, 0);
+    glAssert();
+    compL1Distances();
   }
 
   // Renormalizing the similarities
   void Similarities::renormalizeSimilarities(GLuint selectionBufferHandle) {
+    if (_params->compressSimilarities || _params->segmentedGraph) { return; } // A compressed or segmented graph cannot be edited
     float simSumOrg = dh::util::BufferTools::instance().reduce<float>(_buffers(BufferType::eSimilaritiesOriginal), 0, _params->n, selectionBufferHandle, -1, true, _buffers(BufferType::eLayout), _buffers(BufferType::eNeighbors));
     float simSumNew = dh::util::BufferTools::instance().reduce<float>(_buffers(BufferType::eSimilarities), 0, _params->n, selectionBufferHandle, -1, true, _buffers(BufferType::eLayout), _buffers(BufferType::eNeighbors));
     float factor = simSumOrg / simSumNew;
@@ -382,6 +1939,7 @@ namespace dh::sne {
   }
 
   void Similarities::weighSimilarities(float weight, GLuint selectionBufferHandle, bool interOnly) {
+    if(_params->compressSimilarities || _params->segmentedGraph) { return; }
     if(interOnly) { weight = std::pow(weight, 3); }
 
     auto &program = _programs(ProgramType::eWeighSimilaritiesComp);
@@ -405,12 +1963,13 @@ namespace dh::sne {
   }
 
   void Similarities::weighSimilaritiesPerAttributeRatio(std::set<uint> weightedAttributeIndices, GLuint selectionBufferHandle, uint nSelected, GLuint labelsBufferHandle) {
-    if(weightedAttributeIndices.size() == 0) { return; }
+    if(weightedAttributeIndices.size() == 0 || _params->knnBlockSize > 0 || _params->compressSimilarities || _params->segmentedGraph) { return; }
     
     // Create and initialize temp buffers
-    glCreateBuffers(_buffersTemp.size(), _buffersTemp.data());
+    auto& pool = util::GLBufferPool::instance();
     std::vector<uint> setvec(weightedAttributeIndices.begin(), weightedAttributeIndices.end());
-    glNamedBufferStorage(_buffersTemp(BufferTempType::eWeightedAttributeIndices), weightedAttributeIndices.size() * sizeof(uint), setvec.data(), 0);
+    _buffersTemp(BufferTempType::eWeightedAttributeIndices) = pool.acquire(setvec.size() * sizeof(uint));
+    glNamedBufferSubData(_buffersTemp(BufferTempType::eWeightedAttributeIndices), 0, setvec.size() * sizeof(uint), setvec.data());
 
     // Weighting the similarities
     {
@@ -433,6 +1992,10 @@ namespace dh::sne {
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _buffers(BufferType::eNeighbors));
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _buffers(BufferType::eSimilaritiesOriginal));
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _buffers(BufferType::eSimilarities));
+      if (_params->sparseData) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, _buffers(BufferType::eDatasetOffsets));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, _buffers(BufferType::eDatasetIndices));
+      }
 
       // Dispatch shader
       glDispatchCompute(ceilDiv(_params->n, 256u / 32u), 1, 1);
@@ -443,17 +2006,18 @@ namespace dh::sne {
 
 
     glAssert();
-    glDeleteBuffers(_buffersTemp.size(), _buffersTemp.data());
+    pool.release(_buffersTemp(BufferTempType::eWeightedAttributeIndices));
   }
 
   void Similarities::weighSimilaritiesPerAttributeRange(std::set<uint> weightedAttributeIndices, GLuint selectionBufferHandle, uint nSelected, GLuint labelsBufferHandle) {
-    if(weightedAttributeIndices.size() == 0) { return; }
+    if(weightedAttributeIndices.size() == 0 || _params->knnBlockSize > 0 || _params->compressSimilarities || _params->segmentedGraph) { return; }
 
     // Create and initialize temp buffers
-    glCreateBuffers(_buffersTemp.size(), _buffersTemp.data());
+    auto& pool = util::GLBufferPool::instance();
     std::vector<uint> setvec(weightedAttributeIndices.begin(), weightedAttributeIndices.end());
-    glNamedBufferStorage(_buffersTemp(BufferTempType::eWeightedAttributeIndices), weightedAttributeIndices.size() * sizeof(uint), setvec.data(), 0);
-    glNamedBufferStorage(_buffersTemp(BufferTempType::eSubDistancesL1), _symmetricSize * sizeof(float), nullptr, 0);
+    _buffersTemp(BufferTempType::eWeightedAttributeIndices) = pool.acquire(setvec.size() * sizeof(uint));
+    glNamedBufferSubData(_buffersTemp(BufferTempType::eWeightedAttributeIndices), 0, setvec.size() * sizeof(uint), setvec.data());
+    _buffersTemp(BufferTempType::eSubDistancesL1) = pool.acquire(_symmetricSize * sizeof(float));
     glClearNamedBufferData(_buffersTemp(BufferTempType::eSubDistancesL1), GL_R32F, GL_RED, GL_FLOAT, nullptr); // Initialize with all zeros
 
     // Obtaining the subdistances across the weighted attributes
@@ -474,6 +2038,10 @@ namespace dh::sne {
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _buffers(BufferType::eLayout));
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _buffers(BufferType::eNeighbors));
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _buffersTemp(BufferTempType::eSubDistancesL1));
+      if (_params->sparseData) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _buffers(BufferType::eDatasetOffsets));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, _buffers(BufferType::eDatasetIndices));
+      }
 
       // Dispatch shader
       glDispatchCompute(ceilDiv(_params->n, 256u / 32u), 1, 1);
@@ -510,12 +2078,15 @@ namespace dh::sne {
     renormalizeSimilarities(selectionBufferHandle);
 
     glAssert();
-    glDeleteBuffers(_buffersTemp.size(), _buffersTemp.data());
+    pool.release(_buffersTemp(BufferTempType::eWeightedAttributeIndices));
+    pool.release(_buffersTemp(BufferTempType::eSubDistancesL1));
   }
 
   void Similarities::weighSimilaritiesPerAttributeResemble(std::set<uint> weightedAttributeIndices, GLuint selectionBufferHandle, uint nSelected, GLuint labelsBufferHandle, std::pair<uint, uint> snapslotHandles, uint nHighDims) {
+    if(_params->sparseData || _params->knnBlockSize > 0 || _params->compressSimilarities || _params->segmentedGraph) { return; } // Resemblance compares dense per-attribute snapshots, unavailable for sparse or out-of-core input
+
     // Create and initialize temp buffers
-    glCreateBuffers(_buffersTemp.size(), _buffersTemp.data());
+    auto& pool = util::GLBufferPool::instance();
     std::vector<uint> attributeIndices;
     if(weightedAttributeIndices.size() > 0) {
       attributeIndices = std::vector<uint>(weightedAttributeIndices.begin(), weightedAttributeIndices.end());
@@ -525,7 +2096,8 @@ namespace dh::sne {
       const std::vector<float> zeroes(_params->nHighDims, 0.f);
       glClearNamedBufferData(_buffers(BufferType::eAttributeWeights), GL_R32F, GL_RED, GL_FLOAT, zeroes.data());
     }
-    glNamedBufferStorage(_buffersTemp(BufferTempType::eWeightedAttributeIndices), attributeIndices.size() * sizeof(uint), attributeIndices.data(), 0);
+    _buffersTemp(BufferTempType::eWeightedAttributeIndices) = pool.acquire(attributeIndices.size() * sizeof(uint));
+    glNamedBufferSubData(_buffersTemp(BufferTempType::eWeightedAttributeIndices), 0, attributeIndices.size() * sizeof(uint), attributeIndices.data());
 
     // Weighting the similarities
     {
@@ -560,11 +2132,12 @@ namespace dh::sne {
       const std::vector<float> ones(_params->nHighDims, 1.f);
       glClearNamedBufferData(_buffers(BufferType::eAttributeWeights), GL_R32F, GL_RED, GL_FLOAT, ones.data());
     }
-    glDeleteBuffers(_buffersTemp.size(), _buffersTemp.data());
+    pool.release(_buffersTemp(BufferTempType::eWeightedAttributeIndices));
     glAssert();
   }
 
   void Similarities::reset() {
+    if (_params->compressSimilarities || _params->segmentedGraph) { return; }
     glCopyNamedBufferSubData(_buffers(BufferType::eSimilaritiesOriginal), _buffers(BufferType::eSimilarities), 0, 0, _symmetricSize * sizeof(float));
   }
 
@@ -0,0 +1,318 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+#include "dh/sne/components/snapshots.hpp"
+#include "dh/util/io.hpp"
+#include "dh/util/logger.hpp"
+#include "dh/util/reorder.hpp"
+#include "dh/util/gl/error.hpp"
+
+namespace dh::sne {
+  // Logging shorthands
+  using util::Logger;
+  const std::string prefix = util::genLoggerPrefix("[Snapshots]");
+
+  // Writer thread and the state it shares with the GL thread. Staging buffers are persistently
+  // mapped, so the writer reads directly from pinned memory; only fences are touched by the GL thread.
+  struct Snapshots::Writer {
+    // Configuration, fixed before the thread starts
+    std::string filename;
+    bool append;
+    bool npy;
+    uint n;
+    uint nDims;
+    uint nDimsPadded;
+    std::vector<uint> permutation;
+    std::array<const float*, nStagingBuffers> data;
+
+    // Shared state
+    std::mutex mutex;
+    std::condition_variable cvQueue;
+    std::condition_variable cvDone;
+    std::deque<std::pair<uint, uint>> queue;     // Pairs of staging buffer and iteration
+    std::array<bool, nStagingBuffers> busy = {}; // Staging buffer is being copied into, queued, or written
+    std::string error;
+    bool stop = false;
+
+    // Writer thread state
+    std::thread thread;
+    std::ofstream appendStream;
+    std::vector<float> packed;
+    size_t nWritten = 0;
+
+    void run() {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        cvQueue.wait(lock, [&] { return stop || !queue.empty(); });
+        if (queue.empty()) {
+          return;
+        }
+        const auto [buffer, iteration] = queue.front();
+        queue.pop_front();
+
+        // Write without holding the lock, so the GL thread is never held up by disk
+        lock.unlock();
+        try {
+          write(buffer, iteration);
+        } catch (const std::exception& e) {
+          lock.lock();
+          error = e.what();
+          lock.unlock();
+        }
+        lock.lock();
+        busy[buffer] = false;
+        cvDone.notify_all();
+      }
+    }
+
+    void write(uint buffer, uint iteration) {
+      // Drop padding of 3D embeddings, which are stored as 4-component vectors, and restore input order
+      const float* ptr = data[buffer];
+      if (!permutation.empty()) {
+        packed.resize(static_cast<size_t>(n) * nDims);
+        util::restoreRowOrder(permutation, ptr, nDimsPadded, packed.data(), nDims);
+        ptr = packed.data();
+      } else if (nDims != nDimsPadded) {
+        packed.resize(static_cast<size_t>(n) * nDims);
+        for (size_t i = 0; i < n; ++i) {
+          std::memcpy(&packed[i * nDims], &ptr[i * nDimsPadded], nDims * sizeof(float));
+        }
+        ptr = packed.data();
+      }
+      const std::streamsize size = static_cast<std::streamsize>(n) * nDims * sizeof(float);
+
+      if (append) {
+        // Add one snapshot to the end, then grow the leading axis of the header in place
+        appendStream.write((const char *) ptr, size);
+        nWritten++;
+        if (npy) {
+          appendStream.seekp(0);
+          util::writeNpyHeader(appendStream, util::DataType::eFloat32, { nWritten, n, nDims });
+          appendStream.seekp(0, std::ios::end);
+        }
+        appendStream.flush();
+        if (!appendStream) {
+          throw std::runtime_error("Snapshot file cannot be written: " + filename);
+        }
+      } else {
+        const std::string numberedFilename = numbered(iteration);
+        std::ofstream ofs(numberedFilename, std::ios::out | std::ios::binary);
+        if (!ofs) {
+          throw std::runtime_error("Snapshot file cannot be accessed: " + numberedFilename);
+        }
+        if (npy) {
+          util::writeNpyHeader(ofs, util::DataType::eFloat32, { n, nDims });
+        }
+        ofs.write((const char *) ptr, size);
+      }
+    }
+
+    // Insert iteration before the extension, e.g. embedding.npy becomes embedding_000100.npy
+    std::string numbered(uint iteration) const {
+      const size_t dot = filename.find_last_of('.');
+      const size_t slash = filename.find_last_of("/\\");
+      const size_t split = (dot == std::string::npos || (slash != std::string::npos && dot < slash)) 
+                         ? filename.size() : dot;
+      std::stringstream ss;
+      ss << filename.substr(0, split) << '_' << std::setw(6) << std::setfill('0') << iteration << filename.substr(split);
+      return ss.str();
+    }
+  };
+
+  Snapshots::Snapshots()
+  : _isInit(false), _params(nullptr), _embeddingBuffer(0), _snapshotSize(0), _buffers(), _fences(), _iterations() {
+    // ...
+  }
+
+  Snapshots::Snapshots(Params* params, GLuint embeddingBuffer, uint nDims, uint nDimsPadded, std::vector<uint> permutation)
+  : _isInit(false), _params(params), _embeddingBuffer(embeddingBuffer), _buffers(), _fences(), _iterations(),
+    _writer(std::make_unique<Writer>()) {
+    Logger::newt() << prefix << "Initializing...";
+
+    _snapshotSize = static_cast<size_t>(_params->n) * nDimsPadded * sizeof(float);
+
+    // Initialize persistently mapped staging buffers in client memory
+    {
+      const GLbitfield mapFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glCreateBuffers(_buffers.size(), _buffers.data());
+      for (uint i = 0; i < nStagingBuffers; ++i) {
+        glNamedBufferStorage(_buffers[i], _snapshotSize, nullptr, mapFlags | GL_CLIENT_STORAGE_BIT);
+        _writer->data[i] = static_cast<const float*>(glMapNamedBufferRange(_buffers[i], 0, _snapshotSize, mapFlags));
+      }
+      glAssert();
+    }
+
+    // Configure and start writer thread
+    {
+      const std::string& filename = _params->snapshotFilename;
+      _writer->filename = filename;
+      _writer->append = _params->snapshotAppend;
+      _writer->npy = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".npy") == 0;
+      _writer->n = _params->n;
+      _writer->nDims = nDims;
+      _writer->nDimsPadded = nDimsPadded;
+      _writer->permutation = std::move(permutation);
+      if (_writer->append) {
+        _writer->appendStream.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!_writer->appendStream) {
+          throw std::runtime_error("Snapshot file cannot be accessed: " + filename);
+        }
+        if (_writer->npy) {
+          util::writeNpyHeader(_writer->appendStream, util::DataType::eFloat32, { 0, _params->n, nDims });
+        }
+      }
+      _writer->thread = std::thread(&Writer::run, _writer.get());
+    }
+
+    Logger::rest() << prefix << "Initialized, every " << _params->snapshotInterval << " iterations to " << _params->snapshotFilename;
+    _isInit = true;
+  }
+
+  Snapshots::~Snapshots() {
+    if (_isInit) {
+      try {
+        flush();
+      } catch (const std::exception& e) {
+        Logger::newl() << prefix << e.what();
+      }
+
+      // Stop writer thread once the queue is drained
+      {
+        std::lock_guard<std::mutex> lock(_writer->mutex);
+        _writer->stop = true;
+      }
+      _writer->cvQueue.notify_one();
+      _writer->thread.join();
+
+      for (GLuint buffer : _buffers) {
+        glUnmapNamedBuffer(buffer);
+      }
+      glDeleteBuffers(_buffers.size(), _buffers.data());
+    }
+  }
+
+  Snapshots::Snapshots(Snapshots&& other) noexcept
+  : Snapshots() {
+    swap(*this, other);
+  }
+
+  Snapshots& Snapshots::operator=(Snapshots&& other) noexcept {
+    swap(*this, other);
+    return *this;
+  }
+
+  void Snapshots::comp(uint iteration) {
+    runtimeAssert(_isInit, "Snapshots::comp() called before initialization");
+
+    std::unique_lock<std::mutex> lock(_writer->mutex);
+    if (!_writer->error.empty()) {
+      throw std::runtime_error(std::exchange(_writer->error, ""));
+    }
+
+    // Queue copies which have landed in staging memory for writing, oldest first
+    for (uint i : pendingOrder()) {
+      GLint status;
+      glGetSynciv(static_cast<GLsync>(_fences[i]), GL_SYNC_STATUS, 1, nullptr, &status);
+      if (status != GL_SIGNALED) {
+        break;
+      }
+      glDeleteSync(static_cast<GLsync>(_fences[i]));
+      _fences[i] = nullptr;
+      _writer->queue.emplace_back(i, _iterations[i]);
+      _writer->cvQueue.notify_one();
+    }
+
+    if (iteration % _params->snapshotInterval != 0) {
+      return;
+    }
+
+    // Find a free staging buffer, or skip this snapshot rather than wait on the writer
+    uint i = 0;
+    while (i < nStagingBuffers && _writer->busy[i]) { ++i; }
+    if (i == nStagingBuffers) {
+      return;
+    }
+    _writer->busy[i] = true;
+    lock.unlock();
+
+    // Copy embedding into staging memory; a fence tells when the copy is done
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(_embeddingBuffer, _buffers[i], 0, 0, _snapshotSize);
+    _fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _iterations[i] = iteration;
+    glAssert();
+  }
+
+  std::vector<uint> Snapshots::pendingOrder() const {
+    std::vector<uint> order;
+    for (uint i = 0; i < nStagingBuffers; ++i) {
+      if (_fences[i]) {
+        order.push_back(i);
+      }
+    }
+    std::sort(order.begin(), order.end(), [&](uint a, uint b) { return _iterations[a] < _iterations[b]; });
+    return order;
+  }
+
+  void Snapshots::flush() {
+    runtimeAssert(_isInit, "Snapshots::flush() called before initialization");
+
+    // Wait for in-flight copies and hand them to the writer, oldest first
+    for (uint i : pendingOrder()) {
+      while (glClientWaitSync(static_cast<GLsync>(_fences[i]), GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000) == GL_TIMEOUT_EXPIRED) {
+        // ...
+      }
+      glDeleteSync(static_cast<GLsync>(_fences[i]));
+      _fences[i] = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(_writer->mutex);
+        _writer->queue.emplace_back(i, _iterations[i]);
+      }
+      _writer->cvQueue.notify_one();
+    }
+    glAssert();
+
+    // Wait for the writer to finish all queued snapshots
+    std::unique_lock<std::mutex> lock(_writer->mutex);
+    _writer->cvDone.wait(lock, [&] {
+      return std::none_of(_writer->busy.begin(), _writer->busy.end(), [](bool b) { return b; });
+    });
+    if (!_writer->error.empty()) {
+      throw std::runtime_error(std::exchange(_writer->error, ""));
+    }
+  }
+} // dh::sne
@@ -22,20 +22,52 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include "dh/sne/sne.hpp"
 #include "dh/util/aligned.hpp"
+#include "dh/util/coarsen.hpp"
 #include "dh/util/logger.hpp"
+#include "dh/util/reorder.hpp"
+#include "dh/util/thread_pool.hpp"
+#include "dh/util/gl/buffer_pool.hpp"
 #include "dh/util/gl/error.hpp"
+#include "dh/util/gl/metric.hpp"
 
 namespace dh::sne {
+  // Logging shorthands
+  using util::Logger;
+  const std::string prefix = util::genLoggerPrefix("[SNE]");
+
+  namespace {
+    // An embedding's extent grows with the number of points it holds, about as n^(1/D). Returns the factor by which
+    // positions of an embedding of nFrom points are scaled to start an embedding of nTo points
+    float extentScale(uint nFrom, uint nTo, uint nDims) {
+      return std::pow(static_cast<float>(nTo) / static_cast<float>(nFrom), 1.f / static_cast<float>(nDims));
+    }
+  } // anonymous namespace
+
   SNE::SNE() 
   : _isInit(false), _dataPtr(nullptr) {
     // ...
   }
 
   SNE::SNE(Params* params, std::vector<char> axisMapping, const std::vector<float>& data, const std::vector<int>& labels)
-  : _dataPtr(data.data()),
-    _labelPtr(labels.data()),
+  : SNE(params, axisMapping, data.data(), labels.data()) {
+    // ...
+  }
+
+  SNE::SNE(Params* params, std::vector<char> axisMapping, const float* dataPtr, const int* labelPtr)
+  : _dataPtr(dataPtr),
+    _labelPtr(labelPtr),
     _params(params),
     _axisMapping(axisMapping),
     _similarities(_dataPtr, params),
@@ -43,6 +75,16 @@ namespace dh::sne {
     // ...
   }
 
+  SNE::SNE(Params* params, std::vector<char> axisMapping, util::CSRMatrix data, const int* labelPtr)
+  : _dataPtr(nullptr),
+    _labelPtr(labelPtr),
+    _params(params),
+    _axisMapping(axisMapping),
+    _similarities(std::move(data), params),
+    _isInit(true) {
+    // ...
+  }
+
   SNE::~SNE() {
     // ...
   }
@@ -81,10 +123,65 @@ namespace dh::sne {
     _similaritiesTimer.tock();
     _similaritiesTimer.poll();
 
+    // Landmark walks and multilevel coarsening read the graph on the host through 32-bit offsets, which a graph split
+    // into segments lacks. Whether it is split is only known once symmetrized, so this stops before any minimization is set up
+    if (_params->segmentedGraph && _params->nLandmarks > 0 && _params->nLandmarks < _params->n) {
+      throw std::runtime_error("Landmarks cannot be selected over a KNN graph exceeding one storage block; lower --perplexity or disable --landmarks");
+    }
+    if (_params->segmentedGraph && _params->multilevelLevels > 1) {
+      throw std::runtime_error("A KNN graph exceeding one storage block cannot be coarsened; lower --perplexity or disable --levels");
+    }
+
+    // If points were reordered, the minimization's host inputs must follow. The dataset is only read for PCA
+    if (const auto& permutation = _similarities.permutation(); !permutation.empty()) {
+      if (_labelPtr) {
+        _labelsReordered.resize(permutation.size());
+        for (uint i = 0; i < permutation.size(); ++i) { _labelsReordered[i] = _labelPtr[permutation[i]]; }
+        _labelPtr = _labelsReordered.data();
+      }
+      if (_dataPtr && !_params->disablePCA) {
+        _dataReordered.assign(_dataPtr, _dataPtr + static_cast<ulong>(_params->n) * _params->nHighDims);
+        util::permuteRows(_dataReordered, _params->nHighDims, permutation);
+        _dataPtr = _dataReordered.data();
+      }
+    }
+
     // After similarities are available, initialize minimization subcomponent
+    if (_params->autoSchedule) {
+      scheduleAutomatically(*_params);
+    }
     constructMinimization();
   }
 
+  // Nested minimizations follow the current params, but have no dataset to initialize from along principal
+  // components, and no output. Their schedule is derived again from their own number of points
+  Params SNE::childParams(uint n) {
+    Params params = *_params;
+    params.n = n;
+    params.disablePCA = true;
+    params.snapshotFilename.clear();
+    if (params.autoSchedule) {
+      scheduleAutomatically(params);
+    }
+    return params;
+  }
+
+  // The learning rate grows with the number of points, as in Belkina et al. (2019), so that large datasets do not
+  // need many more iterations to expand; exaggeration and momentum follow TSNE-CUDA. Exaggeration lasts longer on
+  // larger datasets, by 250 iterations per tenfold beyond 100k points, and momentum switches as it ends
+  void SNE::scheduleAutomatically(Params& params) {
+    const float scale = std::max(1.f, 1.f + std::log10(static_cast<float>(params.n) / 100'000.f));
+    params.exaggerationFactor = 12.f;
+    params.eta = std::max(200.f, static_cast<float>(params.n) / params.exaggerationFactor);
+    params.momentum = 0.5f;
+    params.finalMomentum = 0.8f;
+    params.nExaggerationIters = static_cast<uint>(250.f * scale);
+    params.nExponentialDecayIters = static_cast<uint>(150.f * scale);
+    params.momentumSwitchIter = params.nExaggerationIters;
+    Logger::newl() << prefix << "Schedule: eta " << params.eta << ", exaggeration " << params.exaggerationFactor
+                   << " for " << params.nExaggerationIters << " iterations, decaying over " << params.nExponentialDecayIters;
+  }
+
   void SNE::compMinimization() {
     const bool mIsInit = std::visit([](const auto& m) { return m.isInit(); }, _minimization);
     runtimeAssert(_isInit, "SNE::compMinimization() called before initialization");
@@ -92,11 +189,346 @@ namespace dh::sne {
 
     // Run timer to track full minimization computation
     _minimizationTimer.tick();
-    std::visit([&](auto& m) { m.comp(); }, _minimization);  // This selects the correct template instantiation, i.e. Minimization<_params->nLowDims>
+    if (_params->nLandmarks > 0 && _params->nLandmarks < _params->n) {
+      compLandmarks();
+    } else if (_params->multilevelLevels > 1) {
+      compMultilevel();
+    } else if (_params->negativeSampling) {
+      runtimeAssert((!std::holds_alternative<sne::Minimization<2, 3>>(_minimization)), "SNE: negative sampling requires all embedding axes to be t-SNE axes");
+      std::visit([&](auto& m) { m.compSampling(); }, _minimization);
+    } else if (_params->nReplicates > 1) {
+      compReplicates();
+    } else {
+      std::visit([&](auto& m) { m.comp(); }, _minimization);  // This selects the correct template instantiation, i.e. Minimization<_params->nLowDims>
+    }
     _minimizationTimer.tock();
     _minimizationTimer.poll();
   }
 
+  void SNE::recompSimilarities(float perplexity) {
+    const bool mIsInit = std::visit([](const auto& m) { return m.isInit(); }, _minimization);
+    runtimeAssert(mIsInit, "SNE::recompSimilarities() called before SNE::compSimilarities()");
+
+    _similaritiesTimer.tick();
+    _similarities.recomp(perplexity);
+    _similaritiesTimer.tock();
+    _similaritiesTimer.poll();
+    std::visit([](auto& m) { m.refreshSimilarities(); }, _minimization);
+  }
+
+  void SNE::restartMinimization() {
+    const bool mIsInit = std::visit([](const auto& m) { return m.isInit(); }, _minimization);
+    runtimeAssert(mIsInit, "SNE::restartMinimization() called before SNE::compSimilarities()");
+
+    std::visit([&](auto& m) { m.restart(_params->seed); }, _minimization);
+  }
+
+  std::vector<float> SNE::transform(const float* dataPtr, uint n) {
+    const bool mIsInit = std::visit([](const auto& m) { return m.isInit(); }, _minimization);
+    runtimeAssert(mIsInit, "SNE::transform() called before SNE::compSimilarities()");
+    runtimeAssert((!std::holds_alternative<sne::Minimization<2, 3>>(_minimization)), "SNE::transform() requires all embedding axes to be t-SNE axes");
+
+    // New points are similar to the reference points only, which stay fixed, so the current minimization embeds them
+    // against its own embedding. Their params follow the reference's
+    Params params = childParams(n);
+    Similarities similarities(_similarities, dataPtr, &params);
+    std::vector<float> embedding = std::visit([&](auto& m) {
+      return m.transform(similarities.getBuffers(), n);
+    }, _minimization);
+
+    Logger::newl() << prefix << "Transformed " << n << " points";
+    return embedding;
+  }
+
+  void SNE::insert(const float* dataPtr, uint n, const int* labelPtr) {
+    const bool mIsInit = std::visit([](const auto& m) { return m.isInit(); }, _minimization);
+    runtimeAssert(mIsInit, "SNE::insert() called before SNE::compSimilarities()");
+
+    const uint nOld = _params->n;
+    const ulong nHighDims = _params->nHighDims;
+    _similaritiesTimer.tick();
+    _similarities.insert(dataPtr, n);
+    _similaritiesTimer.tock();
+    _similaritiesTimer.poll();
+
+    // Host inputs of the minimization are appended to, in minimization order. The dataset is only read for PCA, by
+    // later minimizations; the resumed one below does not need it
+    if (_dataPtr && !_params->disablePCA) {
+      auto& pool = util::ThreadPool::instance();
+      util::HostVector<float> data;
+      pool.firstTouch(data, nOld + n, nHighDims);
+      pool.parallelFor(0, nOld + n, 0, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          const float* src = i < nOld ? _dataPtr + i * nHighDims : dataPtr + (i - nOld) * nHighDims;
+          std::copy_n(src, nHighDims, data.data() + i * nHighDims);
+        }
+      });
+      _dataReordered = std::move(data);
+      _dataPtr = _dataReordered.data();
+    }
+    if (_labelPtr != _labelsReordered.data() || _labelsReordered.size() != nOld) {
+      _labelsReordered.assign(nOld, -1);
+      if (_labelPtr) { std::copy_n(_labelPtr, nOld, _labelsReordered.begin()); }
+    }
+    if (labelPtr) {
+      _labelsReordered.insert(_labelsReordered.end(), labelPtr, labelPtr + n);
+    } else {
+      _labelsReordered.resize(_params->n, -1);
+    }
+    _labelPtr = _labelsReordered.data();
+
+    // Each new point starts at the mean position of its existing nearest neighbors, with some jitter,
+    // so that new points sharing their neighbors do not coincide
+    const uint k = _similarities.knnK();
+    const uint nNeighbors = _params->k;
+    const auto& indices = _similarities.knnIndices();
+    std::mt19937 rng(_params->seed);
+    std::uniform_real_distribution<float> jitter(-1.f, 1.f);
+    std::visit([&](auto& m) {
+      const uint nDims = _params->nLowDims;
+      const uint stride = util::detail::std430_align(nDims) / sizeof(float);
+      std::vector<float> embedding(static_cast<ulong>(nOld) * stride);
+      glGetNamedBufferSubData(m.buffers().embedding, 0, embedding.size() * sizeof(float), embedding.data());
+      glAssert();
+
+      std::vector<float> positions(static_cast<ulong>(n) * nDims, 0.f);
+      for (ulong i = 0; i < n; ++i) {
+        uint count = 0;
+        for (ulong ij = (nOld + i) * k + 1; ij < (nOld + i) * k + nNeighbors; ++ij) {
+          if (indices[ij] >= nOld) { continue; }
+          for (uint d = 0; d < nDims; ++d) { positions[i * nDims + d] += embedding[static_cast<ulong>(indices[ij]) * stride + d]; }
+          ++count;
+        }
+        for (uint d = 0; d < nDims; ++d) {
+          positions[i * nDims + d] = positions[i * nDims + d] / std::max(count, 1u) + 0.01f * _params->rngRange * jitter(rng);
+        }
+      }
+
+      // The new minimization's initial embedding is overwritten on resuming, so is not worth an informed
+      // initialization, nor training PCA over all points
+      const std::string initialization = std::exchange(_params->initialization, "random");
+      const bool disablePCA = std::exchange(_params->disablePCA, true);
+      std::decay_t<decltype(m)> minimization(&_similarities, _dataPtr, _labelPtr, _params, _axisMapping);
+      _params->initialization = initialization;
+      _params->disablePCA = disablePCA;
+      minimization.resume(m, positions);
+      m = std::move(minimization);
+    }, _minimization);
+  }
+
+  void SNE::compLandmarks() {
+    runtimeAssert((!std::holds_alternative<sne::Minimization<2, 3>>(_minimization)), "SNE: landmark minimization requires all embedding axes to be t-SNE axes");
+
+    // Landmarks are minimized in a nested minimization, over their own similarities
+    const uint n = _params->n;
+    std::vector<uint> landmarks;
+    util::CSRMatrix walks;
+    _similarities.landmarks(landmarks, walks);
+    const uint nLandmarks = static_cast<uint>(landmarks.size());
+    Params params = childParams(nLandmarks);
+    Similarities similarities(_similarities, landmarks, walks, &params);
+
+    std::vector<int> labels(nLandmarks, -1);
+    if (_labelPtr) {
+      for (uint l = 0; l < nLandmarks; ++l) { labels[l] = _labelPtr[landmarks[l]]; }
+    }
+
+    std::visit([&](auto& m) {
+      const uint nDims = _params->nLowDims;
+      const uint stride = util::detail::std430_align(nDims) / sizeof(float);
+      std::vector<float> landmarkEmbedding(static_cast<ulong>(nLandmarks) * stride);
+      {
+        std::decay_t<decltype(m)> minimization(&similarities, nullptr, labels.data(), &params, _axisMapping);
+        minimization.comp();
+        glGetNamedBufferSubData(minimization.buffers().embedding, 0, landmarkEmbedding.size() * sizeof(float), landmarkEmbedding.data());
+        glAssert();
+      }
+
+      // Landmarks keep their positions, and other points start at the mean of the landmarks their walks reached,
+      // weighted by the fraction of walks, scaled up to the extent of all points. Points whose walks reached none are
+      // spread over the landmarks
+      const float scale = extentScale(nLandmarks, n, nDims);
+      std::vector<float> positions(static_cast<ulong>(n) * nDims, 0.f);
+      for (uint l = 0; l < nLandmarks; ++l) {
+        for (uint d = 0; d < nDims; ++d) { positions[static_cast<ulong>(landmarks[l]) * nDims + d] = scale * landmarkEmbedding[l * stride + d]; }
+      }
+      const ulong nUnreached = util::ThreadPool::instance().parallelReduce(0, n, 0, ulong(0), [&](ulong begin, ulong end) {
+        ulong count = 0;
+        for (ulong i = begin; i < end; ++i) {
+          if (std::binary_search(landmarks.begin(), landmarks.end(), static_cast<uint>(i))) { continue; }
+          if (walks.offsets[i] == walks.offsets[i + 1]) {
+            for (uint d = 0; d < nDims; ++d) { positions[i * nDims + d] = scale * landmarkEmbedding[(i % nLandmarks) * stride + d]; }
+            ++count;
+            continue;
+          }
+          for (size_t ij = walks.offsets[i]; ij < walks.offsets[i + 1]; ++ij) {
+            for (uint d = 0; d < nDims; ++d) {
+              positions[i * nDims + d] += scale * walks.values[ij] * landmarkEmbedding[static_cast<ulong>(walks.indices[ij]) * stride + d];
+            }
+          }
+        }
+        return count;
+      }, std::plus<ulong>());
+      Logger::newl() << prefix << "Interpolated " << n - nLandmarks << " points from " << nLandmarks << " landmarks";
+      if (nUnreached > 0) {
+        Logger::newl() << prefix << nUnreached << " points reached no landmark, consider raising Params::landmarkWalkLength";
+      }
+
+      m.refine(positions, _params->landmarkRefineIterations);
+    }, _minimization);
+  }
+
+  void SNE::compMultilevel() {
+    runtimeAssert((!std::holds_alternative<sne::Minimization<2, 3>>(_minimization)), "SNE: multilevel minimization requires all embedding axes to be t-SNE axes");
+
+    // Coarsen the graph level by level. Level 0 is the full graph, and coarse[l] maps points of level l to level l + 1.
+    // Edge weights are rescaled to sum to the number of points, as symmetrized similarities of a full graph do
+    struct Graph {
+      std::vector<uint> layout;
+      std::vector<uint> neighbors;
+      std::vector<float> similarities;
+    };
+    std::vector<Graph> graphs(1);
+    std::vector<std::vector<uint>> coarse;
+    std::vector<uint> sizes = { _params->n };
+    _similarities.downloadGraph(graphs[0].layout, graphs[0].neighbors, graphs[0].similarities);
+    while (sizes.size() < _params->multilevelLevels && sizes.back() >= _params->multilevelMinPoints) {
+      const Graph& fine = graphs.back();
+      uint nCoarse;
+      std::vector<uint> matching = util::matchHeavyEdges(fine.layout, fine.neighbors, fine.similarities, _params->seed + static_cast<int>(sizes.size()), nCoarse);
+      if (nCoarse > sizes.back() - sizes.back() / 10) {
+        break; // Few edges left to match
+      }
+      Graph graph;
+      util::coarsenGraph(fine.layout, fine.neighbors, fine.similarities, matching, nCoarse, graph.layout, graph.neighbors, graph.similarities);
+      const double sum = std::accumulate(graph.similarities.begin(), graph.similarities.end(), 0.0);
+      const float scale = sum > 0.0 ? static_cast<float>(nCoarse / sum) : 1.f;
+      std::transform(graph.similarities.begin(), graph.similarities.end(), graph.similarities.begin(), [&](float p) { return p * scale; });
+      coarse.push_back(std::move(matching));
+      graphs.push_back(std::move(graph));
+      sizes.push_back(nCoarse);
+    }
+    graphs[0] = Graph(); // Level 0 is held by _similarities
+    const uint nLevels = static_cast<uint>(sizes.size());
+    if (nLevels == 1) {
+      Logger::newl() << prefix << "Graph could not be coarsened, minimizing all points";
+      std::visit([](auto& m) { m.comp(); }, _minimization);
+      return;
+    }
+
+    std::visit([&](auto& m) {
+      const uint nDims = _params->nLowDims;
+      const uint stride = util::detail::std430_align(nDims) / sizeof(float);
+
+      // Each point starts at its coarse point, scaled up to the finer level's extent, with some jitter so that matched
+      // points do not coincide
+      std::mt19937 rng(_params->seed);
+      std::uniform_real_distribution<float> jitter(-1.f, 1.f);
+      std::vector<float> positions;
+      const auto prolong = [&](uint l) {
+        const float scale = extentScale(sizes[l + 1], sizes[l], nDims);
+        std::vector<float> prolonged(static_cast<ulong>(sizes[l]) * nDims);
+        for (ulong i = 0; i < sizes[l]; ++i) {
+          for (uint d = 0; d < nDims; ++d) {
+            prolonged[i * nDims + d] = scale * positions[static_cast<ulong>(coarse[l][i]) * nDims + d] + 0.01f * _params->rngRange * jitter(rng);
+          }
+        }
+        return prolonged;
+      };
+      const auto refineIterations = [&](uint l) {
+        return std::min(_params->iterations, _params->multilevelRefineIterations << std::min(l, 16u));
+      };
+
+      // Coarse levels are minimized in nested minimizations, over their own similarities
+      for (uint l = nLevels - 1; l > 0; --l) {
+        Params params = childParams(sizes[l]);
+        Similarities similarities(graphs[l].layout, graphs[l].neighbors, graphs[l].similarities, &params);
+        graphs[l] = Graph();
+
+        const std::vector<int> labels(sizes[l], -1);
+        std::decay_t<decltype(m)> minimization(&similarities, nullptr, labels.data(), &params, _axisMapping);
+        if (l == nLevels - 1) {
+          Logger::newl() << prefix << "Level " << l << ", minimizing " << sizes[l] << " points";
+          minimization.comp();
+        } else {
+          Logger::newl() << prefix << "Level " << l << ", refining " << sizes[l] << " points for " << refineIterations(l) << " iterations";
+          minimization.refine(prolong(l), refineIterations(l));
+        }
+
+        std::vector<float> embedding(static_cast<ulong>(sizes[l]) * stride);
+        glGetNamedBufferSubData(minimization.buffers().embedding, 0, embedding.size() * sizeof(float), embedding.data());
+        glAssert();
+        positions.resize(static_cast<ulong>(sizes[l]) * nDims);
+        for (ulong i = 0; i < sizes[l]; ++i) {
+          std::memcpy(&positions[i * nDims], &embedding[i * stride], nDims * sizeof(float));
+        }
+      }
+
+      Logger::newl() << prefix << "Level 0, refining " << sizes[0] << " points for " << refineIterations(0) << " iterations";
+      m.refine(prolong(0), refineIterations(0));
+    }, _minimization);
+  }
+
+  void SNE::compReplicates() {
+    // Replicates are minimized in batches, in lockstep, which read the shared similarities once per iteration for all
+    // their attractive forces; see Minimization::compBatch(). The minimization itself is the first of each batch, and
+    // the others are constructed alongside it, starting from their own seeds, so they need no PCA and write no
+    // snapshots. Replicates are compared by their KL divergence against the field's sum over q_ij, as the exact sum
+    // takes O(n^2) time; the best embedding so far is set aside in a pooled buffer, and copied back at the end
+    std::visit([&](auto& m) {
+      using M = std::decay_t<decltype(m)>;
+      const GLuint embedding = m.buffers().embedding;
+      const ulong size = util::glGetBufferSize(embedding);
+      GLuint best = util::GLBufferPool::instance().acquire(size);
+
+      std::vector<M> others;
+      {
+        const uint nOthers = std::min(_params->nReplicates, M::batchSize) - 1;
+        const std::string initialization = std::exchange(_params->initialization, "random");
+        const bool disablePCA = std::exchange(_params->disablePCA, true);
+        const std::string snapshotFilename = std::exchange(_params->snapshotFilename, "");
+        others.reserve(nOthers);
+        for (uint b = 0; b < nOthers; ++b) {
+          others.emplace_back(&_similarities, _dataPtr, _labelPtr, _params, _axisMapping);
+        }
+        _params->initialization = initialization;
+        _params->disablePCA = disablePCA;
+        _params->snapshotFilename = snapshotFilename;
+      }
+
+      _replicateKLDivergences.clear();
+      uint bestReplicate = 0;
+      for (uint r = 0; r < _params->nReplicates; r += M::batchSize) {
+        const uint nBatch = std::min(M::batchSize, _params->nReplicates - r);
+        std::vector<M*> batch = { &m };
+        for (uint b = 1; b < nBatch; ++b) { batch.push_back(&others[b - 1]); }
+        for (uint b = 0; b < nBatch; ++b) {
+          if (r + b > 0) {
+            batch[b]->restart(_params->seed + static_cast<int>(r + b));
+          }
+        }
+        M::compBatch(batch);
+
+        for (uint b = 0; b < nBatch; ++b) {
+          const int seed = _params->seed + static_cast<int>(r + b);
+          const float kld = batch[b]->klDivergenceApprox();
+          _replicateKLDivergences.push_back(kld);
+          Logger::newl() << prefix << "Replicate " << r + b << " (seed " << seed << "), KL divergence : " << kld;
+
+          if (r + b == 0 || kld < _replicateKLDivergences[bestReplicate]) {
+            bestReplicate = r + b;
+            glCopyNamedBufferSubData(batch[b]->buffers().embedding, best, 0, 0, size);
+          }
+        }
+      }
+      Logger::newl() << prefix << "Kept replicate " << bestReplicate << " (seed " << _params->seed + static_cast<int>(bestReplicate) << ")";
+
+      glCopyNamedBufferSubData(best, embedding, 0, 0, size);
+      util::GLBufferPool::instance().release(best);
+      glAssert();
+    }, _minimization);
+  }
+
   void SNE::compMinimizationStep() {
     // Run timer to track full minimization computation
     _minimizationTimer.tick();
@@ -125,6 +557,13 @@ namespace dh::sne {
     return _minimizationTimer.get<util::TimerValue::eTotal, std::chrono::milliseconds>();
   }
 
+  float SNE::klDivergence() {
+    const auto mIsInit = std::visit([](const auto& m) { return m.isInit(); }, _minimization);
+    runtimeAssert(mIsInit, "SNE::klDivergence() called before minimization");
+
+    return std::visit([](auto& m) { return m.klDivergence(); }, _minimization);
+  }
+
   std::vector<float> SNE::embedding() const {
     const auto mIsInit = std::visit([](const auto& m) { return m.isInit(); }, _minimization);
     runtimeAssert(_isInit, "SNE::embedding() called before initialization");
@@ -132,28 +571,26 @@ namespace dh::sne {
 
     const auto buffers = std::visit([](const auto& m) { return m.buffers(); }, _minimization);
     
-    if (_params->nLowDims == 2) {
-      // Copy embedding data over
-      std::vector<float> buffer(_params->n * 2);
-      glGetNamedBufferSubData(buffers.embedding, 0, buffer.size() * sizeof(float), buffer.data());
-      glAssert();
+    // Copy embedding data over as plain floats; 3D embeddings are padded to 4 floats per point (std430)
+    const uint nDims = _params->nLowDims;
+    const uint stride = util::detail::std430_align(nDims) / sizeof(float);
+    std::vector<float> buffer(static_cast<ulong>(_params->n) * stride);
+    glGetNamedBufferSubData(buffers.embedding, 0, buffer.size() * sizeof(float), buffer.data());
+    glAssert();
 
+    // Drop padding and restore input order in a single pass
+    const auto& permutation = _similarities.permutation();
+    if (permutation.empty() && stride == nDims) {
       return buffer;
-    } else if (_params->nLowDims == 3) {
-      // Copy embedding data over to a padded type (technically 4 floats)
-      std::vector<dh::util::AlignedVec<3, float>> _buffer(_params->n);
-      glGetNamedBufferSubData(buffers.embedding, 0, _buffer.size() * sizeof(dh::util::AlignedVec<3, float>), _buffer.data());
-      glAssert();
-      
-      // Copy embedding data over to unpadded type (3 floats)
-      std::vector<glm::vec<3, float, glm::highp>> buffer(_buffer.begin(), _buffer.end());
-      
-      // Copy embedding over to floats only
-      std::vector<float> embedding(_params->n * 3);
-      std::memcpy(embedding.data(), buffer.data(), embedding.size() * sizeof(float));
-      return embedding;
     }
-
-    return {};
+    std::vector<float> embedding(static_cast<ulong>(_params->n) * nDims);
+    if (permutation.empty()) {
+      for (ulong i = 0; i < _params->n; ++i) {
+        std::memcpy(&embedding[i * nDims], &buffer[i * stride], nDims * sizeof(float));
+      }
+    } else {
+      util::restoreRowOrder(permutation, buffer.data(), stride, embedding.data(), nDims);
+    }
+    return embedding;
   }
 } // dh::sne
\ No newline at end of file
@@ -0,0 +1,148 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <utility>
+#include "dh/util/coarsen.hpp"
+#include "dh/util/error.hpp"
+#include "dh/util/thread_pool.hpp"
+
+namespace dh::util {
+  namespace {
+    constexpr uint unmatched = std::numeric_limits<uint>::max();
+  } // anonymous namespace
+
+  std::vector<uint> matchHeavyEdges(const std::vector<uint>& layout, const std::vector<uint>& neighbors,
+                                    const std::vector<float>& weights, int seed, uint& nCoarse) {
+    runtimeAssert(layout.size() % 2 == 0 && neighbors.size() == weights.size(), "matchHeavyEdges: graph does not match layout");
+    const uint n = static_cast<uint>(layout.size() / 2);
+
+    // Each point's mate, itself if it stays on its own
+    std::vector<uint> order(n);
+    std::iota(order.begin(), order.end(), 0u);
+    std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+    std::vector<uint> mate(n, unmatched);
+    for (uint i : order) {
+      if (mate[i] != unmatched) {
+        continue;
+      }
+      uint best = i;
+      float bestWeight = 0.f;
+      for (uint ij = layout[2 * i]; ij < layout[2 * i] + layout[2 * i + 1]; ++ij) {
+        const uint j = neighbors[ij];
+        if (j != i && mate[j] == unmatched && weights[ij] > bestWeight) {
+          best = j;
+          bestWeight = weights[ij];
+        }
+      }
+      mate[i] = best;
+      mate[best] = i;
+    }
+
+    // Number coarse points in order of their first point
+    std::vector<uint> coarse(n, unmatched);
+    nCoarse = 0;
+    for (uint i = 0; i < n; ++i) {
+      if (coarse[i] == unmatched) {
+        coarse[i] = nCoarse;
+        coarse[mate[i]] = nCoarse;
+        ++nCoarse;
+      }
+    }
+    return coarse;
+  }
+
+  void coarsenGraph(const std::vector<uint>& layout, const std::vector<uint>& neighbors,
+                    const std::vector<float>& weights, const std::vector<uint>& coarse, uint nCoarse,
+                    std::vector<uint>& coarseLayout, std::vector<uint>& coarseNeighbors, std::vector<float>& coarseWeights) {
+    const uint n = static_cast<uint>(layout.size() / 2);
+    runtimeAssert(coarse.size() == n, "coarsenGraph: matching does not match graph");
+
+    // The one or two points of each coarse point
+    std::vector<std::pair<uint, uint>> members(nCoarse, { unmatched, unmatched });
+    for (uint i = 0; i < n; ++i) {
+      auto& m = members[coarse[i]];
+      (m.first == unmatched ? m.first : m.second) = i;
+    }
+
+    // Edges are merged per chunk of coarse points, as their sizes are unknown up front, and then concatenated
+    auto& pool = ThreadPool::instance();
+    const ulong grain = pool.grainSize(nCoarse, 1024);
+    std::vector<std::vector<std::pair<uint, float>>> chunks(ceilDiv(static_cast<ulong>(nCoarse), grain));
+    std::vector<ulong> offsets(static_cast<ulong>(nCoarse) + 1, 0);
+    pool.parallelFor(0, nCoarse, grain, [&](ulong begin, ulong end) {
+      auto& chunk = chunks[begin / grain];
+      std::vector<std::pair<uint, float>> edges;
+      for (ulong c = begin; c < end; ++c) {
+        edges.clear();
+        for (uint i : { members[c].first, members[c].second }) {
+          if (i == unmatched) {
+            continue;
+          }
+          for (uint ij = layout[2 * i]; ij < layout[2 * i] + layout[2 * i + 1]; ++ij) {
+            if (coarse[neighbors[ij]] != c) {
+              edges.emplace_back(coarse[neighbors[ij]], weights[ij]);
+            }
+          }
+        }
+        std::sort(edges.begin(), edges.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        const size_t size = chunk.size();
+        for (const auto& edge : edges) {
+          if (chunk.size() > size && chunk.back().first == edge.first) {
+            chunk.back().second += edge.second;
+          } else {
+            chunk.push_back(edge);
+          }
+        }
+        offsets[c] = chunk.size() - size;
+      }
+    });
+
+    const ulong nEdges = pool.parallelScan(offsets.data(), offsets.data(), nCoarse);
+    offsets[nCoarse] = nEdges;
+    runtimeAssert(nEdges <= std::numeric_limits<uint>::max(), "coarsenGraph: coarse graph exceeds 32-bit indexing");
+    coarseLayout.resize(2 * static_cast<ulong>(nCoarse));
+    coarseNeighbors.resize(nEdges);
+    coarseWeights.resize(nEdges);
+    pool.parallelFor(0, chunks.size(), 1, [&](ulong begin, ulong end) {
+      for (ulong k = begin; k < end; ++k) {
+        const ulong cBegin = k * grain;
+        const ulong cEnd = std::min(cBegin + grain, static_cast<ulong>(nCoarse));
+        for (ulong c = cBegin; c < cEnd; ++c) {
+          coarseLayout[2 * c] = static_cast<uint>(offsets[c]);
+          coarseLayout[2 * c + 1] = static_cast<uint>(offsets[c + 1] - offsets[c]);
+        }
+        for (size_t e = 0; e < chunks[k].size(); ++e) {
+          coarseNeighbors[offsets[cBegin] + e] = chunks[k][e].first;
+          coarseWeights[offsets[cBegin] + e] = chunks[k][e].second;
+        }
+        std::vector<std::pair<uint, float>>().swap(chunks[k]);
+      }
+    });
+  }
+} // dh::util
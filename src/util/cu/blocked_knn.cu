@@ -0,0 +1,215 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include <cuda_runtime.h>
+#include <faiss/gpu/StandardGpuResources.h>
+#include <faiss/gpu/GpuIndexFlat.h>
+#include "dh/util/cu/blocked_knn.cuh"
+#include "dh/util/cu/error.cuh"
+
+namespace dh::util {
+  namespace {
+    // Reset running top-k lists to empty
+    __global__
+    void kernFillTopK(size_t n, float * distances, int64_t * indices) {
+      for (size_t i = blockIdx.x * blockDim.x + threadIdx.x; 
+        i < n; 
+        i += blockDim.x * gridDim.x) 
+      {
+        distances[i] = FLT_MAX;
+        indices[i] = -1;
+      }
+    }
+
+    // Merge each query's running top-k list with the top-kBlock list against one reference block,
+    // both sorted ascending. Block results hold block-local indices, shifted by offset
+    __global__
+    void kernMergeTopK(uint n, uint k, uint kBlock, int64_t offset,
+                       const float * bestDistances, const int64_t * bestIndices,
+                       const float * blockDistances, const int64_t * blockIndices,
+                       float * mergedDistances, int64_t * mergedIndices) {
+      for (uint i = blockIdx.x * blockDim.x + threadIdx.x; 
+        i < n; 
+        i += blockDim.x * gridDim.x) 
+      {
+        const float * aD = bestDistances + (size_t) i * k;
+        const int64_t * aI = bestIndices + (size_t) i * k;
+        const float * bD = blockDistances + (size_t) i * kBlock;
+        const int64_t * bI = blockIndices + (size_t) i * kBlock;
+        float * oD = mergedDistances + (size_t) i * k;
+        int64_t * oI = mergedIndices + (size_t) i * k;
+
+        uint a = 0, b = 0;
+        for (uint j = 0; j < k; ++j) {
+          if (b < kBlock && bI[b] >= 0 && bD[b] < aD[a]) {
+            oD[j] = bD[b];
+            oI[j] = bI[b] + offset;
+            b++;
+          } else {
+            oD[j] = aD[a];
+            oI[j] = aI[a];
+            a++;
+          }
+        }
+      }
+    }
+
+    // Downcast 64 bit FAISS indices to the 32 bit indices of the output buffer
+    __global__
+    void kernDownCastTopK(size_t n, const int64_t * input, int32_t * output) {
+      for (size_t i = blockIdx.x * blockDim.x + threadIdx.x; 
+        i < n; 
+        i += blockDim.x * gridDim.x) 
+      {
+        output[i] = static_cast<int32_t>(input[i]);
+      }
+    }
+  } // anonymous namespace
+
+  BlockedKNN::BlockedKNN() 
+  : _isInit(false), _n(0), _k(0), _d(0), _blockSize(0), _dataPtr(nullptr) {
+    // ...
+  }
+
+  BlockedKNN::BlockedKNN(const float* dataPtr, GLuint distancesBuffer, GLuint indicesBuffer, uint n, uint k, uint d, uint blockSize,
+                         std::vector<float> mins, std::vector<float> scales)
+  : _isInit(false), _n(n), _k(k), _d(d), _blockSize(std::min(std::max(blockSize, k), n)), _dataPtr(dataPtr), _mins(mins), _scales(scales) {
+    
+    // Set up OpenGL-CUDA interoperability
+    _interopBuffers(BufferType::eDistances) = CUGLInteropBuffer(distancesBuffer, CUGLInteropType::eNone);
+    _interopBuffers(BufferType::eIndices) = CUGLInteropBuffer(indicesBuffer, CUGLInteropType::eNone);
+
+    _isInit = true;
+  }
+
+  BlockedKNN::~BlockedKNN() {
+    if (_isInit) {
+      // ...
+    }
+  }
+
+  BlockedKNN::BlockedKNN(BlockedKNN&& other) noexcept {
+    swap(*this, other);
+  }
+
+  BlockedKNN& BlockedKNN::operator=(BlockedKNN&& other) noexcept {
+    swap(*this, other);
+    return *this;
+  }
+
+  const float* BlockedKNN::stage(uint begin, uint end, std::vector<float>& staging) const {
+    const float* src = _dataPtr + (size_t) begin * _d;
+    if (_scales.empty()) {
+      return src; // Used in place; FAISS copies host data to the device itself
+    }
+    staging.resize((size_t) (end - begin) * _d);
+    for (size_t i = 0; i < staging.size(); ++i) {
+      const size_t a = i % _d;
+      const float v = (src[i] - _mins[a]) * _scales[a];
+      staging[i] = v == v ? v : 0.f;
+    }
+    return staging.data();
+  }
+
+  void BlockedKNN::comp() {
+    runtimeAssert(isInit(), "BlockedKNN::comp() called without proper initialization");
+
+    // Map interop buffers for access on CUDA side
+    _interopBuffers(BufferType::eDistances).map();
+    _interopBuffers(BufferType::eIndices).map();
+
+    // Use a single GPU device. For now, just grab device 0 and pray
+    faiss::gpu::StandardGpuResources faissResources;
+    faiss::gpu::GpuIndexFlatConfig faissConfig;
+    faissConfig.device = 0;
+    faiss::gpu::GpuIndexFlatL2 faissIndex(&faissResources, _d, faissConfig);
+
+    // Device space for the running top-k lists, the top-k lists of one reference block, and their merge
+    const size_t topkSize = (size_t) _blockSize * _k;
+    float * bestDistances, * blockDistances, * mergedDistances;
+    int64_t * bestIndices, * blockIndices, * mergedIndices;
+    cuAssert(cudaMalloc(&bestDistances, topkSize * sizeof(float)));
+    cuAssert(cudaMalloc(&blockDistances, topkSize * sizeof(float)));
+    cuAssert(cudaMalloc(&mergedDistances, topkSize * sizeof(float)));
+    cuAssert(cudaMalloc(&bestIndices, topkSize * sizeof(int64_t)));
+    cuAssert(cudaMalloc(&blockIndices, topkSize * sizeof(int64_t)));
+    cuAssert(cudaMalloc(&mergedIndices, topkSize * sizeof(int64_t)));
+
+    // Device copy of the current query block, as it is searched once per reference block
+    float * deviceQueries;
+    cuAssert(cudaMalloc(&deviceQueries, (size_t) _blockSize * _d * sizeof(float)));
+
+    // Host staging blocks, only used if points are transformed on their way to the device
+    std::vector<float> queryStaging, referenceStaging;
+
+    const uint nBlocks = ceilDiv(_n, _blockSize);
+    for (uint q = 0; q < nBlocks; ++q) {
+      const uint qBegin = q * _blockSize;
+      const uint qEnd = std::min(_n, qBegin + _blockSize);
+      const uint qSize = qEnd - qBegin;
+      const float* queries = stage(qBegin, qEnd, queryStaging);
+      cudaMemcpy(deviceQueries, queries, (size_t) qSize * _d * sizeof(float), cudaMemcpyHostToDevice);
+      kernFillTopK<<<1024, 256>>>((size_t) qSize * _k, bestDistances, bestIndices);
+
+      // Search query block against every reference block, merging top-k lists along the way
+      for (uint r = 0; r < nBlocks; ++r) {
+        const uint rBegin = r * _blockSize;
+        const uint rEnd = std::min(_n, rBegin + _blockSize);
+        const uint kBlock = std::min(_k, rEnd - rBegin);
+        const float* references = r == q ? deviceQueries : stage(rBegin, rEnd, referenceStaging);
+
+        faissIndex.reset();
+        faissIndex.add(rEnd - rBegin, references);
+        faissIndex.search(qSize, deviceQueries, kBlock, blockDistances, blockIndices);
+
+        kernMergeTopK<<<1024, 256>>>(qSize, _k, kBlock, rBegin, bestDistances, bestIndices, blockDistances, blockIndices, mergedDistances, mergedIndices);
+        std::swap(bestDistances, mergedDistances);
+        std::swap(bestIndices, mergedIndices);
+      }
+
+      // Query block is complete; write it to the output buffers
+      const size_t offset = (size_t) qBegin * _k;
+      cudaMemcpy(((float *) _interopBuffers(BufferType::eDistances).cuHandle()) + offset, bestDistances, (size_t) qSize * _k * sizeof(float), cudaMemcpyDeviceToDevice);
+      kernDownCastTopK<<<1024, 256>>>((size_t) qSize * _k, bestIndices, ((int32_t *) _interopBuffers(BufferType::eIndices).cuHandle()) + offset);
+      cudaDeviceSynchronize();
+    }
+
+    // Tell FAISS to bugger off
+    faissIndex.reset();
+    cudaFree(bestDistances);
+    cudaFree(blockDistances);
+    cudaFree(mergedDistances);
+    cudaFree(bestIndices);
+    cudaFree(blockIndices);
+    cudaFree(mergedIndices);
+    cudaFree(deviceQueries);
+
+    // Unmap interop buffers
+    for (auto& buffer : _interopBuffers) {
+      buffer.unmap();
+    }
+  }
+} // dh::util
@@ -22,7 +22,10 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <memory>
 #include <cuda_runtime.h>
 #include <faiss/gpu/StandardGpuResources.h>
 #include <faiss/gpu/GpuIndexIVFFlat.h>
@@ -41,8 +44,8 @@ namespace dh::util {
   // Used because FAISS sticks to returning 64 bit indices
   // even for the GPU, which hates 64 bit anyways...
   __global__
-  void kernDownCast(uint n, const int64_t * input, int32_t * output) {
-    for (uint i = blockIdx.x * blockDim.x + threadIdx.x; 
+  void kernDownCast(size_t n, const int64_t * input, int32_t * output) {
+    for (size_t i = blockIdx.x * blockDim.x + threadIdx.x; 
       i < n; 
       i += blockDim.x * gridDim.x) 
     {
@@ -50,13 +53,41 @@ namespace dh::util {
     }
   }
 
+  // Gather kernel to copy listed rows of a dataset into a contiguous query buffer
+  __global__
+  void kernGather(size_t n, uint d, const float * dataset, const uint * points, float * output) {
+    for (size_t i = blockIdx.x * blockDim.x + threadIdx.x; 
+      i < n * d; 
+      i += blockDim.x * gridDim.x) 
+    {
+      output[i] = dataset[static_cast<size_t>(points[i / d]) * d + i % d];
+    }
+  }
+
+  namespace {
+    // Construct an index with the configuration used by KNN, for nTrain training points
+    std::unique_ptr<faiss::gpu::GpuIndexIVFFlat> makeIndex(faiss::gpu::StandardGpuResources* resources, uint nTrain, uint d) {
+      faiss::gpu::GpuIndexIVFFlatConfig faissConfig;
+      faissConfig.device = 0;
+      faissConfig.indicesOptions = faiss::gpu::INDICES_32_BIT;
+      faissConfig.flatConfig.useFloat16 = true;
+      faissConfig.interleavedLayout = false;
+
+      // Small batches of points cannot train as many lists as their square root suggests
+      const uint nLists = std::max(1u, std::min(nTrain, nListMult * static_cast<uint>(std::sqrt(nTrain))));
+      auto index = std::make_unique<faiss::gpu::GpuIndexIVFFlat>(resources, d, nLists, faiss::METRIC_L2, faissConfig);
+      index->setNumProbes(std::min(nProbe, nLists));
+      return index;
+    }
+  } // anonymous namespace
+
   KNN::KNN() 
-  : _isInit(false), _n(0), _k(0), _d(0), _dataPtr(nullptr) {
+  : _isInit(false), _n(0), _nQuery(0), _k(0), _d(0), _dataPtr(nullptr) {
     // ...
   }
 
   KNN::KNN(const float* dataPtr, GLuint distancesBuffer, GLuint indicesBuffer, uint n, uint k, uint d)
-  : _isInit(false), _n(n), _k(k), _d(d), _dataPtr(dataPtr) {
+  : _isInit(false), _n(n), _nQuery(n), _k(k), _d(d), _dataPtr(dataPtr) {
     
     // Set up OpenGL-CUDA interoperability
     _interopBuffers(BufferType::eDistances) = CUGLInteropBuffer(distancesBuffer, CUGLInteropType::eNone);
@@ -66,10 +97,22 @@ namespace dh::util {
   }
 
   KNN::KNN(GLuint datasetBuffer, GLuint distancesBuffer, GLuint indicesBuffer, uint n, uint k, uint d)
-  : _isInit(false), _n(n), _k(k), _d(d), _dataPtr(nullptr) {
+  : _isInit(false), _n(n), _nQuery(n), _k(k), _d(d), _dataPtr(nullptr) {
+    
+    // Set up OpenGL-CUDA interoperability
+    _interopBuffers(BufferType::eDataset) = CUGLInteropBuffer(datasetBuffer, CUGLInteropType::eNone);
+    _interopBuffers(BufferType::eDistances) = CUGLInteropBuffer(distancesBuffer, CUGLInteropType::eNone);
+    _interopBuffers(BufferType::eIndices) = CUGLInteropBuffer(indicesBuffer, CUGLInteropType::eNone);
+
+    _isInit = true;
+  }
+
+  KNN::KNN(GLuint datasetBuffer, GLuint queryBuffer, GLuint distancesBuffer, GLuint indicesBuffer, uint n, uint nQuery, uint k, uint d)
+  : _isInit(false), _n(n), _nQuery(nQuery), _k(k), _d(d), _dataPtr(nullptr) {
     
     // Set up OpenGL-CUDA interoperability
     _interopBuffers(BufferType::eDataset) = CUGLInteropBuffer(datasetBuffer, CUGLInteropType::eNone);
+    _interopBuffers(BufferType::eQuery) = CUGLInteropBuffer(queryBuffer, CUGLInteropType::eNone);
     _interopBuffers(BufferType::eDistances) = CUGLInteropBuffer(distancesBuffer, CUGLInteropType::eNone);
     _interopBuffers(BufferType::eIndices) = CUGLInteropBuffer(indicesBuffer, CUGLInteropType::eNone);
 
@@ -103,6 +146,13 @@ namespace dh::util {
       dataPtr = (float*) _interopBuffers(BufferType::eDataset).cuHandle();
     }
 
+    // Query points are the dataset itself, unless others were provided
+    const float* queryPtr = dataPtr;
+    if (_interopBuffers(BufferType::eQuery).isInit()) {
+      _interopBuffers(BufferType::eQuery).map();
+      queryPtr = (float*) _interopBuffers(BufferType::eQuery).cuHandle();
+    }
+
     // Nr. of inverted lists used by FAISS IVL.
     // x * O(sqrt(n)) | x := 4, is apparently reasonable?
     // src: https://github.com/facebookresearch/faiss/issues/112
@@ -137,15 +187,15 @@ namespace dh::util {
 
     // Create temporary space for storing 64 bit faiss indices
     void * tempIndicesHandle;
-    cudaMalloc(&tempIndicesHandle, _n * _k * sizeof(faiss::Index::idx_t));
+    cudaMalloc(&tempIndicesHandle, (size_t) _nQuery * _k * sizeof(faiss::Index::idx_t));
 
     // Perform search in batches   
-    for (size_t i = 0; i < ceilDiv((size_t) _n, searchBatchSize); ++i) {
+    for (size_t i = 0; i < ceilDiv((size_t) _nQuery, searchBatchSize); ++i) {
       const size_t offset = i * searchBatchSize;
-      const size_t size = std::min(searchBatchSize, _n - offset);
+      const size_t size = std::min(searchBatchSize, _nQuery - offset);
       faissIndex.search(
         size,
-        dataPtr + (_d * offset),
+        queryPtr + (_d * offset),
         _k,
         ((float *) _interopBuffers(BufferType::eDistances).cuHandle()) + (_k * offset),
         ((faiss::Index::idx_t *) tempIndicesHandle) + (_k * offset)
@@ -157,7 +207,7 @@ namespace dh::util {
     faissIndex.reclaimMemory();
 
     // Free 64-bit temporary indices, after downcasting to 32 bit in the interop buffer
-    kernDownCast<<<1024, 256>>>(_n * _k, (int64_t *) tempIndicesHandle, (int32_t *) _interopBuffers(BufferType::eIndices).cuHandle());
+    kernDownCast<<<1024, 256>>>((size_t) _nQuery * _k, (int64_t *) tempIndicesHandle, (int32_t *) _interopBuffers(BufferType::eIndices).cuHandle());
     cudaDeviceSynchronize();
     cudaFree(tempIndicesHandle);
 
@@ -166,4 +216,118 @@ namespace dh::util {
       buffer.unmap();
     }
   }
-} // dh::util
\ No newline at end of file
+
+  KNNIndex::KNNIndex()
+  : _isInit(false), _begin(0), _n(0), _d(0) {
+    // ...
+  }
+
+  KNNIndex::KNNIndex(GLuint datasetBuffer, uint begin, uint n, uint d)
+  : _isInit(false), _begin(begin), _n(0), _d(d) {
+    _resources = std::make_unique<faiss::gpu::StandardGpuResources>();
+
+    CUGLInteropBuffer dataset(datasetBuffer, CUGLInteropType::eReadOnly);
+    dataset.map();
+    const float* dataPtr = (float*) dataset.cuHandle() + static_cast<size_t>(_d) * _begin;
+    _index = makeIndex(_resources.get(), n, _d);
+    _index->train(n, dataPtr);
+    dataset.unmap();
+
+    _isInit = true;
+    add(datasetBuffer, n);
+  }
+
+  KNNIndex::~KNNIndex() {
+    if (_isInit) {
+      _index.reset();
+      _resources.reset();
+    }
+  }
+
+  KNNIndex::KNNIndex(KNNIndex&& other) noexcept
+  : KNNIndex() {
+    swap(*this, other);
+  }
+
+  KNNIndex& KNNIndex::operator=(KNNIndex&& other) noexcept {
+    swap(*this, other);
+    return *this;
+  }
+
+  void KNNIndex::add(GLuint datasetBuffer, uint n) {
+    CUGLInteropBuffer dataset(datasetBuffer, CUGLInteropType::eReadOnly);
+    dataset.map();
+    const float* dataPtr = (float*) dataset.cuHandle() + static_cast<size_t>(_d) * (_begin + _n);
+    for (size_t i = 0; i < ceilDiv((size_t) n, addBatchSize); ++i) {
+      const size_t offset = i * addBatchSize;
+      const size_t size = std::min(addBatchSize, n - offset);
+      _index->add(size, dataPtr + (_d * offset));
+    }
+    dataset.unmap();
+    _n += n;
+  }
+
+  void KNNIndex::search(GLuint datasetBuffer, uint begin, uint nQuery, uint k, std::vector<float>& distances, std::vector<uint>& indices) {
+    distances.resize(static_cast<size_t>(nQuery) * k);
+    indices.resize(static_cast<size_t>(nQuery) * k);
+    CUGLInteropBuffer dataset(datasetBuffer, CUGLInteropType::eReadOnly);
+    dataset.map();
+    search((float*) dataset.cuHandle() + static_cast<size_t>(_d) * begin, nQuery, k, distances.data(), indices.data());
+    dataset.unmap();
+  }
+
+  void KNNIndex::search(GLuint datasetBuffer, const std::vector<uint>& points, uint k, std::vector<float>& distances, std::vector<uint>& indices) {
+    const uint nQuery = static_cast<uint>(points.size());
+    distances.resize(static_cast<size_t>(nQuery) * k);
+    indices.resize(static_cast<size_t>(nQuery) * k);
+    if (nQuery == 0) {
+      return;
+    }
+
+    // Gather the listed rows, so they are searched as a contiguous batch
+    void * pointsHandle;
+    void * queryHandle;
+    cudaMalloc(&pointsHandle, points.size() * sizeof(uint));
+    cudaMalloc(&queryHandle, points.size() * _d * sizeof(float));
+    cudaMemcpy(pointsHandle, points.data(), points.size() * sizeof(uint), cudaMemcpyHostToDevice);
+    CUGLInteropBuffer dataset(datasetBuffer, CUGLInteropType::eReadOnly);
+    dataset.map();
+    kernGather<<<1024, 256>>>(points.size(), _d, (float*) dataset.cuHandle(), (uint*) pointsHandle, (float*) queryHandle);
+    cudaDeviceSynchronize();
+    dataset.unmap();
+    cudaFree(pointsHandle);
+
+    search((float*) queryHandle, nQuery, k, distances.data(), indices.data());
+    cudaFree(queryHandle);
+  }
+
+  void KNNIndex::search(const float* queryPtr, uint nQuery, uint k, float* distances, uint* indices) {
+    // Search in batches, through temporary space for the 64 bit faiss indices
+    const size_t batchSize = std::min(searchBatchSize, (size_t) nQuery);
+    void * distancesHandle;
+    void * tempIndicesHandle;
+    void * indicesHandle;
+    cudaMalloc(&distancesHandle, batchSize * k * sizeof(float));
+    cudaMalloc(&tempIndicesHandle, batchSize * k * sizeof(faiss::Index::idx_t));
+    cudaMalloc(&indicesHandle, batchSize * k * sizeof(int32_t));
+    for (size_t i = 0; i < ceilDiv((size_t) nQuery, searchBatchSize); ++i) {
+      const size_t offset = i * searchBatchSize;
+      const size_t size = std::min(searchBatchSize, nQuery - offset);
+      _index->search(size, queryPtr + (_d * offset), k, (float *) distancesHandle, (faiss::Index::idx_t *) tempIndicesHandle);
+      kernDownCast<<<1024, 256>>>(size * k, (int64_t *) tempIndicesHandle, (int32_t *) indicesHandle);
+      cudaDeviceSynchronize();
+      cudaMemcpy(distances + k * offset, distancesHandle, size * k * sizeof(float), cudaMemcpyDeviceToHost);
+      cudaMemcpy(indices + k * offset, indicesHandle, size * k * sizeof(uint), cudaMemcpyDeviceToHost);
+    }
+    cudaFree(distancesHandle);
+    cudaFree(tempIndicesHandle);
+    cudaFree(indicesHandle);
+
+    // Indices count from the first point held; missing neighbors stay uint(-1)
+    if (_begin > 0) {
+      for (size_t i = 0; i < static_cast<size_t>(nQuery) * k; ++i) {
+        if (indices[i] != static_cast<uint>(-1)) { indices[i] += _begin; }
+      }
+    }
+  }
+} // dh::util
@@ -0,0 +1,115 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include "dh/util/gl/buffer_pool.hpp"
+#include "dh/util/gl/error.hpp"
+
+namespace dh::util {
+  // Smallest size class, and the most bytes kept in free buffers
+  constexpr ulong minClassSize = 1024;
+  constexpr ulong defaultRetainLimit = 128 * 1'048'576;
+
+  GLBufferPool::GLBufferPool()
+  : _retainLimit(defaultRetainLimit), _allocatedSize(0), _freeSize(0), _inUseSize(0), _highWaterSize(0) { }
+
+  GLBufferPool::~GLBufferPool() {
+    // Buffers are not deleted here, as the context may already be gone; see clear()
+  }
+
+  ulong GLBufferPool::sizeClass(ulong size) const {
+    // Requests too large to be retained are not rounded, which would only waste memory
+    if (size > _retainLimit) {
+      return size;
+    }
+    if (size <= minClassSize) {
+      return minClassSize;
+    }
+
+    // Eight classes per power of two, wasting at most 12.5%
+    ulong pow2 = minClassSize;
+    while (pow2 * 2 <= size) {
+      pow2 *= 2;
+    }
+    const ulong step = pow2 / 8;
+    return ceilDiv(size, step) * step;
+  }
+
+  GLuint GLBufferPool::acquire(ulong size) {
+    const ulong allocSize = sizeClass(size);
+
+    // Reuse the smallest free buffer that fits, unless it is much larger than needed
+    GLuint handle = 0;
+    ulong handleSize = allocSize;
+    if (auto it = _free.lower_bound(allocSize); it != _free.end() && it->first <= allocSize + allocSize / 4) {
+      handle = it->second;
+      handleSize = it->first;
+      _free.erase(it);
+      _freeSize -= handleSize;
+    } else {
+      glCreateBuffers(1, &handle);
+      glNamedBufferStorage(handle, allocSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+      glAssert();
+      _allocatedSize += allocSize;
+    }
+
+    _inUse.emplace(handle, handleSize);
+    _inUseSize += handleSize;
+    _highWaterSize = std::max(_highWaterSize, _inUseSize);
+    return handle;
+  }
+
+  void GLBufferPool::release(GLuint& handle) {
+    auto it = _inUse.find(handle);
+    runtimeAssert(it != _inUse.end(), "GLBufferPool::release() called on a buffer not acquired from the pool");
+    const ulong allocSize = it->second;
+    _inUse.erase(it);
+    _inUseSize -= allocSize;
+
+    if (_freeSize + allocSize <= _retainLimit) {
+      _free.emplace(allocSize, handle);
+      _freeSize += allocSize;
+    } else {
+      glDeleteBuffers(1, &handle);
+      _allocatedSize -= allocSize;
+    }
+    handle = 0;
+  }
+
+  void GLBufferPool::release(GLsizei n, GLuint* handles) {
+    for (GLsizei i = 0; i < n; ++i) {
+      release(handles[i]);
+    }
+  }
+
+  void GLBufferPool::clear() {
+    for (auto& [size, handle] : _free) {
+      glDeleteBuffers(1, &handle);
+      _allocatedSize -= size;
+    }
+    _free.clear();
+    _freeSize = 0;
+  }
+} // dh::util
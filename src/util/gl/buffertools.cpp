@@ -22,10 +22,12 @@
  * SOFTWARE.
  */
 
+#include <limits>
 #include <resource_embed/resource_embed.hpp>
 #include "dh/util/io.hpp"
 #include "dh/util/gl/error.hpp"
 #include "dh/util/gl/buffertools.hpp"
+#include "dh/util/gl/buffer_pool.hpp"
 #include "dh/util/cu/inclusive_scan.cuh"
 
 namespace dh::util {
@@ -87,12 +89,13 @@ namespace dh::util {
   
   template<typename T>
   T BufferTools::reduce(GLuint& bufferToReduce, uint reductionType, uint n, GLuint selectionBuffer, uint valueToCount, bool largeBuffer, GLuint layoutBuffer, GLuint neighborsBuffer) {
-    glCreateBuffers(_buffersReduce.size(), _buffersReduce.data());
-    glNamedBufferStorage(_buffersReduce(BufferReduceType::eReduce), 128 * sizeof(T), nullptr, 0);
-    glNamedBufferStorage(_buffersReduce(BufferReduceType::eReduced), sizeof(T), nullptr, 0);
+    // Called every frame for selection counts, so temporary buffers come from the pool
+    auto& pool = GLBufferPool::instance();
+    _buffersReduce(BufferReduceType::eReduce) = pool.acquire(128 * sizeof(T));
+    _buffersReduce(BufferReduceType::eReduced) = pool.acquire(sizeof(T));
     
     if(largeBuffer) {
-      glNamedBufferStorage(_buffersReduce(BufferReduceType::eReduceSumPerDatapoint), n * sizeof(T), nullptr, 0);
+      _buffersReduce(BufferReduceType::eReduceSumPerDatapoint) = pool.acquire(n * sizeof(T));
       if(std::is_same<T, float>::value) {
         glClearNamedBufferData(_buffersReduce(BufferReduceType::eReduceSumPerDatapoint), GL_R32F, GL_RED, GL_FLOAT, nullptr);
       } else {
@@ -154,16 +157,21 @@ namespace dh::util {
 
     T reducedValue;
     glGetNamedBufferSubData(_buffersReduce(BufferReduceType::eReduced), 0, sizeof(T), &reducedValue);
-    if(largeBuffer) { std::swap(bufferToReduce, _buffersReduce(BufferReduceType::eReduceSumPerDatapoint)); }
-    glDeleteBuffers(_buffersReduce.size(), _buffersReduce.data());
+    if(largeBuffer) {
+      std::swap(bufferToReduce, _buffersReduce(BufferReduceType::eReduceSumPerDatapoint));
+      pool.release(_buffersReduce(BufferReduceType::eReduceSumPerDatapoint));
+    }
+    pool.release(_buffersReduce(BufferReduceType::eReduce));
+    pool.release(_buffersReduce(BufferReduceType::eReduced));
     glAssert();
     return reducedValue;
   }
 
   template <typename T>
   uint BufferTools::remove(GLuint& bufferToRemove, uint n, uint d, GLuint selectionBuffer) {
-    glCreateBuffers(_buffersRemove.size(), _buffersRemove.data());
-    glNamedBufferStorage(_buffersRemove(BufferRemoveType::eCumSum), n * sizeof(T), nullptr, 0);
+    // The cumulative sum is temporary, but the buffer with removed elements replaces bufferToRemove
+    auto& pool = GLBufferPool::instance();
+    _buffersRemove(BufferRemoveType::eCumSum) = pool.acquire(n * sizeof(uint));
 
     uint nNew;
     {
@@ -173,7 +181,8 @@ namespace dh::util {
     }
 
     if(nNew > 0) {
-      glNamedBufferStorage(_buffersRemove(BufferRemoveType::eRemoved), nNew * d * sizeof(T), nullptr, 0);
+      glCreateBuffers(1, &_buffersRemove(BufferRemoveType::eRemoved));
+      glNamedBufferStorage(_buffersRemove(BufferRemoveType::eRemoved), static_cast<ulong>(nNew) * d * sizeof(T), nullptr, 0);
 
       dh::util::GLProgram& program = std::is_same<T, float>::value ? _programs(ProgramType::eRemoveFloatComp) : _programs(ProgramType::eRemoveUintComp);
       program.bind();
@@ -188,21 +197,66 @@ namespace dh::util {
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _buffersRemove(BufferRemoveType::eRemoved));
 
       // Dispatch shader
-      glDispatchCompute(ceilDiv(n * d, 256u), 1, 1);
+      const ulong nValues = static_cast<ulong>(n) * d;
+      runtimeAssert(nValues <= std::numeric_limits<uint>::max(), "BufferTools::remove() buffer exceeds 32-bit shader indexing");
+      glDispatchCompute(static_cast<uint>(ceilDiv<ulong>(nValues, 256)), 1, 1);
       glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
       std::swap(bufferToRemove, _buffersRemove(BufferRemoveType::eRemoved));
 
-      glDeleteBuffers(_buffersRemove.size(), _buffersRemove.data());
+      glDeleteBuffers(1, &_buffersRemove(BufferRemoveType::eRemoved));
+      pool.release(_buffersRemove(BufferRemoveType::eCumSum));
       glAssert();
       return nNew;
     }
     else {
-      glDeleteBuffers(_buffersRemove.size(), _buffersRemove.data());
+      pool.release(_buffersRemove(BufferRemoveType::eCumSum));
       return n;
     }
   }
 
+  template <typename T>
+  uint BufferTools::compact(GLuint bufferToCompact, uint n, uint d, GLuint selectionBuffer) {
+    // Elements move towards the front, possibly over ones yet to be read, so are gathered in a temporary buffer first
+    auto& pool = GLBufferPool::instance();
+    GLuint cumSum = pool.acquire(n * sizeof(uint));
+    GLuint compacted = pool.acquire(static_cast<ulong>(n) * d * sizeof(T));
+
+    uint nNew;
+    {
+      util::InclusiveScan scan(selectionBuffer, cumSum, n);
+      scan.comp();
+      glGetNamedBufferSubData(cumSum, (n - 1) * sizeof(uint), sizeof(uint), &nNew);
+    }
+
+    if (nNew > 0 && nNew < n) {
+      dh::util::GLProgram& program = std::is_same<T, float>::value ? _programs(ProgramType::eRemoveFloatComp) : _programs(ProgramType::eRemoveUintComp);
+      program.bind();
+
+      program.template uniform<uint>("nPoints", n);
+      program.template uniform<uint>("nDims", d);
+
+      // Set buffer bindings
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufferToCompact);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, selectionBuffer);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cumSum);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, compacted);
+
+      // Dispatch shader
+      const ulong nValues = static_cast<ulong>(n) * d;
+      runtimeAssert(nValues <= std::numeric_limits<uint>::max(), "BufferTools::compact() buffer exceeds 32-bit shader indexing");
+      glDispatchCompute(static_cast<uint>(ceilDiv<ulong>(nValues, 256)), 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+      glCopyNamedBufferSubData(compacted, bufferToCompact, 0, 0, static_cast<ulong>(nNew) * d * sizeof(T));
+    }
+
+    pool.release(cumSum);
+    pool.release(compacted);
+    glAssert();
+    return nNew;
+  }
+
   template <typename T>
   void BufferTools::set(GLuint& bufferToSet, uint n, T setVal, T maskVal, GLuint maskBuffer) {
     auto& program = _programs(ProgramType::eSetUintComp);
@@ -241,8 +295,7 @@ namespace dh::util {
   }
 
   void BufferTools::averageTexturedata(GLuint bufferToAverage, uint n, uint d, uint imgDepth, GLuint maskBuffer, uint maskValue, uint maskCount, GLuint bufferAveraged, GLuint subtractorBuffer, bool calcVariance) {
-    glCreateBuffers(1, _buffersReduce.data());
-    glNamedBufferStorage(_buffersReduce(BufferReduceType::eReduce), 128 * d * sizeof(float), nullptr, 0);
+    _buffersReduce(BufferReduceType::eReduce) = GLBufferPool::instance().acquire(128 * d * sizeof(float));
     
     auto& program = _programs(ProgramType::eAverageTexturedataComp);
     program.bind();
@@ -271,7 +324,7 @@ namespace dh::util {
     glDispatchCompute(1, d, 1);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-    glDeleteBuffers(1, _buffersReduce.data());
+    GLBufferPool::instance().release(_buffersReduce(BufferReduceType::eReduce));
     glAssert();
   }
 
@@ -299,6 +352,8 @@ namespace dh::util {
   template glm::vec2 BufferTools::reduce<glm::vec2>(GLuint& bufferToReduce, uint reductionType, uint n, GLuint selectionBuffer, uint valueToCount, bool largeBuffer, GLuint layoutBuffer, GLuint neighborsBuffer);
   template uint BufferTools::remove<float>(GLuint& bufferToRemove, uint n, uint d, GLuint selectionBuffer);
   template uint BufferTools::remove<uint>(GLuint& bufferToRemove, uint n, uint d, GLuint selectionBuffer);
+  template uint BufferTools::compact<float>(GLuint bufferToCompact, uint n, uint d, GLuint selectionBuffer);
+  template uint BufferTools::compact<uint>(GLuint bufferToCompact, uint n, uint d, GLuint selectionBuffer);
   template void BufferTools::set<uint>(GLuint& bufferToSet, uint n, uint setVal, uint maskVal, GLuint maskBuffer);
   template void BufferTools::flip<uint>(GLuint& bufferToFlip, uint n);
 }
\ No newline at end of file
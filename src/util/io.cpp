@@ -22,17 +22,25 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <stdexcept>
 #include <set>
+#include <utility>
 #include "dh/util/io.hpp"
+#include "dh/util/thread_pool.hpp"
 #include "dh/util/gl/error.hpp"
 #include "dh/util/gl/metric.hpp"
 
 namespace dh::util {
   void readBinFile(const std::string &fileName,
-                   std::vector<float> &data,
+                   HostVector<float> &data,
                    std::vector<int> &labels,
                    uint n,
                    uint d,
@@ -46,7 +54,7 @@ namespace dh::util {
     }
 
     // Clear vectors and create space to store data in
-    data = std::vector<float>(n * d);
+    ThreadPool::instance().firstTouch(data, n, d);
     if (withLabels) {
       labels = std::vector<int>(n);
     }
@@ -57,7 +65,7 @@ namespace dh::util {
         std::set<int> classes;
         for (uint i = 0; i < n; ++i) {
           ifs.read((char *) &labels[i], sizeof(int));
-          ifs.read((char *) &data[d * i], d * sizeof(float));
+          ifs.read((char *) &data[static_cast<ulong>(d) * i], d * sizeof(float));
           classes.insert(labels[i]);
         }
         nClasses = classes.size();
@@ -70,14 +78,14 @@ namespace dh::util {
           int label = ifs.peek();
           if(label < nClasses) {
             ifs.read((char *) &labels[count], sizeof(int));
-            ifs.read((char *) &data[d * count], d * sizeof(float));
+            ifs.read((char *) &data[static_cast<ulong>(d) * count], d * sizeof(float));
             count++;
           } else {
             ifs.ignore(sizeof(int) + d * sizeof(float));
           }
         }
         labels.resize(count);
-        data.resize(d * count);
+        data.resize(static_cast<ulong>(d) * count);
       }
     } else {
       ifs.read((char *) data.data(), data.size() * sizeof(float));
@@ -113,7 +121,7 @@ namespace dh::util {
     if (withLabels) {
       for (uint i = 0; i < n; ++i) {
         ofs.write((char *) &labels[i], sizeof(int));
-        ofs.write((char *) &data[d * i], d * sizeof(float));
+        ofs.write((char *) &data[static_cast<ulong>(d) * i], d * sizeof(float));
       }
     } else {
       ofs.write((char *) data.data(), data.size() * sizeof(float));
@@ -132,121 +140,892 @@ namespace dh::util {
     }
   }
 
+  namespace {
+    // Little-endian loads from possibly unaligned memory, as found inside .npz archives
+    template <typename T>
+    T load(const std::byte* ptr) {
+      T t;
+      std::memcpy(&t, ptr, sizeof(T));
+      return t;
+    }
+
+    float halfToFloat(uint16_t h) {
+      const uint32_t sign = uint32_t(h & 0x8000u) << 16;
+      uint32_t exponent = (h >> 10) & 0x1Fu;
+      uint32_t mantissa = h & 0x3FFu;
+      uint32_t bits;
+      if (exponent == 0x1Fu) {        // Inf/NaN
+        bits = sign | 0x7F800000u | (mantissa << 13);
+      } else if (exponent != 0) {     // Normal
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+      } else if (mantissa != 0) {     // Subnormal, renormalize
+        exponent = 113;
+        while (!(mantissa & 0x400u)) {
+          mantissa <<= 1;
+          exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+      } else {                        // Signed zero
+        bits = sign;
+      }
+      float f;
+      std::memcpy(&f, &bits, sizeof(float));
+      return f;
+    }
+
+    std::string descrOf(DataType type) {
+      switch (type) {
+        case DataType::eFloat32: return "<f4";
+        case DataType::eFloat16: return "<f2";
+        case DataType::eUint8: return "|u1";
+        case DataType::eInt32: return "<i4";
+        case DataType::eUint32: return "<u4";
+        case DataType::eInt64: return "<i8";
+        case DataType::eFloat64: return "<f8";
+        default: throw std::runtime_error("Unsupported npy data type");
+      }
+    }
+
+    DataType parseDescr(const std::string& descr) {
+      if (descr.size() < 3 || descr[0] == '>') {
+        throw std::runtime_error("Unsupported npy data type (big-endian data is not supported): " + descr);
+      }
+      const std::string kind = descr.substr(1);
+      if (kind == "f4") { return DataType::eFloat32; }
+      if (kind == "f2") { return DataType::eFloat16; }
+      if (kind == "u1") { return DataType::eUint8; }
+      if (kind == "i4") { return DataType::eInt32; }
+      if (kind == "u4") { return DataType::eUint32; }
+      if (kind == "i8") { return DataType::eInt64; }
+      if (kind == "f8") { return DataType::eFloat64; }
+      throw std::runtime_error("Unsupported npy data type: " + descr);
+    }
+
+    // Parse the python dict literal which forms an npy header, e.g.
+    // {'descr': '<f4', 'fortran_order': False, 'shape': (60000, 784), }
+    NpyHeader parseNpyHeader(const std::byte* ptr, size_t size, const std::string& fileName) {
+      const char magic[] = "\x93NUMPY";
+      if (size < 10 || std::memcmp(ptr, magic, 6) != 0) {
+        throw std::runtime_error("Input file is not a valid npy file: " + fileName);
+      }
+      const uint8_t major = load<uint8_t>(ptr + 6);
+      const size_t prefixSize = major == 1 ? 10 : 12;
+      const size_t headerSize = major == 1 ? load<uint16_t>(ptr + 8) : load<uint32_t>(ptr + 8);
+      if (major < 1 || major > 3 || prefixSize + headerSize > size) {
+        throw std::runtime_error("Input file is not a valid npy file: " + fileName);
+      }
+      const std::string dict(reinterpret_cast<const char*>(ptr) + prefixSize, headerSize);
+
+      // Find the value following the given key in the dict
+      auto value = [&](const std::string& key) {
+        const size_t keyPos = dict.find("'" + key + "'");
+        const size_t colonPos = dict.find(':', keyPos);
+        if (keyPos == std::string::npos || colonPos == std::string::npos) {
+          throw std::runtime_error("Input file has an invalid npy header: " + fileName);
+        }
+        return dict.find_first_not_of(' ', colonPos + 1);
+      };
+
+      NpyHeader header;
+
+      // Parse 'descr', a quoted dtype string
+      const size_t descrBegin = value("descr") + 1;
+      header.type = parseDescr(dict.substr(descrBegin, dict.find('\'', descrBegin) - descrBegin));
+
+      // Parse 'fortran_order', a python bool
+      header.fortranOrder = dict.compare(value("fortran_order"), 4, "True") == 0;
+
+      // Parse 'shape', a python tuple of ints
+      const size_t shapeBegin = value("shape") + 1;
+      const std::string shape = dict.substr(shapeBegin, dict.find(')', shapeBegin) - shapeBegin);
+      size_t pos = 0;
+      while ((pos = shape.find_first_of("0123456789", pos)) != std::string::npos) {
+        size_t len;
+        header.shape.push_back(std::stoull(shape.substr(pos), &len));
+        pos += len;
+      }
+
+      header.dataOffset = prefixSize + headerSize;
+      if (header.dataOffset + header.rows() * header.cols() * sizeOf(header.type) > size) {
+        throw std::runtime_error("Input file is truncated: " + fileName);
+      }
+      return header;
+    }
+
+    // Zip archive member, as far as the npz reader is concerned
+    struct ZipEntry {
+      std::string name;
+      uint16_t compression;
+      size_t size;
+      size_t localOffset;
+    };
+
+    // Read the central directory of a zip archive, e.g. a .npz file as written by np.savez,
+    // and translate zip64 extensions where these are present (i.e. for members over 4GB)
+    std::vector<ZipEntry> readZipDirectory(const MappedFile& file, const std::string& fileName) {
+      const std::byte* ptr = file.data();
+      const size_t size = file.size();
+      const auto invalid = std::runtime_error("Input file is not a valid npz file: " + fileName);
+
+      // Scan backwards for the end of central directory record, which may be followed by a comment
+      constexpr size_t eocdSize = 22;
+      if (size < eocdSize) {
+        throw invalid;
+      }
+      size_t eocd = size - eocdSize;
+      while (load<uint32_t>(ptr + eocd) != 0x06054b50u) {
+        if (eocd == 0 || size - eocd > eocdSize + 0xFFFF) {
+          throw invalid;
+        }
+        eocd--;
+      }
+      size_t nEntries = load<uint16_t>(ptr + eocd + 10);
+      size_t dirOffset = load<uint32_t>(ptr + eocd + 16);
+
+      // Defer to the zip64 end of central directory record if a locator precedes the record
+      if (eocd >= 20 && load<uint32_t>(ptr + eocd - 20) == 0x07064b50u) {
+        const size_t eocd64 = load<uint64_t>(ptr + eocd - 12);
+        if (eocd64 + 56 > size || load<uint32_t>(ptr + eocd64) != 0x06064b50u) {
+          throw invalid;
+        }
+        nEntries = load<uint64_t>(ptr + eocd64 + 32);
+        dirOffset = load<uint64_t>(ptr + eocd64 + 48);
+      }
+
+      std::vector<ZipEntry> entries;
+      entries.reserve(nEntries);
+      size_t offset = dirOffset;
+      for (size_t i = 0; i < nEntries; ++i) {
+        if (offset + 46 > size || load<uint32_t>(ptr + offset) != 0x02014b50u) {
+          throw invalid;
+        }
+        const size_t nameSize = load<uint16_t>(ptr + offset + 28);
+        const size_t extraSize = load<uint16_t>(ptr + offset + 30);
+        const size_t commentSize = load<uint16_t>(ptr + offset + 32);
+
+        ZipEntry entry;
+        entry.name = std::string(reinterpret_cast<const char*>(ptr) + offset + 46, nameSize);
+        entry.compression = load<uint16_t>(ptr + offset + 10);
+        entry.size = load<uint32_t>(ptr + offset + 20);
+        size_t uncompressedSize = load<uint32_t>(ptr + offset + 24);
+        entry.localOffset = load<uint32_t>(ptr + offset + 42);
+
+        // Zip64 extra field stores those of the three values which overflowed, in this order
+        size_t extra = offset + 46 + nameSize;
+        const size_t extraEnd = extra + extraSize;
+        while (extra + 4 <= extraEnd) {
+          const uint16_t id = load<uint16_t>(ptr + extra);
+          const uint16_t len = load<uint16_t>(ptr + extra + 2);
+          if (id == 0x0001) {
+            size_t field = extra + 4;
+            if (uncompressedSize == 0xFFFFFFFFu) { uncompressedSize = load<uint64_t>(ptr + field); field += 8; }
+            if (entry.size == 0xFFFFFFFFu) { entry.size = load<uint64_t>(ptr + field); field += 8; }
+            if (entry.localOffset == 0xFFFFFFFFu) { entry.localOffset = load<uint64_t>(ptr + field); }
+          }
+          extra += 4 + len;
+        }
+
+        entries.push_back(entry);
+        offset = extraEnd + commentSize;
+      }
+      return entries;
+    }
+
+    std::string stripNpyExtension(const std::string& name) {
+      return name.size() > 4 && name.substr(name.size() - 4) == ".npy"
+        ? name.substr(0, name.size() - 4)
+        : name;
+    }
+
+    bool isNpzFile(const std::string& fileName) {
+      return fileName.size() > 4 && fileName.substr(fileName.size() - 4) == ".npz";
+    }
+
+    // Convert npy data of element type T to row-major output, transposing Fortran-ordered arrays. Rows are
+    // converted in the chunks of a parallelFor over them, matching ThreadPool::firstTouch()
+    template <typename T, typename Out, typename Conv>
+    void convertNpyData(const std::byte* src, const NpyHeader& header, Out* dst, Conv conv) {
+      const size_t rows = header.rows();
+      const size_t cols = header.cols();
+      if (!header.fortranOrder || header.shape.size() < 2) {
+        ThreadPool::instance().parallelFor(0, rows, 0, [&](size_t begin, size_t end) {
+          for (size_t i = begin * cols; i < end * cols; ++i) {
+            dst[i] = static_cast<Out>(conv(load<T>(src + i * sizeof(T))));
+          }
+        });
+        return;
+      }
+
+      // In Fortran order the first axis is contiguous, and remaining axes are reversed
+      std::vector<size_t> srcCols(cols);
+      for (size_t j = 0; j < cols; ++j) {
+        size_t rem = j, srcCol = 0, suffix = 1;
+        for (size_t a = header.shape.size() - 1; a > 0; --a) {
+          suffix *= header.shape[a];
+          srcCol += (rem % header.shape[a]) * (cols / suffix);
+          rem /= header.shape[a];
+        }
+        srcCols[j] = srcCol;
+      }
+      ThreadPool::instance().parallelFor(0, rows, 0, [&](size_t begin, size_t end) {
+        for (size_t j = 0; j < cols; ++j) {
+          for (size_t i = begin; i < end; ++i) {
+            dst[i * cols + j] = static_cast<Out>(conv(load<T>(src + (srcCols[j] * rows + i) * sizeof(T))));
+          }
+        }
+      });
+    }
+
+    template <typename Vector>
+    void convertNpyArray(const NpyArray& array, Vector& data) {
+      using Out = typename Vector::value_type;
+      const NpyHeader& header = array.header();
+      if constexpr (std::is_same_v<Vector, HostVector<Out>>) {
+        ThreadPool::instance().firstTouch(data, header.rows(), header.cols());
+      } else {
+        data.resize(header.rows() * header.cols());
+      }
+      const std::byte* src = array.rawData();
+      auto identity = [](auto v) { return v; };
+      switch (header.type) {
+        case DataType::eFloat32: convertNpyData<float>(src, header, data.data(), identity); break;
+        case DataType::eFloat16: convertNpyData<uint16_t>(src, header, data.data(), halfToFloat); break;
+        case DataType::eUint8: convertNpyData<uint8_t>(src, header, data.data(), identity); break;
+        case DataType::eInt32: convertNpyData<int32_t>(src, header, data.data(), identity); break;
+        case DataType::eUint32: convertNpyData<uint32_t>(src, header, data.data(), identity); break;
+        case DataType::eInt64: convertNpyData<int64_t>(src, header, data.data(), identity); break;
+        case DataType::eFloat64: convertNpyData<double>(src, header, data.data(), identity); break;
+        default: break;
+      }
+    }
+  } // anonymous namespace
+
+  size_t sizeOf(DataType type) {
+    switch (type) {
+      case DataType::eFloat32: return 4;
+      case DataType::eFloat16: return 2;
+      case DataType::eUint8: return 1;
+      case DataType::eInt32: return 4;
+      case DataType::eUint32: return 4;
+      case DataType::eInt64: return 8;
+      case DataType::eFloat64: return 8;
+      default: return 0;
+    }
+  }
+
+  size_t NpyHeader::rows() const {
+    return shape.empty() ? 1 : shape[0];
+  }
+
+  size_t NpyHeader::cols() const {
+    size_t cols = 1;
+    for (size_t i = 1; i < shape.size(); ++i) {
+      cols *= shape[i];
+    }
+    return cols;
+  }
+
+  NpyArray::NpyArray()
+  : _isInit(false), _header(), _data(nullptr) {
+    // ...
+  }
+
+  NpyArray::NpyArray(const std::string& fileName)
+  : _isInit(false), _file(fileName) {
+    _header = parseNpyHeader(_file.data(), _file.size(), fileName);
+    _data = _file.data() + _header.dataOffset;
+    _isInit = true;
+  }
+
+  NpyArray::NpyArray(const std::string& fileName, const std::string& arrayName)
+  : _isInit(false), _file(fileName) {
+    const std::vector<ZipEntry> entries = readZipDirectory(_file, fileName);
+    auto it = std::find_if(entries.begin(), entries.end(), [&](const ZipEntry& e) {
+      return arrayName.empty() || stripNpyExtension(e.name) == arrayName;
+    });
+    if (it == entries.end()) {
+      throw std::runtime_error("Input file does not contain array \"" + arrayName + "\": " + fileName);
+    }
+    if (it->compression != 0) {
+      throw std::runtime_error("Input file contains compressed arrays, which cannot be mapped; use np.savez instead of np.savez_compressed: " + fileName);
+    }
+
+    // Member data starts after its local file header, whose variable fields may differ from the central directory
+    const std::byte* ptr = _file.data();
+    if (it->localOffset + 30 > _file.size() || load<uint32_t>(ptr + it->localOffset) != 0x04034b50u) {
+      throw std::runtime_error("Input file is not a valid npz file: " + fileName);
+    }
+    const size_t memberOffset = it->localOffset + 30
+                              + load<uint16_t>(ptr + it->localOffset + 26)
+                              + load<uint16_t>(ptr + it->localOffset + 28);
+    if (memberOffset + it->size > _file.size()) {
+      throw std::runtime_error("Input file is truncated: " + fileName);
+    }
+
+    _header = parseNpyHeader(ptr + memberOffset, it->size, fileName);
+    _data = ptr + memberOffset + _header.dataOffset;
+    _isInit = true;
+  }
+
+  NpyArray::~NpyArray() {
+    // ...
+  }
+
+  NpyArray::NpyArray(NpyArray&& other) noexcept
+  : NpyArray() {
+    swap(*this, other);
+  }
+
+  NpyArray& NpyArray::operator=(NpyArray&& other) noexcept {
+    swap(*this, other);
+    return *this;
+  }
+
+  const float* NpyArray::floatData() const {
+    if (!_isInit
+        || _header.type != DataType::eFloat32
+        || (_header.fortranOrder && _header.shape.size() > 1)
+        || reinterpret_cast<std::uintptr_t>(_data) % alignof(float) != 0) {
+      return nullptr;
+    }
+    return reinterpret_cast<const float*>(_data);
+  }
+
+  void NpyArray::toFloat(HostVector<float>& data) const {
+    convertNpyArray(*this, data);
+  }
+
+  void NpyArray::toInt(std::vector<int>& data) const {
+    convertNpyArray(*this, data);
+  }
+
+  void NpyArray::toUint(HostVector<uint>& data) const {
+    convertNpyArray(*this, data);
+  }
+
+  void NpyArray::toSize(HostVector<size_t>& data) const {
+    convertNpyArray(*this, data);
+  }
+
+  void NpyArray::toSize(std::vector<size_t>& data) const {
+    convertNpyArray(*this, data);
+  }
+
+  std::vector<std::string> NpyArray::list(const std::string& fileName) {
+    MappedFile file(fileName);
+    std::vector<std::string> names;
+    for (const auto& entry : readZipDirectory(file, fileName)) {
+      names.push_back(stripNpyExtension(entry.name));
+    }
+    return names;
+  }
+
+  void readNpyFile(const std::string &fileName,
+                   HostVector<float> &data,
+                   uint& n,
+                   uint& d,
+                   const std::string &arrayName)
+  {
+    NpyArray array;
+    if (isNpzFile(fileName)) {
+      // Without a specified name, prefer an array called "data" over whichever comes first
+      const auto names = NpyArray::list(fileName);
+      const bool hasData = std::find(names.begin(), names.end(), "data") != names.end();
+      array = NpyArray(fileName, arrayName.empty() && hasData ? "data" : arrayName);
+    } else {
+      array = NpyArray(fileName);
+    }
+
+    const NpyHeader& header = array.header();
+    if (header.rows() > std::numeric_limits<uint>::max() || header.cols() > std::numeric_limits<uint>::max()) {
+      throw std::runtime_error("Input file holds too large an array: " + fileName);
+    }
+    n = static_cast<uint>(header.rows());
+    d = static_cast<uint>(header.cols());
+    array.toFloat(data);
+  }
+
+  void readNpyFile(const std::string &fileName,
+                   std::vector<int> &labels,
+                   const std::string &arrayName)
+  {
+    NpyArray array = isNpzFile(fileName)
+                   ? NpyArray(fileName, arrayName.empty() ? "labels" : arrayName)
+                   : NpyArray(fileName);
+    array.toInt(labels);
+  }
+
+  bool isCSRFile(const std::string &fileName) {
+    if (!isNpzFile(fileName)) {
+      return false;
+    }
+    const auto names = NpyArray::list(fileName);
+    return std::find(names.begin(), names.end(), "indptr") != names.end()
+        && std::find(names.begin(), names.end(), "indices") != names.end();
+  }
+
+  void readCSRFile(const std::string &fileName,
+                   CSRMatrix &data)
+  {
+    if (!isCSRFile(fileName)) {
+      throw std::runtime_error("Input file is not a sparse npz file: " + fileName);
+    }
+
+    std::vector<size_t> shape;
+    NpyArray(fileName, "shape").toSize(shape);
+    NpyArray(fileName, "indptr").toSize(data.offsets);
+    NpyArray(fileName, "indices").toUint(data.indices);
+    NpyArray(fileName, "data").toFloat(data.values);
+    if (shape.size() != 2 
+        || shape[0] > std::numeric_limits<uint>::max() 
+        || data.offsets.size() != shape[0] + 1
+        || data.indices.size() != data.values.size()
+        || data.offsets.back() != data.values.size()) {
+      throw std::runtime_error("Input file holds an invalid sparse matrix: " + fileName);
+    }
+    data.nRows = static_cast<uint>(shape[0]);
+    data.nCols = static_cast<uint>(shape[1]);
+
+    // Sort column indices within rows; scipy does not guarantee this
+    std::vector<std::pair<uint, float>> row;
+    for (uint i = 0; i < data.nRows; ++i) {
+      const size_t begin = data.offsets[i], end = data.offsets[i + 1];
+      if (std::is_sorted(data.indices.begin() + begin, data.indices.begin() + end)) {
+        continue;
+      }
+      row.clear();
+      for (size_t ij = begin; ij < end; ++ij) {
+        row.emplace_back(data.indices[ij], data.values[ij]);
+      }
+      std::sort(row.begin(), row.end());
+      for (size_t ij = begin; ij < end; ++ij) {
+        data.indices[ij] = row[ij - begin].first;
+        data.values[ij] = row[ij - begin].second;
+      }
+    }
+  }
+
+  void selectClasses(HostVector<float> &data,
+                     std::vector<int> &labels,
+                     uint d,
+                     bool withLabels,
+                     int& nClasses,
+                     bool includeAllClasses)
+  {
+    if (!withLabels) {
+      return;
+    }
+
+    if (includeAllClasses) {
+      std::set<int> classes(labels.begin(), labels.end());
+      nClasses = classes.size();
+      if(classes.find(0) == classes.end()) { // No 0 in classes means the first class is 1
+        for (auto& label : labels) { label--; }
+      }
+    } else {
+      uint count = 0;
+      for (uint i = 0; i < labels.size(); ++i) {
+        if(labels[i] < nClasses) {
+          labels[count] = labels[i];
+          std::copy(data.begin() + static_cast<ulong>(d) * i, data.begin() + static_cast<ulong>(d) * (i + 1), data.begin() + static_cast<ulong>(d) * count);
+          count++;
+        }
+      }
+      labels.resize(count);
+      data.resize(static_cast<ulong>(d) * count);
+    }
+  }
+
+  void selectClasses(CSRMatrix &data,
+                     std::vector<int> &labels,
+                     bool withLabels,
+                     int& nClasses,
+                     bool includeAllClasses)
+  {
+    if (!withLabels || includeAllClasses) {
+      HostVector<float> dense; // Unused, as no rows are removed
+      selectClasses(dense, labels, 0, withLabels, nClasses, includeAllClasses);
+      return;
+    }
+
+    // Compact kept rows in place
+    uint count = 0;
+    size_t nnz = 0;
+    for (uint i = 0; i < data.nRows; ++i) {
+      if(labels[i] < nClasses) {
+        const size_t begin = data.offsets[i], end = data.offsets[i + 1];
+        std::copy(data.indices.begin() + begin, data.indices.begin() + end, data.indices.begin() + nnz);
+        std::copy(data.values.begin() + begin, data.values.begin() + end, data.values.begin() + nnz);
+        data.offsets[count] = nnz;
+        nnz += end - begin;
+        labels[count] = labels[i];
+        count++;
+      }
+    }
+    data.offsets[count] = nnz;
+    data.offsets.resize(count + 1);
+    data.indices.resize(nnz);
+    data.values.resize(nnz);
+    data.nRows = count;
+    labels.resize(count);
+  }
+
+  void writeNpyHeader(std::ostream &ofs,
+                      DataType type,
+                      const std::vector<size_t> &shape)
+  {
+    std::string dict = "{'descr': '" + descrOf(type) + "', 'fortran_order': False, 'shape': (";
+    for (size_t i = 0; i < shape.size(); ++i) {
+      dict += std::to_string(shape[i]) + (shape.size() == 1 || i + 1 < shape.size() ? "," : "");
+      if (i + 1 < shape.size()) { dict += " "; }
+    }
+    dict += "), }";
+
+    // Spare room for the first axis to grow to its maximum number of digits, then pad to 64 bytes
+    constexpr size_t growthAxisMaxDigits = 21;
+    const size_t nDigits = shape.empty() ? 0 : std::to_string(shape[0]).size();
+    dict.append(shape.empty() ? 0 : growthAxisMaxDigits - nDigits, ' ');
+    dict.append(63 - (10 + dict.size()) % 64, ' ');
+    dict += '\n';
+
+    const uint16_t headerSize = static_cast<uint16_t>(dict.size());
+    ofs.write("\x93NUMPY\x01\x00", 8);
+    ofs.write((char *) &headerSize, sizeof(uint16_t));
+    ofs.write(dict.data(), dict.size());
+  }
+
+  void writeNpyFile(const std::string &fileName,
+                    const float* data,
+                    uint n,
+                    uint d)
+  {
+    std::ofstream ofs(fileName, std::ios::out | std::ios::binary);
+    if (!ofs) {
+      throw std::runtime_error("Output file cannot be accessed: " + fileName);
+    }
+
+    writeNpyHeader(ofs, DataType::eFloat32, { n, d });
+    ofs.write((char *) data, static_cast<std::streamsize>(n) * d * sizeof(float));
+  }
+
+  void writeNpyFile(const std::string &fileName,
+                    const int* data,
+                    uint n)
+  {
+    std::ofstream ofs(fileName, std::ios::out | std::ios::binary);
+    if (!ofs) {
+      throw std::runtime_error("Output file cannot be accessed: " + fileName);
+    }
+
+    writeNpyHeader(ofs, DataType::eInt32, { n });
+    ofs.write((char *) data, static_cast<std::streamsize>(n) * sizeof(int));
+  }
+
+  namespace {
+    // Binary dump header; data follows at dumpDataOffset, so it stays aligned when mapped
+    struct DumpHeader {
+      char magic[4];
+      uint32_t version;
+      uint32_t type;
+      uint32_t reserved;
+      uint64_t n;
+      uint64_t d;
+      uint64_t checksum;
+    };
+    constexpr char dumpMagic[4] = { 'D', 'H', 'B', 'D' };
+    constexpr uint32_t dumpVersion = 1;
+    constexpr size_t dumpDataOffset = 64;
+    static_assert(sizeof(DumpHeader) <= dumpDataOffset);
+
+    template <typename T> DataType dataTypeOf();
+    template <> DataType dataTypeOf<float>() { return DataType::eFloat32; }
+    template <> DataType dataTypeOf<uint>() { return DataType::eUint32; }
+    template <> DataType dataTypeOf<int>() { return DataType::eInt32; }
+
+    std::string dumpPath(const std::string& filename) {
+      return "./buffer_dumps/" + filename + ".bin";
+    }
+
+    // Word-wise multiplicative hash; cheap enough to verify dumps of several gigabytes
+    uint64_t dumpChecksum(const std::byte* ptr, size_t size) {
+      uint64_t hash = 0xcbf29ce484222325ull ^ size;
+      size_t i = 0;
+      for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, ptr + i, sizeof(uint64_t));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+      }
+      for (; i < size; ++i) {
+        hash = (hash ^ static_cast<uint64_t>(ptr[i])) * 0x100000001b3ull;
+      }
+      return hash;
+    }
+
+    template <typename T>
+    void writeDump(const T* data, ulong n, ulong d, const std::string& filename) {
+      std::ofstream ofs(dumpPath(filename), std::ios::out | std::ios::binary);
+      if (!ofs) {
+        std::cerr << "Unable to open file: " << filename << std::endl;
+        return;
+      }
+
+      const size_t size = n * d * sizeof(T);
+      DumpHeader header = {};
+      std::memcpy(header.magic, dumpMagic, sizeof(dumpMagic));
+      header.version = dumpVersion;
+      header.type = static_cast<uint32_t>(dataTypeOf<T>());
+      header.n = n;
+      header.d = d;
+      header.checksum = dumpChecksum(reinterpret_cast<const std::byte*>(data), size);
+
+      char prefix[dumpDataOffset] = {};
+      std::memcpy(prefix, &header, sizeof(DumpHeader));
+      ofs.write(prefix, dumpDataOffset);
+      ofs.write((const char *) data, size);
+    }
+
+    // Map a dump and check it against the expected type and (if nonzero) size; returns a pointer
+    // to the data inside the mapping, or nullptr on failure
+    template <typename T>
+    const T* mapDump(MappedFile& file, ulong& n, ulong& d, const std::string& filename) {
+      try {
+        file = MappedFile(dumpPath(filename));
+      } catch (const std::runtime_error&) {
+        std::cerr << "Unable to open file: " << filename << std::endl;
+        return nullptr;
+      }
+
+      DumpHeader header;
+      if (file.size() < dumpDataOffset) {
+        std::cerr << "Error parsing file: " << filename << std::endl;
+        return nullptr;
+      }
+      std::memcpy(&header, file.data(), sizeof(DumpHeader));
+      const size_t size = header.n * header.d * sizeof(T);
+      if (std::memcmp(header.magic, dumpMagic, sizeof(dumpMagic)) != 0 || header.version != dumpVersion
+          || file.size() < dumpDataOffset + size) {
+        std::cerr << "Error parsing file: " << filename << std::endl;
+        return nullptr;
+      }
+      if (header.type != static_cast<uint32_t>(dataTypeOf<T>())) {
+        std::cerr << "Mismatched data type in file: " << filename << std::endl;
+        return nullptr;
+      }
+      if ((n != 0 || d != 0) && header.n * header.d != static_cast<ulong>(n) * d) {
+        std::cerr << "Mismatched size in file: " << filename << " (" << header.n << "x" << header.d << ")" << std::endl;
+        return nullptr;
+      }
+
+      const std::byte* ptr = file.data() + dumpDataOffset;
+      if (dumpChecksum(ptr, size) != header.checksum) {
+        std::cerr << "Checksum mismatch in file: " << filename << std::endl;
+        return nullptr;
+      }
+      n = header.n;
+      d = header.d;
+      return reinterpret_cast<const T*>(ptr);
+    }
+  } // anonymous namespace
+
   template<typename T>
   void readGLBuffer(GLuint& handle, uint n, uint d, const std::string filename) {
-    std::vector<T> buffer = readVector<T>(n, d, filename);
+    // Upload straight from the mapping, or zeroes if the dump is unusable
+    MappedFile file;
+    ulong dumpN = n, dumpD = d;
+    const T* ptr = mapDump<T>(file, dumpN, dumpD, filename);
+    std::vector<T> zeros;
+    if (!ptr) {
+      zeros.resize(static_cast<ulong>(n) * d);
+      ptr = zeros.data();
+    }
+
     GLint flags;
     glGetNamedBufferParameteriv(handle, GL_BUFFER_STORAGE_FLAGS, &flags);
     glDeleteBuffers(1, &handle);
     glCreateBuffers(1, &handle);
-    glNamedBufferStorage(handle, n * d * sizeof(T), buffer.data(), flags);
+    glNamedBufferStorage(handle, static_cast<ulong>(n) * d * sizeof(T), ptr, flags);
   }
 
   template<typename T>
   void writeGLBuffer(const GLuint handle, uint n, uint d, const std::string filename) {
-    std::vector<T> buffer(n * d);
-    glGetNamedBufferSubData(handle, 0, n * d * sizeof(T), buffer.data());
-    writeVector<T>(buffer, n, d, filename);
+    std::vector<T> buffer(static_cast<ulong>(n) * d);
+    glGetNamedBufferSubData(handle, 0, buffer.size() * sizeof(T), buffer.data());
+    writeDump(buffer.data(), n, d, filename);
   }
 
   template<typename T>
   std::vector<T> readVector(uint n, uint d, const std::string filename) {
-    std::vector<T> vec(n * d);
-    std::ifstream file("./buffer_dumps/" + filename + ".txt");
-    if (!file.is_open()) {
-        std::cerr << "Unable to open file: " << filename << std::endl;
-        return vec;
-    }
-    std::string line;
-    uint i = 0;
-    while (std::getline(file, line) && i < n) {
-        std::istringstream iss(line);
-        std::string val_str;
-        for (uint j = 0; j < d; ++j) {
-            if (!std::getline(iss, val_str, '|')) {
-                std::cerr << "Error parsing file: " << filename << std::endl;
-                return vec;
-            }
-            std::istringstream val_iss(val_str);
-            T val;
-            if (!(val_iss >> val)) {
-                std::cerr << "Error parsing file: " << filename << std::endl;
-                return vec;
-            }
-            vec[i * d + j] = val;
-        }
-        i++;
+    MappedFile file;
+    ulong dumpN = n, dumpD = d;
+    const T* ptr = mapDump<T>(file, dumpN, dumpD, filename);
+    if (!ptr) {
+      return std::vector<T>(static_cast<ulong>(n) * d);
     }
-    
-    return vec;
+    return std::vector<T>(ptr, ptr + static_cast<ulong>(n) * d);
   }
 
   template<typename T>
   void writeVector(const std::vector<T> vec, uint n, uint d, const std::string filename) {
-    std::ofstream file("./buffer_dumps/" + filename + ".txt");
-    for(uint i = 0; i < n; i++) {
-      for(uint j = 0; j < d; ++j) {
-        T val = vec[i * d + j];
-        file << val << "|";
-      }
-      file << "\n";
-    }
+    writeDump(vec.data(), n, d, filename);
   }
 
   template<typename T>
   std::set<T> readSet(const std::string filename) {
-    std::set<T> set;
-    std::ifstream file("./buffer_dumps/" + filename + ".txt");
-    if (!file.is_open()) {
-        std::cerr << "Unable to open file: " << filename << std::endl;
-        return set;
+    // Sets are stored as sorted vectors of unknown length
+    MappedFile file;
+    ulong n = 0, d = 0;
+    const T* ptr = mapDump<T>(file, n, d, filename);
+    if (!ptr) {
+      return {};
     }
-    std::string str;
-    while (std::getline(file, str)) {
-      set.insert(std::stoi(str));
-    }
-    
-    return set;
+    return std::set<T>(ptr, ptr + n * d);
   }
 
   template<typename T>
   void writeSet(const std::set<T> set, const std::string filename) {
-    std::ofstream file("./buffer_dumps/" + filename + ".txt");
-    for (const auto& str : set) {
-      file << str << "\n";
-    }
+    const std::vector<T> vec(set.begin(), set.end());
+    writeDump(vec.data(), vec.size(), 1, filename);
   }
 
-  void normalizeData(std::vector<float>& data, uint n, uint d, float lower, float upper) {
-    // Determine min and max attribute value
-    auto [minIt, maxIt] = std::minmax_element(data.begin(), data.end());
-    float min = *minIt; float max = *maxIt;
+  namespace {
+    // Columns are processed in blocks, so per-column state stays in cache for very wide data
+    constexpr size_t normalizeColumnBlock = 1024;
 
-    for(uint i = 0; i < n * d; ++i) {
-      data[i] = (data[i] - min) / (max - min);
-      data[i] = data[i] * (upper - lower) + lower;
-      if(data[i] != data[i]) { data[i] = 0.f; }
+    // Determine min and max value; per-chunk reduction written as selects so it vectorizes
+    void valueRange(const float* ptr, size_t size, float& min, float& max) {
+      using Range = std::pair<float, float>;
+      const Range range = ThreadPool::instance().parallelReduce(0, size, ThreadPool::instance().grainSize(size, 4096),
+        Range(FLT_MAX, -FLT_MAX),
+        [&](size_t begin, size_t end) {
+          float min = FLT_MAX, max = -FLT_MAX;
+          for (size_t i = begin; i < end; ++i) {
+            min = ptr[i] < min ? ptr[i] : min;
+            max = ptr[i] > max ? ptr[i] : max;
+          }
+          return Range(min, max);
+        },
+        [](const Range& a, const Range& b) { return Range(std::min(a.first, b.first), std::max(a.second, b.second)); });
+      min = range.first;
+      max = range.second;
     }
+
+    // Determine min and max values per attribute, per chunk of rows, then merge chunks
+    void attributeRanges(const float* ptr, size_t rows, size_t d, std::vector<float>& mins, std::vector<float>& maxs) {
+      auto& pool = ThreadPool::instance();
+      const size_t grain = pool.grainSize(rows, ceilDiv<size_t>(4096, std::max<size_t>(d, 1)));
+      const size_t nChunks = ceilDiv<size_t>(rows, grain);
+      std::vector<float> chunkMins(std::max<size_t>(nChunks, 1) * d,  FLT_MAX);
+      std::vector<float> chunkMaxs(std::max<size_t>(nChunks, 1) * d, -FLT_MAX);
+      pool.parallelFor(0, rows, grain, [&](size_t begin, size_t end) {
+        float* mins = &chunkMins[begin / grain * d];
+        float* maxs = &chunkMaxs[begin / grain * d];
+        for (size_t c = 0; c < d; c += normalizeColumnBlock) {
+          const size_t cEnd = std::min<size_t>(d, c + normalizeColumnBlock);
+          for (size_t i = begin; i < end; ++i) {
+            const float* row = &ptr[i * d];
+            for (size_t a = c; a < cEnd; ++a) {
+              mins[a] = row[a] < mins[a] ? row[a] : mins[a];
+              maxs[a] = row[a] > maxs[a] ? row[a] : maxs[a];
+            }
+          }
+        }
+      });
+      mins.assign(chunkMins.begin(), chunkMins.begin() + d);
+      maxs.assign(chunkMaxs.begin(), chunkMaxs.begin() + d);
+      for (size_t b = 1; b < nChunks; ++b) {
+        for (size_t a = 0; a < d; ++a) {
+          mins[a] = std::min(mins[a], chunkMins[b * d + a]);
+          maxs[a] = std::max(maxs[a], chunkMaxs[b * d + a]);
+        }
+      }
+    }
+  } // anonymous namespace
+
+  void normalizeData(HostVector<float>& data, uint n, uint d, float lower, float upper) {
+    const size_t size = std::min(data.size(), static_cast<ulong>(n) * d);
+    float* ptr = data.data();
+
+    float min, max;
+    valueRange(ptr, size, min, max);
+
+    // Fused affine transform; NaNs (e.g. from a zero range) are scrubbed to 0 without branching
+    const float scale = (upper - lower) / (max - min);
+    ThreadPool::instance().parallelFor(0, size, 0, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const float v = (ptr[i] - min) * scale + lower;
+        ptr[i] = v == v ? v : 0.f;
+      }
+    });
   }
 
-  void normalizeDataNonUniformDims(std::vector<float>& data, uint n, uint d, float lower, float upper) {
-    // Determine min and max attribute values per attribute
-    std::vector<float> mins(d,  FLT_MAX);
-    std::vector<float> maxs(d, -FLT_MAX);
-    for(uint i = 0; i < n; ++i) {
-      for(uint a = 0; a < d; ++a) {
-        if(data[i * d + a] < mins[a]) { mins[a] = data[i * d + a]; }
-        if(data[i * d + a] > maxs[a]) { maxs[a] = data[i * d + a]; }
+  void normalizeDataNonUniformDims(HostVector<float>& data, uint n, uint d, float lower, float upper) {
+    const size_t rows = std::min(static_cast<size_t>(n), d > 0 ? data.size() / d : 0);
+    float* ptr = data.data();
+
+    std::vector<float> mins, maxs;
+    attributeRanges(ptr, rows, d, mins, maxs);
+
+    // Fused per-attribute affine transform and NaN scrub
+    std::vector<float> scales(d);
+    for (size_t a = 0; a < d; ++a) {
+      scales[a] = (upper - lower) / (maxs[a] - mins[a]);
+    }
+    ThreadPool::instance().parallelFor(0, rows, 0, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        float* row = &ptr[i * d];
+        for (size_t a = 0; a < d; ++a) {
+          const float v = (row[a] - mins[a]) * scales[a] + lower;
+          row[a] = v == v ? v : 0.f;
+        }
       }
+    });
+  }
+
+  void computeNormalization(const float* data, ulong n, uint d, bool uniformDims, std::vector<float>& mins, std::vector<float>& scales) {
+    std::vector<float> maxs;
+    if (uniformDims) {
+      float min, max;
+      valueRange(data, n * d, min, max);
+      mins.assign(d, min);
+      maxs.assign(d, max);
+    } else {
+      attributeRanges(data, n, d, mins, maxs);
+    }
+    scales.resize(d);
+    for (size_t a = 0; a < d; ++a) {
+      scales[a] = 1.f / (maxs[a] - mins[a]);
     }
+  }
 
-    for(uint i = 0; i < n; ++i) {
-      for(uint a = 0; a < d; ++a) {
-        data[i * d + a] = (data[i * d + a] - mins[a]) / (maxs[a] - mins[a]);
-        data[i * d + a] = data[i * d + a] * (upper - lower) + lower;
-        if(data[i * d + a] != data[i * d + a]) { data[i * d + a] = 0.f; }
+  void applyNormalization(const float* data, ulong n, uint d, const std::vector<float>& mins, const std::vector<float>& scales, float* output) {
+    ThreadPool::instance().parallelFor(0, n, 0, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        for (size_t a = 0; a < d; ++a) {
+          const float v = (data[i * d + a] - mins[a]) * scales[a];
+          output[i * d + a] = v == v ? v : 0.f;
+        }
       }
+    });
+  }
+
+  void normalizeData(CSRMatrix& data, bool uniformDims, float upper) {
+    std::vector<float> maxs(uniformDims ? 1 : data.nCols, 0.f);
+    for (size_t ij = 0; ij < data.nnz(); ++ij) {
+      float& max = maxs[uniformDims ? 0 : data.indices[ij]];
+      max = std::max(max, std::abs(data.values[ij]));
+    }
+
+    std::vector<float> scales(maxs.size());
+    for (size_t a = 0; a < maxs.size(); ++a) {
+      scales[a] = maxs[a] > 0.f ? upper / maxs[a] : 0.f;
     }
+    ThreadPool::instance().parallelFor(0, data.nnz(), 0, [&](size_t begin, size_t end) {
+      for (size_t ij = begin; ij < end; ++ij) {
+        const float v = data.values[ij] * scales[uniformDims ? 0 : data.indices[ij]];
+        data.values[ij] = v == v ? v : 0.f;
+      }
+    });
   }
 
   // Template instantiations for writeGLBuffer for float, int, uint
@@ -258,6 +1037,19 @@ namespace dh::util {
   template void writeGLBuffer<uint>(const GLuint handle, uint n, uint d, const std::string filename);
   template void writeGLBuffer<int>(const GLuint handle, uint n, uint d, const std::string filename);
 
+  template std::vector<float> readVector<float>(uint n, uint d, const std::string filename);
+  template std::vector<uint> readVector<uint>(uint n, uint d, const std::string filename);
+  template std::vector<int> readVector<int>(uint n, uint d, const std::string filename);
+
+  template void writeVector<float>(const std::vector<float> vec, uint n, uint d, const std::string filename);
+  template void writeVector<uint>(const std::vector<uint> vec, uint n, uint d, const std::string filename);
+  template void writeVector<int>(const std::vector<int> vec, uint n, uint d, const std::string filename);
+
+  template std::set<float> readSet<float>(const std::string filename);
   template std::set<uint> readSet<uint>(const std::string filename);
+  template std::set<int> readSet<int>(const std::string filename);
+
+  template void writeSet<float>(const std::set<float> set, const std::string filename);
   template void writeSet<uint>(const std::set<uint> set, const std::string filename);
+  template void writeSet<int>(const std::set<int> set, const std::string filename);
 } // dh::util
\ No newline at end of file
@@ -0,0 +1,129 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdexcept>
+#include "dh/util/mapped_file.hpp"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dh::util {
+  MappedFile::MappedFile()
+  : _isInit(false), _data(nullptr), _size(0) {
+#ifdef _WIN32
+    _fileHandle = nullptr;
+    _mappingHandle = nullptr;
+#else
+    _fileDescriptor = -1;
+#endif
+  }
+
+  MappedFile::MappedFile(const std::string& fileName)
+  : MappedFile() {
+#ifdef _WIN32
+    _fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, 
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_fileHandle == INVALID_HANDLE_VALUE) {
+      _fileHandle = nullptr;
+      throw std::runtime_error("Input file cannot be accessed: " + fileName);
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(_fileHandle, &fileSize)) {
+      CloseHandle(_fileHandle);
+      throw std::runtime_error("Input file cannot be accessed: " + fileName);
+    }
+    _size = static_cast<size_t>(fileSize.QuadPart);
+
+    // Empty files cannot be mapped, but are otherwise valid
+    if (_size > 0) {
+      _mappingHandle = CreateFileMappingA(_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (!_mappingHandle) {
+        CloseHandle(_fileHandle);
+        throw std::runtime_error("Input file cannot be mapped: " + fileName);
+      }
+      _data = static_cast<const std::byte*>(MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+      if (!_data) {
+        CloseHandle(_mappingHandle);
+        CloseHandle(_fileHandle);
+        throw std::runtime_error("Input file cannot be mapped: " + fileName);
+      }
+    }
+#else
+    _fileDescriptor = open(fileName.c_str(), O_RDONLY);
+    if (_fileDescriptor < 0) {
+      throw std::runtime_error("Input file cannot be accessed: " + fileName);
+    }
+
+    struct stat fileStat;
+    if (fstat(_fileDescriptor, &fileStat) != 0) {
+      close(_fileDescriptor);
+      throw std::runtime_error("Input file cannot be accessed: " + fileName);
+    }
+    _size = static_cast<size_t>(fileStat.st_size);
+
+    // Empty files cannot be mapped, but are otherwise valid
+    if (_size > 0) {
+      void* ptr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fileDescriptor, 0);
+      if (ptr == MAP_FAILED) {
+        close(_fileDescriptor);
+        throw std::runtime_error("Input file cannot be mapped: " + fileName);
+      }
+      _data = static_cast<const std::byte*>(ptr);
+    }
+#endif
+
+    _isInit = true;
+  }
+
+  MappedFile::~MappedFile() {
+    if (_isInit) {
+#ifdef _WIN32
+      if (_data) { UnmapViewOfFile(_data); }
+      if (_mappingHandle) { CloseHandle(_mappingHandle); }
+      CloseHandle(_fileHandle);
+#else
+      if (_data) { munmap(const_cast<std::byte*>(_data), _size); }
+      close(_fileDescriptor);
+#endif
+    }
+  }
+
+  MappedFile::MappedFile(MappedFile&& other) noexcept
+  : MappedFile() {
+    swap(*this, other);
+  }
+
+  MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    swap(*this, other);
+    return *this;
+  }
+} // dh::util
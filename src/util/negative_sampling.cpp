@@ -0,0 +1,116 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include "dh/util/negative_sampling.hpp"
+#include "dh/util/error.hpp"
+#include "dh/util/thread_pool.hpp"
+
+namespace dh::util {
+  namespace {
+    constexpr float maxStep = 4.f; // Gradient components are clipped to this, as in UMAP, so rare large steps cannot tear the embedding
+
+    float clip(float v) {
+      return std::clamp(v, -maxStep, maxStep);
+    }
+  } // anonymous namespace
+
+  NegativeSampler::NegativeSampler(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& weights,
+                                   uint nNegatives, float exaggeration, int seed)
+  : _layout(layout), _neighbors(neighbors), _weights(weights), _nNegatives(nNegatives), _exaggeration(exaggeration),
+    _seed(seed), _meanKernel(1.f), _epoch(0) {
+    runtimeAssert(layout.size() % 2 == 0 && neighbors.size() == weights.size(), "NegativeSampler: graph does not match layout");
+    _maxWeight = weights.empty() ? 1.f : *std::max_element(weights.begin(), weights.end());
+  }
+
+  void NegativeSampler::epoch(float* embedding, uint nDims, uint stride, float learningRate) {
+    runtimeAssert(nDims <= 3 && nDims <= stride, "NegativeSampler: unsupported embedding layout");
+    const uint n = static_cast<uint>(_layout.size() / 2);
+    if (n < 2) {
+      return;
+    }
+
+    // Chunks draw from their own generators, so sampling, though not the interleaving of updates, is reproducible
+    auto& pool = ThreadPool::instance();
+    const float repulsion = 1.f / (_meanKernel * static_cast<float>(std::max(_nNegatives, 1u)));
+    const auto sum = pool.parallelReduce(0, n, pool.grainSize(n, 256), std::pair<double, ulong>(0.0, 0),
+      [&](ulong begin, ulong end) {
+        std::minstd_rand rng(static_cast<uint>(_seed) * 2654435761u ^ _epoch * 40503u ^ static_cast<uint>(begin));
+        std::uniform_real_distribution<float> uniform(0.f, _maxWeight);
+        std::uniform_int_distribution<uint> point(0, n - 1);
+        double kernelSum = 0.0;
+        ulong count = 0;
+        float diff[3];
+        const auto distance = [&](const float* yi, const float* yj) {
+          float dot = 0.f;
+          for (uint d = 0; d < nDims; ++d) {
+            diff[d] = yi[d] - yj[d];
+            dot += diff[d] * diff[d];
+          }
+          return dot;
+        };
+
+        for (ulong i = begin; i < end; ++i) {
+          float* yi = embedding + i * stride;
+          for (uint ij = _layout[2 * i]; ij < _layout[2 * i] + _layout[2 * i + 1]; ++ij) {
+            if (uniform(rng) >= _weights[ij]) {
+              continue;
+            }
+
+            // Attraction along the edge; the gradient of -log q_ij is 2 q_ij (y_i - y_j)
+            const float qij = 1.f / (1.f + distance(yi, embedding + static_cast<ulong>(_neighbors[ij]) * stride));
+            for (uint d = 0; d < nDims; ++d) {
+              yi[d] -= learningRate * clip(2.f * _exaggeration * qij * diff[d]);
+            }
+
+            // Repulsion from negative samples; the gradient of log Z is 2 q_ik^2 (y_i - y_k) / Z per pair
+            for (uint s = 0; s < _nNegatives; ++s) {
+              const uint k = point(rng);
+              if (k == i) {
+                continue;
+              }
+              const float qik = 1.f / (1.f + distance(yi, embedding + static_cast<ulong>(k) * stride));
+              kernelSum += qik;
+              ++count;
+              for (uint d = 0; d < nDims; ++d) {
+                yi[d] += learningRate * clip(2.f * repulsion * qik * qik * diff[d]);
+              }
+            }
+          }
+        }
+        return std::pair<double, ulong>(kernelSum, count);
+      },
+      [](const std::pair<double, ulong>& a, const std::pair<double, ulong>& b) {
+        return std::pair<double, ulong>(a.first + b.first, a.second + b.second);
+      });
+
+    if (sum.second > 0) {
+      _meanKernel = static_cast<float>(sum.first / static_cast<double>(sum.second));
+    }
+    ++_epoch;
+  }
+} // dh::util
@@ -0,0 +1,188 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <numeric>
+#include <random>
+#include "dh/util/random_walk.hpp"
+#include "dh/util/error.hpp"
+#include "dh/util/thread_pool.hpp"
+
+namespace dh::util {
+  namespace {
+    constexpr uint noLandmark = std::numeric_limits<uint>::max();
+
+    // Graph with per-row cumulative weights, so that a step is a binary search over a point's neighbors
+    class Walker {
+    public:
+      Walker(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& weights)
+      : _layout(layout), _neighbors(neighbors), _cumulative(weights.size()) {
+        runtimeAssert(layout.size() % 2 == 0 && neighbors.size() == weights.size(), "Walker: graph does not match layout");
+        ThreadPool::instance().parallelFor(0, nPoints(), 0, [&](ulong begin, ulong end) {
+          for (ulong i = begin; i < end; ++i) {
+            float sum = 0.f;
+            for (uint ij = layout[2 * i]; ij < layout[2 * i] + layout[2 * i + 1]; ++ij) {
+              sum += weights[ij];
+              _cumulative[ij] = sum;
+            }
+          }
+        });
+      }
+
+      uint nPoints() const {
+        return static_cast<uint>(_layout.size() / 2);
+      }
+
+      // Generator for the walks from point i
+      static std::minstd_rand generator(int seed, ulong i) {
+        return std::minstd_rand(static_cast<uint>(seed) * 2654435761u ^ static_cast<uint>(i * 0x9E3779B97F4A7C15ull >> 32));
+      }
+
+      // Move from point i to a neighbor; points without neighbors, or only zero-weight ones, stay put
+      uint step(uint i, std::minstd_rand& rng) const {
+        const uint begin = _layout[2 * i];
+        const uint size = _layout[2 * i + 1];
+        if (size == 0 || _cumulative[begin + size - 1] <= 0.f) {
+          return i;
+        }
+        const float u = std::uniform_real_distribution<float>(0.f, _cumulative[begin + size - 1])(rng);
+        const auto first = _cumulative.begin() + begin;
+        const auto it = std::min(std::upper_bound(first, first + size, u), first + size - 1);
+        return _neighbors[begin + static_cast<uint>(it - first)];
+      }
+
+    private:
+      const std::vector<uint>& _layout;
+      const std::vector<uint>& _neighbors;
+      std::vector<float> _cumulative;
+    };
+  } // anonymous namespace
+
+  std::vector<uint> selectLandmarksByWalks(const std::vector<uint>& layout, const std::vector<uint>& neighbors,
+                                           const std::vector<float>& weights, uint nLandmarks, uint nWalks,
+                                           uint walkLength, int seed) {
+    const Walker walker(layout, neighbors, weights);
+    const uint n = walker.nPoints();
+    runtimeAssert(nLandmarks <= n, "selectLandmarksByWalks: more landmarks than points");
+
+    // Count visits; counts are only compared, so relaxed increments suffice
+    std::vector<std::atomic<uint>> visits(n);
+    auto& pool = ThreadPool::instance();
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        visits[i].store(0, std::memory_order_relaxed);
+      }
+    });
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        auto rng = Walker::generator(seed, i);
+        for (uint w = 0; w < nWalks; ++w) {
+          uint j = static_cast<uint>(i);
+          for (uint s = 0; s < walkLength; ++s) {
+            j = walker.step(j, rng);
+            visits[j].fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      }
+    });
+
+    // Most visited points first; ties, such as among unvisited points, are broken by a seeded shuffle
+    std::vector<uint> order(n);
+    std::iota(order.begin(), order.end(), 0u);
+    std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+    std::stable_sort(order.begin(), order.end(), [&](uint a, uint b) {
+      return visits[a].load(std::memory_order_relaxed) > visits[b].load(std::memory_order_relaxed);
+    });
+    order.resize(nLandmarks);
+    std::sort(order.begin(), order.end());
+    return order;
+  }
+
+  CSRMatrix walkToLandmarks(const std::vector<uint>& layout, const std::vector<uint>& neighbors,
+                            const std::vector<float>& weights, const std::vector<uint>& landmarks, uint nWalks,
+                            uint walkLength, int seed) {
+    const Walker walker(layout, neighbors, weights);
+    const uint n = walker.nPoints();
+    std::vector<uint> landmarkIndex(n, noLandmark);
+    for (uint l = 0; l < landmarks.size(); ++l) {
+      landmarkIndex[landmarks[l]] = l;
+    }
+
+    // Rows are gathered per chunk of points, as their sizes are unknown up front, and then concatenated
+    auto& pool = ThreadPool::instance();
+    const ulong grain = pool.grainSize(n, 1024);
+    std::vector<std::vector<std::pair<uint, float>>> chunks(ceilDiv(static_cast<ulong>(n), grain));
+    CSRMatrix walks;
+    walks.nRows = n;
+    walks.nCols = static_cast<uint>(landmarks.size());
+    walks.offsets.resize(static_cast<ulong>(n) + 1);
+    pool.parallelFor(0, n, grain, [&](ulong begin, ulong end) {
+      auto& chunk = chunks[begin / grain];
+      std::vector<uint> ends;
+      for (ulong i = begin; i < end; ++i) {
+        auto rng = Walker::generator(seed, i);
+        ends.clear();
+        for (uint w = 0; w < nWalks; ++w) {
+          uint j = static_cast<uint>(i);
+          for (uint s = 0; s < walkLength; ++s) {
+            j = walker.step(j, rng);
+            if (landmarkIndex[j] != noLandmark && j != i) {
+              ends.push_back(landmarkIndex[j]);
+              break;
+            }
+          }
+        }
+
+        // Count walks per landmark reached
+        std::sort(ends.begin(), ends.end());
+        const size_t size = chunk.size();
+        for (size_t e = 0; e < ends.size();) {
+          size_t f = e;
+          while (f < ends.size() && ends[f] == ends[e]) { ++f; }
+          chunk.emplace_back(ends[e], static_cast<float>(f - e) / static_cast<float>(ends.size()));
+          e = f;
+        }
+        walks.offsets[i] = chunk.size() - size;
+      }
+    });
+
+    walks.offsets[n] = pool.parallelScan(walks.offsets.data(), walks.offsets.data(), n);
+    walks.indices.resize(walks.offsets[n]);
+    walks.values.resize(walks.offsets[n]);
+    pool.parallelFor(0, chunks.size(), 1, [&](ulong begin, ulong end) {
+      for (ulong c = begin; c < end; ++c) {
+        const size_t offset = walks.offsets[c * grain];
+        for (size_t e = 0; e < chunks[c].size(); ++e) {
+          walks.indices[offset + e] = chunks[c][e].first;
+          walks.values[offset + e] = chunks[c][e].second;
+        }
+        std::vector<std::pair<uint, float>>().swap(chunks[c]);
+      }
+    });
+    return walks;
+  }
+} // dh::util
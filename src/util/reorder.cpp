@@ -0,0 +1,146 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include "dh/util/reorder.hpp"
+#include "dh/util/error.hpp"
+#include "dh/util/thread_pool.hpp"
+
+namespace dh::util {
+  std::vector<uint> reverseCuthillMcKee(const std::vector<uint>& layout, const std::vector<uint>& neighbors) {
+    runtimeAssert(layout.size() % 2 == 0, "reverseCuthillMcKee: layout must hold (offset, size) pairs");
+    const uint n = static_cast<uint>(layout.size() / 2);
+    const auto degree = [&](uint i) { return layout[2 * i + 1]; };
+
+    // Components are started from their lowest-degree point, a cheap stand-in for a peripheral one
+    std::vector<uint> byDegree(n);
+    std::iota(byDegree.begin(), byDegree.end(), 0u);
+    std::stable_sort(byDegree.begin(), byDegree.end(), [&](uint a, uint b) { return degree(a) < degree(b); });
+
+    // Breadth-first traversal, queueing each point's unvisited neighbors in order of increasing degree.
+    // The order vector doubles as the queue
+    std::vector<uint> order;
+    order.reserve(n);
+    std::vector<bool> visited(n, false);
+    std::vector<uint> front;
+    for (uint start : byDegree) {
+      if (visited[start]) {
+        continue;
+      }
+      visited[start] = true;
+      order.push_back(start);
+      for (size_t head = order.size() - 1; head < order.size(); ++head) {
+        const uint i = order[head];
+        front.clear();
+        for (uint ij = layout[2 * i]; ij < layout[2 * i] + degree(i); ++ij) {
+          const uint j = neighbors[ij];
+          if (!visited[j]) {
+            visited[j] = true;
+            front.push_back(j);
+          }
+        }
+        std::stable_sort(front.begin(), front.end(), [&](uint a, uint b) { return degree(a) < degree(b); });
+        order.insert(order.end(), front.begin(), front.end());
+      }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return order;
+  }
+
+  std::vector<uint> invertPermutation(const std::vector<uint>& permutation) {
+    std::vector<uint> inverse(permutation.size());
+    for (uint i = 0; i < permutation.size(); ++i) {
+      inverse[permutation[i]] = i;
+    }
+    return inverse;
+  }
+
+  void compactPermutation(std::vector<uint>& permutation, const std::vector<uint>& selection) {
+    runtimeAssert(selection.size() == permutation.size(), "compactPermutation: selection does not match permutation");
+
+    // Keep the original indices of selected points, then replace them by their rank
+    std::vector<uint> kept;
+    for (uint i = 0; i < permutation.size(); ++i) {
+      if (selection[i]) {
+        kept.push_back(permutation[i]);
+      }
+    }
+    std::vector<uint> sorted = kept;
+    std::sort(sorted.begin(), sorted.end());
+    for (uint& index : kept) {
+      index = static_cast<uint>(std::lower_bound(sorted.begin(), sorted.end(), index) - sorted.begin());
+    }
+    permutation = std::move(kept);
+  }
+
+  void permuteRows(HostVector<float>& data, uint nDims, const std::vector<uint>& permutation) {
+    HostVector<float> permuted;
+    ThreadPool::instance().firstTouch(permuted, permutation.size(), nDims);
+    ThreadPool::instance().parallelFor(0, permutation.size(), 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        std::memcpy(&permuted[i * nDims], &data[static_cast<ulong>(permutation[i]) * nDims], nDims * sizeof(float));
+      }
+    });
+    data = std::move(permuted);
+  }
+
+  void permuteRows(CSRMatrix& data, const std::vector<uint>& permutation) {
+    auto& pool = ThreadPool::instance();
+    CSRMatrix permuted;
+    permuted.nRows = data.nRows;
+    permuted.nCols = data.nCols;
+
+    // Row offsets are a scan over the permuted row lengths, after which rows are copied independently
+    const ulong nRows = permutation.size();
+    permuted.offsets.resize(nRows + 1);
+    for (ulong i = 0; i < nRows; ++i) {
+      permuted.offsets[i] = data.offsets[permutation[i] + 1] - data.offsets[permutation[i]];
+    }
+    permuted.offsets[nRows] = pool.parallelScan(permuted.offsets.data(), permuted.offsets.data(), nRows);
+    permuted.indices.resize(permuted.offsets[nRows]);
+    permuted.values.resize(permuted.offsets[nRows]);
+    pool.parallelFor(0, nRows, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        const size_t src = data.offsets[permutation[i]];
+        const size_t dst = permuted.offsets[i];
+        const size_t length = permuted.offsets[i + 1] - dst;
+        std::copy_n(data.indices.begin() + src, length, permuted.indices.begin() + dst);
+        std::copy_n(data.values.begin() + src, length, permuted.values.begin() + dst);
+      }
+    });
+    data = std::move(permuted);
+  }
+
+  void restoreRowOrder(const std::vector<uint>& permutation, const float* src, uint srcStride, float* dst, uint nDims) {
+    ThreadPool::instance().parallelFor(0, permutation.size(), 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        std::memcpy(&dst[static_cast<ulong>(permutation[i]) * nDims], &src[i * srcStride], nDims * sizeof(float));
+      }
+    });
+  }
+} // dh::util
@@ -0,0 +1,161 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include "dh/util/sparse_knn.hpp"
+#include "dh/util/error.hpp"
+#include "dh/util/thread_pool.hpp"
+
+namespace dh::util {
+  SparseKNN::SparseKNN()
+  : _isInit(false), _k(0), _dataPtr(nullptr) {
+    // ...
+  }
+
+  SparseKNN::SparseKNN(const CSRMatrix* dataPtr, uint k)
+  : _isInit(false), _k(k), _dataPtr(dataPtr) {
+    _isInit = true;
+  }
+
+  SparseKNN::~SparseKNN() {
+    // ...
+  }
+
+  SparseKNN::SparseKNN(SparseKNN&& other) noexcept
+  : SparseKNN() {
+    swap(*this, other);
+  }
+
+  SparseKNN& SparseKNN::operator=(SparseKNN&& other) noexcept {
+    swap(*this, other);
+    return *this;
+  }
+
+  void SparseKNN::comp(std::vector<float>& distances, std::vector<uint>& indices) {
+    runtimeAssert(_isInit, "SparseKNN::comp() called without proper initialization");
+    const CSRMatrix& data = *_dataPtr;
+    const uint n = data.nRows;
+    runtimeAssert(_k <= n, "SparseKNN::comp() called with k larger than the number of points");
+
+    // Build inverted index, i.e. the same matrix in compressed sparse column format
+    auto& pool = ThreadPool::instance();
+    std::vector<size_t> colOffsets(data.nCols + 1, 0);
+    for (uint c : data.indices) {
+      colOffsets[c]++;
+    }
+    colOffsets[data.nCols] = pool.parallelScan(colOffsets.data(), colOffsets.data(), data.nCols);
+    std::vector<uint> colRows(data.nnz());
+    std::vector<float> colValues(data.nnz());
+    {
+      std::vector<size_t> heads(colOffsets.begin(), colOffsets.end() - 1);
+      for (uint i = 0; i < n; ++i) {
+        for (size_t ij = data.offsets[i]; ij < data.offsets[i + 1]; ++ij) {
+          const size_t dst = heads[data.indices[ij]]++;
+          colRows[dst] = i;
+          colValues[dst] = data.values[ij];
+        }
+      }
+    }
+
+    // Squared norms, and points ordered by them for filling neighborhoods with non-overlapping points
+    std::vector<float> norms(n, 0.f);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        for (size_t ij = data.offsets[i]; ij < data.offsets[i + 1]; ++ij) {
+          norms[i] += data.values[ij] * data.values[ij];
+        }
+      }
+    });
+    std::vector<uint> byNorm(n);
+    std::iota(byNorm.begin(), byNorm.end(), 0);
+    std::sort(byNorm.begin(), byNorm.end(), [&](uint a, uint b) { return norms[a] < norms[b]; });
+
+    distances.resize(static_cast<size_t>(n) * _k);
+    indices.resize(static_cast<size_t>(n) * _k);
+
+    // Process queries in chunks; scratch space is per worker, as stamps must stay unique within it
+    struct Scratch {
+      std::vector<float> dots;
+      std::vector<uint> stamps;
+    };
+    std::vector<Scratch> scratch(pool.nThreads());
+    pool.parallelFor(0, n, std::min<ulong>(pool.grainSize(n), 1024), [&](ulong begin, ulong end) {
+      Scratch& local = scratch[pool.workerIndex()];
+      if (local.dots.empty()) {
+        local.dots.assign(n, 0.f);
+        local.stamps.assign(n, 0);
+      }
+      std::vector<float>& dots = local.dots;
+      std::vector<uint>& stamps = local.stamps;
+      std::vector<uint> touched;
+      std::vector<std::pair<float, uint>> candidates;
+
+      for (uint i = begin; i < end; ++i) {
+        // Accumulate dot products with all points sharing a column with i
+        touched.clear();
+        const uint stamp = i + 1;
+        stamps[i] = stamp;
+        for (size_t ij = data.offsets[i]; ij < data.offsets[i + 1]; ++ij) {
+          const float v = data.values[ij];
+          const uint c = data.indices[ij];
+          for (size_t cj = colOffsets[c]; cj < colOffsets[c + 1]; ++cj) {
+            const uint j = colRows[cj];
+            if (stamps[j] != stamp) {
+              stamps[j] = stamp;
+              dots[j] = 0.f;
+              touched.push_back(j);
+            }
+            dots[j] += v * colValues[cj];
+          }
+        }
+
+        // Candidates are all touched points, plus the k - 1 untouched points of smallest norm
+        candidates.clear();
+        for (uint j : touched) {
+          candidates.emplace_back(std::max(norms[i] + norms[j] - 2.f * dots[j], 0.f), j);
+        }
+        for (uint l = 0, nAdded = 0; l < n && nAdded + 1 < _k; ++l) {
+          const uint j = byNorm[l];
+          if (stamps[j] != stamp) {
+            candidates.emplace_back(norms[i] + norms[j], j);
+            nAdded++;
+          }
+        }
+        const size_t nKept = std::min<size_t>(_k - 1, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + nKept, candidates.end());
+
+        // Point itself comes first, as returned by FAISS
+        const size_t offset = static_cast<size_t>(i) * _k;
+        distances[offset] = 0.f;
+        indices[offset] = i;
+        for (size_t l = 0; l < nKept; ++l) {
+          distances[offset + 1 + l] = candidates[l].first;
+          indices[offset + 1 + l] = candidates[l].second;
+        }
+      }
+    });
+  }
+} // dh::util
@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include "dh/util/sparsify.hpp"
+#include "dh/util/error.hpp"
+#include "dh/util/thread_pool.hpp"
+
+namespace dh::util {
+  namespace {
+    // Prunes rows of either graph format, row i spanning size(i) edges of neighbors and weights from first(i).
+    // Offsets receives the n + 1 offsets of the rows' kept edges
+    template <typename First, typename Size, typename Offsets, typename Neighbors, typename Weights>
+    float pruneRows(ulong n, First first, Size size, const Neighbors& neighbors, const Weights& weights, float threshold, float mass,
+                    Offsets& offsets, Neighbors& prunedNeighbors, Weights& prunedWeights) {
+      auto& pool = ThreadPool::instance();
+      const ulong grain = pool.grainSize(n, 256);
+
+      // Both criteria amount to a lower bound on a row's weights; the mass criterion's bound is the lightest weight
+      // of the shortest prefix of the row, sorted by descending weight, that covers the mass fraction
+      std::vector<float> cutoffs(n);
+      pool.parallelFor(0, n, grain, [&](ulong begin, ulong end) {
+        std::vector<float> row;
+        for (ulong i = begin; i < end; ++i) {
+          const auto rowFirst = weights.begin() + first(i);
+          const auto rowLast = rowFirst + size(i);
+          if (rowFirst == rowLast) {
+            cutoffs[i] = 0.f;
+            continue;
+          }
+          const float max = *std::max_element(rowFirst, rowLast);
+          float cutoff = threshold * max;
+          if (mass < 1.f) {
+            row.assign(rowFirst, rowLast);
+            std::sort(row.begin(), row.end(), std::greater<float>());
+            double sum = 0.0;
+            for (float w : row) { sum += w; }
+            double covered = 0.0;
+            for (float w : row) {
+              covered += w;
+              if (covered >= mass * sum) {
+                cutoff = std::max(cutoff, w);
+                break;
+              }
+            }
+          }
+          cutoffs[i] = std::min(cutoff, max);
+        }
+      });
+
+      const auto isKept = [&](ulong i, ulong ij) {
+        return weights[ij] >= std::min(cutoffs[i], cutoffs[neighbors[ij]]);
+      };
+
+      // Count kept edges per row, and compact them after a scan over the counts
+      offsets.assign(n + 1, 0);
+      const auto sums = pool.parallelReduce(0, n, grain, std::pair<double, double>(0.0, 0.0), [&](ulong begin, ulong end) {
+        double total = 0.0, kept = 0.0;
+        for (ulong i = begin; i < end; ++i) {
+          for (ulong ij = first(i); ij < first(i) + size(i); ++ij) {
+            total += weights[ij];
+            if (isKept(i, ij)) {
+              kept += weights[ij];
+              ++offsets[i];
+            }
+          }
+        }
+        return std::pair<double, double>(total, kept);
+      }, [](const std::pair<double, double>& a, const std::pair<double, double>& b) {
+        return std::pair<double, double>(a.first + b.first, a.second + b.second);
+      });
+
+      const ulong nEdges = pool.parallelScan(offsets.data(), offsets.data(), n);
+      offsets[n] = nEdges;
+      const float scale = sums.second > 0.0 ? static_cast<float>(sums.first / sums.second) : 1.f;
+      prunedNeighbors.resize(nEdges);
+      prunedWeights.resize(nEdges);
+      pool.parallelFor(0, n, grain, [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; ++i) {
+          ulong e = offsets[i];
+          for (ulong ij = first(i); ij < first(i) + size(i); ++ij) {
+            if (isKept(i, ij)) {
+              prunedNeighbors[e] = neighbors[ij];
+              prunedWeights[e] = scale * weights[ij];
+              ++e;
+            }
+          }
+        }
+      });
+
+      return sums.first > 0.0 ? static_cast<float>(sums.second / sums.first) : 1.f;
+    }
+  } // anonymous namespace
+
+  float pruneGraph(const std::vector<uint>& layout, const std::vector<uint>& neighbors, const std::vector<float>& weights,
+                   float threshold, float mass,
+                   std::vector<uint>& prunedLayout, std::vector<uint>& prunedNeighbors, std::vector<float>& prunedWeights) {
+    runtimeAssert(layout.size() % 2 == 0 && neighbors.size() == weights.size(), "pruneGraph: graph does not match layout");
+    const ulong n = layout.size() / 2;
+    std::vector<ulong> offsets;
+    const float kept = pruneRows(n, [&](ulong i) { return static_cast<ulong>(layout[2 * i]); }, [&](ulong i) { return static_cast<ulong>(layout[2 * i + 1]); },
+                                 neighbors, weights, threshold, mass, offsets, prunedNeighbors, prunedWeights);
+    prunedLayout.resize(2 * n);
+    ThreadPool::instance().parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        prunedLayout[2 * i] = static_cast<uint>(offsets[i]);
+        prunedLayout[2 * i + 1] = static_cast<uint>(offsets[i + 1] - offsets[i]);
+      }
+    });
+    return kept;
+  }
+
+  float pruneGraph(const HostVector<ulong>& offsets, const HostVector<uint>& neighbors, const HostVector<float>& weights,
+                   float threshold, float mass,
+                   HostVector<ulong>& prunedOffsets, HostVector<uint>& prunedNeighbors, HostVector<float>& prunedWeights) {
+    runtimeAssert(!offsets.empty() && neighbors.size() == weights.size() && offsets.back() == neighbors.size(), "pruneGraph: graph does not match offsets");
+    return pruneRows(offsets.size() - 1, [&](ulong i) { return offsets[i]; }, [&](ulong i) { return offsets[i + 1] - offsets[i]; },
+                     neighbors, weights, threshold, mass, prunedOffsets, prunedNeighbors, prunedWeights);
+  }
+} // dh::util
@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <vector>
+#include "dh/util/symmetrize.hpp"
+#include "dh/util/error.hpp"
+
+namespace dh::util {
+  namespace {
+    struct Edge {
+      uint j;
+      float p;
+    };
+
+    // Calls emit(j, p) for the union of two runs of edges sorted by index, summing the p of edges to the same j
+    template <typename F>
+    void mergeEdges(const Edge* a, const Edge* aEnd, const Edge* b, const Edge* bEnd, F emit) {
+      while (a != aEnd || b != bEnd) {
+        const uint j = std::min(a != aEnd ? a->j : std::numeric_limits<uint>::max(),
+                                b != bEnd ? b->j : std::numeric_limits<uint>::max());
+        float p = 0.f;
+        while (a != aEnd && a->j == j) { p += (a++)->p; }
+        while (b != bEnd && b->j == j) { p += (b++)->p; }
+        emit(j, p);
+      }
+    }
+  } // anonymous namespace
+
+  void symmetrizeKNN(const HostVector<uint>& indices, const HostVector<float>& conditionals, uint n, uint k,
+                     HostVector<ulong>& offsets, HostVector<uint>& neighbors, HostVector<float>& similarities) {
+    runtimeAssert(indices.size() == static_cast<ulong>(n) * k && conditionals.size() == indices.size(), "symmetrizeKNN: KNN does not match n and k");
+    auto& pool = ThreadPool::instance();
+    const auto byIndex = [](const Edge& a, const Edge& b) { return a.j < b.j; };
+
+    // Row i's own neighbors, sorted by index; the first is i itself, and neighbors a search did not find are out of range
+    const auto knnRow = [&](ulong i, std::vector<Edge>& row) {
+      row.clear();
+      for (ulong l = 1; l < k; ++l) {
+        const uint j = indices[i * k + l];
+        if (j < n && j != i) { row.push_back({ j, conditionals[i * k + l] }); }
+      }
+      std::sort(row.begin(), row.end(), byIndex);
+    };
+
+    // Transpose the KNN graph, so each point finds the points having it as neighbor, with their p_i|j. Counts
+    // are only summed, so relaxed increments suffice. Reverse edges are left uninitialized, so that their pages
+    // are first touched by the workers writing them
+    std::vector<std::atomic<uint>> cursors(n);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        cursors[i].store(0, std::memory_order_relaxed);
+      }
+    });
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        for (ulong l = 1; l < k; ++l) {
+          const uint j = indices[i * k + l];
+          if (j < n && j != i) { cursors[j].fetch_add(1, std::memory_order_relaxed); }
+        }
+      }
+    });
+    HostVector<ulong> reverseOffsets;
+    pool.firstTouch(reverseOffsets, static_cast<ulong>(n) + 1);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        reverseOffsets[i] = cursors[i].exchange(0, std::memory_order_relaxed);
+      }
+    });
+    reverseOffsets[n] = pool.parallelScan(reverseOffsets.data(), reverseOffsets.data(), n);
+    HostVector<Edge> reverse(reverseOffsets[n]);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      for (ulong i = begin; i < end; ++i) {
+        for (ulong l = 1; l < k; ++l) {
+          const uint j = indices[i * k + l];
+          if (j < n && j != i) {
+            reverse[reverseOffsets[j] + cursors[j].fetch_add(1, std::memory_order_relaxed)] = { static_cast<uint>(i), conditionals[i * k + l] };
+          }
+        }
+      }
+    });
+
+    // Sort reverse edges, and size each row by the union of its own and its reverse edges
+    pool.firstTouch(offsets, static_cast<ulong>(n) + 1);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      std::vector<Edge> row;
+      for (ulong i = begin; i < end; ++i) {
+        Edge* first = reverse.data() + reverseOffsets[i];
+        Edge* last = reverse.data() + reverseOffsets[i + 1];
+        std::sort(first, last, byIndex);
+        knnRow(i, row);
+        ulong size = 0;
+        mergeEdges(row.data(), row.data() + row.size(), first, last, [&](uint, float) { ++size; });
+        offsets[i] = size;
+      }
+    });
+    offsets[n] = pool.parallelScan(offsets.data(), offsets.data(), n);
+
+    // Fill rows, each edge weighing 0.5 * (p_j|i + p_i|j), either of which is 0 if the edge is not mutual
+    HostVector<uint>(offsets[n]).swap(neighbors);
+    HostVector<float>(offsets[n]).swap(similarities);
+    pool.parallelFor(0, n, 0, [&](ulong begin, ulong end) {
+      std::vector<Edge> row;
+      for (ulong i = begin; i < end; ++i) {
+        knnRow(i, row);
+        ulong ij = offsets[i];
+        mergeEdges(row.data(), row.data() + row.size(), reverse.data() + reverseOffsets[i], reverse.data() + reverseOffsets[i + 1], [&](uint j, float p) {
+          neighbors[ij] = j;
+          similarities[ij] = 0.5f * p;
+          ++ij;
+        });
+      }
+    });
+  }
+} // dh::util
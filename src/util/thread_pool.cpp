@@ -0,0 +1,243 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Mark van de Ruit (Delft University of Technology)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <limits>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "dh/util/thread_pool.hpp"
+#include "dh/util/error.hpp"
+
+namespace dh::util {
+  namespace {
+    // Set on pool workers, and on the calling thread while it takes part in a job
+    thread_local bool insideTask = false;
+    thread_local uint workerId = 0;
+
+    // Chunk ranges hold two 32-bit chunk indices
+    constexpr ulong maxChunks = std::numeric_limits<uint>::max();
+    constexpr ulong lowMask = maxChunks;
+
+    ulong pack(ulong lo, ulong hi) {
+      return (hi << 32) | lo;
+    }
+  } // anonymous namespace
+
+  ThreadPool::ThreadPool()
+  : _nThreads(0), _pinThreads(false), _stop(false), _generation(0), _pending(0), _failed(false),
+    _kernel(nullptr), _ctx(nullptr), _begin(0), _end(0), _grain(1) {
+    start(0, false);
+  }
+
+  ThreadPool::~ThreadPool() {
+    stop();
+  }
+
+  void ThreadPool::configure(uint nThreads, bool pinThreads) {
+    runtimeAssert(!insideTask, "ThreadPool::configure() called from inside a task");
+    std::lock_guard<std::mutex> dispatch(_dispatchMutex);
+    stop();
+    start(nThreads, pinThreads);
+  }
+
+  ulong ThreadPool::grainSize(ulong n, ulong minGrain) const {
+    return std::max<ulong>({ minGrain, ceilDiv<ulong>(n, 4 * static_cast<ulong>(_nThreads)), ceilDiv<ulong>(n, maxChunks), 1 });
+  }
+
+  uint ThreadPool::workerIndex() const {
+    return workerId;
+  }
+
+  void ThreadPool::start(uint nThreads, bool pinThreads) {
+    _nThreads = nThreads > 0 ? nThreads : std::max(1u, std::thread::hardware_concurrency());
+    _pinThreads = pinThreads;
+    _stop = false;
+    _ranges = std::make_unique<ChunkRange[]>(_nThreads);
+    for (uint w = 0; w < _nThreads; ++w) {
+      _ranges[w].packed.store(0);
+    }
+    _workers.reserve(_nThreads - 1);
+    for (uint w = 1; w < _nThreads; ++w) {
+      _workers.emplace_back(&ThreadPool::workerLoop, this, w);
+    }
+  }
+
+  void ThreadPool::stop() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers) {
+      worker.join();
+    }
+    _workers.clear();
+  }
+
+  void ThreadPool::run(Kernel kernel, const void* ctx, ulong begin, ulong end, ulong grain) {
+    runtimeAssert(ceilDiv(end - begin, grain) <= maxChunks, "ThreadPool::run() called with too small a grain size");
+    const ulong nChunks = ceilDiv(end - begin, grain);
+
+    // Nested calls, single chunks and single-threaded pools run in place
+    if (insideTask || nChunks <= 1 || _nThreads == 1) {
+      for (ulong b = begin; b < end; b += grain) {
+        kernel(ctx, b, std::min(end, b + grain));
+      }
+      return;
+    }
+
+    std::lock_guard<std::mutex> dispatch(_dispatchMutex);
+    _kernel = kernel;
+    _ctx = ctx;
+    _begin = begin;
+    _end = end;
+    _grain = grain;
+    _failed.store(false);
+    for (uint w = 0; w < _nThreads; ++w) {
+      _ranges[w].packed.store(pack(w * nChunks / _nThreads, (w + 1) * nChunks / _nThreads));
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending = _nThreads - 1;
+      _generation++;
+    }
+    _wake.notify_all();
+
+    insideTask = true;
+    work(0);
+    insideTask = false;
+
+    // Wait for the other workers, as the job's state lives on the caller's stack
+    std::exception_ptr exception;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _done.wait(lock, [&] { return _pending == 0; });
+      std::swap(exception, _exception);
+    }
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  void ThreadPool::workerLoop(uint worker) {
+    insideTask = true;
+    workerId = worker;
+#ifdef __linux__
+    if (_pinThreads) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(worker % CPU_SETSIZE, &cpus);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    }
+#endif
+
+    ulong generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait(lock, [&] { return _stop || _generation != generation; });
+        if (_stop) {
+          return;
+        }
+        generation = _generation;
+      }
+
+      work(worker);
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_pending == 0) {
+          _done.notify_one();
+        }
+      }
+    }
+  }
+
+  void ThreadPool::work(uint worker) {
+    auto execute = [&](ulong chunk) {
+      // After a failure, remaining chunks are drained without running them
+      if (_failed.load(std::memory_order_relaxed)) {
+        return;
+      }
+      const ulong b = _begin + chunk * _grain;
+      try {
+        _kernel(_ctx, b, std::min(_end, b + _grain));
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_failed.exchange(true)) {
+          _exception = std::current_exception();
+        }
+      }
+    };
+
+    // Own run first, then steal until no run has chunks left
+    ulong chunk;
+    while (pop(worker, chunk)) {
+      execute(chunk);
+    }
+    for (bool found = true; found;) {
+      found = false;
+      for (uint offset = 1; offset < _nThreads; ++offset) {
+        const uint victim = (worker + offset) % _nThreads;
+        while (steal(victim, chunk)) {
+          execute(chunk);
+          found = true;
+        }
+      }
+    }
+  }
+
+  bool ThreadPool::pop(uint worker, ulong& chunk) {
+    std::atomic<ulong>& range = _ranges[worker].packed;
+    ulong packed = range.load();
+    while (true) {
+      const ulong lo = packed & lowMask, hi = packed >> 32;
+      if (lo >= hi) {
+        return false;
+      }
+      if (range.compare_exchange_weak(packed, pack(lo + 1, hi))) {
+        chunk = lo;
+        return true;
+      }
+    }
+  }
+
+  bool ThreadPool::steal(uint victim, ulong& chunk) {
+    std::atomic<ulong>& range = _ranges[victim].packed;
+    ulong packed = range.load();
+    while (true) {
+      const ulong lo = packed & lowMask, hi = packed >> 32;
+      if (lo >= hi) {
+        return false;
+      }
+      if (range.compare_exchange_weak(packed, pack(lo, hi - 1))) {
+        chunk = hi - 1;
+        return true;
+      }
+    }
+  }
+} // dh::util
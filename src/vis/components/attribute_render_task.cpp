@@ -97,7 +97,11 @@ namespace dh::vis {
     {
       const std::vector<float> ones(_params->nHighDims, 1.0f);
       glCreateBuffers(_buffers.size(), _buffers.data());
-      glNamedBufferStorage(_buffers(BufferType::ePairwiseAttrDists), _params->n * _params->nHighDims * sizeof(float), nullptr, 0);
+      if(_params->sparseData || _params->knnBlockSize > 0) {
+        enable = false; // Per-attribute views index the dataset densely, and a dense n * nHighDims buffer is exactly what sparse and out-of-core input avoid
+      } else {
+        glNamedBufferStorage(_buffers(BufferType::ePairwiseAttrDists), static_cast<ulong>(_params->n) * _params->nHighDims * sizeof(float), nullptr, 0);
+      }
       glCreateBuffers(_buffersTextureData.size(), _buffersTextureData.data());
       for(uint i = 0; i < _buffersTextureData.size() - 1; ++i) {
         glNamedBufferStorage(_buffersTextureData[i], _params->nTexels * _params->imgDepth * sizeof(float), nullptr, 0);
@@ -626,6 +630,7 @@ namespace dh::vis {
 
   void AttributeRenderTask::update(std::vector<uint> selectionCounts) {
     _selectionCounts = selectionCounts;
+    if(_params->sparseData || _params->knnBlockSize > 0) { return; }
     for(uint i = 0; i < 2; ++i) { _denominators[i * 2] = _selectionCounts[i]; _denominators[i * 2 + 1] = _selectionCounts[i];  }
 
     // Calculate selection average and/or variance per attribute
@@ -639,8 +644,8 @@ namespace dh::vis {
       dh::util::BufferTools::instance().difference(_buffersTextureData[i], _buffersTextureData[i+2], _params->nHighDims, _buffersTextureData[i+4]);
     }
 
-    // Compute pairwise attribute differences if relevant texture tabs are open
-    if(_currentTabUpper == 3) {
+    // Compute pairwise attribute differences if relevant texture tabs are open; compressed similarities have no plain neighbor indices
+    if(_currentTabUpper == 3 && !_params->compressSimilarities && !_params->segmentedGraph) {
       std::pair<int, int> classes;
       glClearNamedBufferData(_buffers(BufferType::ePairwiseAttrDists), GL_R32F, GL_RED, GL_FLOAT, nullptr);
       glClearNamedBufferData(_similaritiesBuffers.neighborsSelected, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
@@ -283,6 +283,8 @@ namespace dh::vis {
       ImGui::SameLine(); ImGui::SliderInt("k", &_k, 2, _params->kMax);
       if(ImGui::SameLine(); ImGui::Button("Focus")) { _buttonPressed = 1; }
       if(ImGui::IsItemHovered()) { ImGui::BeginTooltip(); ImGui::Text("Restarts minimization with only the selected datapoints and hyperparameters."); ImGui::EndTooltip(); }
+      if(ImGui::SameLine(); ImGui::Button("Remove disabled")) { _buttonPressed = 3; }
+      if(ImGui::IsItemHovered()) { ImGui::BeginTooltip(); ImGui::Text("Removes disabled datapoints for good, continuing minimization with the rest."); ImGui::EndTooltip(); }
       ImGui::PopItemWidth();
     }
   }